@@ -23,6 +23,12 @@
 #define COMMAND_BUFFER_SIZE 1024
 #define RESULTS_SIZE 1024 // size in 32-bit numbers
 
+// the reply to a batch of snapshot requests (4-byte words after an 8-byte
+// header) must fit into the arbiter's message buffer
+#if (ARBITER_MAX_SNAPSHOT_BATCH * RESULTS_SIZE + 2) * 4 + 8 > BUFFER_SIZE
+#error please ensure ARBITER_MAX_SNAPSHOT_BATCH replies fit into BUFFER_SIZE
+#endif
+
 typedef struct ArbiterConnData *ArbiterConn;
 
 typedef struct ArbiterConnData
@@ -187,10 +193,8 @@ static bool ArbiterConnect(ArbiterConn conn)
 	return false;
 }
 
-static bool arbiter_send_command(ArbiterConn arbiter, xid_t cmd, int argc, ...)
+static bool arbiter_send_argv(ArbiterConn arbiter, xid_t cmd, int argc, xid_t *argv)
 {
-	va_list argv;
-	int i;
 	int sent;
 	char buf[COMMAND_BUFFER_SIZE];
 	int datasize;
@@ -202,20 +206,16 @@ static bool arbiter_send_command(ArbiterConn arbiter, xid_t cmd, int argc, ...)
 	msg->size = sizeof(xid_t) * (argc + 1);
 	cursor += sizeof(ShubMessageHdr);
 
+	assert(msg->size + sizeof(ShubMessageHdr) <= COMMAND_BUFFER_SIZE);
+
 	*(xid_t*)cursor = cmd;
 	cursor += sizeof(xid_t);
 
-	va_start(argv, argc);
-	for (i = 0; i < argc; i++)
-	{
-		*(xid_t*)cursor = va_arg(argv, xid_t);
-		cursor += sizeof(xid_t);
-	}
-	va_end(argv);
+	memcpy(cursor, argv, argc * sizeof(xid_t));
+	cursor += argc * sizeof(xid_t);
 
 	datasize = cursor - buf;
 	assert(msg->size + sizeof(ShubMessageHdr) == datasize);
-	assert(datasize <= COMMAND_BUFFER_SIZE);
 
 	sent = 0;
 	while (sent < datasize)
@@ -232,6 +232,24 @@ static bool arbiter_send_command(ArbiterConn arbiter, xid_t cmd, int argc, ...)
 	return true;
 }
 
+static bool arbiter_send_command(ArbiterConn arbiter, xid_t cmd, int argc, ...)
+{
+	va_list args;
+	int i;
+	xid_t argv[COMMAND_BUFFER_SIZE / sizeof(xid_t)];
+
+	assert(argc < COMMAND_BUFFER_SIZE / sizeof(xid_t));
+
+	va_start(args, argc);
+	for (i = 0; i < argc; i++)
+	{
+		argv[i] = va_arg(args, xid_t);
+	}
+	va_end(args);
+
+	return arbiter_send_argv(arbiter, cmd, argc, argv);
+}
+
 void ArbiterConfig(char *servers, char *sock_dir)
 {
 	char *hstate, *pstate;
@@ -429,6 +447,66 @@ failure:
 	);
 }
 
+bool ArbiterGetSnapshots(int n, TransactionId *xids, int *snapnos, Snapshot *snapshots, TransactionId *gxmin)
+{
+	int i, j;
+	int reslen;
+	int pos;
+	xid_t argv[ARBITER_MAX_SNAPSHOT_BATCH * 2];
+	xid_t *results = NULL;
+	ArbiterConn arbiter;
+
+	assert(n > 0 && n <= ARBITER_MAX_SNAPSHOT_BATCH);
+
+	arbiter = GetConnection();
+	if (!arbiter) {
+		goto failure;
+	}
+
+	// command
+	for (i = 0; i < n; i++)
+	{
+		argv[i*2] = xids[i];
+		argv[i*2 + 1] = snapnos[i];
+	}
+	if (!arbiter_send_argv(arbiter, CMD_SNAPSHOTS, n*2, argv)) goto failure;
+
+	// response: each snapshot can not be larger than the reply to a single snapshot request
+	results = (xid_t*)malloc((n * RESULTS_SIZE + 2) * sizeof(xid_t));
+	if (results == NULL) goto failure;
+	reslen = arbiter_recv_results(arbiter, n * RESULTS_SIZE + 2, results);
+	if (reslen < 2) goto failure;
+	if (results[0] != RES_OK) goto failure;
+	*gxmin = results[1];
+
+	for (i = 0, pos = 2; i < n; i++)
+	{
+		Snapshot snapshot = snapshots[i];
+		int xcnt;
+
+		if (pos + 3 > reslen) goto failure;
+		xcnt = results[pos + 2];
+		if (xcnt > ARBITER_MAX_XCNT || pos + 3 + xcnt > reslen) goto failure;
+
+		ArbiterInitSnapshot(snapshot);
+		snapshot->xmin = results[pos];
+		snapshot->xmax = results[pos + 1];
+		snapshot->xcnt = xcnt;
+		pos += 3;
+		for (j = 0; j < xcnt; j++)
+		{
+			snapshot->xip[j] = results[pos++];
+		}
+	}
+	free(results);
+	return true;
+failure:
+	free(results);
+	DiscardConnection();
+	fprintf(stderr, "ArbiterGetSnapshots: failed to get %d snapshots\n", n);
+	return false;
+}
+
 XidStatus ArbiterSetTransStatus(TransactionId xid, XidStatus status, bool wait)
 {
 	int reslen;
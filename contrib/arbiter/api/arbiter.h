@@ -8,6 +8,15 @@
 
 #define INVALID_XID 0
 
+/*
+ * maximal number of snapshots requested by one ArbiterGetSnapshots call,
+ * the reply must fit into the arbiter's message buffer
+ */
+#define ARBITER_MAX_SNAPSHOT_BATCH 32
+
+/* maximal number of active transactions in the snapshot received from the arbiter */
+#define ARBITER_MAX_XCNT 1020
+
 /**
  * Sets up the servers and the unix sockdir for Arbiter connections.
  */
@@ -29,6 +38,16 @@ TransactionId ArbiterStartTransaction(Snapshot snapshot, TransactionId *gxmin, i
  */
 void ArbiterGetSnapshot(TransactionId xid, Snapshot snapshot, TransactionId *gxmin);
 
+/**
+ * Asks the arbiter for snapshots of 'n' global transactions with one round
+ * trip. 'snapnos[i]' is the number of snapshots previously received by the
+ * backend for 'xids[i]': the arbiter replies with the same snapshot to all
+ * participants asking for the snapshot with the same number, generating a
+ * fresh one when needed. Fills the 'snapshots' and 'gxmin' on success.
+ * Returns 'true' on success, 'false' otherwise.
+ */
+bool ArbiterGetSnapshots(int n, TransactionId *xids, int *snapnos, Snapshot *snapshots, TransactionId *gxmin);
+
 /**
  * Commits transaction only once all participants have called this function,
  * does not change CLOG otherwise. Set 'wait' to 'true' if you want this call
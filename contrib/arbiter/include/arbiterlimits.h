@@ -21,5 +21,9 @@
 #define ELECTION_TIMEOUT_MS_MAX 300
 #define RAFT_LOGLEN 1024
 #define RAFT_KEEP_APPLIED 512 /* how many applied entries to keep during compaction */
+#define RAFT_MAX_BATCH 64 /* max number of entries in one raft update message */
+#define RAFT_MAX_INFLIGHT (4 * RAFT_MAX_BATCH) /* max number of unacked entries sent to a follower */
+#define RAFT_BATCH_DELAY_MS 0 /* default delay for grouping new entries before sending */
+#define RAFT_SNAPSHOT_CHUNK 256 /* max number of values in one snapshot message */
 
 #endif
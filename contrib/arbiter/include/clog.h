@@ -28,9 +28,13 @@ clog_t clog_open(char *datadir);
 int clog_read(clog_t clog, xid_t xid);
 
 // Set the status of the specified global commit. Return 'true' on success,
-// 'false' otherwise.
+// 'false' otherwise. Call clog_flush() before telling anybody about it.
 bool clog_write(clog_t clog, xid_t xid, int status);
 
+// Flush the statuses written since the previous call. Return 'true' on
+// success, 'false' otherwise.
+bool clog_flush(clog_t clog);
+
 // Forget about the commits before the given one ('until'), and free the
 // occupied space if possible. Return 'true' on success, 'false' otherwise.
 bool clog_forget(clog_t clog, xid_t until);
@@ -17,15 +17,23 @@
 #define XID_TO_OFFSET(XID) (((XID) % (COMMITS_PER_FILE)) / (COMMITS_PER_BYTE))
 #define XID_TO_SUBOFFSET(XID) (((XID) % (COMMITS_PER_FILE)) % (COMMITS_PER_BYTE))
 
+// how far ahead of the last written status to ask the kernel for pages
+#define PREFETCH_BYTES (64 * 1024)
+
 typedef struct clogfile_t {
 	char *path;
 	xid_t min;
 	xid_t max;
 	void *data; // ptr for mmap
+
+	off64_t dirty_min; // the range of bytes changed since the last flush,
+	off64_t dirty_max; // empty if dirty_min > dirty_max
+	off64_t prefetched; // the bytes before this have been prefetched
 } clogfile_t;
 
 // Open a clog file with the gived id. Create before opening if 'create' is
-// true. Return 'true' on success, 'false' otherwise.
+// true. Return 'true' on success, 'false' otherwise. If compiled with
+// HUGEPAGES, ask the kernel to back the mapping with huge pages.
 bool clogfile_open_by_id(clogfile_t *clogfile, char *datadir, int fileid, bool create);
 
 // Close and remove the given clog file. Return 'true' on success, 'false'
@@ -39,7 +47,16 @@ bool clogfile_close(clogfile_t *clogfile);
 int clogfile_get_status(clogfile_t *clogfile, xid_t xid);
 
 // Set the status of the specified global commit in the clog file. Return
-// 'true' on success, 'false' otherwise.
+// 'true' on success, 'false' otherwise. The change is not flushed until
+// clogfile_flush() is called.
 bool clogfile_set_status(clogfile_t *clogfile, xid_t xid, int status);
 
+// Write the changed pages of the clog file to disk, synchronously if compiled
+// with SYNC. Return 'true' on success, 'false' otherwise.
+bool clogfile_flush(clogfile_t *clogfile);
+
+// Find the last global commit with a status in the clog file. Return 'true'
+// and set 'xid' if found, 'false' if the file is blank.
+bool clogfile_find_last_used(clogfile_t *clogfile, xid_t *xid);
+
 #endif
@@ -14,6 +14,8 @@ typedef struct Edge {
     struct Edge* next;  /* list of edges of local subgraph */  
     struct Vertex* dst;
     struct Vertex* src;
+    struct Node* owner; /* node which reported this edge */
+    int epoch; /* last update of the owner's subgraph containing this edge */
 } Edge;
 
 typedef struct Vertex
@@ -23,6 +25,7 @@ typedef struct Vertex
     xid_t xid;    
     int nIncomingEdges;
     int visited;
+    int checked; /* generation at which no deadlock was found for this vertex */
     int deadlock_duration;
 } Vertex;
 
@@ -32,6 +35,8 @@ typedef struct Graph
     Edge* freeEdges;
     Vertex* freeVertexes;
     int marker;
+    int epoch; /* incremented by each subgraph update */
+    int generation; /* incremented when a subgraph adds new edges */
     int min_deadlock_duration;
 } Graph;
 
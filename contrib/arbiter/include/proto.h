@@ -7,6 +7,7 @@
 #define CMD_FOR      'y'
 #define CMD_AGAINST  'n'
 #define CMD_SNAPSHOT 't'
+#define CMD_SNAPSHOTS 'T'
 #define CMD_STATUS   's'
 #define CMD_DEADLOCK 'd'
 
@@ -3,6 +3,7 @@
 
 #include <arpa/inet.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "arbiterlimits.h"
 
 #define NOBODY -1
@@ -20,6 +21,10 @@
 #error please ensure RAFT_KEEP_APPLIED < RAFT_LOGLEN
 #endif
 
+#if RAFT_MAX_BATCH > RAFT_MAX_INFLIGHT
+#error please ensure RAFT_MAX_BATCH <= RAFT_MAX_INFLIGHT
+#endif
+
 #if HEARTBEAT_TIMEOUT_MS >= ELECTION_TIMEOUT_MS_MIN
 #error please ensure HEARTBEAT_TIMEOUT_MS < ELECTION_TIMEOUT_MS_MIN (considerably)
 #endif
@@ -46,6 +51,10 @@ typedef struct raft_entry_t {
 
 typedef void (*raft_applier_t)(int action, int argument);
 
+// returns the current action for the argument, or 0 if there is none,
+// used for sending the state covered by a snapshot entry
+typedef int (*raft_reader_t)(int argument);
+
 typedef struct raft_log_t {
 	int first;
 	int size;    // number of entries past first
@@ -58,6 +67,12 @@ typedef struct raft_server_t {
 	int seqno;  // the rpc sequence number
 	int tosend; // index of the next entry to send
 	int acked;  // index of the highest entry known to be replicated
+	int ackmark; // 'acked' as of the previous heartbeat
+
+	int snapindex;  // index of the snapshot being sent, -1 if none
+	int snapoffset; // how many snapshot values the follower has got
+	raft_entry_t snapentry; // the snapshot entry being sent
+	int *snapdata;  // the values it covers, as of when the sending started
 
 	char *host;
 	int port;
@@ -80,7 +95,15 @@ typedef struct raft_t {
 
 	int timer;
 
-	raft_applier_t applier;
+	int batch_delay; // ms to wait for more entries before sending new ones
+	int batch_timer; // ms left before sending new entries, -1 if none
+	int unsent;      // number of entries emitted but not sent yet
+
+	int logfd; // the file the log is persisted to, -1 if none
+	int dirty; // the lowest index not yet written to the file, INT_MAX if clean
+
+	raft_applier_t applier; // used for installing snapshots
+	raft_reader_t reader;   // used for sending snapshots
 } raft_t;
 
 #define RAFT_LOG(RAFT, INDEX) ((RAFT)->log.entries[(INDEX) % (RAFT_LOGLEN)])
@@ -89,6 +112,7 @@ typedef struct raft_t {
 #define RAFT_MSG_DONE   1 // entry appended
 #define RAFT_MSG_CLAIM  2 // vote for me
 #define RAFT_MSG_VOTE   3 // my vote
+#define RAFT_MSG_SNAPSHOT 4 // install a chunk of the snapshot
 
 typedef struct raft_msg_t {
 	int msgtype;
@@ -101,20 +125,36 @@ typedef struct raft_msg_update_t {
 	raft_msg_t msg;
 	int previndex; // the index of the preceding log entry
 	int prevterm;  // the term of the preceding log entry
-
-	bool empty;    // the message is just a heartbeat if empty
-	raft_entry_t entry;
-
 	int acked;     // the leader's acked number
+
+	int nentries;  // the message is just a heartbeat if zero
+	raft_entry_t entries[RAFT_MAX_BATCH]; // only 'nentries' are sent
 } raft_msg_update_t;
 
+#define RAFT_MSG_UPDATE_SIZE(NENTRIES) \
+	(offsetof(raft_msg_update_t, entries) + (NENTRIES) * sizeof(raft_entry_t))
+
 typedef struct raft_msg_done_t {
 	raft_msg_t msg;
-	int index; // the index of the appended entry
-	int term;  // the term of the appended entry
+	int index; // the index of the last appended entry
+	int term;  // the term of the last appended entry
 	bool success;
+	int installed; // snapshot values installed so far, -1 if not a snapshot reply
 } raft_msg_done_t;
 
+typedef struct raft_msg_snapshot_t {
+	raft_msg_t msg;
+	int index;          // the index of the snapshot entry
+	raft_entry_t entry; // the snapshot entry itself
+
+	int offset; // the first value in this chunk is for 'minarg + offset'
+	int count;  // the number of values in this chunk
+	int actions[RAFT_SNAPSHOT_CHUNK]; // only 'count' are sent
+} raft_msg_snapshot_t;
+
+#define RAFT_MSG_SNAPSHOT_SIZE(COUNT) \
+	(offsetof(raft_msg_snapshot_t, actions) + (COUNT) * sizeof(int))
+
 typedef struct raft_msg_claim_t {
 	raft_msg_t msg;
 	int index; // the index of my last entry
@@ -128,11 +168,13 @@ typedef struct raft_msg_vote_t {
 
 // configuration
 void raft_init(raft_t *r);
+bool raft_open_log(raft_t *r, char *path);
 bool raft_add_server(raft_t *r, char *host, int port);
 bool raft_set_myid(raft_t *r, int myid);
 
 // log actions
 bool raft_emit(raft_t *r, int action, int argument);
+void raft_flush(raft_t *r);
 int raft_apply(raft_t *r, raft_applier_t applier);
 
 // control
@@ -28,6 +28,12 @@ typedef void (*onconnect_callback_t)(client_t client);
  */
 typedef void (*ondisconnect_callback_t)(client_t client);
 
+/*
+ * The server will call this function right before sending the replies
+ * accumulated during a tick.
+ */
+typedef void (*onflush_callback_t)(void);
+
 /*
  * Creates a new server that will listen on 'host:port' and call the specified
  * callbacks. Returns the server handle to use in other methods.
@@ -46,6 +52,12 @@ server_t server_init(
  */
 void server_set_raft_socket(server_t server, int sock);
 
+/*
+ * Sets the callback to call before sending the replies, e.g. to make the
+ * state they depend on durable.
+ */
+void server_set_onflush(server_t server, onflush_callback_t onflush);
+
 /*
  * Starts the server. Returns 'true' on success, 'false' otherwise.
  */
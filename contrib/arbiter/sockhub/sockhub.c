@@ -60,6 +60,7 @@ void ShubInitParams(ShubParams* params)
 {
     memset(params, 0, sizeof(*params));
     params->buffer_size = 64*1024;
+    params->delay = SHUB_ADAPTIVE_DELAY;
     params->queue_size = 100;
     params->max_attempts = 10;
     params->error_handler = default_error_handler;
@@ -201,6 +202,9 @@ static void reconnect(Shub* shub)
     if (shub->output >= 0) {
         close_socket(shub, shub->output);
     }
+    /* the responses to the requests sent so far are lost */
+    shub->stats->queue_depth = 0;
+    shub->rtt_probe_time = 0;
 
     sock_inet.sin_family = AF_INET;
 
@@ -263,6 +267,77 @@ static void reconnect(Shub* shub)
     }
 }
 
+static long get_time_usec(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* Send the first 'size' bytes of in_buffer to the server */
+static void send_requests(Shub* shub, int size)
+{
+    ShubStatistics* stats = shub->stats;
+    while (!ShubWriteSocket(shub->output, shub->in_buffer, size)) {
+        shub->params->error_handler("Failed to write to inet socket", SHUB_RECOVERABLE_ERROR);
+        reconnect(shub);
+    }
+    if (stats->queue_depth == 0 && shub->in_buffer_requests != 0 && shub->rtt_probe_time == 0) {
+        /* the server is idle, so the first response will show its round trip time */
+        shub->rtt_probe_time = get_time_usec();
+    }
+    stats->batches += 1;
+    stats->bytes_sent += size;
+    stats->queue_depth += shub->in_buffer_requests;
+    if (stats->queue_depth > stats->max_queue_depth) {
+        stats->max_queue_depth = stats->queue_depth;
+    }
+    shub->in_buffer_requests = 0;
+}
+
+static void request_received(Shub* shub)
+{
+    if (shub->in_buffer_requests++ == 0) {
+        shub->first_request_time = get_time_usec();
+    }
+    shub->stats->requests += 1;
+}
+
+static void response_received(Shub* shub)
+{
+    ShubStatistics* stats = shub->stats;
+    stats->responses += 1;
+    if (stats->queue_depth > 0) {
+        stats->queue_depth -= 1;
+    }
+    if (shub->rtt_probe_time != 0) {
+        int sample = (int)(get_time_usec() - shub->rtt_probe_time);
+        stats->rtt = stats->rtt == 0 ? sample : (stats->rtt*7 + sample)/8;
+        shub->rtt_probe_time = 0;
+    }
+}
+
+/*
+ * Adaptive coalescing: while the server is busy with the previous requests,
+ * wait up to half of its round trip time for more requests to send them in
+ * one batch. Returns the number of microseconds to wait, 0 if the buffer
+ * should be sent right away.
+ */
+static int adaptive_delay(Shub* shub)
+{
+    ShubStatistics* stats = shub->stats;
+    long elapsed;
+    int delay;
+
+    if (stats->queue_depth == 0 || shub->in_buffer_used >= shub->params->buffer_size/2) {
+        return 0;
+    }
+    delay = stats->rtt/2 < SHUB_MAX_ADAPTIVE_DELAY ? stats->rtt/2 : SHUB_MAX_ADAPTIVE_DELAY;
+    stats->batch_delay = delay;
+    elapsed = get_time_usec() - shub->first_request_time;
+    return delay > elapsed ? (int)(delay - elapsed) : 0;
+}
+
 static void notify_disconnect(Shub* shub, int chan)
 {
     ShubMessageHdr* hdr;
@@ -273,10 +348,7 @@ static void notify_disconnect(Shub* shub, int chan)
     hdr->code = MSG_DISCONNECT;
     shub->in_buffer_used += sizeof(ShubMessageHdr);
     if (shub->in_buffer_used + sizeof(ShubMessageHdr) > shub->params->buffer_size) {
-        while (!ShubWriteSocket(shub->output, shub->in_buffer, shub->in_buffer_used)) {
-            shub->params->error_handler("Failed to write to inet socket", SHUB_RECOVERABLE_ERROR);
-            reconnect(shub);
-        }
+        send_requests(shub, shub->in_buffer_used);
         shub->in_buffer_used = 0;
     }
 }
@@ -308,6 +380,11 @@ void ShubInitialize(Shub* shub, ShubParams* params)
     struct sockaddr sock;
 
     shub->params = params;
+    shub->stats = params->stats != NULL ? params->stats : &shub->own_stats;
+    memset(shub->stats, 0, sizeof(ShubStatistics));
+    shub->in_buffer_requests = 0;
+    shub->first_request_time = 0;
+    shub->rtt_probe_time = 0;
 
     sock.sa_family = AF_UNIX;
     assert(strlen(params->file) < sizeof(sock.sa_data));
@@ -364,16 +441,35 @@ void ShubLoop(Shub* shub)
 
     while (!stop) { 
         int i, rc;
+        long delay = shub->params->delay == SHUB_ADAPTIVE_DELAY /* microseconds */
+            ? adaptive_delay(shub)
+            : (long)shub->params->delay*1000;
+        struct timeval tm;
 #ifdef USE_EPOLL
         struct epoll_event events[MAX_EVENTS];
-        rc = epoll_wait(shub->epollfd, events, MAX_EVENTS, shub->in_buffer_used == 0 ? -1 : shub->params->delay);
+        if (shub->in_buffer_used == 0) {
+            rc = epoll_wait(shub->epollfd, events, MAX_EVENTS, -1);
+        } else {
+            /*
+             * epoll_wait() takes milliseconds, but round trips on a LAN are
+             * shorter than that: wait for the epoll descriptor with select()
+             */
+            fd_set epollset;
+            FD_ZERO(&epollset);
+            FD_SET(shub->epollfd, &epollset);
+            tm.tv_sec = delay/1000000;
+            tm.tv_usec = delay % 1000000;
+            rc = select(shub->epollfd+1, &epollset, NULL, NULL, &tm);
+            if (rc > 0) {
+                rc = epoll_wait(shub->epollfd, events, MAX_EVENTS, 0);
+            }
+        }
 #else
         fd_set events;
-        struct timeval tm;
         int max_fd = shub->max_fd;
 
-        tm.tv_sec = shub->params->delay/1000;
-        tm.tv_usec = shub->params->delay % 1000 * 1000;
+        tm.tv_sec = delay/1000000;
+        tm.tv_usec = delay % 1000000;
         events = shub->inset;
         rc = select(max_fd+1, &events, NULL, NULL, shub->in_buffer_used == 0 ? NULL : &tm);
 #endif
@@ -439,6 +535,7 @@ void ShubLoop(Shub* shub)
                                     firstHdr = NULL;
                                 }
                                 if (pos <= available) {
+                                    response_received(shub);
                                     if (!firstHdr) {
                                         firstHdr = hdr;
                                     }
@@ -449,6 +546,7 @@ void ShubLoop(Shub* shub)
                                     } else {
                                         /* read rest of message if it doesn't fit in the buffer */
                                         int tail = pos - available;
+                                        response_received(shub);
                                         if (!ShubWriteSocket(chan, hdr, available)) {
                                             shub->params->error_handler("Failed to write to local socket", SHUB_RECOVERABLE_ERROR);
                                             close_socket(shub, chan);
@@ -513,16 +611,14 @@ void ShubLoop(Shub* shub)
                                     int processed = pos;
                                     pos += sizeof(ShubMessageHdr) + size;
                                     hdr->chan = chan; /* remember socket descriptor from which this message was read */
+                                    request_received(shub);
                                     if (pos <= available) {
                                         /* message cmopletely fetched */
                                         continue;
                                     }
                                     if (pos + sizeof(ShubMessageHdr) > buffer_size) {
                                         /* message doesn't completely fit in buffer */
-                                        while (!ShubWriteSocket(shub->output, shub->in_buffer, available)) {
-                                            shub->params->error_handler("Failed to write to inet socket", SHUB_RECOVERABLE_ERROR);
-                                            reconnect(shub);
-                                        }
+                                        send_requests(shub, available);
                                         processed = 0;
                                         hdr = NULL;
                                     } else {
@@ -553,10 +649,7 @@ void ShubLoop(Shub* shub)
                                         /* if there is no more free space in the buffer to receive new message header... */
                                         if (processed + sizeof(ShubMessageHdr) > buffer_size) {
                                             /* ... then send buffer to the server */
-                                            while (!ShubWriteSocket(shub->output, shub->in_buffer, processed)) {
-                                                shub->params->error_handler("Failed to write to inet socket", SHUB_RECOVERABLE_ERROR);
-                                                reconnect(shub);
-                                            }
+                                            send_requests(shub, processed);
                                             hdr = NULL; /* message is partly sent to the server: can not skip it any more */
                                             processed = 0;
                                         }
@@ -571,10 +664,7 @@ void ShubLoop(Shub* shub)
                                     break;
                                 }
                                 if (pos + sizeof(ShubMessageHdr) > buffer_size) {
-                                    while (!ShubWriteSocket(shub->output, shub->in_buffer, pos)) {
-                                        shub->params->error_handler("Failed to write to inet socket", SHUB_RECOVERABLE_ERROR);
-                                        reconnect(shub);
-                                    }
+                                    send_requests(shub, pos);
                                     memmove(shub->in_buffer, shub->in_buffer + pos, available -= pos);
                                     pos = 0;
                                 } else {
@@ -587,24 +677,17 @@ void ShubLoop(Shub* shub)
                         }
                     }
                 }
-                if (shub->params->delay != 0) {
+                if (shub->params->delay == SHUB_ADAPTIVE_DELAY) {
+                    if (shub->in_buffer_used != 0 && adaptive_delay(shub) > 0) {
+                        continue;
+                    }
+                } else if (shub->params->delay != 0) {
                     continue;
                 }
             }
             if (shub->in_buffer_used != 0) { /* if buffer is not empty... */
                 /* ...then send it */
-#if SHOW_SENT_STATISTIC
-                static size_t total_sent;
-                static size_t total_count;
-                total_sent += shub->in_buffer_used;
-                if (++total_count % 1024 == 0) {
-                    printf("Average sent buffer size: %ld\n", total_sent/total_count);
-                }
-#endif
-                while (!ShubWriteSocket(shub->output, shub->in_buffer, shub->in_buffer_used)) {
-                    shub->params->error_handler("Failed to write to inet socket", SHUB_RECOVERABLE_ERROR);
-                    reconnect(shub);
-                }
+                send_requests(shub, shub->in_buffer_used);
                 shub->in_buffer_used = 0;
             }
         }
@@ -43,15 +43,31 @@ typedef struct host_t
     struct host_t *prev;
 } host_t;
 
+#define SHUB_ADAPTIVE_DELAY (-1)   /* derive the delay from the server round trip time */
+#define SHUB_MAX_ADAPTIVE_DELAY 10000 /* microseconds */
+
+typedef struct
+{
+    long requests;       /* messages received from the local sockets */
+    long responses;      /* messages received from the server */
+    long batches;        /* buffers sent to the server */
+    long bytes_sent;     /* bytes sent to the server */
+    int  queue_depth;    /* requests sent to the server and not answered yet */
+    int  max_queue_depth;
+    int  rtt;            /* smoothed server round trip time, microseconds */
+    int  batch_delay;    /* current adaptive coalescing delay, microseconds */
+} ShubStatistics;
+
 typedef struct 
 {
     int buffer_size;
-    int delay;
+    int delay;           /* milliseconds, or SHUB_ADAPTIVE_DELAY */
     int queue_size;
     int max_attempts;
     char const* file;
     host_t *leader;
     ShubErrorHandler error_handler;
+    ShubStatistics* stats; /* where to keep the statistics, e.g. in shared memory, or NULL */
 } ShubParams;
    
 typedef struct
@@ -68,7 +84,12 @@ typedef struct
     char*  out_buffer;
     int    in_buffer_used;
     int    out_buffer_used;
+    int    in_buffer_requests; /* number of requests in in_buffer */
+    long   first_request_time; /* when the oldest request in in_buffer was received */
+    long   rtt_probe_time;     /* when the batch used for measuring RTT was sent, 0 if none */
     ShubParams* params;
+    ShubStatistics* stats;
+    ShubStatistics own_stats;
 } Shub;
 
 
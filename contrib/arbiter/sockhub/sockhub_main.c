@@ -35,7 +35,7 @@ int main(int argc, char* argv[])
                 "Options:\n"
                 "\t-h HOST:PORT\tremote address\n"
                 "\t-f FILE\tunix socket file name\n"
-                "\t-d DELAY\tdelay for waiting income requests (milliseconds)\n"
+                "\t-d DELAY\tdelay for waiting income requests (milliseconds, -1 to adapt to the server round trip time)\n"
                 "\t-b SIZE\tbuffer size\n"
                 "\t-q SIZE\tlisten queue size\n"
                 "\t-r N\tmaximun connect attempts\n"
@@ -51,5 +51,10 @@ int main(int argc, char* argv[])
     
     ShubLoop(&shub);
 
+    fprintf(stderr, "requests: %ld, responses: %ld, batches: %ld, bytes sent: %ld\n"
+            "average batch: %.1f requests, max queue depth: %d, rtt: %d usec\n",
+            shub.stats->requests, shub.stats->responses, shub.stats->batches, shub.stats->bytes_sent,
+            shub.stats->batches ? (double)shub.stats->requests/shub.stats->batches : 0.0,
+            shub.stats->max_queue_depth, shub.stats->rtt);
     return 0;
 }
@@ -7,6 +7,7 @@
 #include <unistd.h>
 
 #include "clog.h"
+#include "clogfile.h"
 
 bool test_clog(char *datadir) {
 	bool ok = true;
@@ -41,6 +42,26 @@ bool test_clog(char *datadir) {
 	printf("commit %d status %d (should be 0)\n", 2044, status = clog_read(clog, 2044));
 	if (status != BLANK) return false;
 
+	if (!clog_close(clog)) return false;
+	if (!(clog = clog_open(datadir))) return false;
+
+	xid_t last_used;
+
+	printf("last used %u (should be 1500)\n", last_used = clog_find_last_used(clog));
+	if (last_used != 1500) return false;
+
+	// the next file gets preallocated, but is still blank
+	if (!clog_write(clog, COMMITS_PER_FILE - 10, POSITIVE)) return false;
+	if (!clog_flush(clog)) return false;
+	if (!clog_close(clog)) return false;
+	if (!(clog = clog_open(datadir))) return false;
+
+	printf("last used %u (should be %u)\n", last_used = clog_find_last_used(clog), COMMITS_PER_FILE - 10);
+	if (last_used != COMMITS_PER_FILE - 10) return false;
+
+	printf("commit %d status %d (should be 0)\n", COMMITS_PER_FILE + 10, status = clog_read(clog, COMMITS_PER_FILE + 10));
+	if (status != BLANK) return false;
+
 	if (!clog_close(clog)) return false;
 
 	return ok;
@@ -16,6 +16,10 @@
 
 #define MAX_CLOG_FILES 10 // FIXME: Enforce this limit.
 
+// create the next file when this number of xids is left in the last one, so
+// that allocating it does not stall the commits at the file boundary
+#define PREALLOCATE_XIDS (COMMITS_PER_FILE / 16)
+
 typedef struct clogfile_chain_t {
 	struct clogfile_chain_t *prev;
 	clogfile_t file;
@@ -133,33 +137,66 @@ int clog_read(clog_t clog, xid_t xid) {
 	}
 }
 
+// Create the clog file with the given id and make it the last one. Return
+// 'true' on success, 'false' otherwise.
+static bool clog_add_file(clog_t clog, int fileid) {
+	clogfile_t newfile;
+	clogfile_chain_t *lastfile;
+
+	if (!clogfile_open_by_id(&newfile, clog->datadir, fileid, true)) {
+		return false;
+	}
+
+	lastfile = new_clogfile_chain(&newfile);
+	lastfile->prev = clog->lastfile;
+	clog->lastfile = lastfile;
+	return true;
+}
+
 // Set the status of the specified global commit. Return 'true' on success,
 // 'false' otherwise.
 bool clog_write(clog_t clog, xid_t xid, int status) {
 	clogfile_t *file = clog_xid_to_file(clog, xid);
 	if (!file) {
-		clogfile_t newfile;
-		clogfile_chain_t *lastfile;
-
 		debug("xid %u out of range, creating the file\n", xid);
-		if (!clogfile_open_by_id(&newfile, clog->datadir, XID_TO_FILEID(xid), true)) {
+		if (!clog_add_file(clog, XID_TO_FILEID(xid))) {
 			shout(
 				"failed to create new clogfile "
 				"while saving transaction status\n"
 			);
 			return false;
 		}
-
-		lastfile = new_clogfile_chain(&newfile);
-		lastfile->prev = clog->lastfile;
-		clog->lastfile = lastfile;
 	}
 	file = clog_xid_to_file(clog, xid);
 	if (!file) {
 		shout("the file is absent despite our efforts\n");
 		return false;
 	}
-	return clogfile_set_status(file, xid, status);
+	if (!clogfile_set_status(file, xid, status)) {
+		return false;
+	}
+
+	if ((file == &clog->lastfile->file) && (xid > file->max - PREALLOCATE_XIDS)) {
+		debug("xid %u is close to the end of the file, creating the next one\n", xid);
+		if (!clog_add_file(clog, XID_TO_FILEID(xid) + 1)) {
+			// not fatal, will try again on the next write
+			shout("failed to preallocate the next clogfile\n");
+		}
+	}
+	return true;
+}
+
+// Flush the statuses written since the previous call. Return 'true' on
+// success, 'false' otherwise.
+bool clog_flush(clog_t clog) {
+	clogfile_chain_t *cur;
+	bool ok = true;
+	for (cur = clog->lastfile; cur; cur = cur->prev) {
+		if (!clogfile_flush(&cur->file)) {
+			ok = false;
+		}
+	}
+	return ok;
 }
 
 // Forget about the commits before the given one ('until'), and free the
@@ -205,14 +242,16 @@ bool clog_close(clog_t clog) {
 // Returns the last used xid.
 xid_t clog_find_last_used(clog_t clog) {
 	xid_t last_used = INVALID_XID;
-	clogfile_chain_t *chain = clog->lastfile;
-	xid_t xid;
-	for (xid = chain->file.min; xid <= chain->file.max; xid++) {
-		int status = clogfile_get_status(&chain->file, xid);
-		if ((last_used == INVALID_XID) || (status != BLANK)) {
-			last_used = xid;
+	clogfile_chain_t *chain;
+	// the last file may have been preallocated and still be blank
+	for (chain = clog->lastfile; chain; chain = chain->prev) {
+		if (clogfile_find_last_used(&chain->file, &last_used)) {
+			break;
 		}
 	}
+	if (!chain) {
+		last_used = clog->lastfile->file.min;
+	}
 	if (last_used < MIN_XID) {
 		last_used = MIN_XID;
 	}
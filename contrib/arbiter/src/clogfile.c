@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <errno.h>
+#include <stdint.h>
 #include <sys/mman.h>
 
 #include "clogfile.h"
@@ -19,6 +20,14 @@ static char *clogfile_get_path(char *datadir, int fileid) {
 	return join_path(datadir, fileidstr);
 }
 
+static off64_t page_size(void) {
+	static off64_t size = 0;
+	if (!size) {
+		size = sysconf(_SC_PAGESIZE);
+	}
+	return size;
+}
+
 // Open a clog file with the gived id. Create before opening if 'create' is
 // true. Return 'true' on success, 'false' otherwise.
 bool clogfile_open_by_id(clogfile_t *clogfile, char *datadir, int fileid, bool create) {
@@ -62,6 +71,17 @@ bool clogfile_open_by_id(clogfile_t *clogfile, char *datadir, int fileid, bool c
 		shout("cannot mmap clog file '%s': %s\n", clogfile->path, strerror(errno));
 		return false;
 	}
+
+	#if defined(HUGEPAGES) && defined(MADV_HUGEPAGE)
+	if (madvise(clogfile->data, BYTES_PER_FILE, MADV_HUGEPAGE)) {
+		// not every filesystem supports this, regular pages will do
+		debug("cannot use huge pages for clog file '%s': %s\n", clogfile->path, strerror(errno));
+	}
+	#endif
+
+	clogfile->dirty_min = BYTES_PER_FILE;
+	clogfile->dirty_max = -1;
+	clogfile->prefetched = 0;
 	return true;
 }
 
@@ -79,6 +99,9 @@ bool clogfile_remove(clogfile_t *clogfile) {
 
 // Close the specified clogfile. Return 'true' on success, 'false' otherwise.
 bool clogfile_close(clogfile_t *clogfile) {
+	if (!clogfile_flush(clogfile)) {
+		return false;
+	}
 	if (munmap(clogfile->data, BYTES_PER_FILE)) {
 		return false;
 	}
@@ -101,11 +124,65 @@ bool clogfile_set_status(clogfile_t *clogfile, xid_t xid, int status) {
 	char *p = ((char*)clogfile->data + offset);
 	*p &= ~(COMMIT_MASK << (BITS_PER_COMMIT * suboffset));   // AND-out the old status
 	*p |= status << (BITS_PER_COMMIT * suboffset); // OR-in the new status
+
+	if (offset < clogfile->dirty_min) clogfile->dirty_min = offset;
+	if (offset > clogfile->dirty_max) clogfile->dirty_max = offset;
+
+	// the xids grow sequentially, so the following pages will be needed soon
+	if (offset + PREFETCH_BYTES / 2 >= clogfile->prefetched) {
+		off64_t start = max(offset, clogfile->prefetched) & ~(page_size() - 1);
+		off64_t end = min(start + PREFETCH_BYTES, BYTES_PER_FILE);
+		if (start < end) {
+			madvise((char*)clogfile->data + start, end - start, MADV_WILLNEED);
+		}
+		clogfile->prefetched = end;
+	}
+	return true;
+}
+
+bool clogfile_flush(clogfile_t *clogfile) {
+	off64_t start, end;
+	int flags;
+
+	if (clogfile->dirty_min > clogfile->dirty_max) {
+		return true;
+	}
+
+	start = clogfile->dirty_min & ~(page_size() - 1);
+	end = clogfile->dirty_max + 1;
 	#ifdef SYNC
-	if (msync(clogfile->data, BYTES_PER_FILE, MS_SYNC)) {
+	flags = MS_SYNC;
+	#else
+	// start the writeback early to avoid huge flushes later
+	flags = MS_ASYNC;
+	#endif
+	if (msync((char*)clogfile->data + start, end - start, flags)) {
 		shout("cannot msync clog file '%s': %s\n", clogfile->path, strerror(errno));
 		return false;
 	}
-	#endif
+
+	clogfile->dirty_min = BYTES_PER_FILE;
+	clogfile->dirty_max = -1;
+	return true;
+}
+
+bool clogfile_find_last_used(clogfile_t *clogfile, xid_t *xid) {
+	uint64_t *words = (uint64_t*)clogfile->data;
+	off64_t i = BYTES_PER_FILE / sizeof(uint64_t);
+	unsigned char *p;
+	int suboffset;
+
+	// skip the blank tail quickly
+	while ((i > 0) && !words[i - 1]) i--;
+	if (i == 0) {
+		return false;
+	}
+
+	p = (unsigned char*)(words + i) - 1;
+	while (!*p) p--;
+	for (suboffset = COMMITS_PER_BYTE - 1; suboffset > 0; suboffset--) {
+		if ((*p >> (BITS_PER_COMMIT * suboffset)) & COMMIT_MASK) break;
+	}
+	*xid = clogfile->min + (p - (unsigned char*)clogfile->data) * COMMITS_PER_BYTE + suboffset;
 	return true;
 }
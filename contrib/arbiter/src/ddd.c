@@ -13,6 +13,8 @@ void initGraph(Graph* graph)
     graph->freeEdges = NULL;
     graph->freeVertexes = NULL;
     graph->marker = 0;
+    graph->epoch = 0;
+    graph->generation = 0;
 }
 
 static inline Edge* newEdge(Graph* graph)
@@ -69,6 +71,8 @@ static inline Vertex* findVertex(Graph* graph, xid_t xid)
     l2_list_init(&v->outgoingEdges);
     v->xid = xid;
     v->nIncomingEdges = 0;
+    v->visited = 0;
+    v->checked = -1;
     v->next = graph->hashtable[h];
     graph->hashtable[h] = v;
     return v;
@@ -91,37 +95,84 @@ static inline Node* findNode(Cluster* cluster, nodeid_t node_id)
     return node;
 }
 
+static inline bool isIsolated(Vertex* v)
+{
+    return v->nIncomingEdges == 0 && l2_list_is_empty(&v->outgoingEdges);
+}
+
+/*
+ * Find the edge src->dst reported by the given node, if any. The lists of
+ * outgoing edges are short: a transaction waits for a single lock.
+ */
+static inline Edge* findEdge(Vertex* src, Vertex* dst, Node* owner)
+{
+    L2List* l;
+    for (l = src->outgoingEdges.next; l != &src->outgoingEdges; l = l->next) {
+        Edge* e = (Edge*)l;
+        if (e->dst == dst && e->owner == owner) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Replace the subgraph reported by the node with the new one. Only the
+ * difference is applied: edges present in both versions are kept as is, so
+ * that a node resending a mostly unchanged lock graph does not make the
+ * detector forget what it has already checked.
+ */
 void addSubgraph(Graph* graph, nodeid_t node_id, xid_t* xids, int n_xids)
 {
     xid_t *last = xids + n_xids;
-    Edge *e, *next, *edges = NULL;
+    Edge *e, **epp;
     Node* node = findNode(&cluster, node_id);
+    int epoch = ++graph->epoch;
+    bool grown = false;
+
     while (xids != last) { 
         Vertex* src = findVertex(graph, *xids++);
         xid_t xid;
         while ((xid = *xids++) != 0) { 
             Vertex* dst = findVertex(graph, xid);
-            e = newEdge(graph);
-            dst->nIncomingEdges += 1;
-            e->dst = dst;
-            e->src = src;
-            e->next = edges;
-            edges = e;
-            l2_list_link(&src->outgoingEdges, &e->node);
+            e = findEdge(src, dst, node);
+            if (e == NULL) {
+                e = newEdge(graph);
+                dst->nIncomingEdges += 1;
+                e->dst = dst;
+                e->src = src;
+                e->owner = node;
+                e->next = node->edges;
+                node->edges = e;
+                l2_list_link(&src->outgoingEdges, &e->node);
+                grown = true;
+            }
+            e->epoch = epoch;
+        }
+        if (isIsolated(src)) {
+            freeVertex(graph, src);
         }
     }
-    for (e = node->edges; e != NULL; e = next) { 
-        next = e->next;
+    if (grown) {
+        /* new edges may close a cycle through any vertex */
+        graph->generation += 1;
+    }
+    for (epp = &node->edges; (e = *epp) != NULL;) {
+        if (e->epoch == epoch) {
+            epp = &e->next;
+            continue;
+        }
+        *epp = e->next;
         l2_list_unlink(&e->node);
-        if (--e->dst->nIncomingEdges == 0 && l2_list_is_empty(&e->dst->outgoingEdges)) {
+        e->dst->nIncomingEdges -= 1;
+        if (isIsolated(e->dst)) {
             freeVertex(graph, e->dst);
         }
-        if (e->dst != e->src && e->src->nIncomingEdges == 0 && l2_list_is_empty(&e->src->outgoingEdges)) {
+        if (e->dst != e->src && isIsolated(e->src)) {
             freeVertex(graph, e->src);
         }
         freeEdge(graph, e);
     }
-    node->edges = edges;
 }
 
 static bool recursiveTraverseGraph(Vertex* root, Vertex* v, int marker)
@@ -145,9 +196,17 @@ bool detectDeadLock(Graph* graph, xid_t root)
     Vertex* v;
     for (v = graph->hashtable[root % MAX_TRANSACTIONS]; v != NULL; v = v->next) { 
         if (v->xid == root) { 
+            /*
+             * Removing edges cannot create a cycle, so if nothing was added
+             * since the last check of this vertex, the answer is the same.
+             */
+            if (v->checked == graph->generation) {
+                return false;
+            }
             if (recursiveTraverseGraph(v, v, ++graph->marker)) { 
                 return true;
             }
+            v->checked = graph->generation;
             break;
         }
     }
@@ -20,6 +20,10 @@ static void raft_update_apply(int action, int argument) {
 	state[argument % STATELEN] = action;
 }
 
+static int raft_update_read(int argument) {
+	return state[argument % STATELEN];
+}
+
 static void die(int signum) {
 	shout("terminated\n");
 	exit(signum);
@@ -83,6 +87,7 @@ static void main_loop() {
 			raft_emit(&raft, action, arg);
 			arg++;
 		}
+		raft_flush(&raft);
 	}
 
 	close(s);
@@ -99,6 +104,8 @@ int main(int argc, char **argv) {
 	int opt;
 
 	raft_init(&raft);
+	raft.applier = raft_update_apply;
+	raft.reader = raft_update_read;
 
 	while ((opt = getopt(argc, argv, "hi:r:l:")) != -1) {
 		switch (opt) {
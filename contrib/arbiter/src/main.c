@@ -34,6 +34,44 @@ Transaction* transaction_hash[MAX_TRANSACTIONS];
 xid_t prev_gxid, next_gxid;
 xid_t global_xmin = INVALID_XID;
 
+/*
+ * Xids of the active transactions in ascending order. A transaction is added
+ * when it starts and removed when it finishes, so generating a snapshot does
+ * not have to walk the transaction list.
+ */
+static xid_t active_xids[MAX_TRANSACTIONS];
+static int nactive_xids = 0;
+
+/* Position of 'xid' in active_xids, or of the first greater xid. */
+static int active_xids_search(xid_t xid) {
+	int lo = 0, hi = nactive_xids;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (active_xids[mid] < xid) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* New xids are the greatest ones, so this is usually an append. */
+static void active_xids_add(xid_t xid) {
+	int pos = active_xids_search(xid);
+	assert(nactive_xids < MAX_TRANSACTIONS);
+	memmove(&active_xids[pos + 1], &active_xids[pos], sizeof(xid_t) * (nactive_xids - pos));
+	active_xids[pos] = xid;
+	nactive_xids++;
+}
+
+static void active_xids_remove(xid_t xid) {
+	int pos = active_xids_search(xid);
+	assert(pos < nactive_xids && active_xids[pos] == xid);
+	nactive_xids--;
+	memmove(&active_xids[pos], &active_xids[pos + 1], sizeof(xid_t) * (nactive_xids - pos));
+}
+
 static Transaction *find_transaction(xid_t xid) {    
 	Transaction *t;    
 	for (t = transaction_hash[xid % MAX_TRANSACTIONS]; t != NULL && t->xid != xid; t = t->collision);
@@ -81,6 +119,7 @@ inline static void free_transaction(Transaction* t) {
 	for (tpp = &transaction_hash[t->xid % MAX_TRANSACTIONS]; *tpp != t; tpp = &(*tpp)->collision);
 	*tpp = t->collision;
 	l2_list_unlink(&t->elem);
+	active_xids_remove(t->xid);
 	t->elem.next = free_transactions;
 	free_transactions = &t->elem;
 	if (t->xmin == global_xmin) { 
@@ -157,6 +196,22 @@ static void apply_clog_update(int action, int argument) {
 	}
 }
 
+/* Make the statuses durable before the clients hear about them. */
+static void onflush(void) {
+	if (!clog_flush(clg)) {
+		shout("failed to flush the clog\n");
+	}
+}
+
+/* Used for sending the clog state covered by a Raft snapshot entry. */
+static int read_clog_update(int argument) {
+	int status = clog_read(clg, argument);
+	if ((status == NEGATIVE) || (status == POSITIVE)) {
+		return status;
+	}
+	return BLANK;
+}
+
 static int next_client_id = 0;
 static void onconnect(client_t client) {
 	client_userdata_t *cd = create_client_userdata(next_client_id++);
@@ -198,6 +253,7 @@ static void debug_cmd(client_t client, int argc, xid_t *argv) {
 		case CMD_FOR     : cmdname =      "FOR"; break;
 		case CMD_AGAINST : cmdname =  "AGAINST"; break;
 		case CMD_SNAPSHOT: cmdname = "SNAPSHOT"; break;
+		case CMD_SNAPSHOTS: cmdname = "SNAPSHOTS"; break;
 		case CMD_STATUS  : cmdname =   "STATUS"; break;
 		case CMD_DEADLOCK: cmdname = "DEADLOCK"; break;
 		default          : cmdname =  "unknown";
@@ -230,23 +286,20 @@ static xid_t max_of_xids(xid_t a, xid_t b) {
 }
 
 static void gen_snapshot(Snapshot *s) {
-	Transaction* t;
-    int n = 0;
+    int n = nactive_xids;
 	s->times_sent = 0;
-	for (t = (Transaction*)active_transactions.prev; t != (Transaction*)&active_transactions; t = (Transaction*)t->elem.prev) {
-		s->active[n++] = t->xid;
-	}
-	while (n > 1 && s->active[n-2]+1 == s->active[n-1]) { 
+	while (n > 1 && active_xids[n-2]+1 == active_xids[n-1]) { 
 		n -= 1;
 	}
 	if (n > 0) {
-        s->xmin = s->active[0];
-        s->xmax = s->active[--n];
+        s->xmin = active_xids[0];
+        s->xmax = active_xids[--n];
 		assert(s->xmin <= s->xmax);
 	} else {
 		s->xmin = s->xmax = 0;
 	} 
 	s->nactive = n;
+	memcpy(s->active, active_xids, sizeof(xid_t) * n);
 }
 
 static void onhello(client_t client, int argc, xid_t *argv) {
@@ -374,15 +427,19 @@ static void onreserve(client_t client, int argc, xid_t *argv) {
 	client_message_finish(client);
 }
 
+/*
+ * Transactions are linked to the head of the active list in order of their
+ * start, and xmin of a transaction can not be smaller than xmin of
+ * transactions started before it. So the oldest transaction (the list tail)
+ * has the smallest xmin.
+ */
 static xid_t get_global_xmin() {
-	xid_t xmin = next_gxid;
 	Transaction *t;
-	for (t = (Transaction*)active_transactions.next; t != (Transaction*)&active_transactions; t = (Transaction*)t->elem.next) {
-		if (t->xmin < xmin) { 
-			xmin = t->xmin;
-		}
+	if (l2_list_is_empty(&active_transactions)) {
+		return next_gxid;
 	}
-	return xmin;
+	t = (Transaction*)active_transactions.prev;
+	return t->xmin < next_gxid ? t->xmin : next_gxid;
 }
 
 static void onbegin(client_t client, int argc, xid_t *argv) {
@@ -409,6 +466,7 @@ static void onbegin(client_t client, int argc, xid_t *argv) {
 	l2_list_link(&active_transactions, &t->elem);
 
 	t->xid = next_gxid;
+	active_xids_add(t->xid);
 	CHECK(
 		use_xid(next_gxid),
 		client,
@@ -612,6 +670,64 @@ static void onsnapshot(client_t client, int argc, xid_t *argv) {
 	} client_message_finish(client);
 }
 
+/*
+ * Batched version of 'onsnapshot' used by clients which combine snapshot
+ * requests of several backends into one message. Each request is a pair
+ * (xid, snapno), where 'snapno' is the number of snapshots the backend has
+ * already received for this transaction, so the reply does not depend on the
+ * connection the request came from. At most one fresh snapshot is generated
+ * for the whole batch.
+ */
+static void onsnapshots(client_t client, int argc, xid_t *argv) {
+	Snapshot snapshot_now;
+	bool generated = false;
+	int i;
+
+	CHECK(
+		(argc > 1) && (argc % 2 == 1),
+		client,
+		"SNAPSHOTS: wrong number of arguments"
+	);
+
+	xid_t ok = RES_OK;
+	client_message_start(client);
+	client_message_append(client, sizeof(xid_t), &ok);
+	client_message_append(client, sizeof(xid_t), &global_xmin);
+
+	for (i = 1; i < argc; i += 2) {
+		xid_t xid = argv[i];
+		int snapno = argv[i + 1];
+		Snapshot *snap;
+		Transaction *t = find_transaction(xid);
+
+		if (!generated && (t == NULL || snapno >= t->snapshots_count)) {
+			gen_snapshot(&snapshot_now);
+			generated = true;
+		}
+		if (t == NULL) {
+			debug(
+				"[%d] SNAPSHOTS: xid=%u not found: use current snapshot\n",
+				CLIENT_ID(client), xid
+			);
+			snap = &snapshot_now;
+		} else {
+			while (snapno >= t->snapshots_count) {
+				/* a fresh snapshot is needed */
+				*transaction_next_snapshot(t) = snapshot_now;
+			}
+			snap = transaction_snapshot(t, snapno);
+			snap->times_sent += 1;
+		}
+
+		xid_t nactive = snap->nactive;
+		client_message_append(client, sizeof(xid_t), &snap->xmin);
+		client_message_append(client, sizeof(xid_t), &snap->xmax);
+		client_message_append(client, sizeof(xid_t), &nactive);
+		client_message_append(client, sizeof(xid_t) * snap->nactive, snap->active);
+	}
+	client_message_finish(client);
+}
+
 static void onstatus(client_t client, int argc, xid_t *argv) {
 	if (argc != 3) {
 		shout(
@@ -718,6 +834,10 @@ static void oncmd(client_t client, int argc, xid_t *argv) {
 			CHECKLEADER(client);
 			onsnapshot(client, argc, argv);
 			break;
+		case CMD_SNAPSHOTS:
+			CHECKLEADER(client);
+			onsnapshots(client, argc, argv);
+			break;
 		case CMD_STATUS:
 			CHECKLEADER(client);
 			onstatus(client, argc, argv);
@@ -742,11 +862,12 @@ static void onmessage(client_t client, size_t len, char *data) {
 
 static void usage(char *prog) {
 	printf(
-		"Usage: %s -i ID -r HOST:PORT [-r HOST:PORT ...] [-d DATADIR] [-k] [-l LOGFILE]\n"
+		"Usage: %s -i ID -r HOST:PORT [-r HOST:PORT ...] [-d DATADIR] [-b MSEC] [-k] [-l LOGFILE]\n"
 		"   arbiter will try to kill the other one running at\n"
 		"   the same DATADIR.\n"
 		"   -r : Listen on the HOST and PORT. Specify multiple times to enable Raft protocol.\n"
 		"   -i : A number to distinguish this instance among the Raft peers.\n"
+		"   -b : Wait MSEC milliseconds to batch new Raft entries before replicating them.\n"
 		"   -l : Run as a daemon and write output to LOGFILE.\n"
 		"   -k : Just kill the other arbiter and exit.\n",
 		prog
@@ -849,7 +970,7 @@ bool configure(int argc, char **argv) {
     initGraph(&graph);
 
 	int opt;
-	while ((opt = getopt(argc, argv, "hd:i:r:l:k")) != -1) {
+	while ((opt = getopt(argc, argv, "hd:i:r:l:kb:")) != -1) {
 		char *host;
 		char *portstr;
 		int port;
@@ -860,6 +981,9 @@ bool configure(int argc, char **argv) {
 			case 'd':
 				datadir = optarg;
 				break;
+			case 'b':
+				raft.batch_delay = atoi(optarg);
+				break;
 			case 'r':
 				host = strtok(optarg, ":");
 				portstr = strtok(NULL, ":");
@@ -932,7 +1056,17 @@ int main(int argc, char **argv) {
 		shout("could not set last used xid to %u\n", last_used_xid);
 		return EXIT_FAILURE;
 	}
-	raft.term = xid2term(next_gxid);
+	if (use_raft) {
+		char *raftlogpath = join_path(datadir, "raft.log");
+		if (!raft_open_log(&raft, raftlogpath)) {
+			shout("could not open raft log at '%s'\n", raftlogpath);
+			return EXIT_FAILURE;
+		}
+		free(raftlogpath);
+		raft.applier = apply_clog_update;
+		raft.reader = read_clog_update;
+	}
+	raft.term = max(raft.term, xid2term(next_gxid));
 
 	prev_gxid = next_gxid - 1;
 	debug("initial next_gxid = %u\n", next_gxid);
@@ -966,6 +1100,7 @@ int main(int argc, char **argv) {
 	);
 
 	server_set_raft_socket(server, raftsock);
+	server_set_onflush(server, onflush);
 
 	if (!server_start(server)) {
 		return EXIT_FAILURE;
@@ -976,14 +1111,19 @@ int main(int argc, char **argv) {
 	int old_term = 0;
 	while (true) {
 		int ms = mstimer_reset(&t);
+		int timeout = HEARTBEAT_TIMEOUT_MS;
 		raft_msg_t *m = NULL;
 
 		if (use_raft) {
 			raft_tick(&raft, ms);
+			/* Do not sleep past the moment the pending entries should be sent. */
+			if (raft.batch_timer >= 0) {
+				timeout = min(timeout, raft.batch_timer);
+			}
 		}
 
 		/* The client interaction is done in server_tick. */
-		if (server_tick(server, HEARTBEAT_TIMEOUT_MS)) {
+		if (server_tick(server, timeout)) {
 			m = raft_recv_message(&raft);
 			assert(m); /* m should not be NULL, because the message should be ready to recv */
 		}
@@ -998,6 +1138,9 @@ int main(int argc, char **argv) {
 				raft_handle_message(&raft, m);
 			}
 
+			/* Replicate the updates emitted during this iteration in one go. */
+			raft_flush(&raft);
+
 			server_set_enabled(server, raft.role == ROLE_LEADER);
 
 			/* Update the gxid limits based on current term and leadership. */
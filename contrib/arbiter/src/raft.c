@@ -2,6 +2,8 @@
 #include <errno.h>
 #include <string.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "raft.h"
 #include "util.h"
@@ -10,6 +12,11 @@ static void raft_server_init(raft_server_t *s) {
 	s->seqno = 0;
 	s->tosend = 0;
 	s->acked = 0;
+	s->ackmark = 0;
+
+	s->snapindex = -1;
+	s->snapoffset = 0;
+	s->snapdata = NULL;
 
 	s->host = DEFAULT_LISTENHOST;
 	s->port = DEFAULT_LISTENPORT;
@@ -79,6 +86,137 @@ void raft_init(raft_t *r) {
 	r->log.applied = 0;
 
 	r->servernum = 0;
+
+	r->batch_delay = RAFT_BATCH_DELAY_MS;
+	r->batch_timer = -1;
+	r->unsent = 0;
+
+	r->logfd = -1;
+	r->dirty = INT_MAX;
+
+	r->applier = NULL;
+	r->reader = NULL;
+}
+
+#define RAFT_LOG_MAGIC 0x52414654 // "RAFT"
+
+// the header of the log file, followed by RAFT_LOGLEN entries which are
+// stored at the same positions as in the in-memory log
+typedef struct raft_log_header_t {
+	int magic;
+	int term;
+	int vote;
+	int first;
+	int size;
+	int acked;
+} raft_log_header_t;
+
+static off_t raft_log_offset(int index) {
+	return sizeof(raft_log_header_t) + (off_t)(index % RAFT_LOGLEN) * sizeof(raft_entry_t);
+}
+
+// Remember that the entries since 'index' need to be written. Marking the
+// end of the log means that only the header has changed.
+static void raft_log_dirty(raft_t *r, int index) {
+	if (index < r->dirty) {
+		r->dirty = index;
+	}
+}
+
+// Write the changed part of the log to the file and sync it. Must be called
+// before telling anybody about the changes.
+static bool raft_sync_log(raft_t *r) {
+	raft_log_header_t h;
+	int end = r->log.first + r->log.size;
+	int index;
+
+	if ((r->logfd == -1) || (r->dirty == INT_MAX)) {
+		return true;
+	}
+
+	// the snapshot entry at 'first' may change without being marked
+	index = max(r->dirty, r->log.first);
+	if (index > r->log.first) {
+		if (pwrite(
+			r->logfd, &RAFT_LOG(r, r->log.first), sizeof(raft_entry_t),
+			raft_log_offset(r->log.first)
+		) != sizeof(raft_entry_t)) goto failure;
+	}
+	while (index < end) {
+		// write the contiguous pieces of the ring at once
+		int count = min(end - index, RAFT_LOGLEN - index % RAFT_LOGLEN);
+		if (pwrite(
+			r->logfd, &RAFT_LOG(r, index), count * sizeof(raft_entry_t),
+			raft_log_offset(index)
+		) != count * sizeof(raft_entry_t)) goto failure;
+		index += count;
+	}
+
+	h.magic = RAFT_LOG_MAGIC;
+	h.term = r->term;
+	h.vote = r->vote;
+	h.first = r->log.first;
+	h.size = r->log.size;
+	h.acked = r->log.acked;
+	if (pwrite(r->logfd, &h, sizeof(h), 0) != sizeof(h)) goto failure;
+
+	if (fdatasync(r->logfd) == -1) goto failure;
+
+	r->dirty = INT_MAX;
+	return true;
+failure:
+	shout("failed to write the raft log: %s\n", strerror(errno));
+	return false;
+}
+
+// Open the file to persist the log to, and load the log from it if it
+// exists. Return 'true' on success, 'false' otherwise.
+bool raft_open_log(raft_t *r, char *path) {
+	raft_log_header_t h;
+	int index;
+
+	r->logfd = open(path, O_RDWR | O_CREAT, 0660);
+	if (r->logfd == -1) {
+		shout("cannot open raft log '%s': %s\n", path, strerror(errno));
+		return false;
+	}
+
+	if (
+		(pread(r->logfd, &h, sizeof(h), 0) != sizeof(h)) ||
+		(h.magic != RAFT_LOG_MAGIC) ||
+		(h.size < 0) || (h.size > RAFT_LOGLEN) ||
+		(h.acked > h.first + h.size)
+	) {
+		debug("no valid raft log at '%s', starting a new one\n", path);
+		raft_log_dirty(r, 0);
+		return raft_sync_log(r);
+	}
+
+	for (index = h.first; index < h.first + h.size; index++) {
+		if (pread(
+			r->logfd, &RAFT_LOG(r, index), sizeof(raft_entry_t),
+			raft_log_offset(index)
+		) != sizeof(raft_entry_t)) {
+			shout("failed to read the raft log: %s\n", strerror(errno));
+			return false;
+		}
+	}
+
+	r->term = h.term;
+	r->vote = h.vote;
+	r->log.first = h.first;
+	r->log.size = h.size;
+	r->log.acked = h.acked;
+	// the state machine is persistent, reapplying the entries is harmless
+	r->log.applied = h.first;
+	if ((h.size > 0) && RAFT_LOG(r, h.first).snapshot) {
+		r->log.applied++;
+	}
+	debug(
+		"loaded raft log: term = %d, first = %d, size = %d, acked = %d\n",
+		r->term, r->log.first, r->log.size, r->log.acked
+	);
+	return true;
 }
 
 int raft_apply(raft_t *r, raft_applier_t applier) {
@@ -155,13 +293,21 @@ int raft_create_udp_socket(raft_t *r) {
 static bool msg_size_is(raft_msg_t *m, int mlen) {
 	switch (m->msgtype) {
 		case RAFT_MSG_UPDATE:
-			return mlen == sizeof(raft_msg_update_t);
+			if (mlen < RAFT_MSG_UPDATE_SIZE(0)) return false;
+			if (((raft_msg_update_t*)m)->nentries < 0) return false;
+			if (((raft_msg_update_t*)m)->nentries > RAFT_MAX_BATCH) return false;
+			return mlen == RAFT_MSG_UPDATE_SIZE(((raft_msg_update_t*)m)->nentries);
 		case RAFT_MSG_DONE:
 			return mlen == sizeof(raft_msg_done_t);
 		case RAFT_MSG_CLAIM:
 			return mlen == sizeof(raft_msg_claim_t);
 		case RAFT_MSG_VOTE:
 			return mlen == sizeof(raft_msg_vote_t);
+		case RAFT_MSG_SNAPSHOT:
+			if (mlen < RAFT_MSG_SNAPSHOT_SIZE(0)) return false;
+			if (((raft_msg_snapshot_t*)m)->count < 0) return false;
+			if (((raft_msg_snapshot_t*)m)->count > RAFT_SNAPSHOT_CHUNK) return false;
+			return mlen == RAFT_MSG_SNAPSHOT_SIZE(((raft_msg_snapshot_t*)m)->count);
 	}
 	return false;
 }
@@ -169,7 +315,7 @@ static bool msg_size_is(raft_msg_t *m, int mlen) {
 static void raft_send(raft_t *r, int dst, void *m, int mlen) {
 	assert(msg_size_is((raft_msg_t*)m, mlen));
 	assert(((raft_msg_t*)m)->msgtype >= 0);
-	assert(((raft_msg_t*)m)->msgtype < 4);
+	assert(((raft_msg_t*)m)->msgtype <= RAFT_MSG_SNAPSHOT);
 	assert(dst >= 0);
 	assert(dst < r->servernum);
 	assert(dst != r->me);
@@ -189,21 +335,12 @@ static void raft_send(raft_t *r, int dst, void *m, int mlen) {
 	}
 }
 
-static void raft_beat(raft_t *r, int dst) {
-	if (dst == NOBODY) {
-		// send a beat/update to everybody
-		int i;
-		for (i = 0; i < r->servernum; i++) {
-			if (i == r->me) continue;
-			raft_beat(r, i);
-		}
-		return;
-	}
-
-	assert(r->role == ROLE_LEADER);
-	assert(r->leader == r->me);
-
+// Send one update to 'dst' with up to RAFT_MAX_BATCH entries starting at
+// 'tosend', or a heartbeat if there is nothing to send. Does not wait for
+// the acknowledgement, so several updates can be in flight.
+static void raft_send_update(raft_t *r, int dst) {
 	raft_server_t *s = r->servers + dst;
+	int end = r->log.first + r->log.size;
 
 	raft_msg_update_t m;
 
@@ -211,14 +348,8 @@ static void raft_beat(raft_t *r, int dst) {
 	m.msg.term = r->term;
 	m.msg.from = r->me;
 
-	if (s->tosend < r->log.first + r->log.size) {
-		raft_entry_t *e = &RAFT_LOG(r, s->tosend);
-		if (e->snapshot) {
-			// TODO: implement snapshot sending
-			shout("tosend = %d, first = %d, size = %d\n", s->tosend, r->log.first, r->log.size);
-			assert(false); // snapshot sending not implemented
-		}
-
+	m.nentries = 0;
+	if (s->tosend < end) {
 		// the follower is a bit behind: send an update
 		m.previndex = s->tosend - 1;
 		if (m.previndex >= 0) {
@@ -226,21 +357,126 @@ static void raft_beat(raft_t *r, int dst) {
 		} else {
 			m.prevterm = -1;
 		}
-		m.entry = *e;
-		m.empty = false;
-	} else {
-		// the follower is up to date: send a heartbeat
-		m.empty = true;
+		while ((s->tosend < end) && (m.nentries < RAFT_MAX_BATCH)) {
+			m.entries[m.nentries++] = RAFT_LOG(r, s->tosend);
+			s->tosend++;
+		}
 	}
 	m.acked = r->log.acked;
 
 	s->seqno++;
 	m.msg.seqno = s->seqno;
-	if (!m.empty) {
-		debug("[to %d] update with seqno = %d, tosend = %d, previndex = %d\n", dst, m.msg.seqno, s->tosend, m.previndex);
+	if (m.nentries) {
+		debug("[to %d] update with seqno = %d, previndex = %d, nentries = %d\n", dst, m.msg.seqno, m.previndex, m.nentries);
+	}
+
+	raft_send(r, dst, &m, RAFT_MSG_UPDATE_SIZE(m.nentries));
+}
+
+// Does the follower need the snapshot instead of the entries?
+static bool raft_needs_snapshot(raft_t *r, raft_server_t *s) {
+	if (s->snapindex >= 0) return true; // finish the one being sent first
+	if (s->tosend > r->log.first) return false;
+	if (r->log.size == 0) return false;
+	return RAFT_LOG(r, r->log.first).snapshot;
+}
+
+static void raft_unpin_snapshot(raft_server_t *s) {
+	free(s->snapdata);
+	s->snapdata = NULL;
+	s->snapindex = -1;
+	s->snapoffset = 0;
+}
+
+// Pin the snapshot entry at 'first' and the state it covers for sending to
+// 's'. The log may get compacted and new entries applied while the chunks are
+// on their way, so they are all taken from this copy until the follower
+// reports the snapshot installed.
+static bool raft_pin_snapshot(raft_t *r, raft_server_t *s) {
+	raft_entry_t *e = &RAFT_LOG(r, r->log.first);
+	int total = e->maxarg - e->minarg + 1;
+	int *data;
+	int i;
+
+	data = malloc(total * sizeof(int));
+	if (!data) {
+		shout("cannot pin the snapshot of %d values\n", total);
+		return false;
+	}
+	for (i = 0; i < total; i++) {
+		data[i] = r->reader(e->minarg + i);
+	}
+
+	raft_unpin_snapshot(s);
+	s->snapindex = r->log.first;
+	s->snapentry = *e;
+	s->snapdata = data;
+	return true;
+}
+
+// Send the next chunk of the snapshot to 'dst'. The chunks are sent one at a
+// time, the next one is sent when the previous one is acknowledged.
+static void raft_send_snapshot(raft_t *r, int dst) {
+	raft_server_t *s = r->servers + dst;
+	int total;
+
+	if (s->snapindex < 0) {
+		if (!r->reader) {
+			shout("[to %d] cannot send the snapshot, no reader\n", dst);
+			return;
+		}
+		if (!raft_pin_snapshot(r, s)) {
+			return;
+		}
+	}
+	total = s->snapentry.maxarg - s->snapentry.minarg + 1;
+
+	raft_msg_snapshot_t m;
+
+	m.msg.msgtype = RAFT_MSG_SNAPSHOT;
+	m.msg.term = r->term;
+	m.msg.from = r->me;
+
+	m.index = s->snapindex;
+	m.entry = s->snapentry;
+	m.offset = s->snapoffset;
+	m.count = min(RAFT_SNAPSHOT_CHUNK, total - m.offset);
+	memcpy(m.actions, s->snapdata + m.offset, m.count * sizeof(int));
+
+	s->seqno++;
+	m.msg.seqno = s->seqno;
+	debug("[to %d] snapshot %d with offset = %d, count = %d of %d\n", dst, m.index, m.offset, m.count, total);
+
+	raft_send(r, dst, &m, RAFT_MSG_SNAPSHOT_SIZE(m.count));
+}
+
+static void raft_beat(raft_t *r, int dst) {
+	if (dst == NOBODY) {
+		// send a beat/update to everybody
+		int i;
+		for (i = 0; i < r->servernum; i++) {
+			if (i == r->me) continue;
+			raft_beat(r, i);
+		}
+		return;
 	}
 
-	raft_send(r, dst, &m, sizeof(m));
+	assert(r->role == ROLE_LEADER);
+	assert(r->leader == r->me);
+
+	raft_server_t *s = r->servers + dst;
+	int end = r->log.first + r->log.size;
+
+	if (raft_needs_snapshot(r, s)) {
+		raft_send_snapshot(r, dst);
+		return;
+	}
+
+	// keep sending until the follower is up to date or we have too many
+	// unacknowledged entries in flight
+	do {
+		raft_send_update(r, dst);
+	} while ((s->tosend < end) && (s->tosend - s->acked < RAFT_MAX_INFLIGHT));
 }
 
 static void raft_claim(raft_t *r) {
@@ -285,6 +521,9 @@ void raft_tick(raft_t *r, int msec) {
 				r->leader = NOBODY;
 				r->role = ROLE_CANDIDATE;
 				r->term++;
+				raft_log_dirty(r, r->log.first + r->log.size);
+				// do not claim a term we may forget, try again later
+				if (!raft_sync_log(r)) break;
 				raft_claim(r);
 				break;
 			case ROLE_CANDIDATE:
@@ -293,14 +532,38 @@ void raft_tick(raft_t *r, int msec) {
 					" claiming leadership\n"
 				);
 				r->term++;
+				raft_log_dirty(r, r->log.first + r->log.size);
+				// do not claim a term we may forget, try again later
+				if (!raft_sync_log(r)) break;
 				raft_claim(r);
 				break;
-			case ROLE_LEADER:
+			case ROLE_LEADER: {
+				int i;
+				for (i = 0; i < r->servernum; i++) {
+					raft_server_t *s = r->servers + i;
+					if (i == r->me) continue;
+					if ((s->tosend > s->acked) && (s->acked == s->ackmark)) {
+						// no acks for a whole heartbeat period,
+						// the updates must have been lost
+						debug("[to %d] resending from %d\n", i, s->acked);
+						s->tosend = s->acked;
+					}
+					s->ackmark = s->acked;
+				}
+				// do not send entries we may lose
+				if (!raft_sync_log(r)) break;
 				raft_beat(r, NOBODY);
+				r->unsent = 0;
+				r->batch_timer = -1;
 				break;
+			}
 		}
 		raft_reset_timer(r);
 	}
+
+	if (r->batch_timer > 0) {
+		r->batch_timer = max(0, r->batch_timer - msec);
+	}
 }
 
 static int raft_log_compact(raft_log_t *l, int keep_applied) {
@@ -355,12 +618,39 @@ bool raft_emit(raft_t *r, int action, int argument) {
 	e->action = action;
 	e->argument = argument;
 	r->log.size++;
+	raft_log_dirty(r, r->log.first + r->log.size - 1);
 
-	raft_beat(r, NOBODY);
-	raft_reset_timer(r);
+	// group the entries emitted within 'batch_delay' into one update, it
+	// is sent by raft_flush()
+	if (r->unsent++ == 0) {
+		r->batch_timer = r->batch_delay;
+	}
+	if (r->unsent >= RAFT_MAX_BATCH) {
+		r->batch_timer = 0;
+	}
 	return true;
 }
 
+// Send the emitted entries to the followers if the batch delay has passed or
+// the batch is full. Call this after each round of raft_emit() calls.
+void raft_flush(raft_t *r) {
+	if (r->role != ROLE_LEADER) {
+		r->unsent = 0;
+		r->batch_timer = -1;
+		return;
+	}
+	if ((r->unsent == 0) || (r->batch_timer > 0)) {
+		return;
+	}
+
+	// the leader counts itself as having the entries, so they must be on
+	// disk before they are sent, otherwise leave them for the next flush
+	if (!raft_sync_log(r)) return;
+	raft_beat(r, NOBODY);
+	r->unsent = 0;
+	r->batch_timer = -1;
+}
+
 static bool log_append(raft_log_t *l, int previndex, int prevterm, raft_entry_t *e) {
 	if (e->snapshot) {
 		assert(false);
@@ -439,6 +729,7 @@ static void raft_handle_update(raft_t *r, raft_msg_update_t *m) {
 		reply.term = -1;
 	}
 	reply.success = false;
+	reply.installed = -1;
 
 	// the message is too old
 	if (m->msg.term < r->term) {
@@ -462,20 +753,106 @@ static void raft_handle_update(raft_t *r, raft_msg_update_t *m) {
 		s->acked = s->tosend = r->log.acked;
 	}
 
-	if (m->empty) {
+	if (m->nentries == 0) {
 		// just a hearbeat
 		return;
 	}
 
-	if (!log_append(&r->log, m->previndex, m->prevterm, &m->entry)) {
-		debug("log_append failed\n");
+	int i;
+	for (i = 0; i < m->nentries; i++) {
+		int prevterm = (i > 0) ? m->entries[i - 1].term : m->prevterm;
+		raft_log_dirty(r, m->previndex + i + 1);
+		if (!log_append(&r->log, m->previndex + i, prevterm, m->entries + i)) {
+			debug("log_append failed\n");
+			reply.index = r->log.first + r->log.size - 1;
+			if (reply.index >= 0) {
+				reply.term = RAFT_LOG(r, reply.index).term;
+			}
+			goto finish;
+		}
+	}
+	reply.index = m->previndex + m->nentries;
+	reply.term = m->entries[m->nentries - 1].term;
+
+	reply.success = true;
+finish:
+	// the leader may only count on what we have on disk, it resends the
+	// entries if we do not reply
+	if (!raft_sync_log(r)) return;
+	raft_send(r, sender, &reply, sizeof(reply));
+}
+
+static void raft_handle_snapshot(raft_t *r, raft_msg_snapshot_t *m) {
+	int sender = m->msg.from;
+	int total = m->entry.maxarg - m->entry.minarg + 1;
+	int i;
+
+	raft_msg_done_t reply;
+	reply.msg.msgtype = RAFT_MSG_DONE;
+	reply.msg.term = r->term;
+	reply.msg.from = r->me;
+	reply.msg.seqno = m->msg.seqno;
+
+	reply.index = m->index;
+	reply.term = m->entry.term;
+	reply.success = false;
+	reply.installed = m->offset;
+
+	// the message is too old
+	if (m->msg.term < r->term) {
+		debug("refuse old snapshot %d < %d\n", m->msg.term, r->term);
+		reply.installed = -1;
 		goto finish;
 	}
-	reply.index = r->log.first + r->log.size - 1;
-	reply.term = RAFT_LOG(r, reply.index).term;
+
+	if (sender != r->leader) {
+		shout("changing leader to %d\n", sender);
+		r->leader = sender;
+	}
+
+	raft_reset_timer(r);
+
+	if (!r->applier) {
+		shout("cannot install the snapshot, no applier\n");
+		goto finish;
+	}
+
+	// the state machine is updated right away, applying the values again
+	// if the chunk is resent is harmless
+	for (i = 0; i < m->count; i++) {
+		if (m->actions[i]) {
+			r->applier(m->actions[i], m->entry.minarg + m->offset + i);
+		}
+	}
+	reply.installed = m->offset + m->count;
+
+	if (reply.installed < total) {
+		goto finish;
+	}
+
+	debug("installing snapshot %d\n", m->index);
+	if (
+		(m->index < r->log.first) ||
+		(m->index >= r->log.first + r->log.size) ||
+		(RAFT_LOG(r, m->index).term != m->entry.term)
+	) {
+		// our log has nothing useful, the snapshot replaces all of it
+		r->log.size = 1;
+	} else {
+		// keep the entries following the snapshot
+		r->log.size -= m->index - r->log.first;
+	}
+	r->log.first = m->index;
+	RAFT_LOG(r, m->index) = m->entry;
+	r->log.acked = max(r->log.acked, m->index + 1);
+	r->log.applied = max(r->log.applied, m->index + 1);
+	raft_log_dirty(r, m->index);
 
 	reply.success = true;
 finish:
+	// do not report an installed snapshot we may lose, the leader resends
+	// the chunk if we do not reply
+	if (!raft_sync_log(r)) return;
 	raft_send(r, sender, &reply, sizeof(reply));
 }
 
@@ -519,41 +896,58 @@ static void raft_handle_done(raft_t *r, raft_msg_done_t *m) {
 		return;
 	}
 
+	// Several updates can be in flight, so the replies are not matched
+	// against the seqno, the reported index tells what the follower has.
 	raft_server_t *server = r->servers + sender;
-	if (m->msg.seqno != server->seqno) {
-		debug("[from %d] ============= mseqno(%d) != sseqno(%d)\n", sender, m->msg.seqno, server->seqno);
-		return;
-	}
-	server->seqno++;
 	if (m->msg.term < r->term) {
 		debug("[from %d] ============= msgterm(%d) != term(%d)\n", sender, m->term, r->term);
 		return;
 	}
 
-	if (m->success) {
-		debug("[from %d] ============= done\n", sender);
-		server->tosend++;
-		server->acked = server->tosend;
+	if (m->installed >= 0) {
+		// a reply to a snapshot chunk
+		if (m->index != server->snapindex) {
+			debug("[from %d] ============= stale snapshot reply\n", sender);
+			return;
+		}
+		server->snapoffset = max(server->snapoffset, m->installed);
+		if (!m->success) {
+			// send the next chunk
+			raft_beat(r, sender);
+			return;
+		}
+		debug("[from %d] ============= snapshot %d installed\n", sender, m->index);
+		raft_unpin_snapshot(server);
+		server->tosend = server->acked = m->index + 1;
 		raft_refresh_acked(r);
+	} else if (m->success) {
+		debug("[from %d] ============= done %d\n", sender, m->index);
+		if (m->index + 1 > server->acked) {
+			server->acked = m->index + 1;
+			raft_refresh_acked(r);
+		}
+		if (server->tosend < server->acked) {
+			server->tosend = server->acked;
+		}
 	} else {
 		debug("[from %d] ============= refused\n", sender);
 		if (server->tosend > 0) {
-			// the client should have specified the last index it had gotten
-			if (server->tosend == m->index + 1) {
-				shout(
-					"[from %d] the last index I have is %d, but"
-					" I still refuse, this should not happen\n",
-					sender, m->index
-				);
-				assert(false);
+			// the follower specifies the last index it has
+			if (m->index + 1 < server->tosend) {
+				server->tosend = m->index + 1;
+			} else {
+				// its last entries conflict with ours, step back
+				server->tosend--;
+			}
+			if (server->acked > server->tosend) {
+				// the follower has restarted and lost some entries
+				server->acked = server->tosend;
 			}
-			server->tosend = m->index + 1;
 		}
-		assert(server->tosend >= server->acked); // FIXME: remove this, because 'tosend' is actually allowed to be less than 'acked' if the follower has restarted
 	}
 
 	if (server->tosend < r->log.first + r->log.size) {
-		// send the next entry
+		// send the next entries
 		raft_beat(r, sender);
 	}
 }
@@ -563,12 +957,14 @@ static void raft_set_term(raft_t *r, int term) {
 	r->term = term;
 	r->vote = NOBODY;
 	r->votes = 0;
+	raft_log_dirty(r, r->log.first + r->log.size);
 }
 
 void raft_ensure_term(raft_t *r, int term) {
 	assert(r->role == ROLE_LEADER);
 	if (term > r->term) {
 		r->term = term;
+		raft_log_dirty(r, r->log.first + r->log.size);
 	}
 }
 
@@ -605,16 +1001,21 @@ static void raft_handle_claim(raft_t *r, raft_msg_claim_t *m) {
 
 	if ((r->vote == NOBODY) || (r->vote == candidate)) {
 		r->vote = candidate;
+		raft_log_dirty(r, r->log.first + r->log.size);
 		raft_reset_timer(r);
 		reply.granted = true;
 	}
 finish:
+	// do not forget the vote after a restart, and do not grant one we may
+	// forget
+	if (!raft_sync_log(r)) return;
 	raft_send(r, candidate, &reply, sizeof(reply));
 }
 
 static void raft_handle_vote(raft_t *r, raft_msg_vote_t *m) {
 	int sender = m->msg.from;
 	raft_server_t *server = r->servers + sender;
+	int i;
 	if (m->msg.seqno != server->seqno) return;
 	server->seqno++;
 	if (m->msg.term < r->term) return;
@@ -629,6 +1030,12 @@ static void raft_handle_vote(raft_t *r, raft_msg_vote_t *m) {
 		// got the support of a majority
 		r->role = ROLE_LEADER;
 		r->leader = r->me;
+
+		// a snapshot pinned in an earlier term may be older than what the
+		// followers have got since, start over with the current one
+		for (i = 0; i < r->servernum; i++) {
+			raft_unpin_snapshot(r->servers + i);
+		}
 		raft_reset_timer(r);
 	}
 }
@@ -643,7 +1050,7 @@ void raft_handle_message(raft_t *r, raft_msg_t *m) {
 	}
 
 	assert(m->msgtype >= 0);
-	assert(m->msgtype < 4);
+	assert(m->msgtype <= RAFT_MSG_SNAPSHOT);
 	switch (m->msgtype) {
 		case RAFT_MSG_UPDATE:
 			raft_handle_update(r, (raft_msg_update_t *)m);
@@ -657,12 +1064,18 @@ void raft_handle_message(raft_t *r, raft_msg_t *m) {
 		case RAFT_MSG_VOTE:
 			raft_handle_vote(r, (raft_msg_vote_t *)m);
 			break;
+		case RAFT_MSG_SNAPSHOT:
+			raft_handle_snapshot(r, (raft_msg_snapshot_t *)m);
+			break;
 		default:
 			shout("unknown message type\n");
 	}
 }
 
-static char buf[1024];
+static char buf[
+	sizeof(raft_msg_update_t) > sizeof(raft_msg_snapshot_t) ?
+	sizeof(raft_msg_update_t) : sizeof(raft_msg_snapshot_t)
+];
 
 raft_msg_t *raft_recv_message(raft_t *r) {
 	struct sockaddr_in addr;
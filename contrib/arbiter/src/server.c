@@ -65,6 +65,7 @@ typedef struct server_data_t {
 	onmessage_callback_t onmessage;
 	onconnect_callback_t onconnect;
 	ondisconnect_callback_t ondisconnect;
+	onflush_callback_t onflush;
 
 	bool enabled;
 
@@ -123,6 +124,7 @@ server_t server_init(
 	server->onmessage = onmessage;
 	server->onconnect = onconnect;
 	server->ondisconnect = ondisconnect;
+	server->onflush = NULL;
 
 #ifdef USE_EPOLL
     server->epollfd = epoll_create(MAX_EVENTS);
@@ -178,6 +180,10 @@ static bool server_remove_socket(server_t server, int sock) {
 	return true;
 }
 
+void server_set_onflush(server_t server, onflush_callback_t onflush) {
+	server->onflush = onflush;
+}
+
 void server_set_raft_socket(server_t server, int sock) {
 	server->raft_stream.fd = sock;
 	bool good = server_add_socket(server, sock, &server->raft_stream);
@@ -233,6 +239,9 @@ static bool stream_flush(stream_t stream) {
 
 static void server_flush(server_t server) {
 	stream_t s;
+	if (server->onflush) {
+		server->onflush();
+	}
 	debug("flushing the streams\n");
 	for (s = server->used_chain; s != NULL; s = s->next) { 
 		stream_flush(s);
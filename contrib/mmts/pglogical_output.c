@@ -99,7 +99,14 @@ void MtmOutputPluginPrepareWrite(LogicalDecodingContext *ctx, bool last_write, b
 }
 
 
-/* specify output plugin callbacks */
+/*
+ * specify output plugin callbacks
+ *
+ * There are deliberately no stream callbacks: the receiver hands every
+ * transaction as a whole to a pool worker (spilling it in spill.c while it is
+ * being received), and has no way to apply several in-progress transactions
+ * interleaved. Large transactions are spilled by the reorder buffer instead.
+ */
 void
 _PG_output_plugin_init(OutputPluginCallbacks *cb)
 {
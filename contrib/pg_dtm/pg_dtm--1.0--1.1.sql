@@ -0,0 +1,8 @@
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION pg_dtm UPDATE TO '1.1'" to load this file. \quit
+
+CREATE FUNCTION dtm_get_sockhub_stats(OUT requests bigint, OUT responses bigint,
+	OUT batches bigint, OUT bytes_sent bigint, OUT queue_depth integer,
+	OUT max_queue_depth integer, OUT rtt_usec integer, OUT batch_delay_usec integer)
+AS 'MODULE_PATHNAME','dtm_get_sockhub_stats'
+LANGUAGE C;
@@ -20,3 +20,9 @@ LANGUAGE C;
 CREATE FUNCTION dtm_get_current_snapshot_xcnt() RETURNS integer
 AS 'MODULE_PATHNAME','dtm_get_current_snapshot_xcnt'
 LANGUAGE C;
+
+CREATE FUNCTION dtm_get_sockhub_stats(OUT requests bigint, OUT responses bigint,
+	OUT batches bigint, OUT bytes_sent bigint, OUT queue_depth integer,
+	OUT max_queue_depth integer, OUT rtt_usec integer, OUT batch_delay_usec integer)
+AS 'MODULE_PATHNAME','dtm_get_sockhub_stats'
+LANGUAGE C;
@@ -11,6 +11,7 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "funcapi.h"
 #include "miscadmin.h"
 #include "postmaster/postmaster.h"
 #include "postmaster/bgworker.h"
@@ -29,6 +30,7 @@
 #include "storage/proc.h"
 #include "storage/procarray.h"
 #include "access/twophase.h"
+#include "access/htup_details.h"
 #include <utils/guc.h>
 #include "utils/hsearch.h"
 #include "utils/tqual.h"
@@ -41,17 +43,48 @@
 #include "storage/pmsignal.h"
 #include "storage/proc.h"
 #include "utils/syscache.h"
+#include "utils/timestamp.h"
 
 #include "sockhub.h"
 #include "arbiter.h"
 
+#define DTM_MAX_SNAPSHOT_REQUESTS ARBITER_MAX_SNAPSHOT_BATCH
+
+typedef enum
+{
+	DTM_REQUEST_FREE,     /* slot is not used */
+	DTM_REQUEST_PENDING,  /* waiting to be sent to arbiter */
+	DTM_REQUEST_SENT,     /* sent to arbiter by some backend */
+	DTM_REQUEST_DONE,     /* snapshot is received */
+	DTM_REQUEST_FAILED    /* failed to get snapshot from arbiter */
+} DtmRequestState;
+
+/* Request for global snapshot, combined with requests of other backends */
+typedef struct
+{
+	DtmRequestState state;
+	TransactionId xid;
+	int snapno;
+	TransactionId gxmin;
+	TransactionId xmin;
+	TransactionId xmax;
+	int xcnt;
+	TransactionId xip[ARBITER_MAX_XCNT];
+} DtmSnapshotRequest;
+
 typedef struct
 {
 	LWLockId hashLock;
 	LWLockId xidLock;
+	LWLockId snapshotLock; /* held by backend sending combined snapshot requests to arbiter */
 	TransactionId minXid;  /* XID of oldest transaction visible by any active transaction (local or global) */
 	TransactionId nextXid; /* next XID for local transaction */
 	size_t nReservedXids;  /* number of XIDs reserved for local transactions */
+	int xidReserve;        /* number of XIDs to reserve at next request to arbiter */
+	TimestampTz lastReserveTime; /* time of last reservation of XIDs */
+	slock_t requestLock;   /* protects state of snapshot requests */
+	DtmSnapshotRequest requests[DTM_MAX_SNAPSHOT_REQUESTS];
+	ShubStatistics sockhubStats; /* maintained by sockhub background worker */
 } DtmState;
 
 typedef struct
@@ -65,6 +98,11 @@ typedef struct
 #define DTM_SHMEM_SIZE (1024*1024)
 #define DTM_HASH_SIZE  1003
 
+/* reservations of local XIDs done more often than this interval double reservation size */
+#define DTM_RESERVE_MIN_INTERVAL_MSEC 100
+/* reservations of local XIDs done less often than this interval halve reservation size */
+#define DTM_RESERVE_MAX_INTERVAL_MSEC 1000
+
 void _PG_init(void);
 void _PG_fini(void);
 
@@ -77,6 +115,9 @@ static void DtmInitialize(void);
 static void DtmSubXactCallback(SubXactEvent event, SubTransactionId mySubid, SubTransactionId parentSubid, void *arg);
 static void DtmXactCallback(XactEvent event, void *arg);
 static TransactionId DtmGetNextXid(void);
+static void DtmAdjustXidReserve(void);
+static void DtmGetGlobalSnapshot(TransactionId xid, int snapno, Snapshot snapshot);
+static void DtmSendSnapshotRequests(void);
 static TransactionId DtmGetNewTransactionId(bool isSubXact);
 static TransactionId DtmGetOldestXmin(Relation rel, bool ignoreVacuum);
 static TransactionId DtmGetGlobalTransactionId(void);
@@ -107,6 +148,8 @@ static SnapshotData DtmSnapshot = { HeapTupleSatisfiesMVCC };
 static bool DtmHasGlobalSnapshot;
 static bool DtmGlobalXidAssigned;
 static int DtmLocalXidReserve;
+static int DtmMaxLocalXidReserve;
+static int DtmSnapshotNo; /* number of global snapshots received by this backend for current transaction */
 static CommandId DtmCurcid;
 static Snapshot DtmLastSnapshot;
 static TransactionManager DtmTM = {
@@ -363,7 +406,8 @@ static TransactionId DtmGetNextXid()
 	{
 		if (dtm->nReservedXids == 0)
 		{
-			dtm->nReservedXids = ArbiterReserve(ShmemVariableCache->nextXid, DtmLocalXidReserve, &dtm->nextXid);
+			DtmAdjustXidReserve();
+			dtm->nReservedXids = ArbiterReserve(ShmemVariableCache->nextXid, dtm->xidReserve, &dtm->nextXid);
 			if (dtm->nReservedXids < 1)
 			{
 				elog(WARNING, "failed to reserve a local range of xids on arbiter");
@@ -392,6 +436,190 @@ end:
 	return xid;
 }
 
+/*
+ * Choose number of XIDs to reserve for local transactions.
+ * Reservation size grows when reserved XIDs are consumed quickly, saving round trips to arbiter
+ * under high load of local transactions, and shrinks back when load decreases, to avoid
+ * wasting global XIDs. Caller should hold dtm->xidLock.
+ */
+static void DtmAdjustXidReserve()
+{
+	TimestampTz now = GetCurrentTimestamp();
+
+	if (dtm->xidReserve == 0)
+	{
+		dtm->xidReserve = DtmLocalXidReserve;
+	}
+	else if (TimestampDifferenceExceeds(dtm->lastReserveTime, now, DTM_RESERVE_MAX_INTERVAL_MSEC))
+	{
+		dtm->xidReserve = Max(dtm->xidReserve / 2, DtmLocalXidReserve);
+	}
+	else if (!TimestampDifferenceExceeds(dtm->lastReserveTime, now, DTM_RESERVE_MIN_INTERVAL_MSEC))
+	{
+		dtm->xidReserve = Min(dtm->xidReserve * 2, Max(DtmMaxLocalXidReserve, DtmLocalXidReserve));
+	}
+	dtm->lastReserveTime = now;
+	XTM_INFO("Reserve %d local XIDs\n", dtm->xidReserve);
+}
+
+/*
+ * Get global snapshot from arbiter.
+ * Concurrent requests of different backends are combined: backend puts its request in shared memory
+ * and either becomes a leader sending all pending requests to arbiter with one round trip,
+ * either waits until some other leader does it.
+ */
+static void DtmGetGlobalSnapshot(TransactionId xid, int snapno, Snapshot snapshot)
+{
+	volatile DtmState* vdtm = dtm;
+	volatile DtmSnapshotRequest* req = NULL;
+	DtmRequestState state;
+	int i;
+
+	SpinLockAcquire(&vdtm->requestLock);
+	for (i = 0; i < DTM_MAX_SNAPSHOT_REQUESTS; i++)
+	{
+		if (vdtm->requests[i].state == DTM_REQUEST_FREE)
+		{
+			req = &vdtm->requests[i];
+			req->state = DTM_REQUEST_PENDING;
+			req->xid = xid;
+			req->snapno = snapno;
+			break;
+		}
+	}
+	SpinLockRelease(&vdtm->requestLock);
+
+	if (req == NULL)
+	{
+		/* Too many concurrent requests: ask arbiter directly */
+		if (!ArbiterGetSnapshots(1, &xid, &snapno, &snapshot, &dtm->minXid))
+			elog(ERROR, "Failed to get snapshot for transaction %u from arbiter", xid);
+		return;
+	}
+
+	PG_TRY();
+	{
+		while (true)
+		{
+			SpinLockAcquire(&vdtm->requestLock);
+			state = req->state;
+			SpinLockRelease(&vdtm->requestLock);
+
+			if (state != DTM_REQUEST_PENDING && state != DTM_REQUEST_SENT)
+				break;
+
+			/* If somebody else is sending requests, then wait until it completes and check state of our request once again */
+			if (LWLockAcquireOrWait(dtm->snapshotLock, LW_EXCLUSIVE))
+			{
+				DtmSendSnapshotRequests();
+				LWLockRelease(dtm->snapshotLock);
+			}
+		}
+	}
+	PG_CATCH();
+	{
+		/* Only leader can get error here and it has already marked sent requests as failed */
+		SpinLockAcquire(&vdtm->requestLock);
+		req->state = DTM_REQUEST_FREE;
+		SpinLockRelease(&vdtm->requestLock);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	if (state == DTM_REQUEST_DONE)
+	{
+		ArbiterInitSnapshot(snapshot);
+		snapshot->xmin = req->xmin;
+		snapshot->xmax = req->xmax;
+		snapshot->xcnt = req->xcnt;
+		memcpy(snapshot->xip, (TransactionId*)req->xip, req->xcnt*sizeof(TransactionId));
+		dtm->minXid = req->gxmin;
+	}
+
+	SpinLockAcquire(&vdtm->requestLock);
+	req->state = DTM_REQUEST_FREE;
+	SpinLockRelease(&vdtm->requestLock);
+
+	if (state != DTM_REQUEST_DONE)
+		elog(ERROR, "Failed to get snapshot for transaction %u from arbiter", xid);
+}
+
+/*
+ * Send all pending snapshot requests to arbiter in one message and deliver results.
+ * Caller should hold dtm->snapshotLock.
+ */
+static void DtmSendSnapshotRequests()
+{
+	volatile DtmState* vdtm = dtm;
+	TransactionId xids[DTM_MAX_SNAPSHOT_REQUESTS];
+	int snapnos[DTM_MAX_SNAPSHOT_REQUESTS];
+	int slots[DTM_MAX_SNAPSHOT_REQUESTS];
+	SnapshotData snapshots[DTM_MAX_SNAPSHOT_REQUESTS];
+	Snapshot snapshotPtrs[DTM_MAX_SNAPSHOT_REQUESTS];
+	TransactionId gxmin = InvalidTransactionId;
+	bool ok = false;
+	int i, n = 0;
+
+	SpinLockAcquire(&vdtm->requestLock);
+	for (i = 0; i < DTM_MAX_SNAPSHOT_REQUESTS; i++)
+	{
+		if (vdtm->requests[i].state == DTM_REQUEST_PENDING)
+		{
+			vdtm->requests[i].state = DTM_REQUEST_SENT;
+			xids[n] = vdtm->requests[i].xid;
+			snapnos[n] = vdtm->requests[i].snapno;
+			slots[n] = i;
+			n += 1;
+		}
+	}
+	SpinLockRelease(&vdtm->requestLock);
+
+	if (n == 0)
+		return;
+
+	/* Results are stored directly in the request slots: their owners do not access them until state is changed */
+	for (i = 0; i < n; i++)
+	{
+		snapshots[i].xip = (TransactionId*)vdtm->requests[slots[i]].xip;
+		snapshotPtrs[i] = &snapshots[i];
+	}
+
+	PG_TRY();
+	{
+		ok = ArbiterGetSnapshots(n, xids, snapnos, snapshotPtrs, &gxmin);
+	}
+	PG_CATCH();
+	{
+		SpinLockAcquire(&vdtm->requestLock);
+		for (i = 0; i < n; i++)
+			vdtm->requests[slots[i]].state = DTM_REQUEST_FAILED;
+		SpinLockRelease(&vdtm->requestLock);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	XTM_INFO("%d: combined %d snapshot requests\n", getpid(), n);
+
+	SpinLockAcquire(&vdtm->requestLock);
+	for (i = 0; i < n; i++)
+	{
+		volatile DtmSnapshotRequest* req = &vdtm->requests[slots[i]];
+		if (ok)
+		{
+			req->gxmin = gxmin;
+			req->xmin = snapshots[i].xmin;
+			req->xmax = snapshots[i].xmax;
+			req->xcnt = snapshots[i].xcnt;
+			req->state = DTM_REQUEST_DONE;
+		}
+		else
+		{
+			req->state = DTM_REQUEST_FAILED;
+		}
+	}
+	SpinLockRelease(&vdtm->requestLock);
+}
+
 TransactionId
 DtmGetGlobalTransactionId()
 {
@@ -625,7 +853,7 @@ static Snapshot DtmGetSnapshot(Snapshot snapshot)
 	if (TransactionIdIsValid(DtmNextXid) && snapshot != &CatalogSnapshotData)
 	{		
 		if (!DtmHasGlobalSnapshot && (snapshot != DtmLastSnapshot || DtmCurcid != GetCurrentCommandId(false))) {
-			ArbiterGetSnapshot(DtmNextXid, &DtmSnapshot, &dtm->minXid);
+			DtmGetGlobalSnapshot(DtmNextXid, DtmSnapshotNo++, &DtmSnapshot);
 		}
 		DtmLastSnapshot = snapshot;
 		DtmMergeWithGlobalSnapshot(snapshot);
@@ -734,7 +962,13 @@ static void DtmInitialize()
 	{
 		dtm->hashLock = LWLockAssign();
 		dtm->xidLock = LWLockAssign();
+		dtm->snapshotLock = LWLockAssign();
 		dtm->nReservedXids = 0;
+		dtm->xidReserve = 0;
+		dtm->lastReserveTime = 0;
+		SpinLockInit(&dtm->requestLock);
+		memset(dtm->requests, 0, sizeof(dtm->requests));
+		memset(&dtm->sockhubStats, 0, sizeof(dtm->sockhubStats));
 		dtm->minXid = InvalidTransactionId;
 		RegisterXactCallback(DtmXactCallback, NULL);
 		RegisterSubXactCallback(DtmSubXactCallback, NULL);
@@ -831,8 +1065,8 @@ _PG_init(void)
 	 * the postmaster process.)  We'll allocate or attach to the shared
 	 * resources in imcs_shmem_startup().
 	 */
-	RequestAddinShmemSpace(DTM_SHMEM_SIZE);
-	RequestAddinLWLocks(2);
+	RequestAddinShmemSpace(DTM_SHMEM_SIZE + MAXALIGN(sizeof(DtmState)));
+	RequestAddinLWLocks(3);
 
 	DefineCustomIntVariable(
 		"dtm.local_xid_reserve",
@@ -849,6 +1083,21 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomIntVariable(
+		"dtm.max_local_xid_reserve",
+		"Maximal number of XIDs reserved by node for local transactions: reservation grows up to this value under high load",
+		NULL,
+		&DtmMaxLocalXidReserve,
+		10000,
+		1,
+		INT_MAX,
+		PGC_SIGHUP,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomIntVariable(
 		"dtm.buffer_size",
 		"Size of sockhub buffer for connection to arbiters, if 0, then direct connection will be used",
@@ -921,6 +1170,7 @@ PG_FUNCTION_INFO_V1(dtm_join_transaction);
 PG_FUNCTION_INFO_V1(dtm_get_current_snapshot_xmax);
 PG_FUNCTION_INFO_V1(dtm_get_current_snapshot_xmin);
 PG_FUNCTION_INFO_V1(dtm_get_current_snapshot_xcnt);
+PG_FUNCTION_INFO_V1(dtm_get_sockhub_stats);
 
 Datum
 dtm_get_current_snapshot_xmin(PG_FUNCTION_ARGS)
@@ -940,6 +1190,33 @@ dtm_get_current_snapshot_xcnt(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(CurrentTransactionSnapshot->xcnt);
 }
 
+Datum
+dtm_get_sockhub_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc desc;
+	Datum values[8];
+	bool nulls[8] = {false};
+	volatile ShubStatistics* stats;
+
+	if (dtm == NULL)
+		elog(ERROR, "DTM is not properly initialized, please check that pg_dtm plugin was added to shared_preload_libraries list in postgresql.conf");
+	if (get_call_result_type(fcinfo, NULL, &desc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* The counters are updated by sockhub without locking, so the values are approximate */
+	stats = &dtm->sockhubStats;
+	values[0] = Int64GetDatum(stats->requests);
+	values[1] = Int64GetDatum(stats->responses);
+	values[2] = Int64GetDatum(stats->batches);
+	values[3] = Int64GetDatum(stats->bytes_sent);
+	values[4] = Int32GetDatum(stats->queue_depth);
+	values[5] = Int32GetDatum(stats->max_queue_depth);
+	values[6] = Int32GetDatum(stats->rtt);
+	values[7] = Int32GetDatum(stats->batch_delay);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(desc), values, nulls)));
+}
+
 Datum
 dtm_begin_transaction(PG_FUNCTION_ARGS)
 {
@@ -955,6 +1232,7 @@ dtm_begin_transaction(PG_FUNCTION_ARGS)
 	DtmHasGlobalSnapshot = true;
 	DtmGlobalXidAssigned = true;
 	DtmLastSnapshot = NULL;
+	DtmSnapshotNo = 0; /* snapshot received at begin is not counted by arbiter */
 
 	PG_RETURN_INT32(DtmNextXid);
 }
@@ -973,6 +1251,7 @@ Datum dtm_join_transaction(PG_FUNCTION_ARGS)
 	DtmHasGlobalSnapshot = true;
 	DtmGlobalXidAssigned = true;
 	DtmLastSnapshot = NULL;
+	DtmSnapshotNo = 1;
 
 	PG_RETURN_VOID();
 }
@@ -990,6 +1269,7 @@ void DtmBackgroundWorker(Datum arg)
 	ShubParamsSetHosts(&params, ArbitersCopy);
 	params.file = unix_sock_path;
 	params.buffer_size = DtmBufferSize;
+	params.stats = &dtm->sockhubStats;
 
 	ShubInitialize(&shub, &params);
 	ShubLoop(&shub);
@@ -1033,10 +1313,8 @@ static void DtmSerializeLock(PROCLOCK* proclock, void* arg)
         
         if (TransactionIdIsValid(srcPgXact->xid) && proc->waitLock == lock) { 
             LockMethod lockMethodTable = GetLocksMethodTable(lock);
-            int numLockModes = lockMethodTable->numLockModes;
             int conflictMask = lockMethodTable->conflictTab[proc->waitLockMode];
             SHM_QUEUE *procLocks = &(lock->procLocks);
-            int lm;
             
             ByteBufferAppendInt32(buf, srcPgXact->xid); /* waiting transaction */
             proclock = (PROCLOCK *) SHMQueueNext(procLocks, procLocks,
@@ -1047,14 +1325,10 @@ static void DtmSerializeLock(PROCLOCK* proclock, void* arg)
                     PGXACT* dstPgXact = &ProcGlobal->allPgXact[proclock->tag.myProc->pgprocno];
                     if (TransactionIdIsValid(dstPgXact->xid)) { 
                         Assert(srcPgXact->xid != dstPgXact->xid);
-                        for (lm = 1; lm <= numLockModes; lm++)
+                        if (proclock->holdMask & conflictMask)
                         {
-                            if ((proclock->holdMask & LOCKBIT_ON(lm)) && (conflictMask & LOCKBIT_ON(lm)))
-                            {
-                                XTM_INFO("%d: %u(%u) waits for %u(%u)\n", getpid(), srcPgXact->xid, proc->pid, dstPgXact->xid, proclock->tag.myProc->pid);
-                                ByteBufferAppendInt32(buf, dstPgXact->xid); /* transaction holding lock */
-                                break;
-                            }
+                            XTM_INFO("%d: %u(%u) waits for %u(%u)\n", getpid(), srcPgXact->xid, proc->pid, dstPgXact->xid, proclock->tag.myProc->pid);
+                            ByteBufferAppendInt32(buf, dstPgXact->xid); /* transaction holding lock */
                         }
                     }
                 }
@@ -1079,8 +1353,10 @@ bool DtmDetectGlobalDeadLock(PGPROC* proc)
         XTM_INFO("%d: wait graph end\n", getpid());
         hasDeadlock = ArbiterDetectDeadLock(PostPortNumber, pgxact->xid, buf.data, buf.used);
         ByteBufferFree(&buf);
-        XTM_INFO("%d: deadlock detected for %u\n", getpid(), pgxact->xid);
-        elog(WARNING, "Deadlock detected for transaction %u", pgxact->xid);
+        if (hasDeadlock) {
+            XTM_INFO("%d: deadlock detected for %u\n", getpid(), pgxact->xid);
+            elog(WARNING, "Deadlock detected for transaction %u", pgxact->xid);
+        }
     }
     return hasDeadlock;
 }
@@ -14,6 +14,7 @@
 
 #include "postgres.h"
 #include "c.h"
+#include "fmgr.h"
 
 #include "nodes/pg_list.h"
 #include "nodes/primnodes.h"
@@ -104,14 +105,28 @@ typedef struct ShardPlacement
 
 
 /*
- * ShardIntervalListCacheEntry contains the information for a cache entry in
- * shard interval list cache entry.
+ * DistributedTableCacheEntry holds the partitioning metadata and the shard
+ * intervals of a distributed table. The intervals are also kept in an array
+ * sorted by their min values; if no two intervals overlap, the shard holding
+ * a given partition value can be found with a binary search over that array.
+ * Entries are invalidated by relcache invalidations of the distributed table.
  */
-typedef struct ShardIntervalListCacheEntry
+typedef struct DistributedTableCacheEntry
 {
-	Oid distributedTableId; /* cache key */
+	Oid distributedTableId;      /* cache key */
+	bool isValid;                /* false once the entry must be reloaded */
+	MemoryContext entryContext;  /* holds all data referenced by the entry */
+
+	char partitionMethod;
+	Var *partitionColumn;
 	List *shardIntervalList;
-} ShardIntervalListCacheEntry;
+
+	int shardIntervalArrayLength;
+	ShardInterval **sortedShardIntervalArray;
+	bool hasDisjointShardIntervals; /* true if the sorted array is searchable */
+	FmgrInfo shardIntervalCompareFunction;
+	Oid shardIntervalCollation;
+} DistributedTableCacheEntry;
 
 
 /*
@@ -127,6 +142,8 @@ typedef enum
 } ShardLockType;
 
 /* function declarations to access and manipulate the metadata */
+extern DistributedTableCacheEntry * LookupDistributedTableCacheEntry(
+	Oid distributedTableId);
 extern List * LookupShardIntervalList(Oid distributedTableId);
 extern List * LoadShardIntervalList(Oid distributedTableId);
 extern ShardInterval * LoadShardInterval(int64 shardId);
@@ -20,6 +20,8 @@
 #include "nodes/pg_list.h"
 #include "nodes/plannodes.h"
 #include "lib/stringinfo.h"
+#include "utils/hsearch.h"
+#include "utils/palloc.h"
 #include "utils/tuplestore.h"
 
 
@@ -74,6 +76,18 @@ typedef struct DistributedPlan
 
 	bool selectFromMultipleShards; /* does the select run across multiple shards? */
 	CreateStmt *createTemporaryTableStmt; /* valid for multiple shard selects */
+	List *aggregateMergeList; /* merges partial aggregates returned by the shards */
+
+	/*
+	 * Plans for queries with unbound parameters are routed to a shard only when
+	 * executed: the task list is then built from the routing clause, in which
+	 * the parameters are bound, and from the shard query strings deparsed so
+	 * far. Such plans may be executed many times, so they are never modified.
+	 */
+	OpExpr *routingClause;     /* partition column equals parameter expression */
+	Query *parameterizedQuery; /* query to deparse for the selected shard */
+	HTAB *shardQueryCache;     /* query strings already deparsed, by shard id */
+	MemoryContext planContext; /* context holding the plan and its caches */
 } DistributedPlan;
 
 
@@ -97,6 +111,9 @@ extern void _PG_init(void);
 extern void _PG_fini(void);
 extern bool ExecuteTaskAndStoreResults(Task *task, TupleDesc tupleDescriptor,
 									   Tuplestorestate *tupleStore);
+extern PlannerType DeterminePlannerType(Query *query);
+extern bool IsParameterizedRouterQuery(Query *query);
+extern bool ExtractRangeTableEntryWalker(Node *node, List **rangeTableList);
 
 
 #endif /* PG_SHARD_H */
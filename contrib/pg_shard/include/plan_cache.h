@@ -0,0 +1,32 @@
+/*-------------------------------------------------------------------------
+ *
+ * include/plan_cache.h
+ *
+ * Declarations for public functions related to executing prepared statements
+ * on distributed tables.
+ *
+ * Copyright (c) 2014-2015, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PG_SHARD_PLAN_CACHE_H
+#define PG_SHARD_PLAN_CACHE_H
+
+#include "c.h"
+
+#include "nodes/params.h"
+#include "nodes/parsenodes.h"
+#include "tcop/dest.h"
+
+
+/* function declarations for executing prepared statements */
+extern bool ExecutePreparedDistributedStatement(ExecuteStmt *executeStatement,
+												const char *queryString,
+												ParamListInfo params,
+												DestReceiver *dest,
+												char *completionTag);
+extern void DropPreparedDistributedStatement(const char *statementName);
+
+
+#endif /* PG_SHARD_PLAN_CACHE_H */
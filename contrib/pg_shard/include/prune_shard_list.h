@@ -15,6 +15,8 @@
 
 #include "c.h"
 
+#include "distribution_metadata.h"
+
 #include "access/attnum.h"
 #include "nodes/pg_list.h"
 #include "nodes/primnodes.h"
@@ -41,6 +43,8 @@ typedef struct OperatorIdCacheEntry
 /* function declarations for shard pruning */
 extern List * PruneShardList(Oid relationId, List *whereClauseList,
 							 List *shardIntervalList);
+extern List * PruneCachedShardList(DistributedTableCacheEntry *cacheEntry,
+								   List *whereClauseList);
 extern OpExpr * MakeOpExpression(Var *variable, int16 strategyNumber);
 extern Oid GetOperatorByType(Oid typeId, Oid accessMethodId, int16 strategyNumber);
 
@@ -0,0 +1,76 @@
+/*-------------------------------------------------------------------------
+ *
+ * include/query_pushdown.h
+ *
+ * Declarations for public functions and types related to pushing aggregates
+ * and top-N clauses of multi-shard SELECT queries down to the shards.
+ *
+ * Copyright (c) 2014-2015, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PG_SHARD_QUERY_PUSHDOWN_H
+#define PG_SHARD_QUERY_PUSHDOWN_H
+
+#include "c.h"
+#include "fmgr.h"
+
+#include "executor/tuptable.h"
+#include "nodes/parsenodes.h"
+#include "nodes/pg_list.h"
+
+
+/* AggregateMergeType specifies how partial results of an aggregate combine */
+typedef enum AggregateMergeType
+{
+	AGGREGATE_MERGE_INVALID_FIRST = 0,
+	AGGREGATE_MERGE_COUNT = 1,
+	AGGREGATE_MERGE_SUM = 2,
+	AGGREGATE_MERGE_MIN = 3,
+	AGGREGATE_MERGE_MAX = 4,
+	AGGREGATE_MERGE_AVG = 5
+} AggregateMergeType;
+
+
+/*
+ * AggregateMerge describes how the coordinator computes one aggregate of the
+ * original query from the partial results the shards return. The average is
+ * computed from a sum and a count, which come in two columns.
+ */
+typedef struct AggregateMerge
+{
+	AggregateMergeType mergeType;
+	int columnIndex;      /* remote column holding the partial result */
+	int countColumnIndex; /* remote column holding the row count, for avg */
+	Oid partialTypeId;    /* type of the partial result */
+	Oid resultTypeId;     /* type of the final result */
+	Oid collationId;      /* collation used to compare values */
+	Oid mergeFunctionId;  /* adds partial results, or compares them */
+} AggregateMerge;
+
+
+/* AggregateMergeState holds the running result of an aggregate merge */
+typedef struct AggregateMergeState
+{
+	AggregateMerge *merge;
+	FmgrInfo mergeFunction;
+	bool partialTypeByValue;
+	int16 partialTypeLength;
+	Datum value;
+	bool isNull;
+	int64 count;
+} AggregateMergeState;
+
+
+/* function declarations for pushing query clauses down to shards */
+extern List * PartialAggregateTargetList(Query *query, List **aggregateMergeList);
+extern void PushDownTopN(Query *query, Query *remoteQuery);
+extern AggregateMergeState * BeginAggregateMerge(List *aggregateMergeList);
+extern void MergePartialAggregates(AggregateMergeState *mergeStateArray,
+								   int mergeStateCount, TupleTableSlot *slot);
+extern void FinalizeAggregates(AggregateMergeState *mergeStateArray, int mergeStateCount,
+							   Datum *values, bool *nulls);
+
+
+#endif /* PG_SHARD_QUERY_PUSHDOWN_H */
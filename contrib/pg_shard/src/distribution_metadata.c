@@ -36,19 +36,33 @@
 #include "utils/builtins.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/palloc.h"
+#include "utils/typcache.h"
 
 
 /*
- * ShardIntervalListCache is used for caching shard interval lists. It begins
- * initialized to empty list as there are no items in the cache.
+ * DistributedTableCache maps distributed table identifiers to their cached
+ * partitioning metadata and shard intervals. It is created on first use, at
+ * which point we also register the relcache callback that invalidates it.
  */
-static List *ShardIntervalListCache = NIL;
+static HTAB *DistributedTableCache = NULL;
+
+/* number of invalidations seen, used to detect those arriving during a load */
+static uint64 DistributedTableCacheInvalidationCount = 0;
 
 
 /* local function forward declarations */
+static void InitializeDistributedTableCache(void);
+static void InvalidateDistributedTableCacheCallback(Datum argument, Oid relationId);
+static void BuildSortedShardIntervalArray(DistributedTableCacheEntry *cacheEntry);
+static int CompareShardIntervalMinValues(const void *leftElement,
+										 const void *rightElement, void *context);
+static int CompareShardIntervalValues(DistributedTableCacheEntry *cacheEntry,
+									  Datum leftValue, Datum rightValue);
 static ShardInterval * TupleToShardInterval(HeapTuple heapTuple,
 											TupleDesc tupleDescriptor);
 static ShardPlacement * TupleToShardPlacement(HeapTuple heapTuple,
@@ -57,6 +71,90 @@ static void AcquireShardLock(int64 shardId, ShardLockType shardLockType,
 							 LOCKMODE lockMode);
 
 
+/*
+ * LookupDistributedTableCacheEntry returns the cache entry for the specified
+ * distributed table, loading the table's metadata if the entry is missing or
+ * has been invalidated. Tables without any shards are not cached, so that the
+ * next call loads their shards again; the function returns NULL for these.
+ */
+DistributedTableCacheEntry *
+LookupDistributedTableCacheEntry(Oid distributedTableId)
+{
+	DistributedTableCacheEntry *cacheEntry = NULL;
+	MemoryContext entryContext = NULL;
+	MemoryContext oldContext = NULL;
+	List *shardIntervalList = NIL;
+	Var *partitionColumn = NULL;
+	char partitionMethod = 0;
+	uint64 invalidationCount = 0;
+	bool foundEntry = false;
+
+	if (DistributedTableCache == NULL)
+	{
+		InitializeDistributedTableCache();
+	}
+
+	cacheEntry = hash_search(DistributedTableCache, &distributedTableId, HASH_FIND,
+							 NULL);
+	if (cacheEntry != NULL && cacheEntry->isValid)
+	{
+		return cacheEntry;
+	}
+
+	/* drop a stale entry; nobody may hold its data across a lookup */
+	if (cacheEntry != NULL)
+	{
+		MemoryContextDelete(cacheEntry->entryContext);
+		hash_search(DistributedTableCache, &distributedTableId, HASH_REMOVE, NULL);
+	}
+
+	/*
+	 * Load the metadata into a context that hangs off the current one, so an
+	 * error while loading frees it. We move it under CacheMemoryContext below.
+	 */
+	entryContext = AllocSetContextCreate(CurrentMemoryContext,
+										 "pg_shard distributed table cache entry",
+										 ALLOCSET_SMALL_MINSIZE,
+										 ALLOCSET_SMALL_INITSIZE,
+										 ALLOCSET_SMALL_MAXSIZE);
+	oldContext = MemoryContextSwitchTo(entryContext);
+
+	invalidationCount = DistributedTableCacheInvalidationCount;
+	shardIntervalList = LoadShardIntervalList(distributedTableId);
+	if (shardIntervalList != NIL)
+	{
+		partitionColumn = PartitionColumn(distributedTableId);
+		partitionMethod = PartitionType(distributedTableId);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	if (shardIntervalList == NIL)
+	{
+		MemoryContextDelete(entryContext);
+		return NULL;
+	}
+
+	MemoryContextSetParent(entryContext, CacheMemoryContext);
+
+	cacheEntry = hash_search(DistributedTableCache, &distributedTableId, HASH_ENTER,
+							 &foundEntry);
+	Assert(!foundEntry);
+
+	cacheEntry->entryContext = entryContext;
+	cacheEntry->partitionMethod = partitionMethod;
+	cacheEntry->partitionColumn = partitionColumn;
+	cacheEntry->shardIntervalList = shardIntervalList;
+
+	BuildSortedShardIntervalArray(cacheEntry);
+
+	/* an invalidation that arrived while loading makes the next lookup reload */
+	cacheEntry->isValid = (invalidationCount == DistributedTableCacheInvalidationCount);
+
+	return cacheEntry;
+}
+
+
 /*
  * LookupShardIntervalList is wrapper around LoadShardIntervalList that uses a
  * cache to avoid multiple lookups of a distributed table's shards within a
@@ -65,48 +163,183 @@ static void AcquireShardLock(int64 shardId, ShardLockType shardLockType,
 List *
 LookupShardIntervalList(Oid distributedTableId)
 {
-	ShardIntervalListCacheEntry *matchingCacheEntry = NULL;
-	ListCell *cacheEntryCell = NULL;
+	DistributedTableCacheEntry *cacheEntry =
+		LookupDistributedTableCacheEntry(distributedTableId);
 
-	/* search the cache */
-	foreach(cacheEntryCell, ShardIntervalListCache)
+	/*
+	 * The only case we don't cache the shard list is when the distributed table
+	 * doesn't have any shards. This is to force reloading shard list on next call.
+	 */
+	if (cacheEntry == NULL)
 	{
-		ShardIntervalListCacheEntry *cacheEntry = lfirst(cacheEntryCell);
-		if (cacheEntry->distributedTableId == distributedTableId)
+		return NIL;
+	}
+
+	return cacheEntry->shardIntervalList;
+}
+
+
+/*
+ * InitializeDistributedTableCache creates the distributed table cache and
+ * registers the callback that invalidates its entries.
+ */
+static void
+InitializeDistributedTableCache(void)
+{
+	HASHCTL info;
+	int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(DistributedTableCacheEntry);
+	info.hcxt = CacheMemoryContext;
+
+	DistributedTableCache = hash_create("pg_shard distributed table cache", 32, &info,
+										hashFlags);
+
+	CacheRegisterRelcacheCallback(InvalidateDistributedTableCacheCallback,
+								  (Datum) 0);
+}
+
+
+/*
+ * InvalidateDistributedTableCacheCallback marks the cache entry of the given
+ * relation as invalid, or all entries if the relation identifier is invalid.
+ * The entries are only freed by the next lookup, as the current query may
+ * still be using their shard intervals.
+ */
+static void
+InvalidateDistributedTableCacheCallback(Datum argument, Oid relationId)
+{
+	DistributedTableCacheInvalidationCount++;
+
+	if (relationId == InvalidOid)
+	{
+		HASH_SEQ_STATUS status;
+		DistributedTableCacheEntry *cacheEntry = NULL;
+
+		hash_seq_init(&status, DistributedTableCache);
+		while ((cacheEntry = hash_seq_search(&status)) != NULL)
 		{
-			matchingCacheEntry = cacheEntry;
-			break;
+			cacheEntry->isValid = false;
 		}
 	}
+	else
+	{
+		DistributedTableCacheEntry *cacheEntry =
+			hash_search(DistributedTableCache, &relationId, HASH_FIND, NULL);
+		if (cacheEntry != NULL)
+		{
+			cacheEntry->isValid = false;
+		}
+	}
+}
+
 
-	/* if not found in the cache, load the shard interval and put it in cache */
-	if (matchingCacheEntry == NULL)
+/*
+ * BuildSortedShardIntervalArray fills in the sorted shard interval array of
+ * the given cache entry, using the default btree comparison function of the
+ * interval values. It also records whether the sorted intervals are disjoint,
+ * which is what allows searching the array for a partition value.
+ */
+static void
+BuildSortedShardIntervalArray(DistributedTableCacheEntry *cacheEntry)
+{
+	List *shardIntervalList = cacheEntry->shardIntervalList;
+	int shardIntervalCount = list_length(shardIntervalList);
+	ShardInterval *firstShardInterval = (ShardInterval *) linitial(shardIntervalList);
+	TypeCacheEntry *typeEntry = lookup_type_cache(firstShardInterval->valueTypeId,
+												  TYPECACHE_CMP_PROC_FINFO);
+	ShardInterval **sortedShardIntervalArray = NULL;
+	ListCell *shardIntervalCell = NULL;
+	int shardIndex = 0;
+
+	sortedShardIntervalArray = MemoryContextAlloc(cacheEntry->entryContext,
+												  shardIntervalCount *
+												  sizeof(ShardInterval *));
+	foreach(shardIntervalCell, shardIntervalList)
 	{
-		MemoryContext oldContext = MemoryContextSwitchTo(CacheMemoryContext);
+		sortedShardIntervalArray[shardIndex++] = lfirst(shardIntervalCell);
+	}
 
-		List *loadedIntervalList = LoadShardIntervalList(distributedTableId);
-		if (loadedIntervalList != NIL)
-		{
-			matchingCacheEntry = palloc0(sizeof(ShardIntervalListCacheEntry));
-			matchingCacheEntry->distributedTableId = distributedTableId;
-			matchingCacheEntry->shardIntervalList = loadedIntervalList;
+	cacheEntry->sortedShardIntervalArray = sortedShardIntervalArray;
+	cacheEntry->shardIntervalArrayLength = shardIntervalCount;
+	cacheEntry->hasDisjointShardIntervals = false;
 
-			ShardIntervalListCache = lappend(ShardIntervalListCache, matchingCacheEntry);
-		}
+	/* without a comparison function we can only prune shards one by one */
+	if (!OidIsValid(typeEntry->cmp_proc_finfo.fn_oid))
+	{
+		return;
+	}
 
-		MemoryContextSwitchTo(oldContext);
+	fmgr_info_copy(&cacheEntry->shardIntervalCompareFunction,
+				   &typeEntry->cmp_proc_finfo, cacheEntry->entryContext);
+	if (cacheEntry->partitionMethod == HASH_PARTITION_TYPE)
+	{
+		cacheEntry->shardIntervalCollation = InvalidOid;
+	}
+	else
+	{
+		cacheEntry->shardIntervalCollation = cacheEntry->partitionColumn->varcollid;
 	}
 
-	/*
-	 * The only case we don't cache the shard list is when the distributed table
-	 * doesn't have any shards. This is to force reloading shard list on next call.
-	 */
-	if (matchingCacheEntry == NULL)
+	qsort_arg(sortedShardIntervalArray, shardIntervalCount, sizeof(ShardInterval *),
+			  CompareShardIntervalMinValues, cacheEntry);
+
+	for (shardIndex = 0; shardIndex < shardIntervalCount; shardIndex++)
 	{
-		return NIL;
+		ShardInterval *shardInterval = sortedShardIntervalArray[shardIndex];
+
+		if (CompareShardIntervalValues(cacheEntry, shardInterval->minValue,
+									   shardInterval->maxValue) > 0)
+		{
+			return;
+		}
+
+		if (shardIndex > 0)
+		{
+			ShardInterval *previousInterval = sortedShardIntervalArray[shardIndex - 1];
+
+			if (CompareShardIntervalValues(cacheEntry, previousInterval->maxValue,
+										   shardInterval->minValue) >= 0)
+			{
+				return;
+			}
+		}
 	}
 
-	return matchingCacheEntry->shardIntervalList;
+	cacheEntry->hasDisjointShardIntervals = true;
+}
+
+
+/* CompareShardIntervalMinValues is a qsort_arg comparator for shard intervals. */
+static int
+CompareShardIntervalMinValues(const void *leftElement, const void *rightElement,
+							  void *context)
+{
+	ShardInterval *leftInterval = *((ShardInterval **) leftElement);
+	ShardInterval *rightInterval = *((ShardInterval **) rightElement);
+	DistributedTableCacheEntry *cacheEntry = (DistributedTableCacheEntry *) context;
+
+	return CompareShardIntervalValues(cacheEntry, leftInterval->minValue,
+									  rightInterval->minValue);
+}
+
+
+/*
+ * CompareShardIntervalValues compares two values of the shard intervals of the
+ * given cache entry and returns a negative, zero or positive integer depending
+ * on whether the left value sorts before, equal to or after the right value.
+ */
+static int
+CompareShardIntervalValues(DistributedTableCacheEntry *cacheEntry, Datum leftValue,
+						   Datum rightValue)
+{
+	Datum comparisonDatum = FunctionCall2Coll(&cacheEntry->shardIntervalCompareFunction,
+											  cacheEntry->shardIntervalCollation,
+											  leftValue, rightValue);
+
+	return DatumGetInt32(comparisonDatum);
 }
 
 
@@ -709,6 +942,9 @@ InsertPartitionRow(Oid distributedTableId, char partitionType, text *partitionKe
 	Assert(spiStatus == SPI_OK_INSERT);
 
 	SPI_finish();
+
+	/* have every backend reload its cached metadata for this table */
+	CacheInvalidateRelcacheByRelid(distributedTableId);
 }
 
 
@@ -756,6 +992,9 @@ CreateShardRow(Oid distributedTableId, char shardStorage, text *shardMinValue,
 
 	SPI_finish();
 
+	/* have every backend reload its cached shard intervals for this table */
+	CacheInvalidateRelcacheByRelid(distributedTableId);
+
 	return newShardId;
 }
 
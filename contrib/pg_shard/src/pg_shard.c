@@ -22,9 +22,13 @@
 #include "connection.h"
 #include "create_shards.h"
 #include "distribution_metadata.h"
+#include "plan_cache.h"
 #include "prune_shard_list.h"
+#include "query_pushdown.h"
 #include "ruleutils.h"
 
+#include <errno.h>
+#include <poll.h>
 #include <stddef.h>
 #include <string.h>
 #include <inttypes.h>
@@ -33,6 +37,7 @@
 #include "access/htup_details.h"
 #include "access/htup.h"
 #include "access/sdir.h"
+#include "access/transam.h"
 #if (PG_VERSION_NUM >= 90500 && PG_VERSION_NUM < 90600)
 #include "access/stratnum.h"
 #else
@@ -72,6 +77,7 @@
 #include "tcop/tcopprot.h"
 #include "tcop/utility.h"
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
 #include "utils/guc.h"
@@ -85,6 +91,30 @@
 
 typedef long long csn_t;
 
+/*
+ * ShardSelectExecution tracks the progress of one task of a multi-shard
+ * select. A task is running while it has a connection assigned; once its
+ * results have been moved into the intermediate table it is done.
+ */
+typedef struct ShardSelectExecution
+{
+	Task *task;
+	ListCell *placementCell;     /* placement to try next, or the current one */
+	PGconn *connection;          /* connection the query is running on, if any */
+	Tuplestorestate *tupleStore; /* rows received from the current placement */
+	bool done;
+} ShardSelectExecution;
+
+/*
+ * ShardQueryCacheEntry keeps the query string a parameterized plan was deparsed
+ * into for one shard, so that executions routed to the shard can reuse it.
+ */
+typedef struct ShardQueryCacheEntry
+{
+	int64 shardId;          /* hash key */
+	StringInfo queryString; /* query with parameters for the shard */
+} ShardQueryCacheEntry;
+
 /* controls use of locks to enforce safe commutativity */
 bool AllModificationsCommutative = false;
 
@@ -104,10 +134,8 @@ bool LogDistributedStatements = false;
 /* planner functions forward declarations */
 static PlannedStmt * PgShardPlanner(Query *parse, int cursorOptions,
 									ParamListInfo boundParams);
-static PlannerType DeterminePlannerType(Query *query);
 static void ErrorIfQueryNotSupported(Query *queryTree);
 static Oid ExtractFirstDistributedTableId(Query *query);
-static bool ExtractRangeTableEntryWalker(Node *node, List **rangeTableList);
 static List * DistributedQueryShardList(Query *query);
 static bool SelectFromMultipleShards(Query *query, List *queryShardList);
 static void ClassifyRestrictions(List *queryRestrictList, List **remoteRestrictList,
@@ -115,6 +143,7 @@ static void ClassifyRestrictions(List *queryRestrictList, List **remoteRestrictL
 static Query * RowAndColumnFilterQuery(Query *query, List *remoteRestrictList,
 									   List *localRestrictList);
 static Query * BuildLocalQuery(Query *query, List *localRestrictList);
+static void ErrorIfForeignTableQuery(Query *query);
 static PlannedStmt * PlanSequentialScan(Query *query, int cursorOptions,
 										ParamListInfo boundParams);
 static List * QueryRestrictList(Query *query);
@@ -124,6 +153,16 @@ static List * QueryFromList(List *rangeTableList);
 static List * TargetEntryList(List *expressionList);
 static CreateStmt * CreateTemporaryTableLikeStmt(Oid sourceRelationId);
 static DistributedPlan * BuildDistributedPlan(Query *query, List *shardIntervalList);
+static OpExpr * ParameterizedRoutingClause(Query *query);
+static bool ContainsExternParamWalker(Node *node, void *context);
+static DistributedPlan * BuildParameterizedRouterPlan(Query *query,
+													  OpExpr *routingClause);
+static DistributedPlan * BindParameterizedRouterPlan(DistributedPlan *distributedPlan,
+													 ParamListInfo boundParams);
+static Const * EvaluateParameterizedExpression(Expr *expression,
+											   ParamListInfo boundParams);
+static StringInfo LookupShardQueryString(DistributedPlan *distributedPlan,
+										 int64 shardId);
 
 /* executor functions forward declarations */
 static void PgShardExecutorStart(QueryDesc *queryDesc, int eflags);
@@ -133,22 +172,47 @@ static LOCKMODE CommutativityRuleToLockMode(CmdType commandType);
 static void AcquireExecutorShardLocks(List *taskList, LOCKMODE lockMode);
 static int CompareTasksByShardId(const void *leftElement, const void *rightElement);
 static void ExecuteMultipleShardSelect(DistributedPlan *distributedPlan,
-									   RangeVar *intermediateTable);
-static bool SendQueryInSingleRowMode(PGconn *connection, StringInfo query);
+									   RangeVar *intermediateTable,
+									   AggregateMergeState *mergeStateArray);
+static void MergeTupleStore(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor,
+							AggregateMergeState *mergeStateArray, int mergeStateCount);
+static void SendShardSelect(ShardSelectExecution *execution,
+							ShardSelectExecution *executionArray, int taskCount);
+static bool ReceiveShardSelectResults(ShardSelectExecution *execution,
+									  AttInMetadata *attributeInputMetadata,
+									  MemoryContext ioContext);
+static void FailShardSelect(ShardSelectExecution *execution);
+static void CancelRemoteQuery(PGconn *connection);
+static bool ExecuteTaskWithParamsAndStoreResults(Task *task, ParamListInfo boundParams,
+												 TupleDesc tupleDescriptor,
+												 Tuplestorestate *tupleStore);
+static bool SendQueryInSingleRowMode(PGconn *connection, StringInfo query,
+									 ParamListInfo boundParams);
+static void ExtractRemoteParameters(ParamListInfo boundParams, Oid **parameterTypes,
+									const char ***parameterValues);
 static bool StoreQueryResult(PGconn *connection, TupleDesc tupleDescriptor,
 							 Tuplestorestate *tupleStore);
+static void StoreResultTuples(PGresult *result, AttInMetadata *attributeInputMetadata,
+							  Tuplestorestate *tupleStore, MemoryContext ioContext);
 static void TupleStoreToTable(RangeVar *tableRangeVar, List *remoteTargetList,
 							  TupleDesc storeTupleDescriptor, Tuplestorestate *store);
 static void PgShardExecutorRun(QueryDesc *queryDesc, ScanDirection direction, long count);
-static int32 ExecuteDistributedModify(DistributedPlan *distributedPlan);
+static int32 ExecuteDistributedModify(DistributedPlan *distributedPlan,
+									  ParamListInfo boundParams);
 static void PrepareDtmTransaction(Task *task);
 static csn_t SendDtmBeginTransaction(PGconn *connection);
-static bool SendDtmJoinTransaction(PGconn *connection, csn_t TransactionId);
-static bool SendCommand(PGconn *connection, char *command);
+static bool SendDtmJoinTransaction(List *connectionList, csn_t TransactionId,
+								   List **joinedList);
+static PGresult * GetFinalResult(PGconn *connection);
 static void FinishDtmTransaction(XactEvent event, void *arg);
 static void ExecuteSingleShardSelect(DistributedPlan *distributedPlan,
-									 EState *executorState, TupleDesc tupleDescriptor,
+									 ParamListInfo boundParams, EState *executorState,
+									 TupleDesc tupleDescriptor,
 									 DestReceiver *destination);
+static void ExecuteMultipleShardAggregate(DistributedPlan *distributedPlan,
+										  EState *executorState,
+										  TupleDesc tupleDescriptor,
+										  DestReceiver *destination);
 static void PgShardExecutorFinish(QueryDesc *queryDesc);
 static void PgShardExecutorEnd(QueryDesc *queryDesc);
 static void PgShardProcessUtility(Node *parsetree, const char *queryString,
@@ -350,6 +414,7 @@ PgShardPlanner(Query *query, int cursorOptions, ParamListInfo boundParams)
 		List *queryShardList = NIL;
 		bool selectFromMultipleShards = false;
 		CreateStmt *createTemporaryTableStmt = NULL;
+		List *aggregateMergeList = NIL;
 
 		/* call standard planner first to have Query transformations performed */
 		plannedStatement = standard_planner(distributedQuery, cursorOptions,
@@ -357,6 +422,27 @@ PgShardPlanner(Query *query, int cursorOptions, ParamListInfo boundParams)
 
 		ErrorIfQueryNotSupported(distributedQuery);
 
+		/*
+		 * A prepared statement is planned without parameter values. If those
+		 * values only determine the shard to route the query to, leave the
+		 * choice of the shard to the executor so the plan can be reused.
+		 */
+		if (boundParams == NULL &&
+			ContainsExternParamWalker((Node *) distributedQuery, NULL))
+		{
+			OpExpr *routingClause = ParameterizedRoutingClause(distributedQuery);
+			if (routingClause != NULL)
+			{
+				distributedPlan = BuildParameterizedRouterPlan(distributedQuery,
+															   routingClause);
+				distributedPlan->originalPlan = plannedStatement->planTree;
+
+				plannedStatement->planTree = (Plan *) distributedPlan;
+
+				return plannedStatement;
+			}
+		}
+
 		/*
 		 * Compute the list of shards this query needs to access.
 		 * Error out if there are no existing shards for the table.
@@ -378,36 +464,70 @@ PgShardPlanner(Query *query, int cursorOptions, ParamListInfo boundParams)
 		{
 			Oid distributedTableId = InvalidOid;
 			Query *localQuery = NULL;
+			Query *filterQuery = NULL;
 			List *queryRestrictList = QueryRestrictList(distributedQuery);
 			List *remoteRestrictList = NIL;
 			List *localRestrictList = NIL;
+			List *partialTargetList = NIL;
 
 			/* partition restrictions into remote and local lists */
 			ClassifyRestrictions(queryRestrictList, &remoteRestrictList,
 								 &localRestrictList);
 
-			/* build local and distributed query */
-			distributedQuery = RowAndColumnFilterQuery(distributedQuery,
-													   remoteRestrictList,
-													   localRestrictList);
-			localQuery = BuildLocalQuery(query, localRestrictList);
+			/* build distributed query */
+			filterQuery = RowAndColumnFilterQuery(distributedQuery,
+												  remoteRestrictList,
+												  localRestrictList);
 
 			/*
-			 * Force a sequential scan as we change the underlying table to
-			 * point to our intermediate temporary table which contains the
-			 * fetched data.
+			 * If the shards can compute partial aggregates, there are no rows
+			 * to fetch: the executor merges one row per shard into the result
+			 * without going through a temporary table and a local plan.
 			 */
-			plannedStatement = PlanSequentialScan(localQuery, cursorOptions, boundParams);
+			if (localRestrictList == NIL)
+			{
+				partialTargetList = PartialAggregateTargetList(distributedQuery,
+															   &aggregateMergeList);
+			}
+
+			if (partialTargetList != NIL)
+			{
+				ErrorIfForeignTableQuery(distributedQuery);
+
+				filterQuery->targetList = partialTargetList;
+				filterQuery->hasAggs = true;
+				distributedQuery = filterQuery;
+			}
+			else
+			{
+				/* let each shard return only its top rows for ORDER BY ... LIMIT */
+				if (localRestrictList == NIL)
+				{
+					PushDownTopN(distributedQuery, filterQuery);
+				}
+
+				distributedQuery = filterQuery;
+				localQuery = BuildLocalQuery(query, localRestrictList);
 
-			/* construct a CreateStmt to clone the existing table */
-			distributedTableId = ExtractFirstDistributedTableId(distributedQuery);
-			createTemporaryTableStmt = CreateTemporaryTableLikeStmt(distributedTableId);
+				/*
+				 * Force a sequential scan as we change the underlying table to
+				 * point to our intermediate temporary table which contains the
+				 * fetched data.
+				 */
+				plannedStatement = PlanSequentialScan(localQuery, cursorOptions,
+													  boundParams);
+
+				/* construct a CreateStmt to clone the existing table */
+				distributedTableId = ExtractFirstDistributedTableId(distributedQuery);
+				createTemporaryTableStmt = CreateTemporaryTableLikeStmt(distributedTableId);
+			}
 		}
 
 		distributedPlan = BuildDistributedPlan(distributedQuery, queryShardList);
 		distributedPlan->originalPlan = plannedStatement->planTree;
 		distributedPlan->selectFromMultipleShards = selectFromMultipleShards;
 		distributedPlan->createTemporaryTableStmt = createTemporaryTableStmt;
+		distributedPlan->aggregateMergeList = aggregateMergeList;
 
 		plannedStatement->planTree = (Plan *) distributedPlan;
 	}
@@ -450,7 +570,7 @@ PgShardPlanner(Query *query, int cursorOptions, ParamListInfo boundParams)
  * DeterminePlannerType chooses the appropriate planner to use in order to plan
  * the given query.
  */
-static PlannerType
+PlannerType
 DeterminePlannerType(Query *query)
 {
 	PlannerType plannerType = PLANNER_INVALID_FIRST;
@@ -726,7 +846,7 @@ ExtractFirstDistributedTableId(Query *query)
  * query tree walker since the expression tree walker doesn't recurse into
  * sub-queries.
  */
-static bool
+bool
 ExtractRangeTableEntryWalker(Node *node, List **rangeTableList)
 {
 	bool walkIsComplete = false;
@@ -769,11 +889,11 @@ DistributedQueryShardList(Query *query)
 	List *prunedShardList = NIL;
 
 	Oid distributedTableId = ExtractFirstDistributedTableId(query);
-	List *shardIntervalList = NIL;
+	DistributedTableCacheEntry *cacheEntry = NULL;
 
 	/* error out if no shards exist for the table */
-	shardIntervalList = LookupShardIntervalList(distributedTableId);
-	if (shardIntervalList == NIL)
+	cacheEntry = LookupDistributedTableCacheEntry(distributedTableId);
+	if (cacheEntry == NULL)
 	{
 		char *relationName = get_rel_name(distributedTableId);
 
@@ -786,8 +906,7 @@ DistributedQueryShardList(Query *query)
 	}
 
 	restrictClauseList = QueryRestrictList(query);
-	prunedShardList = PruneShardList(distributedTableId, restrictClauseList,
-									 shardIntervalList);
+	prunedShardList = PruneCachedShardList(cacheEntry, restrictClauseList);
 
 	return prunedShardList;
 }
@@ -943,22 +1062,15 @@ BuildLocalQuery(Query *query, List *localRestrictList)
 
 
 /*
- * PlanSequentialScan attempts to plan the given query using only a sequential
- * scan of the underlying table. The function disables index scan types and
- * plans the query. If the plan still contains a non-sequential scan plan node,
- * the function errors out. Note this function modifies the query parameter, so
- * make a copy before calling PlanSequentialScan if that is unacceptable.
+ * ErrorIfForeignTableQuery errors out if the given query reads from a foreign
+ * table, as multi-shard SELECTs cannot fetch their data from one.
  */
-static PlannedStmt *
-PlanSequentialScan(Query *query, int cursorOptions, ParamListInfo boundParams)
+static void
+ErrorIfForeignTableQuery(Query *query)
 {
-	PlannedStmt *sequentialScanPlan = NULL;
-	bool indexScanEnabledOldValue = false;
-	bool bitmapScanEnabledOldValue = false;
 	List *rangeTableList = NIL;
 	ListCell *rangeTableCell = NULL;
 
-	/* error out if the table is a foreign table */
 	ExtractRangeTableEntryWalker((Node *) query, &rangeTableList);
 
 	foreach(rangeTableCell, rangeTableList)
@@ -974,6 +1086,24 @@ PlanSequentialScan(Query *query, int cursorOptions, ParamListInfo boundParams)
 			}
 		}
 	}
+}
+
+
+/*
+ * PlanSequentialScan attempts to plan the given query using only a sequential
+ * scan of the underlying table. The function disables index scan types and
+ * plans the query. If the plan still contains a non-sequential scan plan node,
+ * the function errors out. Note this function modifies the query parameter, so
+ * make a copy before calling PlanSequentialScan if that is unacceptable.
+ */
+static PlannedStmt *
+PlanSequentialScan(Query *query, int cursorOptions, ParamListInfo boundParams)
+{
+	PlannedStmt *sequentialScanPlan = NULL;
+	bool indexScanEnabledOldValue = false;
+	bool bitmapScanEnabledOldValue = false;
+
+	ErrorIfForeignTableQuery(query);
 
 	/* disable index scan types */
 	indexScanEnabledOldValue = enable_indexscan;
@@ -1184,16 +1314,30 @@ BuildDistributedPlan(Query *query, List *shardIntervalList)
 {
 	ListCell *shardIntervalCell = NULL;
 	List *taskList = NIL;
+	FromExpr *joinTree = query->jointree;
 	DistributedPlan *distributedPlan = palloc0(sizeof(DistributedPlan));
 	distributedPlan->plan.type = (NodeTag) T_DistributedPlan;
 	distributedPlan->targetList = query->targetList;
 
+	/*
+	 * Convert the qualifiers to an explicitly and'd clause, which is needed
+	 * before we deparse the query. This applies to SELECT, UPDATE and DELETE
+	 * statements.
+	 */
+	if ((joinTree != NULL) && (joinTree->quals != NULL))
+	{
+		Node *whereClause = joinTree->quals;
+		if (IsA(whereClause, List))
+		{
+			joinTree->quals = (Node *) make_ands_explicit((List *) whereClause);
+		}
+	}
+
 	foreach(shardIntervalCell, shardIntervalList)
 	{
 		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
 		int64 shardId = shardInterval->id;
 		List *finalizedPlacementList = NIL;
-		FromExpr *joinTree = NULL;
 		Task *task = NULL;
 		StringInfo queryString = makeStringInfo();
 
@@ -1203,21 +1347,6 @@ BuildDistributedPlan(Query *query, List *shardIntervalList)
 		/* now safe to populate placement list */
 		finalizedPlacementList = LoadFinalizedShardPlacementList(shardId);
 
-		/*
-		 * Convert the qualifiers to an explicitly and'd clause, which is needed
-		 * before we deparse the query. This applies to SELECT, UPDATE and
-		 * DELETE statements.
-		 */
-		joinTree = query->jointree;
-		if ((joinTree != NULL) && (joinTree->quals != NULL))
-		{
-			Node *whereClause = joinTree->quals;
-			if (IsA(whereClause, List))
-			{
-				joinTree->quals = (Node *) make_ands_explicit((List *) whereClause);
-			}
-		}
-
 		deparse_shard_query(query, shardId, queryString);
 
 		if (LogDistributedStatements)
@@ -1240,163 +1369,556 @@ BuildDistributedPlan(Query *query, List *shardIntervalList)
 
 
 /*
- * PgShardExecutorStart sets up the executor state and queryDesc for pgShard
- * executed statements. The function also handles multi-shard selects
- * differently by fetching the remote data and modifying the existing plan to
- * scan that data.
+ * IsParameterizedRouterQuery returns whether the given query on a distributed
+ * table can be planned without parameter values and routed to a single shard
+ * once the values are known; see ParameterizedRoutingClause.
  */
-static void
-PgShardExecutorStart(QueryDesc *queryDesc, int eflags)
+bool
+IsParameterizedRouterQuery(Query *query)
 {
-	PlannedStmt *plannedStatement = queryDesc->plannedstmt;
-	bool pgShardExecution = IsPgShardPlan(plannedStatement);
+	OpExpr *routingClause = NULL;
 
-	if (pgShardExecution)
+	if (ContainsExternParamWalker((Node *) query, NULL))
 	{
-		DistributedPlan *distributedPlan = (DistributedPlan *) plannedStatement->planTree;
-		bool selectFromMultipleShards = distributedPlan->selectFromMultipleShards;
-		bool zeroShardQuery = (list_length(distributedPlan->taskList) == 0);
+		routingClause = ParameterizedRoutingClause(query);
+	}
 
-		if (zeroShardQuery)
+	return (routingClause != NULL);
+}
+
+
+/*
+ * ParameterizedRoutingClause finds the clause which routes the given query to a
+ * single shard, provided that clause compares the partition column with an
+ * expression over the query's external parameters. For INSERT statements, the
+ * clause is built from the value of the partition column; for other statements
+ * it is a top-level equality restriction on the partition column. The function
+ * returns NULL if there is no such clause, or if equality on the partition
+ * column may match multiple shards of the table.
+ */
+static OpExpr *
+ParameterizedRoutingClause(Query *query)
+{
+	OpExpr *routingClause = NULL;
+	Oid distributedTableId = ExtractFirstDistributedTableId(query);
+	DistributedTableCacheEntry *cacheEntry = NULL;
+	Var *partitionColumn = NULL;
+	OpExpr *equalityExpr = NULL;
+	List *candidateClauseList = NIL;
+	ListCell *candidateClauseCell = NULL;
+
+	cacheEntry = LookupDistributedTableCacheEntry(distributedTableId);
+	if (cacheEntry == NULL || !cacheEntry->hasDisjointShardIntervals)
+	{
+		return NULL;
+	}
+
+	partitionColumn = PartitionColumn(distributedTableId);
+	equalityExpr = MakeOpExpression(partitionColumn, BTEqualStrategyNumber);
+
+	if (query->commandType == CMD_INSERT)
+	{
+		TargetEntry *targetEntry = get_tle_by_resno(query->targetList,
+													partitionColumn->varattno);
+		if (targetEntry != NULL)
 		{
-			/* if zero shards are involved, let non-INSERTs hit local table */
-			Plan *originalPlan = distributedPlan->originalPlan;
-			plannedStatement->planTree = originalPlan;
+			Node *leftOp = get_leftop((Expr *) equalityExpr);
 
-			if (plannedStatement->commandType == CMD_INSERT)
-			{
-				ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-								errmsg("could not find destination shard for new row"),
-								errdetail("Target relation does not contain any shards "
-										  "capable of storing the new row.")));
-			}
+			equalityExpr->args = list_make2(leftOp, targetEntry->expr);
+			candidateClauseList = list_make1(equalityExpr);
+		}
+	}
+	else if (query->jointree != NULL && query->jointree->quals != NULL)
+	{
+		Node *whereClause = query->jointree->quals;
 
-			NextExecutorStartHook(queryDesc, eflags);
+		/* planned queries have implicitly and'd qualifiers, parsed ones don't */
+		if (IsA(whereClause, List))
+		{
+			candidateClauseList = (List *) whereClause;
 		}
-		else if (!selectFromMultipleShards)
+		else
 		{
-			/* bool topLevel = true; */
-			LOCKMODE lockMode = NoLock;
-			EState *executorState = NULL;
+			candidateClauseList = make_ands_implicit((Expr *) whereClause);
+		}
+	}
 
-			/*
-			 * Also enable transactions to have ability to run the same test 
-			 * with and without DTM.
-			 */
-			/*
-			 * if (!UseDtmTransactions)
-			 * {
-			 *	PreventTransactionChain(topLevel, "distributed commands");
-			 *	eflags |= EXEC_FLAG_SKIP_TRIGGERS;
-			 * }
-			 *
-			 */
+	foreach(candidateClauseCell, candidateClauseList)
+	{
+		Node *candidateClause = (Node *) lfirst(candidateClauseCell);
+		OpExpr *operatorExpression = NULL;
+		Node *leftOp = NULL;
+		Node *rightOp = NULL;
+		Var *column = NULL;
+		Node *valueExpression = NULL;
 
-			/* build empty executor state to obtain per-query memory context */
-			executorState = CreateExecutorState();
-			executorState->es_top_eflags = eflags;
-			executorState->es_instrument = queryDesc->instrument_options;
+		if (!IsA(candidateClause, OpExpr) ||
+			list_length(((OpExpr *) candidateClause)->args) != 2)
+		{
+			continue;
+		}
 
-			queryDesc->estate = executorState;
+		operatorExpression = (OpExpr *) candidateClause;
+		if (operatorExpression->opno != equalityExpr->opno)
+		{
+			continue;
+		}
 
-			lockMode = CommutativityRuleToLockMode(plannedStatement->commandType);
-			if (lockMode != NoLock)
-			{
-				AcquireExecutorShardLocks(distributedPlan->taskList, lockMode);
-			}
+		leftOp = get_leftop((Expr *) operatorExpression);
+		rightOp = get_rightop((Expr *) operatorExpression);
+		if (IsA(leftOp, Var))
+		{
+			column = (Var *) leftOp;
+			valueExpression = rightOp;
+		}
+		else if (IsA(rightOp, Var))
+		{
+			column = (Var *) rightOp;
+			valueExpression = leftOp;
 		}
 		else
 		{
-			/*
-			 * If its a SELECT query over multiple shards, we fetch the relevant
-			 * data from the remote nodes and insert it into a temp table. We then
-			 * point the existing plan to scan this temp table instead of the
-			 * original one.
-			 */
-			Plan *originalPlan = NULL;
-			RangeTblEntry *sequentialScanRangeTable = NULL;
-			Oid intermediateResultTableId = InvalidOid;
-			bool missingOK = false;
-
-			/* execute the previously created statement to create a temp table */
-			CreateStmt *createStmt = distributedPlan->createTemporaryTableStmt;
-			const char *queryDescription = "create temp table like";
-			RangeVar *intermediateResultTable = createStmt->relation;
+			continue;
+		}
 
-			ProcessUtility((Node *) createStmt, queryDescription,
-						   PROCESS_UTILITY_TOPLEVEL, NULL, None_Receiver, NULL);
+		if (column->varattno != partitionColumn->varattno || column->varlevelsup != 0)
+		{
+			continue;
+		}
 
-			/* execute select queries and fetch results into the temp table */
-			ExecuteMultipleShardSelect(distributedPlan, intermediateResultTable);
+		/* the value must be computable from the parameters alone */
+		if (contain_var_clause(valueExpression) ||
+			contain_volatile_functions(valueExpression) ||
+			!ContainsExternParamWalker(valueExpression, NULL))
+		{
+			continue;
+		}
 
-			/* update the query descriptor snapshot so results are visible */
-			UnregisterSnapshot(queryDesc->snapshot);
-			UpdateActiveSnapshotCommandId();
-			queryDesc->snapshot = RegisterSnapshot(GetActiveSnapshot());
+		routingClause = operatorExpression;
+		break;
+	}
 
-			/* update sequential scan's table entry to point to intermediate table */
-			intermediateResultTableId = RangeVarGetRelid(intermediateResultTable,
-														 NoLock, missingOK);
+	return routingClause;
+}
 
-			Assert(list_length(plannedStatement->rtable) == 1);
-			sequentialScanRangeTable = linitial(plannedStatement->rtable);
-			Assert(sequentialScanRangeTable->rtekind == RTE_RELATION);
-			sequentialScanRangeTable->relid = intermediateResultTableId;
 
-			/* swap in modified (local) plan for compatibility with standard start hook */
-			originalPlan = distributedPlan->originalPlan;
-			plannedStatement->planTree = originalPlan;
+/*
+ * ContainsExternParamWalker returns true if the given query or expression
+ * references a parameter supplied from outside of the query.
+ */
+static bool
+ContainsExternParamWalker(Node *node, void *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
 
-			NextExecutorStartHook(queryDesc, eflags);
-		}
+	if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, ContainsExternParamWalker, context, 0);
 	}
-	else
+
+	if (IsA(node, Param))
 	{
-		NextExecutorStartHook(queryDesc, eflags);
+		Param *param = (Param *) node;
+		if (param->paramkind == PARAM_EXTERN)
+		{
+			return true;
+		}
 	}
+
+	return expression_tree_walker(node, ContainsExternParamWalker, context);
 }
 
 
 /*
- * IsPgShardPlan determines whether the provided plannedStmt contains a plan
- * suitable for execution by PgShard.
+ * BuildParameterizedRouterPlan creates a distributed plan whose task is built
+ * by the executor, once the routing clause can be evaluated using the values
+ * of the query's parameters. The plan keeps the parameterized query, which is
+ * deparsed at most once per shard; the deparsed queries reference parameters
+ * as $n, and their values are sent to the shards with the queries.
  */
-static bool
-IsPgShardPlan(PlannedStmt *plannedStmt)
+static DistributedPlan *
+BuildParameterizedRouterPlan(Query *query, OpExpr *routingClause)
 {
-	Plan *plan = plannedStmt->planTree;
-	NodeTag nodeTag = nodeTag(plan);
-	bool isPgShardPlan = ((DistributedNodeTag) nodeTag == T_DistributedPlan);
+	DistributedPlan *distributedPlan = BuildDistributedPlan(query, NIL);
 
-	return isPgShardPlan;
+	distributedPlan->routingClause = routingClause;
+	distributedPlan->parameterizedQuery = query;
+	distributedPlan->shardQueryCache = NULL;
+	distributedPlan->planContext = CurrentMemoryContext;
+
+	return distributedPlan;
 }
 
 
 /*
- * NextExecutorStartHook simply encapsulates the common logic of calling the
- * next executor start hook in the chain or the standard executor start hook
- * if no other hooks are present.
+ * BindParameterizedRouterPlan evaluates the routing clause of the given plan
+ * using the bound parameter values, and returns a copy of the plan with a task
+ * for the single shard the clause matches. The copy has no tasks if the clause
+ * matches no shards. The plan itself is left untouched so that it can be used
+ * by further executions.
  */
-static void
-NextExecutorStartHook(QueryDesc *queryDesc, int eflags)
+static DistributedPlan *
+BindParameterizedRouterPlan(DistributedPlan *distributedPlan, ParamListInfo boundParams)
 {
-	/* call into the standard executor start, or hook if set */
-	if (PreviousExecutorStartHook != NULL)
+	DistributedPlan *boundPlan = palloc(sizeof(DistributedPlan));
+	Query *query = distributedPlan->parameterizedQuery;
+	OpExpr *boundClause = (OpExpr *) copyObject(distributedPlan->routingClause);
+	ListCell *argumentCell = NULL;
+	Var *partitionColumn = NULL;
+	bool partitionValueIsNull = false;
+
+	foreach(argumentCell, boundClause->args)
 	{
-		PreviousExecutorStartHook(queryDesc, eflags);
+		Expr *argument = (Expr *) lfirst(argumentCell);
+
+		if (IsA(argument, Var))
+		{
+			partitionColumn = (Var *) argument;
+		}
+		else
+		{
+			Const *partitionValue = EvaluateParameterizedExpression(argument,
+																	boundParams);
+
+			partitionValueIsNull = partitionValue->constisnull;
+			lfirst(argumentCell) = partitionValue;
+		}
 	}
-	else
+
+	Assert(partitionColumn != NULL);
+
+	*boundPlan = *distributedPlan;
+	boundPlan->taskList = NIL;
+
+	if (partitionValueIsNull && query->commandType == CMD_INSERT)
 	{
-		standard_ExecutorStart(queryDesc, eflags);
+		ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+						errmsg("cannot plan INSERT using row with NULL value "
+							   "in partition column")));
 	}
-}
+	else if (!partitionValueIsNull)
+	{
+		RangeTblEntry *rangeTableEntry = rt_fetch(partitionColumn->varno, query->rtable);
+		Oid distributedTableId = rangeTableEntry->relid;
+		DistributedTableCacheEntry *cacheEntry = NULL;
+		List *shardIntervalList = NIL;
 
+		cacheEntry = LookupDistributedTableCacheEntry(distributedTableId);
+		if (cacheEntry == NULL)
+		{
+			char *relationName = get_rel_name(distributedTableId);
 
-/*
- * CommutativityRuleToLockMode determines the commutativity rule for the given
- * command and returns the appropriate lock mode to enforce that rule. The
- * function assumes a SELECT doesn't modify state and therefore is commutative
- * with all other commands. The function also assumes that an INSERT commutes
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("could not find any shards for query"),
+							errdetail("No shards exist for distributed table \"%s\".",
+									  relationName)));
+		}
+
+		shardIntervalList = PruneCachedShardList(cacheEntry, list_make1(boundClause));
+		if (list_length(shardIntervalList) > 1)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot route prepared statement to a single shard"),
+							errhint("Deallocate the prepared statement and prepare "
+									"it again.")));
+		}
+
+		if (shardIntervalList != NIL)
+		{
+			ShardInterval *shardInterval = (ShardInterval *) linitial(shardIntervalList);
+			int64 shardId = shardInterval->id;
+			Task *task = (Task *) palloc0(sizeof(Task));
+
+			task->queryString = LookupShardQueryString(distributedPlan, shardId);
+			task->shardId = shardId;
+
+			/* grab shared metadata lock to stop concurrent placement additions */
+			LockShardDistributionMetadata(shardId, ShareLock);
+
+			/* now safe to populate placement list */
+			task->taskPlacementList = LoadFinalizedShardPlacementList(shardId);
+
+			boundPlan->taskList = list_make1(task);
+		}
+	}
+
+	return boundPlan;
+}
+
+
+/*
+ * EvaluateParameterizedExpression computes the value of the given expression
+ * using the bound parameter values, and returns that value as a constant.
+ */
+static Const *
+EvaluateParameterizedExpression(Expr *expression, ParamListInfo boundParams)
+{
+	EState *executorState = CreateExecutorState();
+	ExprState *expressionState = NULL;
+	Oid typeId = exprType((Node *) expression);
+	int32 typeModId = exprTypmod((Node *) expression);
+	Oid collationId = exprCollation((Node *) expression);
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	Datum value = 0;
+	bool isNull = false;
+
+	get_typlenbyval(typeId, &typeLength, &typeByValue);
+
+	executorState->es_param_list_info = boundParams;
+	expressionState = ExecPrepareExpr(expression, executorState);
+
+	value = ExecEvalExprSwitchContext(expressionState,
+									  GetPerTupleExprContext(executorState),
+									  &isNull, NULL);
+
+	/* copy the value out of the executor state before freeing it */
+	if (!isNull)
+	{
+		value = datumCopy(value, typeByValue, typeLength);
+	}
+
+	FreeExecutorState(executorState);
+
+	return makeConst(typeId, typeModId, collationId, typeLength, value, isNull,
+					 typeByValue);
+}
+
+
+/*
+ * LookupShardQueryString returns the query string of the given parameterized
+ * plan for the given shard, deparsing the query for the shard the first time
+ * the plan is routed to it. The strings are kept in the plan's memory context.
+ */
+static StringInfo
+LookupShardQueryString(DistributedPlan *distributedPlan, int64 shardId)
+{
+	ShardQueryCacheEntry *cacheEntry = NULL;
+
+	if (distributedPlan->shardQueryCache == NULL)
+	{
+		HASHCTL info;
+		int hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(int64);
+		info.entrysize = sizeof(ShardQueryCacheEntry);
+		info.hash = tag_hash;
+		info.hcxt = distributedPlan->planContext;
+
+		distributedPlan->shardQueryCache = hash_create("pg_shard shard queries", 32,
+													   &info, hashFlags);
+	}
+
+	cacheEntry = hash_search(distributedPlan->shardQueryCache, &shardId, HASH_FIND,
+							 NULL);
+	if (cacheEntry == NULL)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(distributedPlan->planContext);
+		StringInfo queryString = makeStringInfo();
+
+		deparse_shard_query(distributedPlan->parameterizedQuery, shardId, queryString);
+
+		MemoryContextSwitchTo(oldContext);
+
+		if (LogDistributedStatements)
+		{
+			ereport(LOG, (errmsg("distributed statement: %s", queryString->data)));
+		}
+
+		cacheEntry = hash_search(distributedPlan->shardQueryCache, &shardId,
+								 HASH_ENTER, NULL);
+		cacheEntry->queryString = queryString;
+	}
+
+	return cacheEntry->queryString;
+}
+
+
+/*
+ * PgShardExecutorStart sets up the executor state and queryDesc for pgShard
+ * executed statements. The function also handles multi-shard selects
+ * differently by fetching the remote data and modifying the existing plan to
+ * scan that data.
+ */
+static void
+PgShardExecutorStart(QueryDesc *queryDesc, int eflags)
+{
+	PlannedStmt *plannedStatement = queryDesc->plannedstmt;
+	bool pgShardExecution = IsPgShardPlan(plannedStatement);
+
+	if (pgShardExecution)
+	{
+		DistributedPlan *distributedPlan = (DistributedPlan *) plannedStatement->planTree;
+		bool selectFromMultipleShards = false;
+		bool mergeAggregates = false;
+		bool zeroShardQuery = false;
+
+		/*
+		 * Route plans of prepared statements to the shard chosen by the values
+		 * of the parameters. As those plans are cached, execute a copy of them.
+		 */
+		if (distributedPlan->routingClause != NULL)
+		{
+			PlannedStmt *boundStatement = palloc(sizeof(PlannedStmt));
+
+			distributedPlan = BindParameterizedRouterPlan(distributedPlan,
+														  queryDesc->params);
+
+			*boundStatement = *plannedStatement;
+			boundStatement->planTree = (Plan *) distributedPlan;
+
+			plannedStatement = boundStatement;
+			queryDesc->plannedstmt = boundStatement;
+		}
+
+		selectFromMultipleShards = distributedPlan->selectFromMultipleShards;
+		mergeAggregates = (distributedPlan->aggregateMergeList != NIL);
+		zeroShardQuery = (list_length(distributedPlan->taskList) == 0);
+
+		if (zeroShardQuery)
+		{
+			/* if zero shards are involved, let non-INSERTs hit local table */
+			Plan *originalPlan = distributedPlan->originalPlan;
+			plannedStatement->planTree = originalPlan;
+
+			if (plannedStatement->commandType == CMD_INSERT)
+			{
+				ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+								errmsg("could not find destination shard for new row"),
+								errdetail("Target relation does not contain any shards "
+										  "capable of storing the new row.")));
+			}
+
+			NextExecutorStartHook(queryDesc, eflags);
+		}
+		else if (!selectFromMultipleShards || mergeAggregates)
+		{
+			/* bool topLevel = true; */
+			LOCKMODE lockMode = NoLock;
+			EState *executorState = NULL;
+
+			/*
+			 * Also enable transactions to have ability to run the same test 
+			 * with and without DTM.
+			 */
+			/*
+			 * if (!UseDtmTransactions)
+			 * {
+			 *	PreventTransactionChain(topLevel, "distributed commands");
+			 *	eflags |= EXEC_FLAG_SKIP_TRIGGERS;
+			 * }
+			 *
+			 */
+
+			/* build empty executor state to obtain per-query memory context */
+			executorState = CreateExecutorState();
+			executorState->es_top_eflags = eflags;
+			executorState->es_instrument = queryDesc->instrument_options;
+
+			queryDesc->estate = executorState;
+
+			lockMode = CommutativityRuleToLockMode(plannedStatement->commandType);
+			if (lockMode != NoLock)
+			{
+				AcquireExecutorShardLocks(distributedPlan->taskList, lockMode);
+			}
+		}
+		else
+		{
+			/*
+			 * If its a SELECT query over multiple shards, we fetch the relevant
+			 * data from the remote nodes and insert it into a temp table. We then
+			 * point the existing plan to scan this temp table instead of the
+			 * original one.
+			 */
+			Plan *originalPlan = NULL;
+			RangeTblEntry *sequentialScanRangeTable = NULL;
+			Oid intermediateResultTableId = InvalidOid;
+			bool missingOK = false;
+
+			/* execute the previously created statement to create a temp table */
+			CreateStmt *createStmt = distributedPlan->createTemporaryTableStmt;
+			const char *queryDescription = "create temp table like";
+			RangeVar *intermediateResultTable = createStmt->relation;
+
+			ProcessUtility((Node *) createStmt, queryDescription,
+						   PROCESS_UTILITY_TOPLEVEL, NULL, None_Receiver, NULL);
+
+			/* execute select queries and fetch results into the temp table */
+			ExecuteMultipleShardSelect(distributedPlan, intermediateResultTable, NULL);
+
+			/* update the query descriptor snapshot so results are visible */
+			UnregisterSnapshot(queryDesc->snapshot);
+			UpdateActiveSnapshotCommandId();
+			queryDesc->snapshot = RegisterSnapshot(GetActiveSnapshot());
+
+			/* update sequential scan's table entry to point to intermediate table */
+			intermediateResultTableId = RangeVarGetRelid(intermediateResultTable,
+														 NoLock, missingOK);
+
+			Assert(list_length(plannedStatement->rtable) == 1);
+			sequentialScanRangeTable = linitial(plannedStatement->rtable);
+			Assert(sequentialScanRangeTable->rtekind == RTE_RELATION);
+			sequentialScanRangeTable->relid = intermediateResultTableId;
+
+			/* swap in modified (local) plan for compatibility with standard start hook */
+			originalPlan = distributedPlan->originalPlan;
+			plannedStatement->planTree = originalPlan;
+
+			NextExecutorStartHook(queryDesc, eflags);
+		}
+	}
+	else
+	{
+		NextExecutorStartHook(queryDesc, eflags);
+	}
+}
+
+
+/*
+ * IsPgShardPlan determines whether the provided plannedStmt contains a plan
+ * suitable for execution by PgShard.
+ */
+static bool
+IsPgShardPlan(PlannedStmt *plannedStmt)
+{
+	Plan *plan = plannedStmt->planTree;
+	NodeTag nodeTag = nodeTag(plan);
+	bool isPgShardPlan = ((DistributedNodeTag) nodeTag == T_DistributedPlan);
+
+	return isPgShardPlan;
+}
+
+
+/*
+ * NextExecutorStartHook simply encapsulates the common logic of calling the
+ * next executor start hook in the chain or the standard executor start hook
+ * if no other hooks are present.
+ */
+static void
+NextExecutorStartHook(QueryDesc *queryDesc, int eflags)
+{
+	/* call into the standard executor start, or hook if set */
+	if (PreviousExecutorStartHook != NULL)
+	{
+		PreviousExecutorStartHook(queryDesc, eflags);
+	}
+	else
+	{
+		standard_ExecutorStart(queryDesc, eflags);
+	}
+}
+
+
+/*
+ * CommutativityRuleToLockMode determines the commutativity rule for the given
+ * command and returns the appropriate lock mode to enforce that rule. The
+ * function assumes a SELECT doesn't modify state and therefore is commutative
+ * with all other commands. The function also assumes that an INSERT commutes
  * with another INSERT, but not with an UPDATE/DELETE; and an UPDATE/DELETE
  * doesn't commute with an INSERT, UPDATE, or DELETE.
  *
@@ -1483,51 +2005,288 @@ CompareTasksByShardId(const void *leftElement, const void *rightElement)
 
 
 /*
- * ExecuteMultipleShardSelect executes the SELECT queries in the distributed
- * plan and inserts the returned rows into the given tableId.
+ * ExecuteMultipleShardSelect executes the SELECT queries in the distributed
+ * plan and inserts the returned rows into the given tableId. If the plan has
+ * its aggregates pushed down, the rows hold partial aggregates, which are
+ * merged into the given states instead.
+ */
+static void
+ExecuteMultipleShardSelect(DistributedPlan *distributedPlan,
+						   RangeVar *intermediateTable,
+						   AggregateMergeState *mergeStateArray)
+{
+	List *taskList = distributedPlan->taskList;
+	List *targetList = distributedPlan->targetList;
+
+	/* ExecType instead of ExecCleanType so we don't ignore junk columns */
+	TupleDesc tupleStoreDescriptor = ExecTypeFromTL(targetList, false);
+	AttInMetadata *attributeInputMetadata = TupleDescGetAttInMetadata(tupleStoreDescriptor);
+	MemoryContext ioContext = AllocSetContextCreate(CurrentMemoryContext,
+													"ExecuteMultipleShardSelect",
+													ALLOCSET_DEFAULT_MINSIZE,
+													ALLOCSET_DEFAULT_INITSIZE,
+													ALLOCSET_DEFAULT_MAXSIZE);
+	int taskCount = list_length(taskList);
+	int pendingCount = taskCount;
+	ShardSelectExecution *executionArray =
+		(ShardSelectExecution *) palloc0(taskCount * sizeof(ShardSelectExecution));
+	struct pollfd *pollArray = (struct pollfd *) palloc0(taskCount * sizeof(struct pollfd));
+	ListCell *taskCell = NULL;
+	int taskIndex = 0;
+
+	DtmTwoPhaseCommit = IsTransactionBlock();
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		ShardSelectExecution *execution = &executionArray[taskIndex++];
+
+		if (UseDtmTransactions)
+		{
+			PrepareDtmTransaction(task);
+		}
+
+		execution->task = task;
+		execution->placementCell = list_head(task->taskPlacementList);
+		execution->tupleStore = tuplestore_begin_heap(false, false, work_mem);
+	}
+
+	/*
+	 * Queries still running when an error is thrown would leave the cached
+	 * connections busy, so cancel them before rethrowing. The connections are
+	 * kept since they may be enlisted in a distributed transaction.
+	 */
+	PG_TRY();
+	{
+		while (pendingCount > 0)
+		{
+			int pollCount = 0;
+
+			CHECK_FOR_INTERRUPTS();
+
+			/* send queries for the tasks whose placements' connections are idle */
+			for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+			{
+				ShardSelectExecution *execution = &executionArray[taskIndex];
+
+				if (execution->done || execution->connection != NULL)
+				{
+					continue;
+				}
+
+				SendShardSelect(execution, executionArray, taskCount);
+				if (execution->connection == NULL && execution->placementCell == NULL)
+				{
+					ereport(ERROR, (errmsg("could not receive query results")));
+				}
+			}
+
+			for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+			{
+				ShardSelectExecution *execution = &executionArray[taskIndex];
+
+				if (execution->connection != NULL)
+				{
+					pollArray[pollCount].fd = PQsocket(execution->connection);
+					pollArray[pollCount].events = POLLIN;
+					pollArray[pollCount].revents = 0;
+					pollCount++;
+				}
+			}
+
+			/*
+			 * Tasks waiting for a connection busy with another task always have
+			 * that task in the poll set, so there is something to wait for. The
+			 * timeout only bounds the delay of interrupt processing.
+			 */
+			Assert(pollCount > 0);
+			if (poll(pollArray, pollCount, 100) < 0 && errno != EINTR)
+			{
+				ereport(ERROR, (errcode_for_socket_access(),
+								errmsg("poll() failed: %m")));
+			}
+
+			/* read whatever has arrived, moving finished tasks into the table */
+			for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+			{
+				ShardSelectExecution *execution = &executionArray[taskIndex];
+
+				if (execution->connection == NULL)
+				{
+					continue;
+				}
+
+				if (ReceiveShardSelectResults(execution, attributeInputMetadata, ioContext))
+				{
+					if (mergeStateArray != NULL)
+					{
+						MergeTupleStore(execution->tupleStore, tupleStoreDescriptor,
+										mergeStateArray,
+										list_length(distributedPlan->aggregateMergeList));
+					}
+					else
+					{
+						TupleStoreToTable(intermediateTable, targetList,
+										  tupleStoreDescriptor, execution->tupleStore);
+					}
+					tuplestore_end(execution->tupleStore);
+					execution->tupleStore = NULL;
+					execution->done = true;
+					pendingCount--;
+				}
+			}
+		}
+	}
+	PG_CATCH();
+	{
+		for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+		{
+			if (executionArray[taskIndex].connection != NULL)
+			{
+				CancelRemoteQuery(executionArray[taskIndex].connection);
+			}
+		}
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	MemoryContextDelete(ioContext);
+	pfree(pollArray);
+	pfree(executionArray);
+}
+
+
+/*
+ * SendShardSelect sends the task's query to the first of its remaining
+ * placements that can take it. Placements that cannot be connected to or
+ * fail to accept the query are skipped. If the connection to the placement
+ * is busy executing another task, the function leaves the task unsent, to be
+ * retried once that connection becomes idle.
+ */
+static void
+SendShardSelect(ShardSelectExecution *execution, ShardSelectExecution *executionArray,
+				int taskCount)
+{
+	while (execution->placementCell != NULL)
+	{
+		ShardPlacement *taskPlacement =
+			(ShardPlacement *) lfirst(execution->placementCell);
+		PGconn *connection = GetConnection(taskPlacement->nodeName,
+										   taskPlacement->nodePort,
+										   !UseDtmTransactions);
+		int taskIndex = 0;
+
+		if (connection == NULL)
+		{
+			execution->placementCell = lnext(execution->placementCell);
+			continue;
+		}
+
+		for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+		{
+			if (executionArray[taskIndex].connection == connection)
+			{
+				return;
+			}
+		}
+
+		if (!SendQueryInSingleRowMode(connection, execution->task->queryString, NULL))
+		{
+			PurgeConnection(connection);
+			execution->placementCell = lnext(execution->placementCell);
+			continue;
+		}
+
+		execution->connection = connection;
+		return;
+	}
+}
+
+
+/*
+ * ReceiveShardSelectResults consumes the input available on the task's
+ * connection without blocking and stores the received rows in the task's
+ * tuplestore. It returns true once the task has completed. If the query
+ * fails, the rows received so far are discarded and the task is set up to
+ * be retried on its next placement.
+ */
+static bool
+ReceiveShardSelectResults(ShardSelectExecution *execution,
+						  AttInMetadata *attributeInputMetadata, MemoryContext ioContext)
+{
+	PGconn *connection = execution->connection;
+
+	if (PQconsumeInput(connection) == 0)
+	{
+		ReportRemoteError(connection, NULL);
+		FailShardSelect(execution);
+		return false;
+	}
+
+	while (PQisBusy(connection) == 0)
+	{
+		ExecStatusType resultStatus = 0;
+		PGresult *result = PQgetResult(connection);
+
+		if (result == NULL)
+		{
+			execution->connection = NULL;
+			return true;
+		}
+
+		resultStatus = PQresultStatus(result);
+		if ((resultStatus != PGRES_SINGLE_TUPLE) && (resultStatus != PGRES_TUPLES_OK))
+		{
+			ReportRemoteError(connection, result);
+			PQclear(result);
+			FailShardSelect(execution);
+			return false;
+		}
+
+		StoreResultTuples(result, attributeInputMetadata, execution->tupleStore,
+						  ioContext);
+		PQclear(result);
+	}
+
+	return false;
+}
+
+
+/*
+ * CancelRemoteQuery cancels the query running on the connection and discards
+ * its remaining results, so that the connection can be used again.
  */
 static void
-ExecuteMultipleShardSelect(DistributedPlan *distributedPlan,
-						   RangeVar *intermediateTable)
+CancelRemoteQuery(PGconn *connection)
 {
-	List *taskList = distributedPlan->taskList;
-	List *targetList = distributedPlan->targetList;
-
-	/* ExecType instead of ExecCleanType so we don't ignore junk columns */
-	TupleDesc tupleStoreDescriptor = ExecTypeFromTL(targetList, false);
-
-	ListCell *taskCell = NULL;
-
-	DtmTwoPhaseCommit = IsTransactionBlock();
+	char errorBuffer[256];
+	PGcancel *cancel = PQgetCancel(connection);
+	PGresult *result = NULL;
 
-	foreach(taskCell, taskList)
+	if (cancel != NULL)
 	{
-		Task *task = (Task *) lfirst(taskCell);
-		Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
-		bool resultsOK = false;
-
-		if (UseDtmTransactions)
-		{
-			PrepareDtmTransaction(task);
-		}
+		PQcancel(cancel, errorBuffer, sizeof(errorBuffer));
+		PQfreeCancel(cancel);
+	}
 
-		resultsOK = ExecuteTaskAndStoreResults(task, tupleStoreDescriptor, tupleStore);
-		if (!resultsOK)
-		{
-			ereport(ERROR, (errmsg("could not receive query results")));
-		}
+	while ((result = PQgetResult(connection)) != NULL)
+	{
+		PQclear(result);
+	}
+}
 
-		/*
-		 * We successfully fetched data into local tuplestore. Now move results from
-		 * the tupleStore into the table.
-		 */
-		Assert(tupleStore != NULL);
-		TupleStoreToTable(intermediateTable, targetList, tupleStoreDescriptor,
-						  tupleStore);
 
-		tuplestore_end(tupleStore);
-	}
-	
+/*
+ * FailShardSelect drops the connection the task has failed on and makes the
+ * task start over on its next placement.
+ */
+static void
+FailShardSelect(ShardSelectExecution *execution)
+{
+	PurgeConnection(execution->connection);
+	execution->connection = NULL;
+	execution->placementCell = lnext(execution->placementCell);
+	tuplestore_clear(execution->tupleStore);
 }
 
 
@@ -1539,6 +2298,19 @@ ExecuteMultipleShardSelect(DistributedPlan *distributedPlan,
 bool
 ExecuteTaskAndStoreResults(Task *task, TupleDesc tupleDescriptor,
 						   Tuplestorestate *tupleStore)
+{
+	return ExecuteTaskWithParamsAndStoreResults(task, NULL, tupleDescriptor, tupleStore);
+}
+
+
+/*
+ * ExecuteTaskWithParamsAndStoreResults executes the task like the function
+ * above, sending the given parameter values along with the task's query.
+ */
+static bool
+ExecuteTaskWithParamsAndStoreResults(Task *task, ParamListInfo boundParams,
+									 TupleDesc tupleDescriptor,
+									 Tuplestorestate *tupleStore)
 {
 	bool resultsOK = false;
 	List *taskPlacementList = task->taskPlacementList;
@@ -1562,7 +2334,7 @@ ExecuteTaskAndStoreResults(Task *task, TupleDesc tupleDescriptor,
 			continue;
 		}
 
-		queryOK = SendQueryInSingleRowMode(connection, task->queryString);
+		queryOK = SendQueryInSingleRowMode(connection, task->queryString, boundParams);
 		if (!queryOK)
 		{
 			PurgeConnection(connection);
@@ -1588,16 +2360,33 @@ ExecuteTaskAndStoreResults(Task *task, TupleDesc tupleDescriptor,
 
 /*
  * SendQueryInSingleRowMode sends the given query on the connection in an
- * asynchronous way. The function also sets the single-row mode on the
- * connection so that we receive results a row at a time.
+ * asynchronous way, along with the values of its parameters if there are any.
+ * The function also sets the single-row mode on the connection so that we
+ * receive results a row at a time.
  */
 static bool
-SendQueryInSingleRowMode(PGconn *connection, StringInfo query)
+SendQueryInSingleRowMode(PGconn *connection, StringInfo query,
+						 ParamListInfo boundParams)
 {
 	int querySent = 0;
 	int singleRowMode = 0;
 
-	querySent = PQsendQuery(connection, query->data);
+	if (boundParams != NULL && boundParams->numParams > 0)
+	{
+		int parameterCount = boundParams->numParams;
+		Oid *parameterTypes = NULL;
+		const char **parameterValues = NULL;
+
+		ExtractRemoteParameters(boundParams, &parameterTypes, &parameterValues);
+
+		querySent = PQsendQueryParams(connection, query->data, parameterCount,
+									  parameterTypes, parameterValues, NULL, NULL, 0);
+	}
+	else
+	{
+		querySent = PQsendQuery(connection, query->data);
+	}
+
 	if (querySent == 0)
 	{
 		ReportRemoteError(connection, NULL);
@@ -1615,6 +2404,53 @@ SendQueryInSingleRowMode(PGconn *connection, StringInfo query)
 }
 
 
+/*
+ * ExtractRemoteParameters converts the given parameter values to the text form
+ * libpq sends to remote nodes. Built-in types are sent along with the values;
+ * the remote nodes infer all other types, as their type ids may differ from
+ * the local ones.
+ */
+static void
+ExtractRemoteParameters(ParamListInfo boundParams, Oid **parameterTypes,
+						const char ***parameterValues)
+{
+	int parameterCount = boundParams->numParams;
+	int parameterIndex = 0;
+
+	*parameterTypes = (Oid *) palloc0(parameterCount * sizeof(Oid));
+	*parameterValues = (const char **) palloc0(parameterCount * sizeof(char *));
+
+	for (parameterIndex = 0; parameterIndex < parameterCount; parameterIndex++)
+	{
+		ParamExternData *parameterData = &boundParams->params[parameterIndex];
+		Oid typeOutputFunctionId = InvalidOid;
+		bool variableLengthType = false;
+
+		/* give hook a chance in case the parameter is dynamic */
+		if (!OidIsValid(parameterData->ptype) && boundParams->paramFetch != NULL)
+		{
+			(*boundParams->paramFetch) (boundParams, parameterIndex + 1);
+		}
+
+		if (parameterData->ptype < FirstNormalObjectId)
+		{
+			(*parameterTypes)[parameterIndex] = parameterData->ptype;
+		}
+
+		if (parameterData->isnull || !OidIsValid(parameterData->ptype))
+		{
+			(*parameterValues)[parameterIndex] = NULL;
+			continue;
+		}
+
+		getTypeOutputInfo(parameterData->ptype, &typeOutputFunctionId,
+						  &variableLengthType);
+		(*parameterValues)[parameterIndex] = OidOutputFunctionCall(typeOutputFunctionId,
+																   parameterData->value);
+	}
+}
+
+
 /*
  * StoreQueryResult gets the query results from the given connection, builds
  * tuples from the results and stores them in the given tuple-store. If the
@@ -1627,8 +2463,6 @@ StoreQueryResult(PGconn *connection, TupleDesc tupleDescriptor,
 				 Tuplestorestate *tupleStore)
 {
 	AttInMetadata *attributeInputMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
-	uint32 expectedColumnCount = tupleDescriptor->natts;
-	char **columnArray = (char **) palloc0(expectedColumnCount * sizeof(char *));
 	MemoryContext ioContext = AllocSetContextCreate(CurrentMemoryContext,
 													"StoreQueryResult",
 													ALLOCSET_DEFAULT_MINSIZE,
@@ -1639,10 +2473,6 @@ StoreQueryResult(PGconn *connection, TupleDesc tupleDescriptor,
 
 	for (;;)
 	{
-		uint32 rowIndex = 0;
-		uint32 columnIndex = 0;
-		uint32 rowCount = 0;
-		uint32 columnCount = 0;
 		ExecStatusType resultStatus = 0;
 
 		PGresult *result = PQgetResult(connection);
@@ -1660,49 +2490,100 @@ StoreQueryResult(PGconn *connection, TupleDesc tupleDescriptor,
 			return false;
 		}
 
-		rowCount = PQntuples(result);
-		columnCount = PQnfields(result);
-		Assert(columnCount == expectedColumnCount);
+		StoreResultTuples(result, attributeInputMetadata, tupleStore, ioContext);
 
-		for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
-		{
-			HeapTuple heapTuple = NULL;
-			MemoryContext oldContext = NULL;
-			memset(columnArray, 0, columnCount * sizeof(char *));
+		PQclear(result);
+	}
 
-			for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
-			{
-				if (PQgetisnull(result, rowIndex, columnIndex))
-				{
-					columnArray[columnIndex] = NULL;
-				}
-				else
-				{
-					columnArray[columnIndex] = PQgetvalue(result, rowIndex, columnIndex);
-				}
-			}
+	return true;
+}
 
-			/*
-			 * Switch to a temporary memory context that we reset after each tuple. This
-			 * protects us from any memory leaks that might be present in I/O functions
-			 * called by BuildTupleFromCStrings.
-			 */
-			oldContext = MemoryContextSwitchTo(ioContext);
 
-			heapTuple = BuildTupleFromCStrings(attributeInputMetadata, columnArray);
+/*
+ * StoreResultTuples builds tuples from the rows of the given result and
+ * stores them in the given tuple-store. The I/O functions are called in the
+ * given memory context, which is reset after each tuple.
+ */
+static void
+StoreResultTuples(PGresult *result, AttInMetadata *attributeInputMetadata,
+				  Tuplestorestate *tupleStore, MemoryContext ioContext)
+{
+	uint32 rowIndex = 0;
+	uint32 columnIndex = 0;
+	uint32 rowCount = PQntuples(result);
+	uint32 columnCount = PQnfields(result);
+	char **columnArray = NULL;
+
+	Assert(columnCount == (uint32) attributeInputMetadata->tupdesc->natts);
+
+	if (rowCount == 0)
+	{
+		return;
+	}
+
+	columnArray = (char **) palloc0(columnCount * sizeof(char *));
 
-			MemoryContextSwitchTo(oldContext);
+	for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		HeapTuple heapTuple = NULL;
+		MemoryContext oldContext = NULL;
+		memset(columnArray, 0, columnCount * sizeof(char *));
 
-			tuplestore_puttuple(tupleStore, heapTuple);
-			MemoryContextReset(ioContext);
+		for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			if (PQgetisnull(result, rowIndex, columnIndex))
+			{
+				columnArray[columnIndex] = NULL;
+			}
+			else
+			{
+				columnArray[columnIndex] = PQgetvalue(result, rowIndex, columnIndex);
+			}
 		}
 
-		PQclear(result);
+		/*
+		 * Switch to a temporary memory context that we reset after each tuple. This
+		 * protects us from any memory leaks that might be present in I/O functions
+		 * called by BuildTupleFromCStrings.
+		 */
+		oldContext = MemoryContextSwitchTo(ioContext);
+
+		heapTuple = BuildTupleFromCStrings(attributeInputMetadata, columnArray);
+
+		MemoryContextSwitchTo(oldContext);
+
+		tuplestore_puttuple(tupleStore, heapTuple);
+		MemoryContextReset(ioContext);
 	}
 
 	pfree(columnArray);
+}
 
-	return true;
+
+/*
+ * MergeTupleStore merges the partial aggregates held by the tuples in the
+ * given tupleStore into the running aggregate results.
+ */
+static void
+MergeTupleStore(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor,
+				AggregateMergeState *mergeStateArray, int mergeStateCount)
+{
+	TupleTableSlot *tupleTableSlot = MakeSingleTupleTableSlot(tupleDescriptor);
+
+	for (;;)
+	{
+		bool nextTuple = tuplestore_gettupleslot(tupleStore, true, false, tupleTableSlot);
+		if (!nextTuple)
+		{
+			break;
+		}
+
+		MergePartialAggregates(mergeStateArray, mergeStateCount, tupleTableSlot);
+
+		ExecClearTuple(tupleTableSlot);
+	}
+
+	ExecDropSingleTupleTableSlot(tupleTableSlot);
 }
 
 
@@ -1809,6 +2690,7 @@ PgShardExecutorRun(QueryDesc *queryDesc, ScanDirection direction, long count)
 		EState *estate = queryDesc->estate;
 		CmdType operation = queryDesc->operation;
 		DistributedPlan *plan = (DistributedPlan *) plannedStatement->planTree;
+		ParamListInfo remoteParams = NULL;
 		MemoryContext oldcontext = NULL;
 
 		Assert(estate != NULL);
@@ -1828,6 +2710,12 @@ PgShardExecutorRun(QueryDesc *queryDesc, ScanDirection direction, long count)
 								   "is unsupported")));
 		}
 
+		/* only queries of parameterized plans reference the parameters */
+		if (plan->routingClause != NULL)
+		{
+			remoteParams = queryDesc->params;
+		}
+
 		oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
 
 		if (queryDesc->totaltime != NULL)
@@ -1838,16 +2726,25 @@ PgShardExecutorRun(QueryDesc *queryDesc, ScanDirection direction, long count)
 		if (operation == CMD_INSERT || operation == CMD_UPDATE ||
 			operation == CMD_DELETE)
 		{
-			int32 affectedRowCount = ExecuteDistributedModify(plan);
+			int32 affectedRowCount = ExecuteDistributedModify(plan, remoteParams);
 			estate->es_processed = affectedRowCount;
 		}
+		else if (operation == CMD_SELECT && plan->aggregateMergeList != NIL)
+		{
+			DestReceiver *destination = queryDesc->dest;
+			List *targetList = plan->originalPlan->targetlist;
+			TupleDesc tupleDescriptor = ExecCleanTypeFromTL(targetList, false);
+
+			ExecuteMultipleShardAggregate(plan, estate, tupleDescriptor, destination);
+		}
 		else if (operation == CMD_SELECT)
 		{
 			DestReceiver *destination = queryDesc->dest;
 			List *targetList = plan->targetList;
 			TupleDesc tupleDescriptor = ExecCleanTypeFromTL(targetList, false);
 
-			ExecuteSingleShardSelect(plan, estate, tupleDescriptor, destination);
+			ExecuteSingleShardSelect(plan, remoteParams, estate, tupleDescriptor,
+									 destination);
 		}
 		else
 		{
@@ -1885,7 +2782,7 @@ PgShardExecutorRun(QueryDesc *queryDesc, ScanDirection direction, long count)
  * also generate warnings for individual placement failures.
  */
 static int32
-ExecuteDistributedModify(DistributedPlan *plan)
+ExecuteDistributedModify(DistributedPlan *plan, ParamListInfo boundParams)
 {
 	int32 affectedTupleCount = -1;
 	Task *task = (Task *) linitial(plan->taskList);
@@ -1926,7 +2823,22 @@ ExecuteDistributedModify(DistributedPlan *plan)
 			continue;
 		}
 
-		result = PQexec(connection, task->queryString->data);
+		if (boundParams != NULL && boundParams->numParams > 0)
+		{
+			int parameterCount = boundParams->numParams;
+			Oid *parameterTypes = NULL;
+			const char **parameterValues = NULL;
+
+			ExtractRemoteParameters(boundParams, &parameterTypes, &parameterValues);
+
+			result = PQexecParams(connection, task->queryString->data, parameterCount,
+								  parameterTypes, parameterValues, NULL, NULL, 0);
+		}
+		else
+		{
+			result = PQexec(connection, task->queryString->data);
+		}
+
 		if (PQresultStatus(result) != PGRES_COMMAND_OK)
 		{
 			ReportRemoteError(connection, result);
@@ -1977,7 +2889,10 @@ ExecuteDistributedModify(DistributedPlan *plan)
 
 /*
  * PrepareDtmTransaction sends the necessary commands to the nodes to perform
- * a global transaction.
+ * a global transaction. Nodes joining the transaction get BEGIN and the dtm_*
+ * call in a single query string, and all nodes but the one that assigns the
+ * global transaction id are joined concurrently, so that a transaction costs
+ * two round trips at most regardless of the number of shards it touches.
  */
 static void
 PrepareDtmTransaction(Task *task)
@@ -1985,6 +2900,7 @@ PrepareDtmTransaction(Task *task)
 	MemoryContext oldContext = NULL;
 	ListCell *taskPlacementCell = NULL;
 	bool abortTransaction = false;
+	List *newConnections = NIL;
 	List *newTransactions = NIL;
 
 	oldContext = MemoryContextSwitchTo(TopTransactionContext);
@@ -2005,44 +2921,44 @@ PrepareDtmTransaction(Task *task)
 			continue;
 		}
 
-		if (list_member_ptr(connectionsWithDtmTransactions, connection))
+		if (list_member_ptr(connectionsWithDtmTransactions, connection) ||
+			list_member_ptr(newConnections, connection))
 		{
 			/* already started a transaction */
 			continue;
 		}
-		if (!SendCommand(connection, "BEGIN"))
+
+		newConnections = lappend(newConnections, connection);
+	}
+
+	if (!abortTransaction && newConnections != NIL && !currentGlobalTransactionId)
+	{
+		/* the first node assigns the id the rest of the nodes have to join */
+		PGconn *connection = (PGconn *) linitial(newConnections);
+
+		currentGlobalTransactionId = SendDtmBeginTransaction(connection);
+		if (!currentGlobalTransactionId)
 		{
+			ereport(WARNING, (errmsg("failed to parse remoteTransactionId result on %s:%s",
+									 PQhost(connection), PQport(connection))));
 			PurgeConnection(connection);
 			abortTransaction = true;
-			continue;
-		}
-		if (!currentGlobalTransactionId)
-		{
-			/* Send dtm_begin_transaction to the first node */
-			currentGlobalTransactionId = SendDtmBeginTransaction(connection);
-			if (!currentGlobalTransactionId)
-			{
-				ereport(WARNING, (errmsg("failed to parse remoteTransactionId result on %s:%d",
-										 nodeName, nodePort)));
-				abortTransaction = true;
-				continue;
-			}
-			TRACE("shard_xtm: conn#%p: Sent dtm_begin() to %s:%u -> %llu\n",
-					 connection, nodeName, nodePort, currentGlobalTransactionId);
 		}
 		else
 		{
-			/* Send dtm_join_transaction to the rest of the nodes */
-			if (!SendDtmJoinTransaction(connection, currentGlobalTransactionId))
-			{
-				abortTransaction = true;
-				continue;
-			}
-			TRACE("shard_xtm: conn#%p: Sent dtm_access(%llu) to %s:%u\n",
-					 connection, currentGlobalTransactionId, nodeName, nodePort);
+			TRACE("shard_xtm: conn#%p: Sent dtm_begin() to %s:%s -> %llu\n",
+				  connection, PQhost(connection), PQport(connection),
+				  currentGlobalTransactionId);
+			newTransactions = lappend(newTransactions, connection);
 		}
+		newConnections = list_delete_first(newConnections);
+	}
 
-		newTransactions = lappend(newTransactions, connection);
+	if (!abortTransaction && newConnections != NIL)
+	{
+		abortTransaction = !SendDtmJoinTransaction(newConnections,
+												   currentGlobalTransactionId,
+												   &newTransactions);
 	}
 
 	if (abortTransaction)
@@ -2050,7 +2966,8 @@ PrepareDtmTransaction(Task *task)
 		MemoryContextSwitchTo(oldContext);
 
 		/* make sure we abort all pending transactions */
-		connectionsWithDtmTransactions = newTransactions;
+		connectionsWithDtmTransactions = list_union_ptr(connectionsWithDtmTransactions,
+														newTransactions);
 		
 		/*
 		 * Since pg_shard reuses connections across transactions on the master,
@@ -2060,21 +2977,11 @@ PrepareDtmTransaction(Task *task)
 		ereport(ERROR, (errmsg("aborting distributed transaction due to failures")));
 	}
 
-	connectionsWithDtmTransactions = list_union(connectionsWithDtmTransactions,
-												newTransactions);
+	connectionsWithDtmTransactions = list_union_ptr(connectionsWithDtmTransactions,
+												    newTransactions);
 
 	MemoryContextSwitchTo(oldContext);
 
-	if (abortTransaction)
-	{
-		/*
-		 * Since pg_shard reuses connections across transactions on the master,
-		 * we need to abort pending transactions on the workers.
-		 */
-		FinishDtmTransaction(XACT_EVENT_ABORT, NULL);
-		ereport(ERROR, (errmsg("aborting distributed transaction due to failures")));
-	}
-
 	if (!commitCallbackSet)
 	{
 		RegisterXactCallback(FinishDtmTransaction, NULL);
@@ -2092,8 +2999,8 @@ SendDtmBeginTransaction(PGconn *connection)
 
 	
 	result = DtmTwoPhaseCommit
-		? PQexec(connection, psprintf("SELECT dtm_extend('%d.%d')", MyProcPid, ++currentLocalTransactionId))
-		: PQexec(connection, "SELECT dtm_extend()");
+		? PQexec(connection, psprintf("BEGIN; SELECT dtm_extend('%d.%d')", MyProcPid, ++currentLocalTransactionId))
+		: PQexec(connection, "BEGIN; SELECT dtm_extend()");
 	if (PQresultStatus(result) != PGRES_TUPLES_OK)
 	{
 		ReportRemoteError(connection, result);
@@ -2114,45 +3021,93 @@ SendDtmBeginTransaction(PGconn *connection)
 }
 
 
+/*
+ * SendDtmJoinTransaction starts a transaction on each of the given connections
+ * and joins it to the global one. The commands are sent to all connections
+ * before waiting for any reply. Connections that joined successfully are
+ * appended to joinedList, the failed ones are purged.
+ */
 static bool
-SendDtmJoinTransaction(PGconn *connection, csn_t TransactionId)
+SendDtmJoinTransaction(List *connectionList, csn_t TransactionId, List **joinedList)
 {
-	PGresult *result = NULL;
-	bool resultOK = true;
+	char *sql = DtmTwoPhaseCommit
+		? psprintf("BEGIN; SELECT dtm_access(%llu, '%d.%d')", TransactionId, MyProcPid, currentLocalTransactionId)
+		: psprintf("BEGIN; SELECT dtm_access(%llu)", TransactionId);
+	List *sentList = NIL;
+	ListCell *connectionCell = NULL;
+	bool allOk = true;
 
-	result = PQexec(connection, DtmTwoPhaseCommit
-					? psprintf("SELECT dtm_access(%llu, '%d.%d')", TransactionId, MyProcPid, currentLocalTransactionId)
-					: psprintf("SELECT dtm_access(%llu)", TransactionId));
-	if (PQresultStatus(result) != PGRES_TUPLES_OK)
+	foreach(connectionCell, connectionList)
 	{
-		ReportRemoteError(connection, result);
-		resultOK = false;
+		PGconn *connection = (PGconn *) lfirst(connectionCell);
+
+		if (!PQsendQuery(connection, sql))
+		{
+			ReportRemoteError(connection, NULL);
+			PurgeConnection(connection);
+			allOk = false;
+			continue;
+		}
+		sentList = lappend(sentList, connection);
 	}
 
-	PQclear(result);
+	foreach(connectionCell, sentList)
+	{
+		PGconn *connection = (PGconn *) lfirst(connectionCell);
+		PGresult *result = GetFinalResult(connection);
+
+		if (PQresultStatus(result) != PGRES_TUPLES_OK)
+		{
+			ReportRemoteError(connection, result);
+			PQclear(result);
+			PurgeConnection(connection);
+			allOk = false;
+			continue;
+		}
+		PQclear(result);
+
+		TRACE("shard_xtm: conn#%p: Sent dtm_access(%llu) to %s:%s\n",
+			  connection, TransactionId, PQhost(connection), PQport(connection));
+		*joinedList = lappend(*joinedList, connection);
+	}
+
+	list_free(sentList);
 
-	return resultOK;
+	return allOk;
 }
 
 
-static bool
-SendCommand(PGconn *connection, char *command)
+/*
+ * GetFinalResult reads all results of the query sent on the connection. It
+ * returns the first failed result if there is one, the last result otherwise,
+ * so that several commands sent in one query string act like a single one.
+ */
+static PGresult *
+GetFinalResult(PGconn *connection)
 {
+	PGresult *finalResult = NULL;
 	PGresult *result = NULL;
-	bool resultOK = true;
 
-	result = PQexec(connection, command);
-	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+	while ((result = PQgetResult(connection)) != NULL)
 	{
-		ReportRemoteError(connection, result);
-		resultOK = false;
-	}
+		ExecStatusType finalStatus = PQresultStatus(finalResult);
 
-	PQclear(result);
+		if (finalResult == NULL || finalStatus == PGRES_COMMAND_OK ||
+			finalStatus == PGRES_TUPLES_OK)
+		{
+			PQclear(finalResult);
+			finalResult = result;
+		}
+		else
+		{
+			PQclear(result);
+		}
+	}
 
-	return resultOK;
+	return finalResult;
 }
 
+
 typedef bool (*DtmCommandResultHandler)(PGresult *result, void* arg);
 
 static bool RunDtmStatement(char const* sql, unsigned expectedStatus, DtmCommandResultHandler handler, void* arg)
@@ -2184,14 +3139,13 @@ static bool RunDtmStatement(char const* sql, unsigned expectedStatus, DtmCommand
 	foreach(connectionCell, connectionsWithDtmTransactions)
 	{
 		connection = (PGconn *) lfirst(connectionCell);
-		result = PQgetResult(connection);
+		result = GetFinalResult(connection);
 		if (PQresultStatus(result) != expectedStatus || (handler && !handler(result, arg)))
 		{
 			ReportRemoteError(connection, result);
 			allOk = false;
 		}
 		PQclear(result);
-		PQgetResult(connection); /* consume NULL result */
 	}	
 	return allOk;
 }
@@ -2236,12 +3190,18 @@ FinishDtmTransaction(XactEvent event, void * arg)
 			{
 				csn_t maxCSN = 0;
 				
-				if (!RunDtmCommand(psprintf("PREPARE TRANSACTION '%d.%d'", 
-											MyProcPid, currentLocalTransactionId)) ||
-					!RunDtmFunction(psprintf("SELECT dtm_begin_prepare('%d.%d')", 
-											 MyProcPid, currentLocalTransactionId)) ||
-					!RunDtmStatement(psprintf("SELECT dtm_prepare('%d.%d',0)", 
-											  MyProcPid, currentLocalTransactionId), PGRES_TUPLES_OK, DtmMaxCSN, &maxCSN) ||
+				/*
+				 * Preparing, marking the transaction as being prepared and
+				 * taking the local CSN only depend on the node itself, so
+				 * they go in one round trip.
+				 */
+				if (!RunDtmStatement(psprintf("PREPARE TRANSACTION '%d.%d';"
+											  "SELECT dtm_begin_prepare('%d.%d');"
+											  "SELECT dtm_prepare('%d.%d',0)",
+											  MyProcPid, currentLocalTransactionId,
+											  MyProcPid, currentLocalTransactionId,
+											  MyProcPid, currentLocalTransactionId),
+									 PGRES_TUPLES_OK, DtmMaxCSN, &maxCSN) ||
 					!RunDtmFunction(psprintf("SELECT dtm_end_prepare('%d.%d',%lld)", 
 											 MyProcPid, currentLocalTransactionId, maxCSN)) ||
 					!RunDtmCommand(psprintf("COMMIT PREPARED '%d.%d'", 
@@ -2275,8 +3235,9 @@ FinishDtmTransaction(XactEvent event, void * arg)
  * given placement, the function attempts it on its replica.
  */
 static void
-ExecuteSingleShardSelect(DistributedPlan *distributedPlan, EState *executorState,
-						 TupleDesc tupleDescriptor, DestReceiver *destination)
+ExecuteSingleShardSelect(DistributedPlan *distributedPlan, ParamListInfo boundParams,
+						 EState *executorState, TupleDesc tupleDescriptor,
+						 DestReceiver *destination)
 {
 	Task *task = NULL;
 	Tuplestorestate *tupleStore = NULL;
@@ -2289,7 +3250,8 @@ ExecuteSingleShardSelect(DistributedPlan *distributedPlan, EState *executorState
 	task = (Task *) linitial(taskList);
 	tupleStore = tuplestore_begin_heap(false, false, work_mem);
 
-	resultsOK = ExecuteTaskAndStoreResults(task, tupleDescriptor, tupleStore);
+	resultsOK = ExecuteTaskWithParamsAndStoreResults(task, boundParams, tupleDescriptor,
+													 tupleStore);
 	if (!resultsOK)
 	{
 		ereport(ERROR, (errmsg("could not receive query results")));
@@ -2324,6 +3286,45 @@ ExecuteSingleShardSelect(DistributedPlan *distributedPlan, EState *executorState
 }
 
 
+/*
+ * ExecuteMultipleShardAggregate executes the partial aggregate queries of the
+ * distributed plan on all shards concurrently, merges their results as they
+ * arrive and sends the single resulting tuple to the given destination.
+ */
+static void
+ExecuteMultipleShardAggregate(DistributedPlan *distributedPlan, EState *executorState,
+							  TupleDesc tupleDescriptor, DestReceiver *destination)
+{
+	List *aggregateMergeList = distributedPlan->aggregateMergeList;
+	int mergeStateCount = list_length(aggregateMergeList);
+	AggregateMergeState *mergeStateArray = BeginAggregateMerge(aggregateMergeList);
+	Datum *values = (Datum *) palloc0(mergeStateCount * sizeof(Datum));
+	bool *nulls = (bool *) palloc0(mergeStateCount * sizeof(bool));
+	TupleTableSlot *tupleTableSlot = NULL;
+	HeapTuple heapTuple = NULL;
+
+	Assert(tupleDescriptor->natts == mergeStateCount);
+
+	ExecuteMultipleShardSelect(distributedPlan, NULL, mergeStateArray);
+
+	FinalizeAggregates(mergeStateArray, mergeStateCount, values, nulls);
+	heapTuple = heap_form_tuple(tupleDescriptor, values, nulls);
+
+	tupleTableSlot = MakeSingleTupleTableSlot(tupleDescriptor);
+	ExecStoreTuple(heapTuple, tupleTableSlot, InvalidBuffer, false);
+
+	(*destination->rStartup)(destination, CMD_SELECT, tupleDescriptor);
+
+	(*destination->receiveSlot)(tupleTableSlot, destination);
+	executorState->es_processed++;
+
+	(*destination->rShutdown)(destination);
+
+	ExecDropSingleTupleTableSlot(tupleTableSlot);
+	heap_freetuple(heapTuple);
+}
+
+
 /*
  * PgShardExecutorFinish cleans up after a distributed execution, if any, has
  * executed.
@@ -2394,7 +3395,8 @@ PgShardExecutorEnd(QueryDesc *queryDesc)
 
 /*
  * PgShardProcessUtility intercepts utility statements and errors out for
- * unsupported utility statements on distributed tables.
+ * unsupported utility statements on distributed tables. It also executes
+ * prepared statements on distributed tables, and tracks their deallocation.
  */
 static void
 PgShardProcessUtility(Node *parsetree, const char *queryString,
@@ -2418,48 +3420,29 @@ PgShardProcessUtility(Node *parsetree, const char *queryString,
 			}
 		}
 	}
-	else if (statementType == T_PrepareStmt)
+	else if (statementType == T_ExecuteStmt)
 	{
-		PrepareStmt *prepareStatement = (PrepareStmt *) parsetree;
-		Query *parsedQuery = NULL;
-		Node *rawQuery = copyObject(prepareStatement->query);
-		int argumentCount = list_length(prepareStatement->argtypes);
-		Oid *argumentTypeArray = NULL;
-		PlannerType plannerType = PLANNER_INVALID_FIRST;
-
-		/* transform list of TypeNames to array of type OID's if they exist */
-		if (argumentCount > 0)
+		/* prepared statements on distributed tables are executed by pg_shard */
+		ExecuteStmt *executeStatement = (ExecuteStmt *) parsetree;
+		bool statementExecuted = ExecutePreparedDistributedStatement(executeStatement,
+																	 queryString, params,
+																	 dest, completionTag);
+		if (statementExecuted)
 		{
-			List *argumentTypeList = prepareStatement->argtypes;
-			ListCell *argumentTypeCell = NULL;
-			uint32 argumentTypeIndex = 0;
-
-			ParseState *parseState = make_parsestate(NULL);
-			parseState->p_sourcetext = queryString;
-
-			argumentTypeArray = (Oid *) palloc0(argumentCount * sizeof(Oid));
-
-			foreach(argumentTypeCell, argumentTypeList)
-			{
-				TypeName *typeName = lfirst(argumentTypeCell);
-				Oid typeId = typenameTypeId(parseState, typeName);
-
-				argumentTypeArray[argumentTypeIndex] = typeId;
-				argumentTypeIndex++;
-			}
+			return;
 		}
-
-		/* analyze the statement using these parameter types */
-		parsedQuery = parse_analyze_varparams(rawQuery, queryString,
-											  &argumentTypeArray, &argumentCount);
-
-		/* determine if the query runs on a distributed table */
-		plannerType = DeterminePlannerType(parsedQuery);
-		if (plannerType == PLANNER_TYPE_PG_SHARD)
+	}
+	else if (statementType == T_DeallocateStmt)
+	{
+		DeallocateStmt *deallocateStatement = (DeallocateStmt *) parsetree;
+		DropPreparedDistributedStatement(deallocateStatement->name);
+	}
+	else if (statementType == T_DiscardStmt)
+	{
+		DiscardStmt *discardStatement = (DiscardStmt *) parsetree;
+		if (discardStatement->target == DISCARD_ALL)
 		{
-			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-							errmsg("PREPARE commands on distributed tables "
-								   "are unsupported")));
+			DropPreparedDistributedStatement(NULL);
 		}
 	}
 	else if (statementType == T_CopyStmt)
@@ -0,0 +1,592 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/plan_cache.c
+ *
+ * This file contains functions to execute prepared statements on distributed
+ * tables. PostgreSQL's plan cache copies the plans it keeps, which it cannot do
+ * for distributed plans, so pg_shard executes these statements itself. If the
+ * parameters of a statement only determine the shard the statement runs on,
+ * the distributed plan is built once and routed to a shard on each execution.
+ * Other statements are planned on each execution, with their parameter values
+ * known to the planner.
+ *
+ * Copyright (c) 2014-2015, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "c.h"
+#include "miscadmin.h"
+
+#include "pg_shard.h"
+#include "plan_cache.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "commands/prepare.h"
+#include "executor/execdesc.h"
+#include "executor/executor.h"
+#include "nodes/execnodes.h"
+#include "nodes/memnodes.h" /* IWYU pragma: keep */
+#include "nodes/nodeFuncs.h"
+#include "nodes/nodes.h"
+#include "nodes/params.h"
+#include "nodes/parsenodes.h"
+#include "nodes/pg_list.h"
+#include "nodes/plannodes.h"
+#include "optimizer/planner.h"
+#include "parser/parse_coerce.h"
+#include "parser/parse_collate.h"
+#include "parser/parse_expr.h"
+#include "parser/parse_node.h"
+#include "parser/parsetree.h"
+#include "storage/lmgr.h"
+#include "storage/lock.h"
+#include "tcop/dest.h"
+#include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/elog.h"
+#include "utils/errcodes.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/palloc.h"
+#include "utils/plancache.h"
+#include "utils/snapmgr.h"
+
+
+/*
+ * PreparedDistributedStatement keeps what pg_shard knows about a prepared
+ * statement: whether it runs on a distributed table and, if its parameters
+ * only select the shard to run on, its distributed plan. The entry is built
+ * from the statement's raw parse tree, and rebuilt when one of the tables it
+ * uses is invalidated. This includes statements on local tables, which may
+ * become distributed.
+ */
+typedef struct PreparedDistributedStatement
+{
+	char statementName[NAMEDATALEN]; /* hash key */
+	bool isValid;                    /* cleared when the entry must be rebuilt */
+	CachedPlanSource *planSource;    /* PostgreSQL's entry for the statement */
+	bool planSourceWasValid;         /* was planSource valid when we analyzed it? */
+	MemoryContext statementContext;  /* holds all data of the entry */
+	Query *query;                    /* analyzed and rewritten statement */
+	bool isDistributed;              /* is the query planned by pg_shard? */
+	List *relationIdList;            /* tables the query uses */
+	LOCKMODE lockMode;               /* lock the query takes on those tables */
+	PlannedStmt *genericPlan;        /* plan routed to a shard when executed */
+} PreparedDistributedStatement;
+
+
+/*
+ * PreparedDistributedStatementHash maps names of prepared statements to what
+ * pg_shard knows about them. It is created on first use, at which point we
+ * also register the relcache callback that invalidates its entries.
+ */
+static HTAB *PreparedDistributedStatementHash = NULL;
+
+/* number of invalidations seen, used to detect those arriving during a build */
+static uint64 PreparedStatementInvalidationCount = 0;
+
+
+/* local function forward declarations */
+static void InitializePreparedDistributedStatementHash(void);
+static void InvalidatePreparedStatementCallback(Datum argument, Oid relationId);
+static PreparedDistributedStatement * LookupPreparedDistributedStatement(
+	PreparedStatement *preparedStatement);
+static void BuildPreparedDistributedStatement(PreparedDistributedStatement *statement,
+											  CachedPlanSource *planSource);
+static void ResetPreparedDistributedStatement(PreparedDistributedStatement *statement);
+static ParamListInfo EvaluateStatementParameters(PreparedStatement *preparedStatement,
+												 List *parameterList,
+												 const char *queryString,
+												 EState *executorState);
+static void ExecuteDistributedStatementPlan(PlannedStmt *plannedStatement,
+											const char *queryString,
+											ParamListInfo boundParams,
+											DestReceiver *dest, char *completionTag);
+
+
+/*
+ * ExecutePreparedDistributedStatement executes the prepared statement named by
+ * the given EXECUTE statement if that statement runs on a distributed table,
+ * and returns true in that case. For all other statements, including unknown
+ * ones, the function returns false and leaves their execution to PostgreSQL.
+ */
+bool
+ExecutePreparedDistributedStatement(ExecuteStmt *executeStatement, const char *queryString,
+									ParamListInfo params, DestReceiver *dest,
+									char *completionTag)
+{
+	PreparedStatement *preparedStatement = NULL;
+	PreparedDistributedStatement *statement = NULL;
+	PlannedStmt *plannedStatement = NULL;
+	ParamListInfo boundParams = NULL;
+	EState *parameterState = NULL;
+	bool throwError = false;
+
+	preparedStatement = FetchPreparedStatement(executeStatement->name, throwError);
+	if (preparedStatement == NULL || !preparedStatement->plansource->fixed_result)
+	{
+		return false;
+	}
+
+	statement = LookupPreparedDistributedStatement(preparedStatement);
+	if (!statement->isDistributed)
+	{
+		return false;
+	}
+
+	/*
+	 * Evaluate the parameters in an executor state which lives until the end
+	 * of the execution, as the values may be passed by reference. The values
+	 * given to EXECUTE may themselves reference the caller's parameters.
+	 */
+	parameterState = CreateExecutorState();
+	parameterState->es_param_list_info = params;
+	boundParams = EvaluateStatementParameters(preparedStatement,
+											  executeStatement->params,
+											  queryString, parameterState);
+
+	if (statement->genericPlan != NULL)
+	{
+		plannedStatement = statement->genericPlan;
+	}
+	else
+	{
+		/* plan the statement with its parameter values, like any other query */
+		Query *query = copyObject(statement->query);
+		plannedStatement = planner(query, 0, boundParams);
+	}
+
+	ExecuteDistributedStatementPlan(plannedStatement, queryString, boundParams, dest,
+									completionTag);
+
+	FreeExecutorState(parameterState);
+
+	return true;
+}
+
+
+/*
+ * DropPreparedDistributedStatement forgets about the prepared statement with
+ * the given name, or about all prepared statements if the name is NULL.
+ */
+void
+DropPreparedDistributedStatement(const char *statementName)
+{
+	HASH_SEQ_STATUS status;
+	PreparedDistributedStatement *statement = NULL;
+
+	if (PreparedDistributedStatementHash == NULL)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, PreparedDistributedStatementHash);
+	while ((statement = hash_seq_search(&status)) != NULL)
+	{
+		if (statementName != NULL &&
+			strncmp(statement->statementName, statementName, NAMEDATALEN) != 0)
+		{
+			continue;
+		}
+
+		ResetPreparedDistributedStatement(statement);
+		hash_search(PreparedDistributedStatementHash, statement->statementName,
+					HASH_REMOVE, NULL);
+	}
+}
+
+
+/*
+ * InitializePreparedDistributedStatementHash creates the hash of prepared
+ * statements and registers the callback that invalidates its entries.
+ */
+static void
+InitializePreparedDistributedStatementHash(void)
+{
+	HASHCTL info;
+	int hashFlags = (HASH_ELEM | HASH_CONTEXT);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = NAMEDATALEN;
+	info.entrysize = sizeof(PreparedDistributedStatement);
+	info.hcxt = CacheMemoryContext;
+
+	PreparedDistributedStatementHash = hash_create("pg_shard prepared statements", 32,
+												   &info, hashFlags);
+
+	CacheRegisterRelcacheCallback(InvalidatePreparedStatementCallback, (Datum) 0);
+}
+
+
+/*
+ * InvalidatePreparedStatementCallback marks the prepared statements that use
+ * the given relation as invalid, or all of them if no relation is given. The
+ * relcache of a table is also invalidated when it becomes distributed or its
+ * shards change. Entries are only rebuilt on their next execution, as this
+ * callback must not access the catalogs.
+ */
+static void
+InvalidatePreparedStatementCallback(Datum argument, Oid relationId)
+{
+	HASH_SEQ_STATUS status;
+	PreparedDistributedStatement *statement = NULL;
+
+	PreparedStatementInvalidationCount++;
+
+	hash_seq_init(&status, PreparedDistributedStatementHash);
+	while ((statement = hash_seq_search(&status)) != NULL)
+	{
+		if (relationId == InvalidOid ||
+			list_member_oid(statement->relationIdList, relationId))
+		{
+			statement->isValid = false;
+		}
+	}
+}
+
+
+/*
+ * LookupPreparedDistributedStatement returns the entry for the given prepared
+ * statement, building it if necessary. For statements on distributed tables,
+ * the function also locks the tables the statement uses, as PostgreSQL would
+ * do before executing a cached plan.
+ */
+static PreparedDistributedStatement *
+LookupPreparedDistributedStatement(PreparedStatement *preparedStatement)
+{
+	CachedPlanSource *planSource = preparedStatement->plansource;
+	PreparedDistributedStatement *statement = NULL;
+	bool foundStatement = false;
+
+	if (PreparedDistributedStatementHash == NULL)
+	{
+		InitializePreparedDistributedStatementHash();
+	}
+
+	statement = hash_search(PreparedDistributedStatementHash,
+							preparedStatement->stmt_name, HASH_ENTER, &foundStatement);
+	if (!foundStatement)
+	{
+		statement->statementContext = NULL;
+		ResetPreparedDistributedStatement(statement);
+	}
+
+	/* locking the tables processes invalidations, so check validity after it */
+	if (statement->isValid && statement->isDistributed)
+	{
+		ListCell *relationIdCell = NULL;
+
+		foreach(relationIdCell, statement->relationIdList)
+		{
+			Oid relationId = lfirst_oid(relationIdCell);
+
+			LockRelationOid(relationId, statement->lockMode);
+		}
+	}
+
+	/*
+	 * PostgreSQL also invalidates its entry on changes we don't track, such as
+	 * to the search path. Since we never revalidate that entry, only rebuild
+	 * ours when the entry goes from valid to invalid.
+	 */
+	if (!statement->isValid || statement->planSource != planSource ||
+		(statement->planSourceWasValid && !planSource->is_valid))
+	{
+		BuildPreparedDistributedStatement(statement, planSource);
+	}
+
+	return statement;
+}
+
+
+/*
+ * BuildPreparedDistributedStatement analyzes the statement anew from its raw
+ * parse tree, and determines whether it runs on a distributed table. If the
+ * parameters of such a statement only select the shard it runs on, the
+ * function also plans it. The entry's data is kept in its own memory context.
+ */
+static void
+BuildPreparedDistributedStatement(PreparedDistributedStatement *statement,
+								  CachedPlanSource *planSource)
+{
+	MemoryContext statementContext = NULL;
+	MemoryContext oldContext = NULL;
+	uint64 invalidationCount = PreparedStatementInvalidationCount;
+	Node *rawParseTree = NULL;
+	List *queryList = NIL;
+	List *rangeTableList = NIL;
+	ListCell *rangeTableCell = NULL;
+	Query *query = NULL;
+	bool isDistributed = false;
+	List *relationIdList = NIL;
+	PlannedStmt *genericPlan = NULL;
+
+	ResetPreparedDistributedStatement(statement);
+
+	/*
+	 * Build the entry in a context that hangs off the current one, so an error
+	 * while building frees it. We move it under CacheMemoryContext below.
+	 */
+	statementContext = AllocSetContextCreate(CurrentMemoryContext,
+											 "pg_shard prepared statement",
+											 ALLOCSET_SMALL_MINSIZE,
+											 ALLOCSET_SMALL_INITSIZE,
+											 ALLOCSET_SMALL_MAXSIZE);
+	oldContext = MemoryContextSwitchTo(statementContext);
+
+	rawParseTree = copyObject(planSource->raw_parse_tree);
+	queryList = pg_analyze_and_rewrite(rawParseTree, planSource->query_string,
+									   planSource->param_types, planSource->num_params);
+	if (list_length(queryList) == 1)
+	{
+		query = (Query *) linitial(queryList);
+	}
+
+	/*
+	 * Remember the tables of all statements, not only of distributed ones, so
+	 * that a statement is rebuilt when one of its tables becomes distributed.
+	 */
+	ExtractRangeTableEntryWalker((Node *) queryList, &rangeTableList);
+	foreach(rangeTableCell, rangeTableList)
+	{
+		RangeTblEntry *rangeTableEntry = (RangeTblEntry *) lfirst(rangeTableCell);
+
+		if (rangeTableEntry->rtekind == RTE_RELATION)
+		{
+			relationIdList = list_append_unique_oid(relationIdList,
+													rangeTableEntry->relid);
+		}
+	}
+
+	if (query != NULL && query->commandType != CMD_UTILITY &&
+		DeterminePlannerType(query) == PLANNER_TYPE_PG_SHARD)
+	{
+		isDistributed = true;
+
+		if (IsParameterizedRouterQuery(query))
+		{
+			PlannedStmt *routerPlan = planner(copyObject(query), 0, NULL);
+			DistributedPlan *distributedPlan = (DistributedPlan *) routerPlan->planTree;
+			NodeTag nodeTag = nodeTag(routerPlan->planTree);
+
+			/* the planner may still find no routing clause, use custom plans then */
+			if ((DistributedNodeTag) nodeTag == T_DistributedPlan &&
+				distributedPlan->routingClause != NULL)
+			{
+				genericPlan = routerPlan;
+			}
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextSetParent(statementContext, CacheMemoryContext);
+
+	statement->statementContext = statementContext;
+	statement->planSource = planSource;
+	statement->planSourceWasValid = planSource->is_valid;
+	statement->query = query;
+	statement->isDistributed = isDistributed;
+	statement->relationIdList = relationIdList;
+	statement->lockMode = (query != NULL && query->resultRelation > 0) ?
+						  RowExclusiveLock : AccessShareLock;
+	statement->genericPlan = genericPlan;
+
+	/* an invalidation that arrived while building makes the next lookup rebuild */
+	statement->isValid = (invalidationCount == PreparedStatementInvalidationCount);
+}
+
+
+/*
+ * ResetPreparedDistributedStatement frees the data of the given entry and
+ * marks it invalid.
+ */
+static void
+ResetPreparedDistributedStatement(PreparedDistributedStatement *statement)
+{
+	if (statement->statementContext != NULL)
+	{
+		MemoryContextDelete(statement->statementContext);
+	}
+
+	statement->isValid = false;
+	statement->planSource = NULL;
+	statement->planSourceWasValid = false;
+	statement->statementContext = NULL;
+	statement->query = NULL;
+	statement->isDistributed = false;
+	statement->relationIdList = NIL;
+	statement->lockMode = NoLock;
+	statement->genericPlan = NULL;
+}
+
+
+/*
+ * EvaluateStatementParameters evaluates the parameter expressions given to
+ * EXECUTE, coerced to the types the statement was prepared with, and returns
+ * their values. This follows the way PostgreSQL evaluates them.
+ */
+static ParamListInfo
+EvaluateStatementParameters(PreparedStatement *preparedStatement, List *parameterList,
+							const char *queryString, EState *executorState)
+{
+	Oid *parameterTypes = preparedStatement->plansource->param_types;
+	int parameterCount = preparedStatement->plansource->num_params;
+	int givenParameterCount = list_length(parameterList);
+	ParseState *parseState = NULL;
+	ParamListInfo boundParams = NULL;
+	List *expressionStateList = NIL;
+	ListCell *parameterCell = NULL;
+	int parameterIndex = 0;
+
+	if (givenParameterCount != parameterCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_SYNTAX_ERROR),
+						errmsg("wrong number of parameters for prepared statement "
+							   "\"%s\"", preparedStatement->stmt_name),
+						errdetail("Expected %d parameters but got %d.",
+								  parameterCount, givenParameterCount)));
+	}
+
+	if (parameterCount == 0)
+	{
+		return NULL;
+	}
+
+	/* parse analysis scribbles on its input */
+	parameterList = (List *) copyObject(parameterList);
+
+	parseState = make_parsestate(NULL);
+	parseState->p_sourcetext = queryString;
+
+	foreach(parameterCell, parameterList)
+	{
+		Node *expression = (Node *) lfirst(parameterCell);
+		Oid expectedTypeId = parameterTypes[parameterIndex];
+		Oid givenTypeId = InvalidOid;
+
+		expression = transformExpr(parseState, expression, EXPR_KIND_EXECUTE_PARAMETER);
+		givenTypeId = exprType(expression);
+
+		expression = coerce_to_target_type(parseState, expression, givenTypeId,
+										   expectedTypeId, -1, COERCION_ASSIGNMENT,
+										   COERCE_IMPLICIT_CAST, -1);
+		if (expression == NULL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+							errmsg("parameter $%d of type %s cannot be coerced to "
+								   "the expected type %s", parameterIndex + 1,
+								   format_type_be(givenTypeId),
+								   format_type_be(expectedTypeId)),
+							errhint("You will need to rewrite or cast the "
+									"expression.")));
+		}
+
+		assign_expr_collations(parseState, expression);
+
+		lfirst(parameterCell) = expression;
+		parameterIndex++;
+	}
+
+	expressionStateList = (List *) ExecPrepareExpr((Expr *) parameterList, executorState);
+
+	/* the values are static, so no hooks are needed */
+	boundParams = (ParamListInfo) palloc0(offsetof(ParamListInfoData, params) +
+										  parameterCount * sizeof(ParamExternData));
+	boundParams->numParams = parameterCount;
+
+	parameterIndex = 0;
+	foreach(parameterCell, expressionStateList)
+	{
+		ExprState *expressionState = (ExprState *) lfirst(parameterCell);
+		ParamExternData *parameterData = &boundParams->params[parameterIndex];
+
+		parameterData->ptype = parameterTypes[parameterIndex];
+		parameterData->pflags = PARAM_FLAG_CONST;
+		parameterData->value = ExecEvalExprSwitchContext(expressionState,
+														 GetPerTupleExprContext(
+															 executorState),
+														 &parameterData->isnull, NULL);
+
+		parameterIndex++;
+	}
+
+	return boundParams;
+}
+
+
+/*
+ * ExecuteDistributedStatementPlan runs the given plan to completion, sending
+ * its results to the given destination, and sets the completion tag for the
+ * statement.
+ */
+static void
+ExecuteDistributedStatementPlan(PlannedStmt *plannedStatement, const char *queryString,
+								ParamListInfo boundParams, DestReceiver *dest,
+								char *completionTag)
+{
+	QueryDesc *queryDesc = NULL;
+	uint64 processedCount = 0;
+
+	/* let the statement see the effects of earlier ones */
+	PushCopiedSnapshot(GetActiveSnapshot());
+	UpdateActiveSnapshotCommandId();
+
+	queryDesc = CreateQueryDesc(plannedStatement, queryString, GetActiveSnapshot(),
+								InvalidSnapshot, dest, boundParams, 0);
+
+	ExecutorStart(queryDesc, 0);
+	ExecutorRun(queryDesc, ForwardScanDirection, 0L);
+
+	processedCount = (uint64) queryDesc->estate->es_processed;
+	if (completionTag != NULL)
+	{
+		switch (queryDesc->operation)
+		{
+			case CMD_SELECT:
+			{
+				snprintf(completionTag, COMPLETION_TAG_BUFSIZE,
+						 "SELECT " UINT64_FORMAT, processedCount);
+				break;
+			}
+
+			case CMD_INSERT:
+			{
+				snprintf(completionTag, COMPLETION_TAG_BUFSIZE,
+						 "INSERT %u " UINT64_FORMAT, InvalidOid, processedCount);
+				break;
+			}
+
+			case CMD_UPDATE:
+			{
+				snprintf(completionTag, COMPLETION_TAG_BUFSIZE,
+						 "UPDATE " UINT64_FORMAT, processedCount);
+				break;
+			}
+
+			case CMD_DELETE:
+			{
+				snprintf(completionTag, COMPLETION_TAG_BUFSIZE,
+						 "DELETE " UINT64_FORMAT, processedCount);
+				break;
+			}
+
+			default:
+			{
+				strcpy(completionTag, "???");
+				break;
+			}
+		}
+	}
+
+	ExecutorFinish(queryDesc);
+	ExecutorEnd(queryDesc);
+
+	FreeQueryDesc(queryDesc);
+
+	PopActiveSnapshot();
+}
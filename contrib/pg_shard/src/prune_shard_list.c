@@ -69,68 +69,96 @@ static OpExpr * MakeOpExpressionWithZeroConst(void);
 static List * BuildRestrictInfoList(List *qualList);
 static Node * BuildBaseConstraint(Var *column);
 static void UpdateConstraint(Node *baseConstraint, ShardInterval *shardInterval);
+static List * PruneShardIntervals(List *whereClauseList, List *shardIntervalList,
+								  char partitionMethod, Var *partitionColumn);
+static bool PartitionColumnEqualityValue(Expr *clause, char partitionMethod,
+										 Var *partitionColumn, Datum *partitionValue);
+static ShardInterval * SearchSortedShardIntervalArray(
+	DistributedTableCacheEntry *cacheEntry, Datum partitionValue);
 
-static HTAB* shardPlacementCache;
 
-typedef struct ShardPlacementEntryCacheEntry
+/*
+ * PruneShardList prunes shards from given list based on the selection criteria,
+ * and returns remaining shards in another list.
+ */
+List *
+PruneShardList(Oid relationId, List *whereClauseList, List *shardIntervalList)
 {
-	Oid tableId;
-	List** placements;
-} ShardPlacementCacheEntry;
+	Var *partitionColumn = PartitionColumn(relationId);
+	char partitionMethod = PartitionType(relationId);
+
+	return PruneShardIntervals(whereClauseList, shardIntervalList, partitionMethod,
+							   partitionColumn);
+}
 
-#define MAX_DISTRIBUTED_TABLES 101
 
-static List* 
-LookupShardPlacementCache(Oid relationId, int shardHashCode)
+/*
+ * PruneCachedShardList prunes the shards of the distributed table described by
+ * the given cache entry. If the selection criteria include an equality clause
+ * on the partition column and the table's shard intervals are disjoint, this
+ * function finds the only shard that can hold matching rows with a binary
+ * search, and only checks that shard against the remaining clauses. Otherwise,
+ * it checks every shard against the selection criteria.
+ */
+List *
+PruneCachedShardList(DistributedTableCacheEntry *cacheEntry, List *whereClauseList)
 {
-	ShardPlacementCacheEntry* entry = NULL;
+	List *shardIntervalList = cacheEntry->shardIntervalList;
+	Var *partitionColumn = cacheEntry->partitionColumn;
+	char partitionMethod = cacheEntry->partitionMethod;
+	ListCell *whereClauseCell = NULL;
 
-	if (shardPlacementCache == NULL)
+	if (!cacheEntry->hasDisjointShardIntervals)
 	{
-		HASHCTL info;
-		int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
-
-		memset(&info, 0, sizeof(info));
-		info.keysize = sizeof(Oid);
-		info.entrysize = sizeof(ShardPlacementCacheEntry);
-		info.hcxt = CacheMemoryContext;
-
-		shardPlacementCache = hash_create("pg_shard placement cache", MAX_DISTRIBUTED_TABLES, &info, hashFlags);
+		return PruneShardIntervals(whereClauseList, shardIntervalList, partitionMethod,
+								   partitionColumn);
 	}
-	entry = hash_search(shardPlacementCache, &relationId, HASH_FIND, NULL);
-	return (entry != NULL) ? entry->placements[shardHashCode] : NULL;
-}
 
-static void 
-AddToShardPlacementCache(Oid relationId, int shardHashCode, int shardCount, List* shardPlacements)
-{
-	MemoryContext oldContext = MemoryContextSwitchTo(CacheMemoryContext);
-	bool found = false;
-	ShardPlacementCacheEntry* entry = (ShardPlacementCacheEntry*)hash_search(shardPlacementCache, &relationId, HASH_ENTER, &found);
-	if (!found)
+	foreach(whereClauseCell, whereClauseList)
 	{
-		entry->placements = palloc0(shardCount*sizeof(List*));
+		Expr *whereClause = (Expr *) lfirst(whereClauseCell);
+		Datum partitionValue = 0;
+		ShardInterval *shardInterval = NULL;
+
+		if (!PartitionColumnEqualityValue(whereClause, partitionMethod,
+										  partitionColumn, &partitionValue))
+		{
+			continue;
+		}
+
+		shardInterval = SearchSortedShardIntervalArray(cacheEntry, partitionValue);
+		if (shardInterval == NULL)
+		{
+			return NIL;
+		}
+
+		/* a lone equality clause needs no further checks */
+		if (list_length(whereClauseList) == 1)
+		{
+			return list_make1(shardInterval);
+		}
+
+		return PruneShardIntervals(whereClauseList, list_make1(shardInterval),
+								   partitionMethod, partitionColumn);
 	}
-	entry->placements[shardHashCode] = list_copy(shardPlacements);
-	MemoryContextSwitchTo(oldContext);
+
+	return PruneShardIntervals(whereClauseList, shardIntervalList, partitionMethod,
+							   partitionColumn);
 }
 
+
 /*
- * PruneShardList prunes shards from given list based on the selection criteria,
- * and returns remaining shards in another list.
+ * PruneShardIntervals checks each shard interval in the given list against the
+ * selection criteria, and returns the intervals that may hold matching rows.
  */
-List *
-PruneShardList(Oid relationId, List *whereClauseList, List *shardIntervalList)
+static List *
+PruneShardIntervals(List *whereClauseList, List *shardIntervalList,
+					char partitionMethod, Var *partitionColumn)
 {
 	List *remainingShardList = NIL;
 	ListCell *shardIntervalCell = NULL;
 	List *restrictInfoList = NIL;
 	Node *baseConstraint = NULL;
-	int shardHashCode = -1;
-	int shardCount = shardIntervalList->length;
-	uint32 hashTokenIncrement = (uint32)(HASH_TOKEN_COUNT / shardCount);
-	Var *partitionColumn = PartitionColumn(relationId);
-	char partitionMethod = PartitionType(relationId);
 
 	/* build the filter clause list for the partition method */
 	switch (partitionMethod)
@@ -144,49 +172,10 @@ PruneShardList(Oid relationId, List *whereClauseList, List *shardIntervalList)
 
 		case HASH_PARTITION_TYPE:
 		{
-			Node *hashedNode = NULL;
-			List *hashedClauseList = NULL;
-			if (whereClauseList && whereClauseList->length == 1)
-			{
-				Expr* predicate = (Expr *)lfirst(list_head(whereClauseList));
-
-				if (IsA(predicate, OpExpr))
-				{
-					OpExpr *operatorExpression = (OpExpr *) predicate;
-					Oid leftHashFunction = InvalidOid;
-					Oid rightHashFunction = InvalidOid;
-					if (get_op_hash_functions(operatorExpression->opno,
-											  &leftHashFunction,
-											  &rightHashFunction)				
-						&& SimpleOpExpression(predicate)
-						&& OpExpressionContainsColumn(operatorExpression,
-													  partitionColumn))
-					{
-						Node *leftOperand = get_leftop(predicate);
-						Node *rightOperand = get_rightop(predicate);
-						Const *constant = (Const*)(IsA(rightOperand, Const) ? rightOperand : leftOperand);
-						TypeCacheEntry *typeEntry = lookup_type_cache(constant->consttype, TYPECACHE_HASH_PROC_FINFO);
-						FmgrInfo *hashFunction = &(typeEntry->hash_proc_finfo);
-						if (OidIsValid(hashFunction->fn_oid))
-						{
-							int hashedValue = DatumGetInt32(FunctionCall1(hashFunction, constant->constvalue));
-							shardHashCode = (int)((uint32)(hashedValue - INT32_MIN) / hashTokenIncrement);
-							remainingShardList = LookupShardPlacementCache(relationId, shardHashCode);
-							if (remainingShardList != NULL)
-							{
-								return remainingShardList;
-							}
-						}
-					}
-				}
-			}
-			hashedNode = HashableClauseMutator((Node *) whereClauseList,
-											   partitionColumn);
-			hashedClauseList = (List *) hashedNode;
-			restrictInfoList = BuildRestrictInfoList(hashedClauseList);
+			Node *hashedNode = HashableClauseMutator((Node *) whereClauseList,
+													 partitionColumn);
+			List *hashedClauseList = (List *) hashedNode;
 
-			/* override the partition column for hash partitioning */
-			partitionColumn = MakeInt4Column();
 			restrictInfoList = BuildRestrictInfoList(hashedClauseList);
 
 			/* override the partition column for hash partitioning */
@@ -224,26 +213,134 @@ PruneShardList(Oid relationId, List *whereClauseList, List *shardIntervalList)
 		}
 		else
 		{
-			remainingShardList = lappend(remainingShardList, &(shardInterval->id));
+			remainingShardList = lappend(remainingShardList, shardInterval);
+		}
+	}
+
+	return remainingShardList;
+}
+
+
+/*
+ * PartitionColumnEqualityValue checks whether the given clause restricts the
+ * partition column to a single non-null value and, if so, sets partitionValue
+ * to that value in the form shard intervals store it: the hashed value for
+ * hash-partitioned tables, or the value itself otherwise. For the latter, we
+ * only accept the default equality operator of the partition column's type,
+ * so that the value can be compared using the shard intervals' comparator.
+ */
+static bool
+PartitionColumnEqualityValue(Expr *clause, char partitionMethod,
+							 Var *partitionColumn, Datum *partitionValue)
+{
+	OpExpr *operatorExpression = NULL;
+	Node *leftOperand = NULL;
+	Node *rightOperand = NULL;
+	Const *constant = NULL;
+
+	if (!IsA(clause, OpExpr) || !SimpleOpExpression(clause))
+	{
+		return false;
+	}
+
+	operatorExpression = (OpExpr *) clause;
+	if (!OpExpressionContainsColumn(operatorExpression, partitionColumn))
+	{
+		return false;
+	}
+
+	leftOperand = get_leftop(clause);
+	rightOperand = get_rightop(clause);
+	constant = (Const *) (IsA(rightOperand, Const) ? rightOperand : leftOperand);
+
+	if (partitionMethod == HASH_PARTITION_TYPE)
+	{
+		Oid leftHashFunction = InvalidOid;
+		Oid rightHashFunction = InvalidOid;
+		TypeCacheEntry *typeEntry = NULL;
+		FmgrInfo *hashFunction = NULL;
+
+		/* this matches the clauses HashableClauseMutator hashes */
+		if (!get_op_hash_functions(operatorExpression->opno, &leftHashFunction,
+								   &rightHashFunction))
+		{
+			return false;
+		}
+
+		typeEntry = lookup_type_cache(constant->consttype, TYPECACHE_HASH_PROC_FINFO);
+		hashFunction = &(typeEntry->hash_proc_finfo);
+		if (!OidIsValid(hashFunction->fn_oid))
+		{
+			return false;
 		}
+
+		*partitionValue = FunctionCall1(hashFunction, constant->constvalue);
 	}
-	if (shardHashCode >= 0)
+	else
 	{
-		ShardInterval* shardInterval = (ShardInterval *) linitial(remainingShardList);
-		int64 shardId = shardInterval->id;
-		int32 shardMinHashToken = INT32_MIN + (shardId * hashTokenIncrement);
-		int32 shardMaxHashToken = shardMinHashToken + (hashTokenIncrement - 1);
-		if (shardId == (shardCount - 1))
+		TypeCacheEntry *typeEntry = lookup_type_cache(partitionColumn->vartype,
+													  TYPECACHE_EQ_OPR);
+
+		if (operatorExpression->opno != typeEntry->eq_opr ||
+			constant->consttype != partitionColumn->vartype)
 		{
-			shardMaxHashToken = INT32_MAX;
+			return false;
 		}
-		if (DatumGetInt32(shardInterval->minValue) == shardMinHashToken &&
-			DatumGetInt32(shardInterval->maxValue) == shardMaxHashToken)
-		{		
-			AddToShardPlacementCache(relationId, shardHashCode, shardIntervalList->length, remainingShardList);
+
+		*partitionValue = constant->constvalue;
+	}
+
+	return true;
+}
+
+
+/*
+ * SearchSortedShardIntervalArray returns the shard interval of the given cache
+ * entry which contains the given partition value, or NULL if no shard interval
+ * contains it. The cache entry's shard intervals must be disjoint.
+ */
+static ShardInterval *
+SearchSortedShardIntervalArray(DistributedTableCacheEntry *cacheEntry,
+							   Datum partitionValue)
+{
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	FmgrInfo *compareFunction = &cacheEntry->shardIntervalCompareFunction;
+	Oid collationId = cacheEntry->shardIntervalCollation;
+	int lowerBoundIndex = 0;
+	int upperBoundIndex = cacheEntry->shardIntervalArrayLength;
+
+	Assert(cacheEntry->hasDisjointShardIntervals);
+
+	while (lowerBoundIndex < upperBoundIndex)
+	{
+		int middleIndex = lowerBoundIndex + (upperBoundIndex - lowerBoundIndex) / 2;
+		ShardInterval *shardInterval = sortedShardIntervalArray[middleIndex];
+		int minValueComparison = DatumGetInt32(FunctionCall2Coll(compareFunction,
+																 collationId,
+																 partitionValue,
+																 shardInterval->minValue));
+		int maxValueComparison = 0;
+
+		if (minValueComparison < 0)
+		{
+			upperBoundIndex = middleIndex;
+			continue;
 		}
+
+		maxValueComparison = DatumGetInt32(FunctionCall2Coll(compareFunction,
+															 collationId,
+															 partitionValue,
+															 shardInterval->maxValue));
+		if (maxValueComparison > 0)
+		{
+			lowerBoundIndex = middleIndex + 1;
+			continue;
+		}
+
+		return shardInterval;
 	}
-	return remainingShardList;
+
+	return NULL;
 }
 
 
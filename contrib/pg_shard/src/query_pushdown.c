@@ -0,0 +1,622 @@
+/*-------------------------------------------------------------------------
+ *
+ * src/query_pushdown.c
+ *
+ * This file contains functions to push aggregates and top-N clauses of
+ * multi-shard SELECT queries down to the shards, and to merge the partial
+ * aggregates the shards return on the coordinator.
+ *
+ * Copyright (c) 2014-2015, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "c.h"
+#include "fmgr.h"
+
+#include "query_pushdown.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "catalog/namespace.h"
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_namespace.h"
+#include "catalog/pg_type.h"
+#include "executor/tuptable.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "nodes/nodes.h"
+#include "nodes/parsenodes.h"
+#include "nodes/pg_list.h"
+#include "nodes/primnodes.h"
+#include "nodes/value.h"
+#include "optimizer/tlist.h"
+#include "parser/parse_coerce.h"
+#include "parser/parse_func.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/elog.h"
+#include "utils/errcodes.h"
+#include "utils/int8.h"
+#include "utils/lsyscache.h"
+#include "utils/palloc.h"
+#include "utils/typcache.h"
+
+
+/* local function forward declarations */
+static AggregateMergeType AggregateMergeTypeForFunction(Oid functionId);
+static bool AggregateSafeToPushDown(Aggref *aggregate);
+static Oid AggregateFunctionId(char *functionName, Oid argumentTypeId);
+static Oid SumFunctionId(Oid typeId);
+static Oid CompareFunctionId(Oid typeId);
+static TargetEntry * PartialTargetEntry(Aggref *aggregate, int resultNumber);
+static void MergePartialValue(AggregateMergeState *mergeState, Datum partialValue);
+
+
+/*
+ * PartialAggregateTargetList checks whether all aggregates of the given query
+ * can be computed from per-shard partial results, and if so builds the target
+ * list of the query to send to the shards. The function also returns the list
+ * of AggregateMerge instructions to compute the final results with, one per
+ * target entry of the original query.
+ *
+ * Only queries whose target list consists of count, sum, min, max and avg
+ * calls, without grouping, ordering or limits, are supported. The function
+ * returns NIL for any other query, in which case the caller should fall back
+ * to fetching the rows.
+ */
+List *
+PartialAggregateTargetList(Query *query, List **aggregateMergeList)
+{
+	List *partialTargetList = NIL;
+	List *mergeList = NIL;
+	ListCell *targetEntryCell = NULL;
+	int resultNumber = 1;
+
+	*aggregateMergeList = NIL;
+
+	if (query->commandType != CMD_SELECT || !query->hasAggs ||
+		query->hasWindowFuncs || query->groupClause != NIL ||
+		query->havingQual != NULL || query->distinctClause != NIL ||
+		query->sortClause != NIL || query->limitCount != NULL ||
+		query->limitOffset != NULL || query->rowMarks != NIL)
+	{
+		return NIL;
+	}
+
+#if PG_VERSION_NUM >= 90500
+	if (query->groupingSets != NIL)
+	{
+		return NIL;
+	}
+#endif
+
+	foreach(targetEntryCell, query->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		AggregateMerge *merge = NULL;
+		Aggref *aggregate = NULL;
+		TargetEntry *partialEntry = NULL;
+
+		if (targetEntry->resjunk || !IsA(targetEntry->expr, Aggref))
+		{
+			return NIL;
+		}
+
+		aggregate = (Aggref *) targetEntry->expr;
+		if (!AggregateSafeToPushDown(aggregate))
+		{
+			return NIL;
+		}
+
+		merge = palloc0(sizeof(AggregateMerge));
+		merge->mergeType = AggregateMergeTypeForFunction(aggregate->aggfnoid);
+		merge->resultTypeId = aggregate->aggtype;
+		merge->partialTypeId = aggregate->aggtype;
+		merge->collationId = aggregate->inputcollid;
+		merge->columnIndex = resultNumber - 1;
+		merge->countColumnIndex = -1;
+
+		switch (merge->mergeType)
+		{
+			case AGGREGATE_MERGE_COUNT:
+			{
+				partialEntry = makeTargetEntry((Expr *) copyObject(aggregate),
+											   resultNumber++, NULL, false);
+				partialTargetList = lappend(partialTargetList, partialEntry);
+				break;
+			}
+
+			case AGGREGATE_MERGE_SUM:
+			{
+				merge->mergeFunctionId = SumFunctionId(merge->partialTypeId);
+				partialEntry = makeTargetEntry((Expr *) copyObject(aggregate),
+											   resultNumber++, NULL, false);
+				partialTargetList = lappend(partialTargetList, partialEntry);
+				break;
+			}
+
+			case AGGREGATE_MERGE_MIN:
+			case AGGREGATE_MERGE_MAX:
+			{
+				merge->mergeFunctionId = CompareFunctionId(merge->partialTypeId);
+				partialEntry = makeTargetEntry((Expr *) copyObject(aggregate),
+											   resultNumber++, NULL, false);
+				partialTargetList = lappend(partialTargetList, partialEntry);
+				break;
+			}
+
+			case AGGREGATE_MERGE_AVG:
+			{
+				Oid countFunctionId = AggregateFunctionId("count", ANYOID);
+				Aggref *countAggregate = copyObject(aggregate);
+
+				/* averages are only merged for numeric and float results */
+				if (merge->resultTypeId != NUMERICOID && merge->resultTypeId != FLOAT8OID)
+				{
+					return NIL;
+				}
+
+				/* shards compute the sum in the result type to avoid a conversion */
+				merge->mergeFunctionId = SumFunctionId(merge->resultTypeId);
+				partialEntry = PartialTargetEntry(aggregate, resultNumber++);
+				if (partialEntry == NULL)
+				{
+					return NIL;
+				}
+				partialTargetList = lappend(partialTargetList, partialEntry);
+
+				countAggregate->aggfnoid = countFunctionId;
+				countAggregate->aggtype = INT8OID;
+				merge->countColumnIndex = resultNumber - 1;
+				partialEntry = makeTargetEntry((Expr *) countAggregate, resultNumber++,
+											   NULL, false);
+				partialTargetList = lappend(partialTargetList, partialEntry);
+				break;
+			}
+
+			default:
+			{
+				return NIL;
+			}
+		}
+
+		if (merge->mergeType != AGGREGATE_MERGE_COUNT &&
+			merge->mergeFunctionId == InvalidOid)
+		{
+			return NIL;
+		}
+
+		mergeList = lappend(mergeList, merge);
+	}
+
+	*aggregateMergeList = mergeList;
+
+	return partialTargetList;
+}
+
+
+/*
+ * PushDownTopN adds the ORDER BY and LIMIT clauses of the given query to the
+ * remote query, so that each shard returns only the rows which may make it
+ * into the final result. The coordinator still sorts and limits the union of
+ * these rows. The clauses are pushed down only if every sort expression is a
+ * plain column, which the remote query already selects, and the limit and
+ * offset are constants.
+ */
+void
+PushDownTopN(Query *query, Query *remoteQuery)
+{
+	List *remoteSortClauseList = NIL;
+	ListCell *sortClauseCell = NULL;
+	Const *limitCount = (Const *) query->limitCount;
+	Const *limitOffset = (Const *) query->limitOffset;
+	int64 remoteLimit = 0;
+	Index sortGroupRef = 1;
+
+	if (query->sortClause == NIL || limitCount == NULL || query->hasAggs ||
+		query->hasWindowFuncs || query->groupClause != NIL ||
+		query->havingQual != NULL || query->distinctClause != NIL ||
+		query->rowMarks != NIL)
+	{
+		return;
+	}
+
+	if (!IsA(limitCount, Const) || limitCount->constisnull)
+	{
+		return;
+	}
+	remoteLimit = DatumGetInt64(limitCount->constvalue);
+
+	if (limitOffset != NULL)
+	{
+		int64 offset = 0;
+
+		if (!IsA(limitOffset, Const))
+		{
+			return;
+		}
+
+		if (!limitOffset->constisnull)
+		{
+			offset = DatumGetInt64(limitOffset->constvalue);
+		}
+
+		/* shards must return the skipped rows too */
+		if (offset > 0 && remoteLimit > INT64CONST(0x7FFFFFFFFFFFFFFF) - offset)
+		{
+			return;
+		}
+		remoteLimit += Max(offset, 0);
+	}
+
+	foreach(sortClauseCell, query->sortClause)
+	{
+		SortGroupClause *sortClause = (SortGroupClause *) lfirst(sortClauseCell);
+		Node *sortExpression = get_sortgroupclause_expr(sortClause, query->targetList);
+		SortGroupClause *remoteSortClause = NULL;
+		TargetEntry *remoteEntry = NULL;
+		ListCell *remoteEntryCell = NULL;
+
+		if (!IsA(sortExpression, Var))
+		{
+			return;
+		}
+
+		foreach(remoteEntryCell, remoteQuery->targetList)
+		{
+			TargetEntry *targetEntry = (TargetEntry *) lfirst(remoteEntryCell);
+			if (equal(targetEntry->expr, sortExpression))
+			{
+				remoteEntry = targetEntry;
+				break;
+			}
+		}
+
+		if (remoteEntry == NULL)
+		{
+			return;
+		}
+
+		if (remoteEntry->ressortgroupref == 0)
+		{
+			remoteEntry->ressortgroupref = sortGroupRef++;
+		}
+
+		remoteSortClause = copyObject(sortClause);
+		remoteSortClause->tleSortGroupRef = remoteEntry->ressortgroupref;
+		remoteSortClauseList = lappend(remoteSortClauseList, remoteSortClause);
+	}
+
+	remoteQuery->sortClause = remoteSortClauseList;
+	remoteQuery->limitCount = (Node *) makeConst(INT8OID, -1, InvalidOid, sizeof(int64),
+												 Int64GetDatum(remoteLimit), false,
+												 FLOAT8PASSBYVAL);
+}
+
+
+/*
+ * BeginAggregateMerge sets up the state used to merge partial aggregates,
+ * one entry per element of the given AggregateMerge list.
+ */
+AggregateMergeState *
+BeginAggregateMerge(List *aggregateMergeList)
+{
+	int mergeStateCount = list_length(aggregateMergeList);
+	AggregateMergeState *mergeStateArray = palloc0(mergeStateCount *
+												   sizeof(AggregateMergeState));
+	ListCell *mergeCell = NULL;
+	int mergeIndex = 0;
+
+	foreach(mergeCell, aggregateMergeList)
+	{
+		AggregateMerge *merge = (AggregateMerge *) lfirst(mergeCell);
+		AggregateMergeState *mergeState = &mergeStateArray[mergeIndex++];
+
+		mergeState->merge = merge;
+		mergeState->value = (Datum) 0;
+		mergeState->isNull = true;
+		mergeState->count = 0;
+
+		if (merge->mergeFunctionId != InvalidOid)
+		{
+			fmgr_info(merge->mergeFunctionId, &mergeState->mergeFunction);
+		}
+
+		get_typlenbyval(merge->partialTypeId, &mergeState->partialTypeLength,
+						&mergeState->partialTypeByValue);
+	}
+
+	return mergeStateArray;
+}
+
+
+/*
+ * MergePartialAggregates merges the partial aggregates in the given tuple,
+ * which holds a row returned by one of the shards, into the running results.
+ */
+void
+MergePartialAggregates(AggregateMergeState *mergeStateArray, int mergeStateCount,
+					   TupleTableSlot *slot)
+{
+	int mergeIndex = 0;
+
+	for (mergeIndex = 0; mergeIndex < mergeStateCount; mergeIndex++)
+	{
+		AggregateMergeState *mergeState = &mergeStateArray[mergeIndex];
+		AggregateMerge *merge = mergeState->merge;
+		bool partialIsNull = false;
+		Datum partialValue = slot_getattr(slot, merge->columnIndex + 1,
+										  &partialIsNull);
+
+		if (merge->mergeType == AGGREGATE_MERGE_COUNT)
+		{
+			Assert(!partialIsNull);
+			mergeState->count += DatumGetInt64(partialValue);
+			continue;
+		}
+
+		if (merge->mergeType == AGGREGATE_MERGE_AVG)
+		{
+			bool countIsNull = false;
+			Datum countValue = slot_getattr(slot, merge->countColumnIndex + 1,
+											&countIsNull);
+
+			Assert(!countIsNull);
+			mergeState->count += DatumGetInt64(countValue);
+		}
+
+		if (!partialIsNull)
+		{
+			MergePartialValue(mergeState, partialValue);
+		}
+	}
+}
+
+
+/*
+ * FinalizeAggregates computes the final aggregate values from the running
+ * results and stores them in the given arrays, in target list order.
+ */
+void
+FinalizeAggregates(AggregateMergeState *mergeStateArray, int mergeStateCount,
+				   Datum *values, bool *nulls)
+{
+	int mergeIndex = 0;
+
+	for (mergeIndex = 0; mergeIndex < mergeStateCount; mergeIndex++)
+	{
+		AggregateMergeState *mergeState = &mergeStateArray[mergeIndex];
+		AggregateMerge *merge = mergeState->merge;
+
+		if (merge->mergeType == AGGREGATE_MERGE_COUNT)
+		{
+			values[mergeIndex] = Int64GetDatum(mergeState->count);
+			nulls[mergeIndex] = false;
+		}
+		else if (merge->mergeType == AGGREGATE_MERGE_AVG)
+		{
+			if (mergeState->count == 0 || mergeState->isNull)
+			{
+				values[mergeIndex] = (Datum) 0;
+				nulls[mergeIndex] = true;
+			}
+			else if (merge->resultTypeId == NUMERICOID)
+			{
+				Datum count = DirectFunctionCall1(int8_numeric,
+												  Int64GetDatum(mergeState->count));
+
+				values[mergeIndex] = DirectFunctionCall2(numeric_div, mergeState->value,
+														 count);
+				nulls[mergeIndex] = false;
+			}
+			else
+			{
+				Datum count = DirectFunctionCall1(i8tod, Int64GetDatum(mergeState->count));
+
+				Assert(merge->resultTypeId == FLOAT8OID);
+				values[mergeIndex] = DirectFunctionCall2(float8div, mergeState->value,
+														 count);
+				nulls[mergeIndex] = false;
+			}
+		}
+		else
+		{
+			values[mergeIndex] = mergeState->value;
+			nulls[mergeIndex] = mergeState->isNull;
+		}
+	}
+}
+
+
+/*
+ * AggregateMergeTypeForFunction returns how partial results of the given
+ * aggregate function are merged, or AGGREGATE_MERGE_INVALID_FIRST if the
+ * function is not one of the built-in aggregates we know how to merge.
+ */
+static AggregateMergeType
+AggregateMergeTypeForFunction(Oid functionId)
+{
+	char *functionName = NULL;
+
+	if (get_func_namespace(functionId) != PG_CATALOG_NAMESPACE)
+	{
+		return AGGREGATE_MERGE_INVALID_FIRST;
+	}
+
+	functionName = get_func_name(functionId);
+	if (strcmp(functionName, "count") == 0)
+	{
+		return AGGREGATE_MERGE_COUNT;
+	}
+	else if (strcmp(functionName, "sum") == 0)
+	{
+		return AGGREGATE_MERGE_SUM;
+	}
+	else if (strcmp(functionName, "min") == 0)
+	{
+		return AGGREGATE_MERGE_MIN;
+	}
+	else if (strcmp(functionName, "max") == 0)
+	{
+		return AGGREGATE_MERGE_MAX;
+	}
+	else if (strcmp(functionName, "avg") == 0)
+	{
+		return AGGREGATE_MERGE_AVG;
+	}
+
+	return AGGREGATE_MERGE_INVALID_FIRST;
+}
+
+
+/*
+ * AggregateSafeToPushDown returns whether the aggregate call is a plain call
+ * of a mergeable aggregate: no DISTINCT, ORDER BY or FILTER clauses, and at
+ * most one argument.
+ */
+static bool
+AggregateSafeToPushDown(Aggref *aggregate)
+{
+	if (aggregate->agglevelsup != 0 || aggregate->aggdistinct != NIL ||
+		aggregate->aggorder != NIL || list_length(aggregate->args) > 1)
+	{
+		return false;
+	}
+
+#if PG_VERSION_NUM >= 90400
+	if (aggregate->aggfilter != NULL || aggregate->aggdirectargs != NIL ||
+		aggregate->aggkind != AGGKIND_NORMAL)
+	{
+		return false;
+	}
+#endif
+
+	if (aggregate->args == NIL && !aggregate->aggstar)
+	{
+		return false;
+	}
+
+	return AggregateMergeTypeForFunction(aggregate->aggfnoid) !=
+		   AGGREGATE_MERGE_INVALID_FIRST;
+}
+
+
+/* AggregateFunctionId looks up the built-in aggregate with the given name. */
+static Oid
+AggregateFunctionId(char *functionName, Oid argumentTypeId)
+{
+	List *qualifiedName = list_make2(makeString("pg_catalog"), makeString(functionName));
+	bool missingOK = true;
+
+	return LookupFuncName(qualifiedName, 1, &argumentTypeId, missingOK);
+}
+
+
+/* SumFunctionId returns the function adding two values of the given type. */
+static Oid
+SumFunctionId(Oid typeId)
+{
+	List *operatorName = list_make1(makeString("+"));
+	Oid operatorId = OpernameGetOprid(operatorName, typeId, typeId);
+
+	if (operatorId == InvalidOid)
+	{
+		return InvalidOid;
+	}
+
+	return get_opcode(operatorId);
+}
+
+
+/* CompareFunctionId returns the btree comparison function for the given type. */
+static Oid
+CompareFunctionId(Oid typeId)
+{
+	TypeCacheEntry *typeEntry = lookup_type_cache(typeId, TYPECACHE_CMP_PROC);
+
+	return typeEntry->cmp_proc;
+}
+
+
+/*
+ * PartialTargetEntry builds the target entry computing on a shard the sum
+ * of the values averaged by the given aggregate, in the type of its result.
+ * The function returns NULL if the argument cannot be converted to that type.
+ */
+static TargetEntry *
+PartialTargetEntry(Aggref *aggregate, int resultNumber)
+{
+	Oid resultTypeId = aggregate->aggtype;
+	TargetEntry *argumentEntry = (TargetEntry *) linitial(aggregate->args);
+	Expr *argument = argumentEntry->expr;
+	Oid sumFunctionId = AggregateFunctionId("sum", resultTypeId);
+	Aggref *sumAggregate = NULL;
+	Node *convertedArgument = NULL;
+
+	if (sumFunctionId == InvalidOid)
+	{
+		return NULL;
+	}
+
+	convertedArgument = coerce_to_target_type(NULL, (Node *) argument,
+											  exprType((Node *) argument),
+											  resultTypeId, -1, COERCION_EXPLICIT,
+											  COERCE_EXPLICIT_CAST, -1);
+	if (convertedArgument == NULL)
+	{
+		return NULL;
+	}
+
+	sumAggregate = copyObject(aggregate);
+	sumAggregate->aggfnoid = sumFunctionId;
+	sumAggregate->aggtype = resultTypeId;
+	sumAggregate->args = list_make1(makeTargetEntry((Expr *) convertedArgument, 1,
+													NULL, false));
+
+	return makeTargetEntry((Expr *) sumAggregate, resultNumber, NULL, false);
+}
+
+
+/*
+ * MergePartialValue merges one non-null partial result into the running
+ * result. Values are copied into the current memory context since they come
+ * from a tuple which does not outlive the call.
+ */
+static void
+MergePartialValue(AggregateMergeState *mergeState, Datum partialValue)
+{
+	AggregateMerge *merge = mergeState->merge;
+	bool typeByValue = mergeState->partialTypeByValue;
+	int16 typeLength = mergeState->partialTypeLength;
+	Datum mergedValue = partialValue;
+
+	if (!mergeState->isNull)
+	{
+		if (merge->mergeType == AGGREGATE_MERGE_SUM ||
+			merge->mergeType == AGGREGATE_MERGE_AVG)
+		{
+			mergedValue = FunctionCall2(&mergeState->mergeFunction, mergeState->value,
+										partialValue);
+		}
+		else
+		{
+			int comparison = DatumGetInt32(FunctionCall2Coll(&mergeState->mergeFunction,
+															 merge->collationId,
+															 partialValue,
+															 mergeState->value));
+			bool keepCurrent = (merge->mergeType == AGGREGATE_MERGE_MIN)
+							   ? (comparison >= 0) : (comparison <= 0);
+
+			if (keepCurrent)
+			{
+				return;
+			}
+		}
+	}
+
+	mergeState->value = datumCopy(mergedValue, typeByValue, typeLength);
+	mergeState->isNull = false;
+}
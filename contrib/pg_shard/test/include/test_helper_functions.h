@@ -72,6 +72,8 @@ extern Datum prune_using_no_values(PG_FUNCTION_ARGS);
 extern Datum prune_using_single_value(PG_FUNCTION_ARGS);
 extern Datum prune_using_either_value(PG_FUNCTION_ARGS);
 extern Datum prune_using_both_values(PG_FUNCTION_ARGS);
+extern Datum prune_using_cached_single_value(PG_FUNCTION_ARGS);
+extern Datum prune_using_cached_both_values(PG_FUNCTION_ARGS);
 extern Datum debug_equality_expression(PG_FUNCTION_ARGS);
 
 
@@ -22,6 +22,16 @@ CREATE FUNCTION prune_using_both_values(regclass, text, text)
 	AS 'pg_shard'
 	LANGUAGE C STRICT;
 
+CREATE FUNCTION prune_using_cached_single_value(regclass, text)
+	RETURNS text[]
+	AS 'pg_shard'
+	LANGUAGE C;
+
+CREATE FUNCTION prune_using_cached_both_values(regclass, text, text)
+	RETURNS text[]
+	AS 'pg_shard'
+	LANGUAGE C STRICT;
+
 CREATE FUNCTION debug_equality_expression(regclass)
 	RETURNS cstring
 	AS 'pg_shard'
@@ -64,5 +74,15 @@ SELECT prune_using_both_values('pruning', 'tomato', 'petunia');
 -- but if both values are on the same shard, should get back that shard
 SELECT prune_using_both_values('pruning', 'tomato', 'rose');
 
+-- the cached shard intervals are disjoint, so a value finds its shard by search
+SELECT prune_using_cached_single_value('pruning', 'tomato');
+
+SELECT prune_using_cached_single_value('pruning', 'petunia');
+
+-- other clauses are still checked against the shard found by the search
+SELECT prune_using_cached_both_values('pruning', 'tomato', 'petunia');
+
+SELECT prune_using_cached_both_values('pruning', 'tomato', 'rose');
+
 -- unit test of the equality expression generation code
 SELECT debug_equality_expression('pruning');
@@ -192,3 +192,25 @@ UPDATE limit_orders SET symbol = 'GM';
 
 -- cursors are not supported
 UPDATE limit_orders SET symbol = 'GM' WHERE CURRENT OF cursor_name;
+
+-- prepared modifications are routed to a shard using their parameter values
+PREPARE insert_order (bigint, text, bigint, timestamp, order_side, decimal) AS
+	INSERT INTO limit_orders VALUES ($1, $2, $3, $4, $5, $6);
+EXECUTE insert_order(8900, 'IBM', 215, '2015-03-02 09:12:45', 'buy', 150.20);
+EXECUTE insert_order(8901, 'HPQ', 215, '2015-03-02 09:13:10', 'sell', 34.25);
+SELECT id, symbol FROM limit_orders WHERE id IN (8900, 8901) ORDER BY id;
+
+PREPARE update_order (bigint, text) AS
+	UPDATE limit_orders SET symbol = $2 WHERE id = $1;
+EXECUTE update_order(8901, 'HPE');
+SELECT symbol FROM limit_orders WHERE id = 8901;
+
+PREPARE delete_order (bigint) AS DELETE FROM limit_orders WHERE id = $1;
+EXECUTE delete_order(8900);
+EXECUTE delete_order(8901);
+SELECT COUNT(*) FROM limit_orders WHERE id IN (8900, 8901);
+
+-- prepared INSERTs with a NULL partition value are rejected
+EXECUTE insert_order(NULL, 'IBM', 215, '2015-03-02 09:12:45', 'buy', 150.20);
+
+DEALLOCATE ALL;
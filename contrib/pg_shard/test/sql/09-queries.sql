@@ -171,6 +171,26 @@ SELECT author_id, sum(word_count) AS corpus_size FROM articles
 	ORDER BY sum(word_count) DESC
 	LIMIT 5;
 
+-- aggregates are computed on the shards and merged on the master
+SELECT count(*), count(title), sum(word_count), min(word_count), max(word_count)
+	FROM articles;
+
+SELECT max(word_count), count(*) FROM articles WHERE word_count < 0;
+
+-- averages are merged from per-shard sums and counts
+SELECT avg(word_count), avg(word_count::float8) FROM articles;
+
+SELECT avg(word_count) FROM articles WHERE word_count < 0;
+
+-- ORDER BY with LIMIT fetches only the top rows of each shard
+SELECT title, word_count FROM articles
+	ORDER BY word_count DESC
+	LIMIT 3;
+
+SELECT title, word_count FROM articles
+	ORDER BY word_count DESC
+	LIMIT 2 OFFSET 2;
+
 -- cross-shard queries on a foreign table should fail
 -- we'll just point the article shards to a foreign table
 BEGIN;
@@ -196,6 +216,12 @@ SET client_min_messages = log;
 
 SELECT count(*) FROM articles WHERE word_count > 10000;
 
+SELECT avg(word_count) FROM articles WHERE word_count > 10000;
+
+SELECT title, word_count FROM articles
+	ORDER BY word_count DESC
+	LIMIT 2 OFFSET 2;
+
 SET client_min_messages = DEFAULT;
 SET pg_shard.log_distributed_statements = DEFAULT;
 
@@ -208,3 +234,22 @@ SELECT author_id FROM articles
 -- verify temp tables used by cross-shard queries do not persist
 SELECT COUNT(*) FROM pg_class WHERE relname LIKE 'pg_shard_temp_table%' AND
 									relkind = 'r';
+
+-- prepared statements whose parameters select a single shard are planned once
+PREPARE author_articles (bigint) AS
+	SELECT id, title FROM articles WHERE author_id = $1 ORDER BY id;
+EXECUTE author_articles(7);
+EXECUTE author_articles(8);
+
+-- a NULL partition value matches no shards
+EXECUTE author_articles(NULL);
+
+EXECUTE author_articles(7, 8);
+
+-- other prepared statements are planned on each execution
+PREPARE long_articles (integer) AS
+	SELECT count(*) FROM articles WHERE word_count > $1;
+EXECUTE long_articles(10000);
+
+DEALLOCATE author_articles;
+DEALLOCATE long_articles;
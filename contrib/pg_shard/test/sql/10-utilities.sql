@@ -16,5 +16,6 @@ DECLARE all_sharded_rows CURSOR FOR SELECT * FROM sharded_table;
 -- EXPLAIN support isn't implemented
 EXPLAIN SELECT * FROM sharded_table;
 
--- PREPARE support isn't implemented
+-- prepared statements are executed by pg_shard
 PREPARE sharded_query (bigint) AS SELECT * FROM sharded_table WHERE id = $1;
+DEALLOCATE sharded_query;
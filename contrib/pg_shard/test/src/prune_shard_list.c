@@ -37,6 +37,9 @@
 /* local function forward declarations */
 static Expr * MakeTextPartitionExpression(Oid distributedTableId, text *value);
 static ArrayType * PrunedShardIdsForTable(Oid distributedTableId, List *whereClauseList);
+static ArrayType * CachedPrunedShardIdsForTable(Oid distributedTableId,
+												List *whereClauseList);
+static ArrayType * ShardIntervalListToShardIdArray(List *shardList);
 
 
 /* declarations for dynamic loading */
@@ -44,6 +47,8 @@ PG_FUNCTION_INFO_V1(prune_using_no_values);
 PG_FUNCTION_INFO_V1(prune_using_single_value);
 PG_FUNCTION_INFO_V1(prune_using_either_value);
 PG_FUNCTION_INFO_V1(prune_using_both_values);
+PG_FUNCTION_INFO_V1(prune_using_cached_single_value);
+PG_FUNCTION_INFO_V1(prune_using_cached_both_values);
 PG_FUNCTION_INFO_V1(debug_equality_expression);
 
 
@@ -123,6 +128,47 @@ prune_using_both_values(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * prune_using_cached_single_value returns the shards for the specified
+ * distributed table after pruning its cached shard intervals using a single
+ * value provided by the caller.
+ */
+Datum
+prune_using_cached_single_value(PG_FUNCTION_ARGS)
+{
+	Oid distributedTableId = PG_GETARG_OID(0);
+	text *value = (PG_ARGISNULL(1)) ? NULL : PG_GETARG_TEXT_P(1);
+	Expr *equalityExpr = MakeTextPartitionExpression(distributedTableId, value);
+	List *whereClauseList = list_make1(equalityExpr);
+	ArrayType *shardIdArrayType = CachedPrunedShardIdsForTable(distributedTableId,
+															   whereClauseList);
+
+	PG_RETURN_ARRAYTYPE_P(shardIdArrayType);
+}
+
+
+/*
+ * prune_using_cached_both_values returns the shards for the specified
+ * distributed table after pruning its cached shard intervals using both of the
+ * values provided by the caller (AND).
+ */
+Datum
+prune_using_cached_both_values(PG_FUNCTION_ARGS)
+{
+	Oid distributedTableId = PG_GETARG_OID(0);
+	text *firstValue = PG_GETARG_TEXT_P(1);
+	text *secondValue = PG_GETARG_TEXT_P(2);
+	Expr *firstQual = MakeTextPartitionExpression(distributedTableId, firstValue);
+	Expr *secondQual = MakeTextPartitionExpression(distributedTableId, secondValue);
+
+	List *whereClauseList = list_make2(firstQual, secondQual);
+	ArrayType *shardIdArrayType = CachedPrunedShardIdsForTable(distributedTableId,
+															   whereClauseList);
+
+	PG_RETURN_ARRAYTYPE_P(shardIdArrayType);
+}
+
+
 /*
  * debug_equality_expression returns the textual representation of an equality
  * expression generated by a call to MakeOpExpression.
@@ -179,20 +225,50 @@ MakeTextPartitionExpression(Oid distributedTableId, text *value)
  */
 static ArrayType *
 PrunedShardIdsForTable(Oid distributedTableId, List *whereClauseList)
+{
+	List *shardList = LoadShardIntervalList(distributedTableId);
+
+	shardList = PruneShardList(distributedTableId, whereClauseList, shardList);
+
+	return ShardIntervalListToShardIdArray(shardList);
+}
+
+
+/*
+ * CachedPrunedShardIdsForTable works like PrunedShardIdsForTable, but prunes
+ * the shard intervals held in pg_shard's distributed table cache, which lets
+ * equality clauses on the partition column use a binary search.
+ */
+static ArrayType *
+CachedPrunedShardIdsForTable(Oid distributedTableId, List *whereClauseList)
+{
+	DistributedTableCacheEntry *cacheEntry =
+		LookupDistributedTableCacheEntry(distributedTableId);
+	List *shardList = NIL;
+
+	if (cacheEntry != NULL)
+	{
+		shardList = PruneCachedShardList(cacheEntry, whereClauseList);
+	}
+
+	return ShardIntervalListToShardIdArray(shardList);
+}
+
+
+/*
+ * ShardIntervalListToShardIdArray returns an ArrayType containing the
+ * identifiers of the shards in the provided list.
+ */
+static ArrayType *
+ShardIntervalListToShardIdArray(List *shardList)
 {
 	ArrayType *shardIdArrayType = NULL;
 	ListCell *shardCell = NULL;
 	int shardIdIndex = 0;
 	Oid shardIdTypeId = INT8OID;
 
-	List *shardList = LoadShardIntervalList(distributedTableId);
-	int shardIdCount = -1;
-	Datum *shardIdDatumArray = NULL;
-
-	shardList = PruneShardList(distributedTableId, whereClauseList, shardList);
-
-	shardIdCount = list_length(shardList);
-	shardIdDatumArray = palloc0(shardIdCount * sizeof(Datum));
+	int shardIdCount = list_length(shardList);
+	Datum *shardIdDatumArray = palloc0(shardIdCount * sizeof(Datum));
 
 	foreach(shardCell, shardList)
 	{
@@ -12,9 +12,8 @@
 #include "postgres.h"
 #include "fmgr.h"
 #include "miscadmin.h"
-#include "storage/s_lock.h"
-#include "storage/spin.h"
 #include "storage/lmgr.h"
+#include "storage/lwlock.h"
 #include "storage/shmem.h"
 #include "storage/ipc.h"
 #include "access/xlogdefs.h"
@@ -25,6 +24,7 @@
 #include "access/xlog.h"
 #include "access/clog.h"
 #include "access/twophase.h"
+#include "port/atomics.h"
 #include "executor/spi.h"
 #include "utils/hsearch.h"
 #include "utils/tqual.h"
@@ -38,6 +38,9 @@
 #define MAX_WAIT_TIMEOUT 100000
 #define MAX_GTID_SIZE  16
 #define HASH_PER_ELEM_OVERHEAD 64
+#define DTM_CSN_CACHE_SIZE 4096	/* should be power of two */
+#define DTM_NUM_PARTITIONS 32	/* should be power of two not larger than 32 */
+#define DTM_NUM_LOCKS (DTM_NUM_PARTITIONS*2 + 1)
 
 #define USEC 1000000
 
@@ -59,12 +62,14 @@ typedef struct DtmTransStatus
 /* State of DTM node */
 typedef struct
 {
-	cid_t		cid;			/* last assigned CSN; used to provide unique
+	pg_atomic_uint64 cid;		/* last assigned CSN; used to provide unique
 								 * ascending CSNs */
-	TransactionId oldest_xid;	/* XID of oldest transaction visible by any
-								 * active transaction (local or global) */
-	long		time_shift;		/* correction to system time */
-	volatile slock_t lock;		/* spinlock to protect access to hash table  */
+	pg_atomic_uint32 oldest_xid;	/* XID of oldest transaction visible by
+									 * any active transaction (local or
+									 * global) */
+	pg_atomic_uint64 time_shift;	/* correction to system time */
+	LWLockPadded *locks;		/* partition locks of xid2status and gtid2xid
+								 * hashes followed by DtmListLock */
 	DtmTransStatus *trans_list_head;	/* L1 list of finished transactions
 										 * present in xid2status hash table.
 										 * This list is used to perform
@@ -81,6 +86,31 @@ typedef struct
 	int			nSubxids;
 }	DtmTransId;
 
+/*
+ * Backend-local cache of CSNs of completed transactions.
+ * Status and CSN of committed or aborted transaction never change, so
+ * we can remember them and avoid locking of xid2status hash at subsequent
+ * visibility checks of tuples created by the same transaction.
+ * The cache is direct mapped: collisions just replace the old entry.
+ */
+typedef struct
+{
+	TransactionId xid;
+	XidStatus	status;
+	cid_t		cid;
+}	DtmCsnCacheEntry;
+
+/*
+ * xid2status and gtid2xid hashes are partitioned, each partition is protected by its own lock.
+ * Finished transactions list is protected by DtmListLock.
+ * When several xid2status partitions have to be locked, they are locked in ascending order.
+ * DtmListLock can be obtained while holding partition locks, but not vice versa.
+ */
+#define DtmXidPartition(xid)			((xid) & (DTM_NUM_PARTITIONS - 1))
+#define DtmXidPartitionBit(xid)			((uint32) 1 << DtmXidPartition(xid))
+#define DtmXidPartitionLock(xid)		(&local->locks[DtmXidPartition(xid)].lock)
+#define DtmGtidPartitionLock(hash)		(&local->locks[DTM_NUM_PARTITIONS + ((hash) & (DTM_NUM_PARTITIONS - 1))].lock)
+#define DtmListLock						(&local->locks[DTM_NUM_PARTITIONS*2].lock)
 
 #define DTM_TRACE(x)
 /* #define DTM_TRACE(x) fprintf x */
@@ -93,6 +123,7 @@ static DtmCurrentTrans dtm_tx;
 static uint64 totalSleepInterrupts;
 static int	DtmVacuumDelay;
 static bool DtmRecordCommits;
+static DtmCsnCacheEntry dtm_csn_cache[DTM_CSN_CACHE_SIZE];
 
 static Snapshot DtmGetSnapshot(Snapshot snapshot);
 static TransactionId DtmGetOldestXmin(Relation rel, bool ignoreVacuum);
@@ -100,7 +131,7 @@ static bool DtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot);
 static TransactionId DtmAdjustOldestXid(TransactionId xid);
 static bool DtmDetectGlobalDeadLock(PGPROC *proc);
 static cid_t DtmGetCsn(TransactionId xid);
-static void DtmAddSubtransactions(DtmTransStatus * ts, TransactionId *subxids, int nSubxids);
+static DtmTransStatus *DtmAddSubtransactions(DtmTransStatus * ts, TransactionId *subxids, int nSubxids);
 static char const *DtmGetName(void);
 static size_t DtmGetTransactionStateSize(void);
 static void DtmSerializeTransactionState(void* ctx);
@@ -147,7 +178,7 @@ dtm_get_current_time()
 	struct timeval tv;
 
 	gettimeofday(&tv, NULL);
-	return (timestamp_t) tv.tv_sec * USEC + tv.tv_usec + local->time_shift;
+	return (timestamp_t) tv.tv_sec * USEC + tv.tv_usec + pg_atomic_read_u64(&local->time_shift);
 }
 
 /* Sleep for specified amount of time */
@@ -169,26 +200,27 @@ dtm_sleep(timestamp_t interval)
 }
 
 /* Get unique ascending CSN.
- * This function is called inside critical section
+ * This function is lock-free: last assigned CSN is advanced using CAS.
  */
 static cid_t
 dtm_get_cid()
 {
 	cid_t		cid = dtm_get_current_time();
+	uint64		last = pg_atomic_read_u64(&local->cid);
 
-	if (cid <= local->cid)
-	{
-		cid = ++local->cid;
-	}
-	else
+	while (true)
 	{
-		local->cid = cid;
+		cid_t		next = cid > last ? cid : last + 1;
+
+		if (pg_atomic_compare_exchange_u64(&local->cid, &last, next))
+			return next;
 	}
-	return cid;
 }
 
 /*
- * Adjust system time
+ * Adjust system time.
+ * Concurrent backends may try to adjust time simultaneously, so use CAS
+ * to avoid adding the same correction several times.
  */
 static cid_t
 dtm_sync(cid_t global_cid)
@@ -197,7 +229,9 @@ dtm_sync(cid_t global_cid)
 
 	while ((local_cid = dtm_get_cid()) < global_cid)
 	{
-		local->time_shift += global_cid - local_cid;
+		uint64		shift = pg_atomic_read_u64(&local->time_shift);
+
+		pg_atomic_compare_exchange_u64(&local->time_shift, &shift, shift + global_cid - local_cid);
 	}
 	return local_cid;
 }
@@ -219,6 +253,7 @@ _PG_init(void)
 		return;
 
 	RequestAddinShmemSpace(dtm_memsize());
+	RequestNamedLWLockTranche("pg_tsdtm", DTM_NUM_LOCKS);
 
 	DefineCustomIntVariable(
 							"dtm.vacuum_delay",
@@ -463,22 +498,68 @@ DtmGetName(void)
 	return "pg_tsdtm";
 }
 
+/*
+ * Append chain of transaction statuses to the end of the finished
+ * transactions list. Caller should hold DtmListLock.
+ */
+static void
+DtmTransactionListAppend(DtmTransStatus * head, DtmTransStatus * tail)
+{
+	tail->next = NULL;
+	*local->trans_list_tail = head;
+	local->trans_list_tail = &tail->next;
+}
+
+/*
+ * Get mask of xid2status partitions used by transaction and its subtransactions.
+ * Subtransactions are located either in subxids array either in the list after parent transaction.
+ */
+static uint32
+DtmPartitionMask(DtmTransStatus * ts, TransactionId xid, TransactionId *subxids, int nSubxids)
+{
+	uint32		mask = DtmXidPartitionBit(xid);
+	int			i;
+
+	for (i = 0; i < nSubxids; i++)
+	{
+		if (subxids != NULL)
+		{
+			mask |= DtmXidPartitionBit(subxids[i]);
+		}
+		else
+		{
+			ts = ts->next;
+			mask |= DtmXidPartitionBit(ts->xid);
+		}
+	}
+	return mask;
+}
+
+/*
+ * Exclusively lock set of xid2status partitions.
+ * Partitions are always locked in ascending order to avoid deadlocks.
+ */
 static void
-DtmTransactionListAppend(DtmTransStatus * ts)
+DtmLockPartitions(uint32 mask)
 {
-	ts->next = NULL;
-	*local->trans_list_tail = ts;
-	local->trans_list_tail = &ts->next;
+	int			i;
+
+	for (i = 0; i < DTM_NUM_PARTITIONS; i++)
+	{
+		if (mask & ((uint32) 1 << i))
+			LWLockAcquire(&local->locks[i].lock, LW_EXCLUSIVE);
+	}
 }
 
 static void
-DtmTransactionListInsertAfter(DtmTransStatus * after, DtmTransStatus * ts)
+DtmUnlockPartitions(uint32 mask)
 {
-	ts->next = after->next;
-	after->next = ts;
-	if (local->trans_list_tail == &after->next)
+	int			i;
+
+	for (i = DTM_NUM_PARTITIONS; --i >= 0;)
 	{
-		local->trans_list_tail = &ts->next;
+		if (mask & ((uint32) 1 << i))
+			LWLockRelease(&local->locks[i].lock);
 	}
 }
 
@@ -495,32 +576,55 @@ DtmAdjustOldestXid(TransactionId xid)
 	if (TransactionIdIsValid(xid))
 	{
 		DtmTransStatus *ts,
+				   *next,
+				   *head = NULL,
 				   *prev = NULL;
-		timestamp_t now = dtm_get_current_time();
-		timestamp_t cutoff_time = now - DtmVacuumDelay * USEC;
+		timestamp_t cutoff_time = 0;
+		bool		found;
 
-		SpinLockAcquire(&local->lock);
+		LWLockAcquire(DtmXidPartitionLock(xid), LW_SHARED);
 		ts = (DtmTransStatus *) hash_search(xid2status, &xid, HASH_FIND, NULL);
-		if (ts != NULL)
-		{
+		found = ts != NULL;
+		if (found)
 			cutoff_time = ts->cid - DtmVacuumDelay * USEC;
+		LWLockRelease(DtmXidPartitionLock(xid));
 
-			for (ts = local->trans_list_head; ts != NULL && ts->cid < cutoff_time; prev = ts, ts = ts->next)
+		if (found)
+		{
+			/*
+			 * Detach expired prefix of the list. CSNs of in-doubt transactions
+			 * may be concurrently updated, but such transactions are never
+			 * older than cutoff time.
+			 */
+			LWLockAcquire(DtmListLock, LW_EXCLUSIVE);
+			head = local->trans_list_head;
+			for (ts = head; ts != NULL && ts->cid < cutoff_time; prev = ts, ts = ts->next);
+			if (prev != NULL)
 			{
-				if (prev != NULL)
-					hash_search(xid2status, &prev->xid, HASH_REMOVE, NULL);
+				local->trans_list_head = prev;
+				xid = prev->xid;
+				pg_atomic_write_u32(&local->oldest_xid, xid);
+			}
+			LWLockRelease(DtmListLock);
+
+			/* Detached entries are not visible to anybody else through the list, so remove them from hash */
+			if (prev != NULL)
+			{
+				for (ts = head; ts != prev; ts = next)
+				{
+					TransactionId txid = ts->xid;
+
+					next = ts->next;
+					LWLockAcquire(DtmXidPartitionLock(txid), LW_EXCLUSIVE);
+					hash_search(xid2status, &txid, HASH_REMOVE, NULL);
+					LWLockRelease(DtmXidPartitionLock(txid));
+				}
 			}
 		}
-		if (prev != NULL)
-		{
-			local->trans_list_head = prev;
-			local->oldest_xid = xid = prev->xid;
-		}
-		else
+		if (prev == NULL)
 		{
-			xid = local->oldest_xid;
+			xid = pg_atomic_read_u32(&local->oldest_xid);
 		}
-		SpinLockRelease(&local->lock);
 	}
 	return xid;
 }
@@ -550,10 +654,18 @@ bool
 DtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 {
 	timestamp_t delay = MIN_WAIT_TIMEOUT;
+	DtmCsnCacheEntry *ce = &dtm_csn_cache[xid & (DTM_CSN_CACHE_SIZE - 1)];
+	LWLock	   *lock = DtmXidPartitionLock(xid);
 
 	Assert(xid != InvalidTransactionId);
 
-	SpinLockAcquire(&local->lock);
+	if (ce->xid == xid)
+	{
+		DTM_TRACE((stderr, "%d: use cached csn=%lld for xid=%d\n", getpid(), ce->cid, xid));
+		return ce->cid > dtm_tx.snapshot || ce->status == TRANSACTION_STATUS_ABORTED;
+	}
+
+	LWLockAcquire(lock, LW_SHARED);
 
 	while (true)
 	{
@@ -565,27 +677,31 @@ DtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 			{
 				DTM_TRACE((stderr, "%d: tuple with xid=%d(csn=%lld) is invisibile in snapshot %lld\n",
 						   getpid(), xid, ts->cid, dtm_tx.snapshot));
-				SpinLockRelease(&local->lock);
+				LWLockRelease(lock);
 				return true;
 			}
 			if (ts->status == TRANSACTION_STATUS_IN_PROGRESS)
 			{
 				DTM_TRACE((stderr, "%d: wait for in-doubt transaction %u in snapshot %lu\n", getpid(), xid, dtm_tx.snapshot));
-				SpinLockRelease(&local->lock);
+				LWLockRelease(lock);
 
 				dtm_sleep(delay);
 
 				if (delay * 2 <= MAX_WAIT_TIMEOUT)
 					delay *= 2;
-				SpinLockAcquire(&local->lock);
+				LWLockAcquire(lock, LW_SHARED);
 			}
 			else
 			{
 				bool		invisible = ts->status == TRANSACTION_STATUS_ABORTED;
 
+				ce->xid = xid;
+				ce->status = ts->status;
+				ce->cid = ts->cid;
+
 				DTM_TRACE((stderr, "%d: tuple with xid=%d(csn= %lld) is %s in snapshot %lld\n",
 						   getpid(), xid, ts->cid, invisible ? "rollbacked" : "committed", dtm_tx.snapshot));
-				SpinLockRelease(&local->lock);
+				LWLockRelease(lock);
 				return invisible;
 			}
 		}
@@ -595,7 +711,7 @@ DtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 			break;
 		}
 	}
-	SpinLockRelease(&local->lock);
+	LWLockRelease(lock);
 	return PgXidInMVCCSnapshot(xid, snapshot);
 }
 
@@ -609,20 +725,22 @@ DtmInitialize()
 	info.entrysize = sizeof(DtmTransStatus);
 	info.hash = dtm_xid_hash_fn;
 	info.match = dtm_xid_match_fn;
+	info.num_partitions = DTM_NUM_PARTITIONS;
 	xid2status = ShmemInitHash("xid2status",
 							   DTM_HASH_INIT_SIZE, DTM_HASH_INIT_SIZE,
 							   &info,
-							   HASH_ELEM | HASH_FUNCTION | HASH_COMPARE);
+							   HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_PARTITION);
 
 	info.keysize = MAX_GTID_SIZE;
 	info.entrysize = sizeof(DtmTransId);
 	info.hash = dtm_gtid_hash_fn;
 	info.match = dtm_gtid_match_fn;
 	info.keycopy = dtm_gtid_keycopy_fn;
+	info.num_partitions = DTM_NUM_PARTITIONS;
 	gtid2xid = ShmemInitHash("gtid2xid",
 							 DTM_HASH_INIT_SIZE, DTM_HASH_INIT_SIZE,
 							 &info,
-					HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_KEYCOPY);
+		   HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_KEYCOPY | HASH_PARTITION);
 
 	TM = &DtmTM;
 
@@ -630,12 +748,12 @@ DtmInitialize()
 	local = (DtmNodeState *) ShmemInitStruct("dtm", sizeof(DtmNodeState), &found);
 	if (!found)
 	{
-		local->time_shift = 0;
-		local->oldest_xid = FirstNormalTransactionId;
-		local->cid = dtm_get_current_time();
+		pg_atomic_init_u64(&local->time_shift, 0);
+		pg_atomic_init_u32(&local->oldest_xid, FirstNormalTransactionId);
+		pg_atomic_init_u64(&local->cid, dtm_get_current_time());
 		local->trans_list_head = NULL;
 		local->trans_list_tail = &local->trans_list_head;
-		SpinLockInit(&local->lock);
+		local->locks = GetNamedLWLockTranche("pg_tsdtm");
 		RegisterXactCallback(dtm_xact_callback, NULL);
 	}
 	LWLockRelease(AddinShmemInitLock);
@@ -650,18 +768,52 @@ DtmLocalBegin(DtmCurrentTrans * x)
 {
 	if (!TransactionIdIsValid(x->xid))
 	{
-		SpinLockAcquire(&local->lock);
 		x->xid = GetCurrentTransactionId();
 		Assert(TransactionIdIsValid(x->xid));
 		x->cid = INVALID_CID;
 		x->is_global = false;
 		x->is_prepared = false;
 		x->snapshot = dtm_get_cid();
-		SpinLockRelease(&local->lock);
 		DTM_TRACE((stderr, "DtmLocalBegin: transaction %u uses local snapshot %lu\n", x->xid, x->snapshot));
 	}
 }
 
+/*
+ * Register mapping of global transaction identifier to local XID
+ */
+static void
+DtmRegisterGlobalTransaction(GlobalTransactionId gtid, TransactionId xid)
+{
+	uint32		hash = get_hash_value(gtid2xid, gtid);
+	DtmTransId *id;
+
+	LWLockAcquire(DtmGtidPartitionLock(hash), LW_EXCLUSIVE);
+	id = (DtmTransId *) hash_search_with_hash_value(gtid2xid, gtid, hash, HASH_ENTER, NULL);
+	id->xid = xid;
+	id->nSubxids = 0;
+	id->subxids = 0;
+	LWLockRelease(DtmGtidPartitionLock(hash));
+}
+
+/*
+ * Get copy of global transaction descriptor. Only the backend owning
+ * the global transaction can change its descriptor, so it is safe to use the copy.
+ */
+static void
+DtmFindGlobalTransaction(GlobalTransactionId gtid, DtmTransId * copy, HASHACTION action)
+{
+	uint32		hash = get_hash_value(gtid2xid, gtid);
+	DtmTransId *id;
+
+	LWLockAcquire(DtmGtidPartitionLock(hash), action == HASH_REMOVE ? LW_EXCLUSIVE : LW_SHARED);
+	id = (DtmTransId *) hash_search_with_hash_value(gtid2xid, gtid, hash, HASH_FIND, NULL);
+	Assert(id != NULL);
+	*copy = *id;
+	if (action == HASH_REMOVE)
+		hash_search_with_hash_value(gtid2xid, gtid, hash, HASH_REMOVE, NULL);
+	LWLockRelease(DtmGtidPartitionLock(hash));
+}
+
 /*
  * Transaction is going to be distributed.
  * Returns snapshot of current transaction.
@@ -671,15 +823,7 @@ DtmLocalExtend(DtmCurrentTrans * x, GlobalTransactionId gtid)
 {
 	if (gtid != NULL)
 	{
-		SpinLockAcquire(&local->lock);
-		{
-			DtmTransId *id = (DtmTransId *) hash_search(gtid2xid, gtid, HASH_ENTER, NULL);
-
-			id->xid = x->xid;
-			id->nSubxids = 0;
-			id->subxids = 0;
-		}
-		SpinLockRelease(&local->lock);
+		DtmRegisterGlobalTransaction(gtid, x->xid);
 	}
 	x->is_global = true;
 	return x->snapshot;
@@ -694,21 +838,14 @@ DtmLocalAccess(DtmCurrentTrans * x, GlobalTransactionId gtid, cid_t global_cid)
 {
 	cid_t		local_cid;
 
-	SpinLockAcquire(&local->lock);
+	if (gtid != NULL)
 	{
-		if (gtid != NULL)
-		{
-			DtmTransId *id = (DtmTransId *) hash_search(gtid2xid, gtid, HASH_ENTER, NULL);
-
-			id->xid = x->xid;
-			id->nSubxids = 0;
-			id->subxids = 0;
-		}
-		local_cid = dtm_sync(global_cid);
-		x->snapshot = global_cid;
-		x->is_global = true;
+		DtmRegisterGlobalTransaction(gtid, x->xid);
 	}
-	SpinLockRelease(&local->lock);
+	local_cid = dtm_sync(global_cid);
+	x->snapshot = global_cid;
+	x->is_global = true;
+
 	if (global_cid < local_cid - DtmVacuumDelay * USEC)
 	{
 		elog(ERROR, "Too old snapshot: requested %ld, current %ld", global_cid, local_cid);
@@ -723,22 +860,25 @@ DtmLocalAccess(DtmCurrentTrans * x, GlobalTransactionId gtid, cid_t global_cid)
 void
 DtmLocalBeginPrepare(GlobalTransactionId gtid)
 {
-	SpinLockAcquire(&local->lock);
-	{
-		DtmTransStatus *ts;
-		DtmTransId *id;
-
-		id = (DtmTransId *) hash_search(gtid2xid, gtid, HASH_FIND, NULL);
-		Assert(id != NULL);
-		Assert(TransactionIdIsValid(id->xid));
-		ts = (DtmTransStatus *) hash_search(xid2status, &id->xid, HASH_ENTER, NULL);
-		ts->status = TRANSACTION_STATUS_IN_PROGRESS;
-		ts->cid = dtm_get_cid();
-		ts->nSubxids = id->nSubxids;
-		DtmTransactionListAppend(ts);
-		DtmAddSubtransactions(ts, id->subxids, id->nSubxids);
-	}
-	SpinLockRelease(&local->lock);
+	DtmTransStatus *ts,
+			   *tail;
+	DtmTransId	id;
+	uint32		mask;
+
+	DtmFindGlobalTransaction(gtid, &id, HASH_FIND);
+	Assert(TransactionIdIsValid(id.xid));
+
+	mask = DtmPartitionMask(NULL, id.xid, id.subxids, id.nSubxids);
+	DtmLockPartitions(mask);
+	ts = (DtmTransStatus *) hash_search(xid2status, &id.xid, HASH_ENTER, NULL);
+	ts->status = TRANSACTION_STATUS_IN_PROGRESS;
+	ts->cid = dtm_get_cid();
+	ts->nSubxids = id.nSubxids;
+	tail = DtmAddSubtransactions(ts, id.subxids, id.nSubxids);
+	LWLockAcquire(DtmListLock, LW_EXCLUSIVE);
+	DtmTransactionListAppend(ts, tail);
+	LWLockRelease(DtmListLock);
+	DtmUnlockPartitions(mask);
 }
 
 /*
@@ -748,15 +888,12 @@ DtmLocalBeginPrepare(GlobalTransactionId gtid)
 cid_t
 DtmLocalPrepare(GlobalTransactionId gtid, cid_t global_cid)
 {
-	cid_t		local_cid;
+	cid_t		local_cid = dtm_get_cid();
 
-	SpinLockAcquire(&local->lock);
-	local_cid = dtm_get_cid();
 	if (local_cid > global_cid)
 	{
 		global_cid = local_cid;
 	}
-	SpinLockRelease(&local->lock);
 	return global_cid;
 }
 
@@ -766,28 +903,33 @@ DtmLocalPrepare(GlobalTransactionId gtid, cid_t global_cid)
 void
 DtmLocalEndPrepare(GlobalTransactionId gtid, cid_t cid)
 {
-	SpinLockAcquire(&local->lock);
-	{
-		DtmTransStatus *ts;
-		DtmTransId *id;
-		int			i;
+	DtmTransStatus *ts;
+	DtmTransId	id;
+	int			i;
+	int			nSubxids;
+	uint32		mask;
 
-		id = (DtmTransId *) hash_search(gtid2xid, gtid, HASH_FIND, NULL);
-		Assert(id != NULL);
+	DtmFindGlobalTransaction(gtid, &id, HASH_FIND);
 
-		ts = (DtmTransStatus *) hash_search(xid2status, &id->xid, HASH_FIND, NULL);
-		Assert(ts != NULL);
-		ts->cid = cid;
-		for (i = 0; i < ts->nSubxids; i++)
-		{
-			ts = ts->next;
-			ts->cid = cid;
-		}
-		dtm_sync(cid);
+	LWLockAcquire(DtmXidPartitionLock(id.xid), LW_SHARED);
+	ts = (DtmTransStatus *) hash_search(xid2status, &id.xid, HASH_FIND, NULL);
+	Assert(ts != NULL);
+	nSubxids = ts->nSubxids;
+	LWLockRelease(DtmXidPartitionLock(id.xid));
 
-		DTM_TRACE((stderr, "Prepare transaction %u(%s) with CSN %lu\n", id->xid, gtid, cid));
+	mask = DtmPartitionMask(ts, id.xid, NULL, nSubxids);
+	DtmLockPartitions(mask);
+	ts->cid = cid;
+	for (i = 0; i < nSubxids; i++)
+	{
+		ts = ts->next;
+		ts->cid = cid;
 	}
-	SpinLockRelease(&local->lock);
+	DtmUnlockPartitions(mask);
+
+	dtm_sync(cid);
+
+	DTM_TRACE((stderr, "Prepare transaction %u(%s) with CSN %lu\n", id.xid, gtid, cid));
 
 	/*
 	 * Record commit in pg_committed_xact table to be make it possible to
@@ -815,22 +957,18 @@ DtmLocalEndPrepare(GlobalTransactionId gtid, cid_t cid)
 void
 DtmLocalCommitPrepared(DtmCurrentTrans * x, GlobalTransactionId gtid)
 {
-	Assert(gtid != NULL);
+	DtmTransId	id;
 
-	SpinLockAcquire(&local->lock);
-	{
-		DtmTransId *id = (DtmTransId *) hash_search(gtid2xid, gtid, HASH_REMOVE, NULL);
+	Assert(gtid != NULL);
 
-		Assert(id != NULL);
+	DtmFindGlobalTransaction(gtid, &id, HASH_REMOVE);
 
-		x->is_global = true;
-		x->is_prepared = true;
-		x->xid = id->xid;
-		free(id->subxids);
+	x->is_global = true;
+	x->is_prepared = true;
+	x->xid = id.xid;
+	free(id.subxids);
 
-		DTM_TRACE((stderr, "Global transaction %u(%s) is precommitted\n", x->xid, gtid));
-	}
-	SpinLockRelease(&local->lock);
+	DTM_TRACE((stderr, "Global transaction %u(%s) is precommitted\n", x->xid, gtid));
 }
 
 /*
@@ -839,42 +977,60 @@ DtmLocalCommitPrepared(DtmCurrentTrans * x, GlobalTransactionId gtid)
 void
 DtmLocalCommit(DtmCurrentTrans * x)
 {
-	SpinLockAcquire(&local->lock);
 	if (TransactionIdIsValid(x->xid))
 	{
 		bool		found;
 		DtmTransStatus *ts;
+		uint32		mask;
 
-		ts = (DtmTransStatus *) hash_search(xid2status, &x->xid, HASH_ENTER, &found);
-		ts->status = TRANSACTION_STATUS_COMMITTED;
 		if (x->is_prepared)
 		{
 			int			i;
-			DtmTransStatus *sts = ts;
+			int			nSubxids;
+			DtmTransStatus *sts;
 
-			Assert(found);
 			Assert(x->is_global);
-			for (i = 0; i < ts->nSubxids; i++)
+
+			LWLockAcquire(DtmXidPartitionLock(x->xid), LW_SHARED);
+			ts = (DtmTransStatus *) hash_search(xid2status, &x->xid, HASH_FIND, NULL);
+			Assert(ts != NULL);
+			nSubxids = ts->nSubxids;
+			LWLockRelease(DtmXidPartitionLock(x->xid));
+
+			mask = DtmPartitionMask(ts, x->xid, NULL, nSubxids);
+			DtmLockPartitions(mask);
+			ts->status = TRANSACTION_STATUS_COMMITTED;
+			for (i = 0, sts = ts; i < nSubxids; i++)
 			{
 				sts = sts->next;
 				Assert(sts->cid == ts->cid);
 				sts->status = TRANSACTION_STATUS_COMMITTED;
 			}
+			x->cid = ts->cid;
+			DtmUnlockPartitions(mask);
 		}
 		else
 		{
 			TransactionId *subxids;
+			int			nSubxids = xactGetCommittedChildren(&subxids);
+			DtmTransStatus *tail;
 
+			mask = DtmPartitionMask(NULL, x->xid, subxids, nSubxids);
+			DtmLockPartitions(mask);
+			ts = (DtmTransStatus *) hash_search(xid2status, &x->xid, HASH_ENTER, &found);
 			Assert(!found);
+			ts->status = TRANSACTION_STATUS_COMMITTED;
 			ts->cid = dtm_get_cid();
-			DtmTransactionListAppend(ts);
-			ts->nSubxids = xactGetCommittedChildren(&subxids);
-			DtmAddSubtransactions(ts, subxids, ts->nSubxids);
+			ts->nSubxids = nSubxids;
+			tail = DtmAddSubtransactions(ts, subxids, nSubxids);
+			LWLockAcquire(DtmListLock, LW_EXCLUSIVE);
+			DtmTransactionListAppend(ts, tail);
+			LWLockRelease(DtmListLock);
+			x->cid = ts->cid;
+			DtmUnlockPartitions(mask);
 		}
-		x->cid = ts->cid;
 		DTM_TRACE((stderr, "Local transaction %u is committed at %lu\n", x->xid, x->cid));
 	}
-	SpinLockRelease(&local->lock);
 }
 
 /*
@@ -883,22 +1039,18 @@ DtmLocalCommit(DtmCurrentTrans * x)
 void
 DtmLocalAbortPrepared(DtmCurrentTrans * x, GlobalTransactionId gtid)
 {
-	Assert(gtid != NULL);
+	DtmTransId	id;
 
-	SpinLockAcquire(&local->lock);
-	{
-		DtmTransId *id = (DtmTransId *) hash_search(gtid2xid, gtid, HASH_REMOVE, NULL);
+	Assert(gtid != NULL);
 
-		Assert(id != NULL);
+	DtmFindGlobalTransaction(gtid, &id, HASH_REMOVE);
 
-		x->is_global = true;
-		x->is_prepared = true;
-		x->xid = id->xid;
-		free(id->subxids);
+	x->is_global = true;
+	x->is_prepared = true;
+	x->xid = id.xid;
+	free(id.subxids);
 
-		DTM_TRACE((stderr, "Global transaction %u(%s) is preaborted\n", x->xid, gtid));
-	}
-	SpinLockRelease(&local->lock);
+	DTM_TRACE((stderr, "Global transaction %u(%s) is preaborted\n", x->xid, gtid));
 }
 
 /*
@@ -907,30 +1059,32 @@ DtmLocalAbortPrepared(DtmCurrentTrans * x, GlobalTransactionId gtid)
 void
 DtmLocalAbort(DtmCurrentTrans * x)
 {
-	SpinLockAcquire(&local->lock);
-	{
-		bool		found;
-		DtmTransStatus *ts;
+	bool		found;
+	DtmTransStatus *ts;
 
-		Assert(TransactionIdIsValid(x->xid));
-		ts = (DtmTransStatus *) hash_search(xid2status, &x->xid, HASH_ENTER, &found);
-		if (x->is_prepared)
-		{
-			Assert(found);
-			Assert(x->is_global);
-		}
-		else
-		{
-			Assert(!found);
-			ts->cid = dtm_get_cid();
-			ts->nSubxids = 0;
-			DtmTransactionListAppend(ts);
-		}
-		x->cid = ts->cid;
-		ts->status = TRANSACTION_STATUS_ABORTED;
-		DTM_TRACE((stderr, "Local transaction %u is aborted at %lu\n", x->xid, x->cid));
+	Assert(TransactionIdIsValid(x->xid));
+
+	LWLockAcquire(DtmXidPartitionLock(x->xid), LW_EXCLUSIVE);
+	ts = (DtmTransStatus *) hash_search(xid2status, &x->xid, HASH_ENTER, &found);
+	if (x->is_prepared)
+	{
+		Assert(found);
+		Assert(x->is_global);
 	}
-	SpinLockRelease(&local->lock);
+	else
+	{
+		Assert(!found);
+		ts->cid = dtm_get_cid();
+		ts->nSubxids = 0;
+		LWLockAcquire(DtmListLock, LW_EXCLUSIVE);
+		DtmTransactionListAppend(ts, ts);
+		LWLockRelease(DtmListLock);
+	}
+	x->cid = ts->cid;
+	ts->status = TRANSACTION_STATUS_ABORTED;
+	LWLockRelease(DtmXidPartitionLock(x->xid));
+
+	DTM_TRACE((stderr, "Local transaction %u is aborted at %lu\n", x->xid, x->cid));
 }
 
 /*
@@ -980,17 +1134,15 @@ static cid_t
 DtmGetCsn(TransactionId xid)
 {
 	cid_t		csn = 0;
+	DtmTransStatus *ts;
 
-	SpinLockAcquire(&local->lock);
+	LWLockAcquire(DtmXidPartitionLock(xid), LW_SHARED);
+	ts = (DtmTransStatus *) hash_search(xid2status, &xid, HASH_FIND, NULL);
+	if (ts != NULL)
 	{
-		DtmTransStatus *ts = (DtmTransStatus *) hash_search(xid2status, &xid, HASH_FIND, NULL);
-
-		if (ts != NULL)
-		{
-			csn = ts->cid;
-		}
+		csn = ts->cid;
 	}
-	SpinLockRelease(&local->lock);
+	LWLockRelease(DtmXidPartitionLock(xid));
 	return csn;
 }
 
@@ -1002,34 +1154,37 @@ DtmLocalSavePreparedState(GlobalTransactionId gtid)
 {
 	if (gtid != NULL)
 	{
-		SpinLockAcquire(&local->lock);
+		uint32		hash = get_hash_value(gtid2xid, gtid);
+		DtmTransId *id;
+
+		LWLockAcquire(DtmGtidPartitionLock(hash), LW_EXCLUSIVE);
+		id = (DtmTransId *) hash_search_with_hash_value(gtid2xid, gtid, hash, HASH_FIND, NULL);
+		if (id != NULL)
 		{
-			DtmTransId *id = (DtmTransId *) hash_search(gtid2xid, gtid, HASH_FIND, NULL);
+			TransactionId *subxids;
+			int			nSubxids = xactGetCommittedChildren(&subxids);
 
-			if (id != NULL)
+			if (nSubxids != 0)
 			{
-				TransactionId *subxids;
-				int			nSubxids = xactGetCommittedChildren(&subxids);
-
-				if (nSubxids != 0)
-				{
-					id->subxids = (TransactionId *) malloc(nSubxids * sizeof(TransactionId));
-					id->nSubxids = nSubxids;
-					memcpy(id->subxids, subxids, nSubxids * sizeof(TransactionId));
-				}
+				id->subxids = (TransactionId *) malloc(nSubxids * sizeof(TransactionId));
+				id->nSubxids = nSubxids;
+				memcpy(id->subxids, subxids, nSubxids * sizeof(TransactionId));
 			}
 		}
-		SpinLockRelease(&local->lock);
+		LWLockRelease(DtmGtidPartitionLock(hash));
 	}
 }
 
 /*
- * Add subtransactions to finished transactions list.
+ * Add subtransactions to xid2status hash and link them in chain after parent transaction.
  * Copy CSN and status of parent transaction.
+ * Caller should hold locks of all partitions used by transaction.
+ * Returns last element of the chain.
  */
-static void
+static DtmTransStatus *
 DtmAddSubtransactions(DtmTransStatus * ts, TransactionId *subxids, int nSubxids)
 {
+	DtmTransStatus *tail = ts;
 	int			i;
 
 	for (i = 0; i < nSubxids; i++)
@@ -1043,6 +1198,8 @@ DtmAddSubtransactions(DtmTransStatus * ts, TransactionId *subxids, int nSubxids)
 		sts->status = ts->status;
 		sts->cid = ts->cid;
 		sts->nSubxids = 0;
-		DtmTransactionListInsertAfter(ts, sts);
+		tail->next = sts;
+		tail = sts;
 	}
+	return tail;
 }
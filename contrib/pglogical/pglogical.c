@@ -49,6 +49,9 @@ static const struct config_enum_entry PGLogicalConflictResolvers[] = {
 
 bool	pglogical_synchronous_commit = false;
 char   *pglogical_temp_directory;
+int		pglogical_copy_streams = 4;
+int		pglogical_apply_workers = 0;
+bool	pglogical_batch_compression = false;
 
 void _PG_init(void);
 void pglogical_supervisor_main(Datum main_arg);
@@ -280,6 +283,11 @@ pglogical_start_replication(PGconn *streamConn, const char *slot_name,
 	/* Tell the upstream that we want unbounded metadata cache size */
 	appendStringInfoString(&command, ", \"relmeta_cache_size\" '-1'");
 
+	/* Consecutive changes to the same table can be sent together. */
+	appendStringInfoString(&command, ", \"batch_changes\" '1'");
+	appendStringInfo(&command, ", \"batch_compression\" '%d'",
+					 pglogical_batch_compression);
+
 	/* general info about the downstream */
 	appendStringInfo(&command, ", pg_version '%u'", PG_VERSION_NUM);
 	appendStringInfo(&command, ", pglogical_version '%s'", PGLOGICAL_VERSION);
@@ -430,6 +438,14 @@ _PG_init(void)
 							 0,
 							 NULL, NULL, NULL);
 
+	DefineCustomBoolVariable("pglogical.batch_compression",
+							 "compress the batches of changes sent by the provider",
+							 NULL,
+							 &pglogical_batch_compression,
+							 false, PGC_SIGHUP,
+							 0,
+							 NULL, NULL, NULL);
+
 	/*
 	 * We can't use the temp_tablespace safely for our dumps, because Pg's
 	 * crash recovery is very careful to delete only particularly formatted
@@ -442,6 +458,25 @@ _PG_init(void)
 							   "/tmp", PGC_SIGHUP,
 							   0,
 							   NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pglogical.copy_streams",
+							"Number of parallel connections used for initial data copy",
+							NULL,
+							&pglogical_copy_streams,
+							4, 1, 64,
+							PGC_SIGHUP,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pglogical.apply_workers",
+							"Number of parallel workers used to apply changes of a subscription",
+							"Zero disables parallel apply.",
+							&pglogical_apply_workers,
+							0, 0, 64,
+							PGC_SIGHUP,
+							0,
+							NULL, NULL, NULL);
+
 	if (IsBinaryUpgrade)
 		return;
 
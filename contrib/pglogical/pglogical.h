@@ -38,6 +38,9 @@
 
 extern bool pglogical_synchronous_commit;
 extern char *pglogical_temp_directory;
+extern int pglogical_copy_streams;
+extern int pglogical_apply_workers;
+extern bool pglogical_batch_compression;
 
 extern char *shorten_hash(const char *str, int maxlen);
 
@@ -16,10 +16,12 @@
 #include "libpq-fe.h"
 #include "pgstat.h"
 
+#include "access/heapam.h"
 #include "access/htup_details.h"
 #include "access/xact.h"
 
 #include "catalog/namespace.h"
+#include "catalog/pg_class.h"
 
 #include "commands/dbcommands.h"
 #include "commands/tablecmds.h"
@@ -47,10 +49,13 @@
 #include "tcop/utility.h"
 
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/jsonb.h"
 #include "utils/memutils.h"
 #include "utils/snapmgr.h"
+#include "utils/syscache.h"
 
+#include "pglogical_apply_parallel.h"
 #include "pglogical_conflict.h"
 #include "pglogical_node.h"
 #include "pglogical_proto.h"
@@ -64,6 +69,45 @@
 
 
 void pglogical_apply_main(Datum main_arg);
+void pglogical_apply_parallel_main(Datum main_arg);
+
+/* Maximum number of inserts buffered before they are written out. */
+#define APPLY_INSERT_BATCH_SIZE		64
+
+/*
+ * Executor state used to apply changes to a relation.
+ *
+ * The state is kept across consecutive changes to the same relation in a
+ * remote transaction, so that we don't have to set up the executor, open the
+ * indexes and prepare the column defaults for every row. Inserts which don't
+ * conflict with local data are buffered and written using heap_multi_insert.
+ */
+typedef struct ApplyExecState
+{
+	MemoryContext		context;
+	PGLogicalRelation  *rel;		/* relation cache entry */
+	Relation			relation;	/* our own reference to the relation */
+	EState			   *estate;
+	TupleTableSlot	   *localslot;
+	TupleTableSlot	   *applyslot;
+
+	/* Defaults of the columns we don't get from the remote node. */
+	int					num_defaults;
+	int				   *defmap;
+	ExprState		  **defexprs;
+	/* Defaults of inserts are evaluated here so they survive a flush. */
+	ExprContext		   *defaults_econtext;
+
+	/* Scan of the REPLICA IDENTITY index, started on first use. */
+	PGLogicalIndexScan *replidx_scan;
+
+	/* Buffered inserts. */
+	MemoryContext		batch_context;
+	HeapTuple			batch_tuples[APPLY_INSERT_BATCH_SIZE];
+	int					batch_ntuples;
+} ApplyExecState;
+
+static ApplyExecState  *ApplyState = NULL;
 
 static bool			in_remote_transaction = false;
 static XLogRecPtr	remote_origin_lsn = InvalidXLogRecPtr;
@@ -87,7 +131,22 @@ typedef struct PGLFlushPosition
 
 dlist_head lsn_mapping = DLIST_STATIC_INIT(lsn_mapping);
 
+/* Largest transaction we buffer for the parallel apply workers. */
+#define PARALLEL_XACT_MAX_SIZE		(16 * 1024 * 1024)
+
+/*
+ * Remote transaction being buffered by the apply worker when parallel apply
+ * is enabled.
+ */
+static MemoryContext	ParallelXactContext = NULL;
+static List			   *ParallelXactMessages = NIL;
+static Size				ParallelXactSize = 0;
+static bool				ParallelXactSerial = false;	/* applying it ourselves */
+static RepOriginId		ParallelXactOriginId = InvalidRepOriginId;
+
+static void replication_handler(StringInfo s);
 static void handle_queued_message(HeapTuple msgtup, bool tx_just_started);
+static void apply_state_end(void);
 static void handle_startup_param(const char *key, const char *value);
 static bool parse_bool_param(const char *key, const char *value);
 static void process_syncing_tables(XLogRecPtr end_lsn);
@@ -117,6 +176,10 @@ ensure_transaction(void)
 
 	StartTransactionCommand();
 	MemoryContextSwitchTo(MessageContext);
+
+	/* Executor state of previous transaction is gone. */
+	ApplyState = NULL;
+
 	return true;
 }
 
@@ -155,10 +218,17 @@ handle_commit(StringInfo s)
 
 	pglogical_read_commit(s, &commit_lsn, &end_lsn, &commit_time, &flags, &gid);
 
+	/* Write out buffered changes and release the executor state. */
+	apply_state_end();
+
 	switch(PGLOGICAL_XACT_EVENT(flags))
 	{
 		case PGLOGICAL_COMMIT:
 		{
+			/* Wait for the previously received transactions to commit. */
+			if (pglogical_parallel_apply_worker())
+				pglogical_parallel_apply_commit_start();
+
 			if (IsTransactionState())
 				CommitTransactionCommand();
 			else
@@ -225,7 +295,7 @@ handle_commit(StringInfo s)
 			Assert(false);
 	}
 
-	if (flush)
+	if (flush && !pglogical_parallel_apply_worker())
 	{
 		MemoryContextSwitchTo(TopMemoryContext);
 
@@ -255,6 +325,19 @@ handle_commit(StringInfo s)
 
 	in_remote_transaction = false;
 
+	/*
+	 * Parallel apply worker only reports the progress, the apply worker takes
+	 * care of the rest.
+	 */
+	if (pglogical_parallel_apply_worker())
+	{
+		pglogical_parallel_apply_commit_finish(end_lsn,
+											   flush ? XactLastCommitEnd :
+											   InvalidXLogRecPtr);
+		pgstat_report_activity(STATE_IDLE, NULL);
+		return;
+	}
+
 	/*
 	 * Stop replay if we're doing limited replay and we've replayed up to the
 	 * last record we're supposed to process.
@@ -311,6 +394,20 @@ handle_origin(StringInfo s)
 	remote_origin_id = replorigin_by_name(origin, false);
 }
 
+/*
+ * Handle BATCH message.
+ *
+ * The batch contains changes to a single relation, apply them one by one.
+ */
+static void
+handle_batch(StringInfo s)
+{
+	ListCell   *lc;
+
+	foreach (lc, pglogical_read_batch(s))
+		replication_handler((StringInfo) lfirst(lc));
+}
+
 /*
  * Handle RELATION message.
  *
@@ -320,6 +417,9 @@ handle_origin(StringInfo s)
 static void
 handle_relation(StringInfo s)
 {
+	/* The relation cache entry is about to change. */
+	apply_state_end();
+
 	(void) pglogical_read_rel(s);
 }
 
@@ -392,28 +492,24 @@ physatt_in_attmap(PGLogicalRelation *rel, int attid)
 }
 
 /*
- * Executes default values for columns for which we didn't get any data.
- *
- * TODO: this needs caching, it's not exactly fast.
+ * Prepare default values for columns for which we don't get any data.
  */
 static void
-fill_tuple_defaults(PGLogicalRelation *rel, ExprContext *econtext,
-							  PGLogicalTupleData *tuple)
+build_tuple_defaults(ApplyExecState *state)
 {
-	TupleDesc	desc = RelationGetDescr(rel->rel);
+	PGLogicalRelation *rel = state->rel;
+	TupleDesc	desc = RelationGetDescr(state->relation);
 	AttrNumber	num_phys_attrs = desc->natts;
-	int			i;
-	AttrNumber	attnum,
-				num_defaults = 0;
-	int		   *defmap;
-	ExprState **defexprs;
+	AttrNumber	attnum;
+
+	state->num_defaults = 0;
 
-	/* We got all the data via replication, no need to evaluate anything. */
+	/* We get all the data via replication, no need to evaluate anything. */
 	if (num_phys_attrs == rel->natts)
 		return;
 
-	defmap = (int *) palloc(num_phys_attrs * sizeof(int));
-	defexprs = (ExprState **) palloc(num_phys_attrs * sizeof(ExprState *));
+	state->defmap = (int *) palloc(num_phys_attrs * sizeof(int));
+	state->defexprs = (ExprState **) palloc(num_phys_attrs * sizeof(ExprState *));
 
 	for (attnum = 0; attnum < num_phys_attrs; attnum++)
 	{
@@ -425,136 +521,414 @@ fill_tuple_defaults(PGLogicalRelation *rel, ExprContext *econtext,
 		if (physatt_in_attmap(rel, attnum))
 			continue;
 
-		defexpr = (Expr *) build_column_default(rel->rel, attnum + 1);
+		defexpr = (Expr *) build_column_default(state->relation, attnum + 1);
 
 		if (defexpr != NULL)
 		{
 			/* Run the expression through planner */
 			defexpr = expression_planner(defexpr);
 
-			/* Initialize executable expression in copycontext */
-			defexprs[num_defaults] = ExecInitExpr(defexpr, NULL);
-			defmap[num_defaults] = attnum;
-			num_defaults++;
+			/* Initialize executable expression in the state context */
+			state->defexprs[state->num_defaults] = ExecInitExpr(defexpr, NULL);
+			state->defmap[state->num_defaults] = attnum;
+			state->num_defaults++;
 		}
+	}
+}
+
+/*
+ * Executes default values for columns for which we didn't get any data.
+ */
+static void
+fill_tuple_defaults(ApplyExecState *state, ExprContext *econtext,
+					PGLogicalTupleData *tuple)
+{
+	int			i;
+
+	for (i = 0; i < state->num_defaults; i++)
+		tuple->values[state->defmap[i]] =
+			ExecEvalExpr(state->defexprs[i], econtext,
+						 &tuple->nulls[state->defmap[i]], NULL);
+}
+
+/*
+ * Get the executor state for applying changes to given relation.
+ *
+ * The state of the previous relation is finished if there is one.
+ */
+static ApplyExecState *
+apply_state_begin(PGLogicalRelation *rel)
+{
+	ApplyExecState *state;
+	MemoryContext	oldcontext;
 
+	if (ApplyState != NULL)
+	{
+		if (ApplyState->rel == rel &&
+			RelationGetRelid(ApplyState->relation) == RelationGetRelid(rel->rel))
+			return ApplyState;
+
+		apply_state_end();
 	}
 
-	for (i = 0; i < num_defaults; i++)
-		tuple->values[defmap[i]] = ExecEvalExpr(defexprs[i],
-												econtext,
-												&tuple->nulls[defmap[i]],
-												NULL);
+	state = MemoryContextAllocZero(TopTransactionContext,
+								   sizeof(ApplyExecState));
+	state->context = AllocSetContextCreate(TopTransactionContext,
+										   "pglogical apply state",
+										   ALLOCSET_DEFAULT_MINSIZE,
+										   ALLOCSET_DEFAULT_INITSIZE,
+										   ALLOCSET_DEFAULT_MAXSIZE);
+	state->batch_context = AllocSetContextCreate(state->context,
+												 "pglogical apply batch",
+												 ALLOCSET_DEFAULT_MINSIZE,
+												 ALLOCSET_DEFAULT_INITSIZE,
+												 ALLOCSET_DEFAULT_MAXSIZE);
+
+	oldcontext = MemoryContextSwitchTo(state->context);
+
+	/*
+	 * Keep our own reference to the relation, the one in the relation cache
+	 * entry is closed after each change.
+	 */
+	state->rel = rel;
+	state->relation = heap_open(RelationGetRelid(rel->rel), NoLock);
+
+	/* Initialize the executor state. */
+	state->estate = create_estate_for_relation(state->relation);
+	state->localslot = ExecInitExtraTupleSlot(state->estate);
+	state->applyslot = ExecInitExtraTupleSlot(state->estate);
+	ExecSetSlotDescriptor(state->localslot, RelationGetDescr(state->relation));
+	ExecSetSlotDescriptor(state->applyslot, RelationGetDescr(state->relation));
+	state->defaults_econtext = CreateExprContext(state->estate);
+
+	ExecOpenIndices(state->estate->es_result_relation_info, false);
+
+	build_tuple_defaults(state);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	ApplyState = state;
+
+	return state;
 }
 
+/*
+ * Write out the buffered inserts.
+ */
 static void
-handle_insert(StringInfo s)
+apply_state_flush(ApplyExecState *state)
 {
-	PGLogicalTupleData	newtup;
-	PGLogicalRelation  *rel;
-	EState			   *estate;
-	ExprContext		   *econtext;
+	EState	   *estate = state->estate;
+	int			i;
+
+	if (state->batch_ntuples == 0)
+		return;
+
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	heap_multi_insert(state->relation, state->batch_tuples,
+					  state->batch_ntuples, GetCurrentCommandId(true), 0,
+					  NULL);
+
+	for (i = 0; i < state->batch_ntuples; i++)
+	{
+		ResetPerTupleExprContext(estate);
+		ExecStoreTuple(state->batch_tuples[i], state->applyslot,
+					   InvalidBuffer, false);
+		UserTableUpdateOpenIndexes(estate, state->applyslot);
+	}
+
+	PopActiveSnapshot();
+
+	ExecClearTuple(state->applyslot);
+	MemoryContextReset(state->batch_context);
+	state->batch_ntuples = 0;
+
+	/* Make the new rows visible to the following changes. */
+	CommandCounterIncrement();
+}
+
+/*
+ * Finish the current executor state, if any.
+ */
+static void
+apply_state_end(void)
+{
+	ApplyExecState *state = ApplyState;
+
+	if (state == NULL)
+		return;
+
+	apply_state_flush(state);
+
+	if (state->replidx_scan)
+		pglogical_replidx_scan_end(state->replidx_scan);
+
+	ExecCloseIndices(state->estate->es_result_relation_info);
+	ExecResetTupleTable(state->estate->es_tupleTable, true);
+	FreeExecutorState(state->estate);
+
+	heap_close(state->relation, NoLock);
+
+	MemoryContextDelete(state->context);
+	pfree(state);
+
+	ApplyState = NULL;
+}
+
+/*
+ * Find the local tuple matching the remote one using the REPLICA IDENTITY
+ * index, the index scan is kept open for subsequent lookups.
+ */
+static bool
+apply_state_find_replidx(ApplyExecState *state, PGLogicalTupleData *tuple)
+{
+	if (state->replidx_scan == NULL)
+	{
+		MemoryContext	oldcontext = MemoryContextSwitchTo(state->context);
+
+		state->replidx_scan = pglogical_replidx_scan_begin(state->relation);
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	return pglogical_tuple_find_replidx_scan(state->replidx_scan,
+											 state->relation, tuple,
+											 state->localslot);
+}
+
+/*
+ * Binary comparison of two values of the attribute, ignoring the differences
+ * in varlena header format.
+ */
+static bool
+batch_datum_equal(Datum a, Datum b, Form_pg_attribute att)
+{
+	struct varlena *va;
+	struct varlena *vb;
+
+	if (att->attlen != -1)
+		return datumIsEqual(a, b, att->attbyval, att->attlen);
+
+	va = pg_detoast_datum_packed((struct varlena *) DatumGetPointer(a));
+	vb = pg_detoast_datum_packed((struct varlena *) DatumGetPointer(b));
+
+	return VARSIZE_ANY_EXHDR(va) == VARSIZE_ANY_EXHDR(vb) &&
+		memcmp(VARDATA_ANY(va), VARDATA_ANY(vb), VARSIZE_ANY_EXHDR(va)) == 0;
+}
+
+/*
+ * Check if the tuple has the same value in some unique index as any of the
+ * buffered inserts.
+ *
+ * The conflict detection only sees tuples which were already written, so
+ * such tuples have to be written out before the new one is processed. The
+ * check uses binary equality which is enough in practice, the remote node
+ * has the same unique constraints unless somebody added new ones locally.
+ */
+static bool
+batch_has_conflict(ApplyExecState *state, PGLogicalTupleData *tuple)
+{
+	ResultRelInfo  *relinfo = state->estate->es_result_relation_info;
+	TupleDesc		desc = RelationGetDescr(state->relation);
+	int				i;
+
+	for (i = 0; i < relinfo->ri_NumIndices; i++)
+	{
+		IndexInfo  *ii = relinfo->ri_IndexRelationInfo[i];
+		int			j;
+
+		/* Same indexes as pglogical_tuple_find_conflict() looks at. */
+		if (!ii->ii_Unique || ii->ii_Expressions != NIL)
+			continue;
+
+		for (j = 0; j < state->batch_ntuples; j++)
+		{
+			HeapTuple	buftuple = state->batch_tuples[j];
+			bool		match = true;
+			int			k;
+
+			for (k = 0; k < ii->ii_NumIndexAttrs && match; k++)
+			{
+				AttrNumber	attno = ii->ii_KeyAttrNumbers[k];
+				Form_pg_attribute att = desc->attrs[attno - 1];
+				Datum		value;
+				bool		isnull;
+
+				value = heap_getattr(buftuple, attno, desc, &isnull);
+
+				/* NULLs never conflict. */
+				if (isnull || tuple->nulls[attno - 1])
+					match = false;
+				else
+					match = batch_datum_equal(value, tuple->values[attno - 1],
+											  att);
+			}
+
+			if (match)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Apply single INSERT.
+ *
+ * If 'batch' is true and the tuple does not conflict with any local one it's
+ * buffered and written later together with the following inserts. Otherwise
+ * the change is applied immediately and the applied tuple is returned, NULL
+ * is returned when the change was buffered or skipped.
+ */
+static HeapTuple
+apply_insert(ApplyExecState *state, PGLogicalTupleData *newtup, bool batch)
+{
+	EState			   *estate = state->estate;
+	Relation			relation = state->relation;
+	TupleTableSlot	   *localslot = state->localslot,
+					   *applyslot = state->applyslot;
 	Oid					conflicts;
-	TupleTableSlot	   *localslot,
-					   *applyslot;
 	HeapTuple			remotetuple;
 	HeapTuple			applytuple;
-	MemoryContext		oldcontext = CurrentMemoryContext;
+	MemoryContext		oldcontext;
 	PGLogicalConflictResolution resolution;
-	bool				started_tx = ensure_transaction();
 
-	rel = pglogical_read_insert(s, RowExclusiveLock, &newtup);
+	/*
+	 * Fill in the defaults first, unique columns may get their values from
+	 * them.  They are kept in their own context, which writing out the
+	 * buffered tuples doesn't reset.
+	 */
+	ResetExprContext(state->defaults_econtext);
+	oldcontext = MemoryContextSwitchTo(state->defaults_econtext->ecxt_per_tuple_memory);
+	fill_tuple_defaults(state, state->defaults_econtext, newtup);
+	MemoryContextSwitchTo(oldcontext);
 
-	/* If in list of relations which are being synchronized, skip. */
-	if (check_syncing_relation(rel->nspname, rel->relname))
-	{
-		pglogical_relation_close(rel, NoLock);
-		return;
-	}
+	/* Buffered tuple might be the conflicting one, write them out first. */
+	if (state->batch_ntuples > 0 && batch_has_conflict(state, newtup))
+		apply_state_flush(state);
 
-	/* Initialize the executor state. */
-	estate = create_estate_for_relation(rel->rel);
-	econtext = GetPerTupleExprContext(estate);
+	ResetPerTupleExprContext(estate);
+	oldcontext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
 
-	PushActiveSnapshot(GetTransactionSnapshot());
+	conflicts = pglogical_tuple_find_conflict(estate, newtup, localslot);
 
-	MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
-	fill_tuple_defaults(rel, econtext, &newtup);
+	if (!OidIsValid(conflicts) && batch)
+	{
+		/* No conflict, queue the tuple for insertion. */
+		MemoryContextSwitchTo(state->batch_context);
+		remotetuple = heap_form_tuple(RelationGetDescr(relation),
+									  newtup->values, newtup->nulls);
+		MemoryContextSwitchTo(oldcontext);
 
-	localslot = ExecInitExtraTupleSlot(estate);
-	applyslot = ExecInitExtraTupleSlot(estate);
-	ExecSetSlotDescriptor(localslot, RelationGetDescr(rel->rel));
-	ExecSetSlotDescriptor(applyslot, RelationGetDescr(rel->rel));
+		/* Check the constraints of the tuple */
+		if (relation->rd_att->constr)
+		{
+			ExecStoreTuple(remotetuple, applyslot, InvalidBuffer, false);
+			ExecConstraints(estate->es_result_relation_info, applyslot,
+							estate);
+			ExecClearTuple(applyslot);
+		}
 
-	ExecOpenIndices(estate->es_result_relation_info, false);
+		state->batch_tuples[state->batch_ntuples++] = remotetuple;
+		if (state->batch_ntuples >= APPLY_INSERT_BATCH_SIZE)
+			apply_state_flush(state);
 
-	conflicts = pglogical_tuple_find_conflict(estate, &newtup, localslot);
+		return NULL;
+	}
 
-	remotetuple = heap_form_tuple(RelationGetDescr(rel->rel),
-								  newtup.values, newtup.nulls);
+	remotetuple = heap_form_tuple(RelationGetDescr(relation),
+								  newtup->values, newtup->nulls);
 	MemoryContextSwitchTo(oldcontext);
 
+	applytuple = NULL;
 	if (OidIsValid(conflicts))
 	{
 		/* Tuple already exists, try resolving conflict. */
-		bool apply = try_resolve_conflict(rel->rel, localslot->tts_tuple,
+		bool apply = try_resolve_conflict(relation, localslot->tts_tuple,
 										  remotetuple, &applytuple,
 										  &resolution);
 
-		pglogical_report_conflict(CONFLICT_INSERT_INSERT, rel->rel,
+		pglogical_report_conflict(CONFLICT_INSERT_INSERT, relation,
 								  localslot->tts_tuple, remotetuple,
 								  applytuple, resolution);
 
 		if (apply)
 		{
-			ExecStoreTuple(applytuple, applyslot, InvalidBuffer, true);
+			ExecStoreTuple(applytuple, applyslot, InvalidBuffer, false);
 			/* Check the constraints of the tuple */
-			if (rel->rel->rd_att->constr)
+			if (relation->rd_att->constr)
 				ExecConstraints(estate->es_result_relation_info, applyslot,
 								estate);
 
-			simple_heap_update(rel->rel, &localslot->tts_tuple->t_self,
+			simple_heap_update(relation, &localslot->tts_tuple->t_self,
 							   applytuple);
 			/* TODO: check for HOT update? */
 			UserTableUpdateOpenIndexes(estate, applyslot);
 		}
+		else
+			applytuple = NULL;
 	}
 	else
 	{
 		/* No conflict, insert the tuple. */
-		ExecStoreTuple(remotetuple, applyslot, InvalidBuffer, true);
+		applytuple = remotetuple;
+		ExecStoreTuple(remotetuple, applyslot, InvalidBuffer, false);
 		/* Check the constraints of the tuple */
-		if (rel->rel->rd_att->constr)
+		if (relation->rd_att->constr)
 			ExecConstraints(estate->es_result_relation_info, applyslot,
 							estate);
 
-		simple_heap_insert(rel->rel, remotetuple);
+		simple_heap_insert(relation, remotetuple);
 		UserTableUpdateOpenIndexes(estate, applyslot);
 	}
 
-	ExecCloseIndices(estate->es_result_relation_info);
+	CommandCounterIncrement();
 
-	PopActiveSnapshot();
+	return applytuple;
+}
+
+static void
+handle_insert(StringInfo s)
+{
+	PGLogicalTupleData	newtup;
+	PGLogicalRelation  *rel;
+	ApplyExecState	   *state;
+	bool				started_tx = ensure_transaction();
+
+	rel = pglogical_read_insert(s, RowExclusiveLock, &newtup);
+
+	/* If in list of relations which are being synchronized, skip. */
+	if (check_syncing_relation(rel->nspname, rel->relname))
+	{
+		pglogical_relation_close(rel, NoLock);
+		return;
+	}
+
+	state = apply_state_begin(rel);
 
 	/* if INSERT was into our queue, process the message. */
 	if (RelationGetRelid(rel->rel) == QueueRelid)
 	{
+		HeapTuple		applytuple;
 		HeapTuple		ht;
 		LockRelId		lockid = rel->rel->rd_lockInfo.lockRelId;
 		TransactionId	oldxid = GetTopTransactionId();
 		Relation		qrel;
 
+		PushActiveSnapshot(GetTransactionSnapshot());
+		applytuple = apply_insert(state, &newtup, false);
+		PopActiveSnapshot();
+
 		/*
 		 * Release transaction bound resources for CONCURRENTLY support.
 		 */
 		MemoryContextSwitchTo(MessageContext);
-		ht = heap_copytuple(applyslot->tts_tuple);
+		ht = heap_copytuple(applytuple);
 
 		LockRelationIdForSession(&lockid, RowExclusiveLock);
 		pglogical_relation_close(rel, NoLock);
 
-		ExecResetTupleTable(estate->es_tupleTable, true);
-		FreeExecutorState(estate);
+		apply_state_end();
 
 		handle_queued_message(ht, started_tx);
 
@@ -566,16 +940,17 @@ handle_insert(StringInfo s)
 
 		if (oldxid != GetTopTransactionId())
 			CommitTransactionCommand();
+
+		CommandCounterIncrement();
 	}
 	else
 	{
-		/* Otherwise do normal cleanup. */
+		PushActiveSnapshot(GetTransactionSnapshot());
+		(void) apply_insert(state, &newtup, true);
+		PopActiveSnapshot();
+
 		pglogical_relation_close(rel, NoLock);
-		ExecResetTupleTable(estate->es_tupleTable, true);
-		FreeExecutorState(estate);
 	}
-
-	CommandCounterIncrement();
 }
 
 static void
@@ -585,9 +960,9 @@ handle_update(StringInfo s)
 	PGLogicalTupleData	newtup;
 	PGLogicalTupleData *searchtup;
 	PGLogicalRelation  *rel;
+	ApplyExecState	   *state;
 	EState			   *estate;
-	ExprContext		   *econtext;
-	MemoryContext		oldcontext = CurrentMemoryContext;
+	MemoryContext		oldcontext;
 	bool				found;
 	bool				hasoldtup;
 	TupleTableSlot	   *localslot,
@@ -606,22 +981,22 @@ handle_update(StringInfo s)
 		return;
 	}
 
-	/* Initialize the executor state. */
-	estate = create_estate_for_relation(rel->rel);
-	econtext = GetPerTupleExprContext(estate);
+	state = apply_state_begin(rel);
+	estate = state->estate;
+	localslot = state->localslot;
+	applyslot = state->applyslot;
 
-	MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
-	fill_tuple_defaults(rel, econtext, &newtup);
+	/* The tuple to be updated may be among the buffered inserts. */
+	apply_state_flush(state);
 
-	localslot = ExecInitExtraTupleSlot(estate);
-	applyslot = ExecInitExtraTupleSlot(estate);
-	ExecSetSlotDescriptor(localslot, RelationGetDescr(rel->rel));
-	ExecSetSlotDescriptor(applyslot, RelationGetDescr(rel->rel));
+	ResetPerTupleExprContext(estate);
+	oldcontext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+	fill_tuple_defaults(state, GetPerTupleExprContext(estate), &newtup);
 
 	PushActiveSnapshot(GetTransactionSnapshot());
 
 	searchtup = hasoldtup ? &oldtup : &newtup;
-	found = pglogical_tuple_find_replidx(estate, searchtup, localslot);
+	found = apply_state_find_replidx(state, searchtup);
 
 	remotetuple = heap_form_tuple(RelationGetDescr(rel->rel),
 								  newtup.values, newtup.nulls);
@@ -669,7 +1044,7 @@ handle_update(StringInfo s)
 
 		if (apply)
 		{
-			ExecStoreTuple(applytuple, applyslot, InvalidBuffer, true);
+			ExecStoreTuple(applytuple, applyslot, InvalidBuffer, false);
 			/* Check the constraints of the tuple */
 			if (rel->rel->rd_att->constr)
 				ExecConstraints(estate->es_result_relation_info, applyslot,
@@ -679,12 +1054,7 @@ handle_update(StringInfo s)
 							   applytuple);
 
 			/* Only update indexes if it's not HOT update. */
-			if (!HeapTupleIsHeapOnly(applyslot->tts_tuple))
-			{
-				ExecOpenIndices(estate->es_result_relation_info, false);
-				UserTableUpdateOpenIndexes(estate, applyslot);
-				ExecCloseIndices(estate->es_result_relation_info);
-			}
+			UserTableUpdateOpenIndexes(estate, applyslot);
 		}
 	}
 	else
@@ -701,8 +1071,6 @@ handle_update(StringInfo s)
 	/* Cleanup. */
 	PopActiveSnapshot();
 	pglogical_relation_close(rel, NoLock);
-	ExecResetTupleTable(estate->es_tupleTable, true);
-	FreeExecutorState(estate);
 
 	CommandCounterIncrement();
 }
@@ -712,8 +1080,7 @@ handle_delete(StringInfo s)
 {
 	PGLogicalTupleData	oldtup;
 	PGLogicalRelation  *rel;
-	EState			   *estate;
-	TupleTableSlot	   *localslot;
+	ApplyExecState	   *state;
 
 	ensure_transaction();
 
@@ -726,17 +1093,17 @@ handle_delete(StringInfo s)
 		return;
 	}
 
-	/* Initialize the executor state. */
-	estate = create_estate_for_relation(rel->rel);
-	localslot = ExecInitExtraTupleSlot(estate);
-	ExecSetSlotDescriptor(localslot, RelationGetDescr(rel->rel));
+	state = apply_state_begin(rel);
+
+	/* The tuple to be deleted may be among the buffered inserts. */
+	apply_state_flush(state);
 
 	PushActiveSnapshot(GetTransactionSnapshot());
 
-	if (pglogical_tuple_find_replidx(estate, &oldtup, localslot))
+	if (apply_state_find_replidx(state, &oldtup))
 	{
 		/* Tuple found, delete it. */
-		simple_heap_delete(rel->rel, &localslot->tts_tuple->t_self);
+		simple_heap_delete(rel->rel, &state->localslot->tts_tuple->t_self);
 	}
 	else
 	{
@@ -751,8 +1118,6 @@ handle_delete(StringInfo s)
 
 	/* Cleanup. */
 	pglogical_relation_close(rel, NoLock);
-	ExecResetTupleTable(estate->es_tupleTable, true);
-	FreeExecutorState(estate);
 
 	CommandCounterIncrement();
 }
@@ -1114,6 +1479,10 @@ replication_handler(StringInfo s)
 		case 'D':
 			handle_delete(s);
 			break;
+		/* BATCH */
+		case 'X':
+			handle_batch(s);
+			break;
 		/* STARTUP MESSAGE */
 		case 'S':
 			handle_startup(s);
@@ -1123,6 +1492,258 @@ replication_handler(StringInfo s)
 	}
 }
 
+/*
+ * Remember the position of the last transaction committed by the parallel
+ * apply workers so that it's reported back to the walsender.
+ */
+static void
+parallel_apply_flush_progress(void)
+{
+	XLogRecPtr			remote_end;
+	XLogRecPtr			local_end;
+	PGLFlushPosition   *flushpos;
+	MemoryContext		oldcontext;
+
+	if (!pglogical_parallel_apply_progress(&remote_end, &local_end))
+		return;
+
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	flushpos = (PGLFlushPosition *) palloc(sizeof(PGLFlushPosition));
+	flushpos->local_end = local_end;
+	flushpos->remote_end = remote_end;
+	dlist_push_tail(&lsn_mapping, &flushpos->node);
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * Forget the buffered transaction.
+ */
+static void
+parallel_xact_reset(void)
+{
+	MemoryContextReset(ParallelXactContext);
+	ParallelXactMessages = NIL;
+	ParallelXactSize = 0;
+}
+
+/*
+ * Add copy of the message to the buffered transaction.
+ */
+static void
+parallel_xact_add(StringInfo s)
+{
+	MemoryContext	oldcontext;
+	StringInfo		message;
+
+	oldcontext = MemoryContextSwitchTo(ParallelXactContext);
+	message = makeStringInfo();
+	appendBinaryStringInfo(message, &s->data[s->cursor], s->len - s->cursor);
+	ParallelXactMessages = lappend(ParallelXactMessages, message);
+	MemoryContextSwitchTo(oldcontext);
+
+	ParallelXactSize += message->len;
+}
+
+/*
+ * Build list of the local relations the buffered transaction changes.
+ *
+ * All tables with triggers are represented by InvalidOid, as the triggers
+ * (including the foreign key ones) can touch other tables, so we only let
+ * one worker at a time to change those.
+ *
+ * Returns false if the transaction can't be applied in parallel.
+ */
+static bool
+parallel_xact_relations(List **relids)
+{
+	MemoryContext	oldcontext = CurrentMemoryContext;
+	ListCell	   *lc;
+	bool			parallel = true;
+
+	StartTransactionCommand();
+
+	foreach (lc, ParallelXactMessages)
+	{
+		StringInfo			message = (StringInfo) lfirst(lc);
+		StringInfoData		s;
+		PGLogicalRelation  *rel;
+		HeapTuple			tup;
+		Oid					reloid;
+
+		if (message->data[0] != 'I' && message->data[0] != 'U' &&
+			message->data[0] != 'D')
+			continue;
+
+		/* Skip the action and flags. */
+		s = *message;
+		s.cursor = 2;
+
+		rel = pglogical_relation_find(pq_getmsgint(&s, 4));
+		if (rel == NULL)
+		{
+			parallel = false;
+			break;
+		}
+
+		reloid = RangeVarGetRelid(makeRangeVar(rel->nspname, rel->relname, -1),
+								  NoLock, true);
+
+		/* Let the apply worker deal with unknown tables and the queue. */
+		if (!OidIsValid(reloid) || reloid == QueueRelid)
+		{
+			parallel = false;
+			break;
+		}
+
+		tup = SearchSysCache1(RELOID, ObjectIdGetDatum(reloid));
+		if (!HeapTupleIsValid(tup))
+			elog(ERROR, "cache lookup failed for relation %u", reloid);
+		if (((Form_pg_class) GETSTRUCT(tup))->relhastriggers)
+			reloid = InvalidOid;
+		ReleaseSysCache(tup);
+
+		MemoryContextSwitchTo(ParallelXactContext);
+		*relids = list_append_unique_oid(*relids, reloid);
+		MemoryContextSwitchTo(CurTransactionContext);
+	}
+
+	CommitTransactionCommand();
+	MemoryContextSwitchTo(oldcontext);
+
+	return parallel;
+}
+
+/*
+ * Apply the buffered transaction and the rest of it ourselves.
+ */
+static void
+parallel_xact_serial_begin(void)
+{
+	ListCell   *lc;
+
+	/* Take over the replication origin session from the workers. */
+	pglogical_parallel_apply_wait_all();
+	parallel_apply_flush_progress();
+
+	replorigin_session_setup(ParallelXactOriginId);
+	replorigin_session_origin = ParallelXactOriginId;
+	ParallelXactSerial = true;
+
+	foreach (lc, ParallelXactMessages)
+		replication_handler((StringInfo) lfirst(lc));
+
+	parallel_xact_reset();
+}
+
+static void
+parallel_xact_serial_end(void)
+{
+	replorigin_session_reset();
+	replorigin_session_origin = InvalidRepOriginId;
+	ParallelXactSerial = false;
+}
+
+/*
+ * Replication handler of the apply worker when parallel apply is enabled.
+ *
+ * The remote transactions are buffered until their commit and then handed
+ * over to the parallel apply workers. The transactions which use two-phase
+ * commit, go through the queue table, touch tables being synchronized or
+ * are too big to be buffered are applied by the apply worker itself, after
+ * all the previously received ones were committed.
+ */
+static void
+parallel_replication_handler(StringInfo s)
+{
+	char		action = s->data[s->cursor];
+	List	   *relids = NIL;
+
+	if (ParallelXactContext == NULL)
+		ParallelXactContext = AllocSetContextCreate(TopMemoryContext,
+													"ParallelXactContext",
+													ALLOCSET_DEFAULT_MINSIZE,
+													ALLOCSET_DEFAULT_INITSIZE,
+													ALLOCSET_DEFAULT_MAXSIZE);
+
+	switch (action)
+	{
+		/* STARTUP MESSAGE */
+		case 'S':
+			replication_handler(s);
+			return;
+		/* RELATION, every worker needs it */
+		case 'R':
+		{
+			StringInfoData	message = *s;
+
+			message.data = &s->data[s->cursor];
+			message.len = s->len - s->cursor;
+			pglogical_parallel_apply_broadcast(&message);
+			replication_handler(s);
+			return;
+		}
+		/* BATCH, split it so that the changes can be buffered as usual */
+		case 'X':
+		{
+			ListCell	   *lc;
+
+			s->cursor++;
+			foreach (lc, pglogical_read_batch(s))
+				parallel_replication_handler((StringInfo) lfirst(lc));
+			return;
+		}
+	}
+
+	if (ParallelXactSerial)
+	{
+		replication_handler(s);
+		if (action == 'C')
+			parallel_xact_serial_end();
+		return;
+	}
+
+	if (action == 'B')
+	{
+		StringInfoData	begin = *s;
+
+		/* Track the remote transaction state as usual. */
+		begin.cursor++;
+		handle_begin(&begin);
+		parallel_xact_add(s);
+		return;
+	}
+	else if (action != 'C')
+	{
+		parallel_xact_add(s);
+
+		if (ParallelXactSize > PARALLEL_XACT_MAX_SIZE)
+			parallel_xact_serial_begin();
+		return;
+	}
+
+	/* COMMIT, the flags follow the action. */
+	if (PGLOGICAL_XACT_EVENT(s->data[s->cursor + 1]) != PGLOGICAL_COMMIT ||
+		MyApplyWorker->sync_pending || SyncingTables != NIL ||
+		!parallel_xact_relations(&relids))
+	{
+		parallel_xact_serial_begin();
+		replication_handler(s);
+		parallel_xact_serial_end();
+		return;
+	}
+
+	/* Transaction without changes has nothing to apply. */
+	if (list_length(ParallelXactMessages) > 1)
+	{
+		parallel_xact_add(s);
+		pglogical_parallel_apply_dispatch(ParallelXactMessages, relids);
+	}
+
+	parallel_xact_reset();
+	in_remote_transaction = false;
+	pgstat_report_activity(STATE_IDLE, NULL);
+}
+
 /*
  * Figure out which write/flush positions to report to the walsender process.
  *
@@ -1374,7 +1995,10 @@ apply_work(PGconn *streamConn)
 					if (last_received < end_lsn)
 						last_received = end_lsn;
 
-					replication_handler(&s);
+					if (pglogical_parallel_apply_enabled())
+						parallel_replication_handler(&s);
+					else
+						replication_handler(&s);
 				}
 				else if (c == 'k')
 				{
@@ -1393,11 +2017,27 @@ apply_work(PGconn *streamConn)
 			}
 		}
 
+		if (pglogical_parallel_apply_enabled())
+			parallel_apply_flush_progress();
+
 		/* confirm all writes at once */
 		send_feedback(applyconn, last_received, GetCurrentTimestamp(), false);
 
 		if (!in_remote_transaction)
+		{
+			/*
+			 * The table synchronization has to see all the changes received
+			 * so far applied.
+			 */
+			if (pglogical_parallel_apply_enabled() &&
+				(MyApplyWorker->sync_pending || SyncingTables != NIL))
+			{
+				pglogical_parallel_apply_wait_all();
+				parallel_apply_flush_progress();
+			}
+
 			process_syncing_tables(last_received);
+		}
 
 		/* Cleanup the memory. */
 		MemoryContextResetAndDeleteChildren(MessageContext);
@@ -1678,6 +2318,27 @@ start_sync_worker(RangeVar *rv)
 	(void) pglogical_worker_register(&worker);
 }
 
+/*
+ * Set up the configuration options used during replay.
+ */
+static void
+apply_set_config_options(void)
+{
+	/* setup synchronous commit according to the user's wishes */
+	SetConfigOption("synchronous_commit",
+					pglogical_synchronous_commit ? "local" : "off",
+					PGC_BACKEND, PGC_S_OVERRIDE);	/* other context? */
+
+	/*
+	 * Disable function body checks during replay. That's necessary because a)
+	 * the creator of the function might have had it disabled b) the function
+	 * might be search_path dependant and we don't fix the contents of
+	 * functions.
+	 */
+	SetConfigOption("check_function_bodies", "off",
+					PGC_INTERNAL, PGC_S_OVERRIDE);
+}
+
 void
 pglogical_apply_main(Datum main_arg)
 {
@@ -1704,19 +2365,7 @@ pglogical_apply_main(Datum main_arg)
 	/* Connect to our database. */
 	BackgroundWorkerInitializeConnectionByOid(MyPGLogicalWorker->dboid, InvalidOid);
 
-	/* setup synchronous commit according to the user's wishes */
-	SetConfigOption("synchronous_commit",
-					pglogical_synchronous_commit ? "local" : "off",
-					PGC_BACKEND, PGC_S_OVERRIDE);	/* other context? */
-
-	/*
-	 * Disable function body checks during replay. That's necessary because a)
-	 * the creator of the function might have had it disabled b) the function
-	 * might be search_path dependant and we don't fix the contents of
-	 * functions.
-	 */
-	SetConfigOption("check_function_bodies", "off",
-					PGC_INTERNAL, PGC_S_OVERRIDE);
+	apply_set_config_options();
 
 	/* Load the subscription. */
 	StartTransactionCommand();
@@ -1756,6 +2405,20 @@ pglogical_apply_main(Datum main_arg)
 
 	CommitTransactionCommand();
 
+	/*
+	 * The parallel apply workers pass the replication origin session around
+	 * in commit order, we only take it back for the transactions we apply
+	 * ourselves.
+	 */
+	if (pglogical_apply_workers > 0)
+	{
+		replorigin_session_reset();
+		replorigin_session_origin = InvalidRepOriginId;
+		ParallelXactOriginId = originid;
+
+		pglogical_parallel_apply_start(pglogical_apply_workers, originid);
+	}
+
 	apply_work(streamConn);
 
 	/*
@@ -1764,3 +2427,66 @@ pglogical_apply_main(Datum main_arg)
 	 */
 	proc_exit(1);
 }
+
+void
+pglogical_apply_parallel_main(Datum main_arg)
+{
+	int				slot = DatumGetInt32(main_arg);
+	PGLogicalParallelApplyWorker *parallel;
+	MemoryContext	saved_ctx;
+
+	/* Setup shmem. */
+	pglogical_worker_attach(slot);
+	parallel = &MyPGLogicalWorker->worker.parallel;
+	MyApplyWorker = &parallel->apply;
+
+	/* Establish signal handlers. */
+	pqsignal(SIGTERM, handle_sigterm);
+	BackgroundWorkerUnblockSignals();
+
+	Assert(CurrentResourceOwner == NULL);
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "pglogical apply parallel");
+
+	/* Connect to our database. */
+	BackgroundWorkerInitializeConnectionByOid(MyPGLogicalWorker->dboid, InvalidOid);
+
+	apply_set_config_options();
+
+	/* Load the subscription. */
+	StartTransactionCommand();
+	saved_ctx = MemoryContextSwitchTo(TopMemoryContext);
+	MySubscription = get_subscription(MyApplyWorker->subid);
+	MemoryContextSwitchTo(saved_ctx);
+	QueueRelid = get_queue_table_oid();
+	CommitTransactionCommand();
+
+	/* Attach to the apply worker. */
+	pglogical_parallel_apply_attach(parallel->dsm, parallel->index);
+	replorigin_session_origin = pglogical_parallel_apply_origin();
+
+	elog(DEBUG1, "starting parallel apply %d for subscription %s",
+		 parallel->index, MySubscription->name);
+
+	MessageContext = AllocSetContextCreate(TopMemoryContext,
+										   "MessageContext",
+										   ALLOCSET_DEFAULT_MINSIZE,
+										   ALLOCSET_DEFAULT_INITSIZE,
+										   ALLOCSET_DEFAULT_MAXSIZE);
+
+	pgstat_report_activity(STATE_IDLE, NULL);
+
+	while (!got_SIGTERM)
+	{
+		StringInfoData	s;
+
+		MemoryContextSwitchTo(MessageContext);
+
+		/* Exits when the apply worker goes away. */
+		pglogical_parallel_apply_receive(&s);
+		replication_handler(&s);
+
+		MemoryContextResetAndDeleteChildren(MessageContext);
+	}
+
+	proc_exit(1);
+}
@@ -0,0 +1,636 @@
+/*-------------------------------------------------------------------------
+ *
+ * pglogical_apply_parallel.c
+ * 		pglogical parallel apply support
+ *
+ * The apply worker (the leader) reads the replication stream and hands whole
+ * remote transactions over to a pool of parallel apply workers. Every worker
+ * gets its own shared memory queue through which it receives the protocol
+ * messages of the transactions assigned to it.
+ *
+ * Transactions which touch a common table are never applied concurrently,
+ * the leader either queues such transaction to the worker which already has
+ * the conflicting one, or waits until the conflict goes away.
+ *
+ * The transactions are always committed in the order they were received.
+ * That's required because the replication origin progress is a single LSN
+ * and because the replication origin session can only be held by a single
+ * process at a time, the workers pass it around in commit order.
+ *
+ * Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		  pglogical_apply_parallel.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
+#include "storage/spin.h"
+
+#include "utils/memutils.h"
+
+#include "pglogical_apply_parallel.h"
+#include "pglogical_worker.h"
+#include "pglogical.h"
+
+#define PGLOGICAL_APPLY_TOC_MAGIC	0x50474c41
+#define PGLOGICAL_APPLY_TOC_SHARED	0
+#define PGLOGICAL_APPLY_TOC_QUEUE	1	/* first queue, one per worker */
+
+/* Size of the queue of each worker. */
+#define PARALLEL_APPLY_QUEUE_SIZE	(1024 * 1024)
+
+/* Tags of the messages sent over the queue. */
+#define PARALLEL_APPLY_MSG_XACT		'T'	/* start of transaction */
+#define PARALLEL_APPLY_MSG_DATA		'M'	/* replication protocol message */
+
+/*
+ * State shared between the leader and the workers.
+ */
+typedef struct ParallelApplyShared
+{
+	slock_t		mutex;
+
+	/* The leader, used to detect it going away. */
+	int			leader_slot;
+	PGPROC	   *leader_proc;
+
+	/* Replication origin the workers pass around. */
+	RepOriginId	originid;
+
+	/* Sequence number of the transaction which can commit next. */
+	uint64		next_commit;
+
+	/* Position of the last committed transaction. */
+	XLogRecPtr	last_remote_end;
+	XLogRecPtr	last_local_end;
+
+	/* Workers, so that the committing one can wake up the next one. */
+	int			nworkers;
+	PGPROC	   *worker_procs[FLEXIBLE_ARRAY_MEMBER];
+} ParallelApplyShared;
+
+/*
+ * Transaction dispatched to a worker which was not committed yet.
+ */
+typedef struct ParallelApplyXact
+{
+	uint64		seq;
+	List	   *relids;
+} ParallelApplyXact;
+
+/*
+ * Leader's info about a worker.
+ */
+typedef struct ParallelApplySlot
+{
+	int				slot;		/* pglogical worker slot */
+	shm_mq_handle  *mqh;
+	List		   *xacts;		/* in-progress ParallelApplyXacts */
+} ParallelApplySlot;
+
+static dsm_segment		   *ParallelApplySeg = NULL;
+static ParallelApplyShared *ParallelApply = NULL;
+
+/* Leader state. */
+static ParallelApplySlot   *ParallelApplySlots = NULL;
+static int					ParallelApplyNumSlots = 0;
+static uint64				ParallelApplyNextSeq = 1;
+static XLogRecPtr			ParallelApplyReportedEnd = InvalidXLogRecPtr;
+
+/* Worker state. */
+static int					ParallelApplyMyIndex = -1;
+static shm_mq_handle	   *ParallelApplyMyQueue = NULL;
+static uint64				ParallelApplyMySeq = 0;
+
+static void
+parallel_apply_wait(void)
+{
+	int			rc;
+
+	rc = WaitLatch(&MyProc->procLatch,
+				   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+				   1000L);
+
+	ResetLatch(&MyProc->procLatch);
+
+	/* emergency bailout if postmaster has died */
+	if (rc & WL_POSTMASTER_DEATH)
+		proc_exit(1);
+
+	if (got_SIGTERM)
+		proc_exit(1);
+
+	CHECK_FOR_INTERRUPTS();
+}
+
+/*
+ * Check that the parallel apply worker of given slot is still alive.
+ */
+static bool
+parallel_worker_alive(int index)
+{
+	PGLogicalWorker	   *w;
+	bool				alive;
+
+	LWLockAcquire(PGLogicalCtx->lock, LW_SHARED);
+	w = pglogical_get_worker(ParallelApplySlots[index].slot);
+	alive = w->worker_type == PGLOGICAL_WORKER_APPLY_PARALLEL &&
+		w->worker.parallel.dsm == dsm_segment_handle(ParallelApplySeg) &&
+		w->worker.parallel.index == index;
+	LWLockRelease(PGLogicalCtx->lock);
+
+	return alive;
+}
+
+/*
+ * Check that the leader is still alive.
+ */
+static bool
+parallel_leader_alive(void)
+{
+	PGLogicalWorker	   *w;
+	bool				alive;
+
+	LWLockAcquire(PGLogicalCtx->lock, LW_SHARED);
+	w = pglogical_get_worker(ParallelApply->leader_slot);
+	alive = w->worker_type == PGLOGICAL_WORKER_APPLY &&
+		w->proc == ParallelApply->leader_proc;
+	LWLockRelease(PGLogicalCtx->lock);
+
+	return alive;
+}
+
+/*
+ * Start the parallel apply workers.
+ *
+ * Must be called by the apply worker before it starts receiving the stream
+ * and after it released the replication origin session.
+ */
+void
+pglogical_parallel_apply_start(int nworkers, RepOriginId originid)
+{
+	shm_toc_estimator	e;
+	shm_toc			   *toc;
+	Size				shared_size;
+	MemoryContext		oldcontext;
+	int					i;
+
+	Assert(ParallelApplySeg == NULL);
+
+	shared_size = offsetof(ParallelApplyShared, worker_procs) +
+		sizeof(PGPROC *) * nworkers;
+
+	shm_toc_initialize_estimator(&e);
+	shm_toc_estimate_chunk(&e, shared_size);
+	for (i = 0; i < nworkers; i++)
+		shm_toc_estimate_chunk(&e, PARALLEL_APPLY_QUEUE_SIZE);
+	shm_toc_estimate_keys(&e, 1 + nworkers);
+
+	/* The segment lives as long as the apply worker. */
+	ParallelApplySeg = dsm_create(shm_toc_estimate(&e), 0);
+	dsm_pin_mapping(ParallelApplySeg);
+	toc = shm_toc_create(PGLOGICAL_APPLY_TOC_MAGIC,
+						 dsm_segment_address(ParallelApplySeg),
+						 shm_toc_estimate(&e));
+
+	ParallelApply = shm_toc_allocate(toc, shared_size);
+	memset(ParallelApply, 0, shared_size);
+	SpinLockInit(&ParallelApply->mutex);
+	ParallelApply->leader_slot = MyPGLogicalWorker - PGLogicalCtx->workers;
+	ParallelApply->leader_proc = MyProc;
+	ParallelApply->originid = originid;
+	ParallelApply->next_commit = ParallelApplyNextSeq;
+	ParallelApply->nworkers = nworkers;
+	shm_toc_insert(toc, PGLOGICAL_APPLY_TOC_SHARED, ParallelApply);
+
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	ParallelApplySlots = palloc0(sizeof(ParallelApplySlot) * nworkers);
+
+	for (i = 0; i < nworkers; i++)
+	{
+		shm_mq			   *mq;
+		PGLogicalWorker		worker;
+
+		mq = shm_mq_create(shm_toc_allocate(toc, PARALLEL_APPLY_QUEUE_SIZE),
+						   PARALLEL_APPLY_QUEUE_SIZE);
+		shm_toc_insert(toc, PGLOGICAL_APPLY_TOC_QUEUE + i, mq);
+		shm_mq_set_sender(mq, MyProc);
+		ParallelApplySlots[i].mqh = shm_mq_attach(mq, ParallelApplySeg, NULL);
+
+		/* Start the worker. */
+		memset(&worker, 0, sizeof(PGLogicalWorker));
+		worker.worker_type = PGLOGICAL_WORKER_APPLY_PARALLEL;
+		worker.dboid = MyPGLogicalWorker->dboid;
+		worker.worker.parallel.apply.subid = MyApplyWorker->subid;
+		worker.worker.parallel.apply.sync_pending = false;
+		worker.worker.parallel.apply.replay_stop_lsn = InvalidXLogRecPtr;
+		worker.worker.parallel.dsm = dsm_segment_handle(ParallelApplySeg);
+		worker.worker.parallel.index = i;
+
+		ParallelApplySlots[i].slot = pglogical_worker_register(&worker);
+		ParallelApplyNumSlots++;
+	}
+	MemoryContextSwitchTo(oldcontext);
+
+	elog(DEBUG1, "started %d parallel apply workers", nworkers);
+}
+
+bool
+pglogical_parallel_apply_enabled(void)
+{
+	return ParallelApplyNumSlots > 0;
+}
+
+/*
+ * Forget about the transactions which were already committed and make sure
+ * all workers are still running.
+ */
+static void
+parallel_apply_retire(void)
+{
+	uint64		next_commit;
+	int			i;
+
+	SpinLockAcquire(&ParallelApply->mutex);
+	next_commit = ParallelApply->next_commit;
+	SpinLockRelease(&ParallelApply->mutex);
+
+	for (i = 0; i < ParallelApplyNumSlots; i++)
+	{
+		ParallelApplySlot  *slot = &ParallelApplySlots[i];
+
+		while (slot->xacts != NIL)
+		{
+			ParallelApplyXact  *xact = linitial(slot->xacts);
+
+			if (xact->seq >= next_commit)
+				break;
+
+			slot->xacts = list_delete_first(slot->xacts);
+			list_free(xact->relids);
+			pfree(xact);
+		}
+
+		if (!parallel_worker_alive(i))
+			ereport(ERROR,
+					(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+					 errmsg("parallel apply worker %d exited unexpectedly", i)));
+	}
+}
+
+/*
+ * Send message to the worker, tagged with 'tag'.
+ */
+static void
+parallel_apply_send(int index, char tag, const char *data, Size len)
+{
+	shm_mq_iovec	iov[2];
+	shm_mq_result	res;
+
+	iov[0].data = &tag;
+	iov[0].len = 1;
+	iov[1].data = data;
+	iov[1].len = len;
+
+	/*
+	 * Don't block in shm_mq_sendv() so that we can notice the worker dying
+	 * while the queue is full.
+	 */
+	while ((res = shm_mq_sendv(ParallelApplySlots[index].mqh, iov, 2, true))
+		   == SHM_MQ_WOULD_BLOCK)
+	{
+		if (!parallel_worker_alive(index))
+			break;
+
+		parallel_apply_wait();
+	}
+
+	if (res != SHM_MQ_SUCCESS)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not send data to parallel apply worker %d",
+						index)));
+}
+
+/*
+ * Does the list of the relations of the transaction overlap with any of the
+ * in-progress transactions of the worker?
+ */
+static bool
+parallel_apply_conflicts(ParallelApplySlot *slot, List *relids)
+{
+	ListCell   *lc;
+
+	foreach (lc, slot->xacts)
+	{
+		ParallelApplyXact  *xact = lfirst(lc);
+		ListCell		   *lcr;
+
+		foreach (lcr, relids)
+		{
+			if (list_member_oid(xact->relids, lfirst_oid(lcr)))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Dispatch the transaction to one of the workers.
+ *
+ * The transaction is given to the worker which is already applying
+ * transaction touching same tables if there is such worker, otherwise to an
+ * idle worker. Waits if neither is possible.
+ */
+void
+pglogical_parallel_apply_dispatch(List *messages, List *relids)
+{
+	ParallelApplyXact  *xact;
+	MemoryContext		oldcontext;
+	ListCell		   *lc;
+	int					chosen;
+	uint64				seq;
+
+	for (;;)
+	{
+		int		nconflicts = 0;
+		int		conflicting = -1;
+		int		idle = -1;
+		int		i;
+
+		parallel_apply_retire();
+
+		for (i = 0; i < ParallelApplyNumSlots; i++)
+		{
+			ParallelApplySlot  *slot = &ParallelApplySlots[i];
+
+			if (parallel_apply_conflicts(slot, relids))
+			{
+				nconflicts++;
+				conflicting = i;
+			}
+			else if (slot->xacts == NIL && idle < 0)
+				idle = i;
+		}
+
+		if (nconflicts == 1)
+		{
+			chosen = conflicting;
+			break;
+		}
+		else if (nconflicts == 0 && idle >= 0)
+		{
+			chosen = idle;
+			break;
+		}
+
+		parallel_apply_wait();
+	}
+
+	/* Remember the transaction. */
+	seq = ParallelApplyNextSeq++;
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	xact = palloc(sizeof(ParallelApplyXact));
+	xact->seq = seq;
+	xact->relids = list_copy(relids);
+	ParallelApplySlots[chosen].xacts =
+		lappend(ParallelApplySlots[chosen].xacts, xact);
+	MemoryContextSwitchTo(oldcontext);
+
+	/* And send it over. */
+	parallel_apply_send(chosen, PARALLEL_APPLY_MSG_XACT, (char *) &seq,
+						sizeof(seq));
+	foreach (lc, messages)
+	{
+		StringInfo	message = lfirst(lc);
+
+		parallel_apply_send(chosen, PARALLEL_APPLY_MSG_DATA, message->data,
+							message->len);
+	}
+}
+
+/*
+ * Send message to all workers.
+ *
+ * Used for relation metadata which every worker needs to know.
+ */
+void
+pglogical_parallel_apply_broadcast(StringInfo message)
+{
+	int		i;
+
+	for (i = 0; i < ParallelApplyNumSlots; i++)
+		parallel_apply_send(i, PARALLEL_APPLY_MSG_DATA, message->data,
+							message->len);
+}
+
+/*
+ * Wait for all dispatched transactions to be committed.
+ */
+void
+pglogical_parallel_apply_wait_all(void)
+{
+	for (;;)
+	{
+		bool	busy = false;
+		int		i;
+
+		parallel_apply_retire();
+
+		for (i = 0; i < ParallelApplyNumSlots; i++)
+			busy |= ParallelApplySlots[i].xacts != NIL;
+
+		if (!busy)
+			break;
+
+		parallel_apply_wait();
+	}
+}
+
+/*
+ * Get the remote and local end position of the last transaction committed
+ * by the workers.
+ *
+ * Returns false if there was no new commit since the last call.
+ */
+bool
+pglogical_parallel_apply_progress(XLogRecPtr *remote_end,
+								  XLogRecPtr *local_end)
+{
+	SpinLockAcquire(&ParallelApply->mutex);
+	*remote_end = ParallelApply->last_remote_end;
+	*local_end = ParallelApply->last_local_end;
+	SpinLockRelease(&ParallelApply->mutex);
+
+	if (*remote_end == ParallelApplyReportedEnd ||
+		*local_end == InvalidXLogRecPtr)
+		return false;
+
+	ParallelApplyReportedEnd = *remote_end;
+	return true;
+}
+
+/*
+ * Attach the parallel apply worker to the segment created by the leader.
+ */
+void
+pglogical_parallel_apply_attach(dsm_handle handle, int index)
+{
+	shm_toc	   *toc;
+	shm_mq	   *mq;
+
+	ParallelApplySeg = dsm_attach(handle);
+	if (ParallelApplySeg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+	dsm_pin_mapping(ParallelApplySeg);
+
+	toc = shm_toc_attach(PGLOGICAL_APPLY_TOC_MAGIC,
+						 dsm_segment_address(ParallelApplySeg));
+	if (toc == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("bad magic number in dynamic shared memory segment")));
+
+	ParallelApply = shm_toc_lookup(toc, PGLOGICAL_APPLY_TOC_SHARED);
+	ParallelApplyMyIndex = index;
+
+	SpinLockAcquire(&ParallelApply->mutex);
+	ParallelApply->worker_procs[index] = MyProc;
+	SpinLockRelease(&ParallelApply->mutex);
+
+	mq = shm_toc_lookup(toc, PGLOGICAL_APPLY_TOC_QUEUE + index);
+	shm_mq_set_receiver(mq, MyProc);
+	ParallelApplyMyQueue = shm_mq_attach(mq, ParallelApplySeg, NULL);
+}
+
+bool
+pglogical_parallel_apply_worker(void)
+{
+	return ParallelApplyMyIndex >= 0;
+}
+
+RepOriginId
+pglogical_parallel_apply_origin(void)
+{
+	return ParallelApply->originid;
+}
+
+/*
+ * Receive next replication protocol message from the leader.
+ *
+ * Exits the process if the leader went away.
+ */
+void
+pglogical_parallel_apply_receive(StringInfo message)
+{
+	for (;;)
+	{
+		shm_mq_result	res;
+		Size			len;
+		void		   *data;
+
+		res = shm_mq_receive(ParallelApplyMyQueue, &len, &data, true);
+
+		if (res == SHM_MQ_DETACHED)
+			proc_exit(0);
+
+		if (res == SHM_MQ_WOULD_BLOCK)
+		{
+			if (!parallel_leader_alive())
+				proc_exit(0);
+
+			parallel_apply_wait();
+			continue;
+		}
+
+		if (len < 1)
+			elog(ERROR, "invalid message received by parallel apply worker");
+
+		/* Start of new transaction, remember its commit sequence number. */
+		if (((char *) data)[0] == PARALLEL_APPLY_MSG_XACT)
+		{
+			memcpy(&ParallelApplyMySeq, (char *) data + 1,
+				   sizeof(ParallelApplyMySeq));
+			continue;
+		}
+
+		/*
+		 * The data is only valid until the next receive so make a copy in
+		 * the current memory context.
+		 */
+		initStringInfo(message);
+		appendBinaryStringInfo(message, (char *) data + 1, len - 1);
+		return;
+	}
+}
+
+/*
+ * Wait for our turn to commit and take over the replication origin session.
+ */
+void
+pglogical_parallel_apply_commit_start(void)
+{
+	for (;;)
+	{
+		uint64		next_commit;
+
+		SpinLockAcquire(&ParallelApply->mutex);
+		next_commit = ParallelApply->next_commit;
+		SpinLockRelease(&ParallelApply->mutex);
+
+		if (next_commit == ParallelApplyMySeq)
+			break;
+
+		if (!parallel_leader_alive())
+			proc_exit(0);
+
+		parallel_apply_wait();
+	}
+
+	replorigin_session_setup(ParallelApply->originid);
+}
+
+/*
+ * Release the replication origin session and let the next transaction
+ * commit.
+ */
+void
+pglogical_parallel_apply_commit_finish(XLogRecPtr remote_end,
+									   XLogRecPtr local_end)
+{
+	int			i;
+
+	replorigin_session_reset();
+
+	SpinLockAcquire(&ParallelApply->mutex);
+	ParallelApply->next_commit++;
+	if (local_end != InvalidXLogRecPtr)
+	{
+		ParallelApply->last_remote_end = remote_end;
+		ParallelApply->last_local_end = local_end;
+	}
+	SpinLockRelease(&ParallelApply->mutex);
+
+	/* Wake up everybody who might be waiting for us. */
+	SetLatch(&ParallelApply->leader_proc->procLatch);
+	for (i = 0; i < ParallelApply->nworkers; i++)
+	{
+		PGPROC	   *proc = ParallelApply->worker_procs[i];
+
+		if (proc != NULL && i != ParallelApplyMyIndex)
+			SetLatch(&proc->procLatch);
+	}
+}
@@ -0,0 +1,44 @@
+/*-------------------------------------------------------------------------
+ *
+ * pglogical_apply_parallel.h
+ *		pglogical parallel apply support
+ *
+ * Copyright (c) 2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		pglogical_apply_parallel.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PGLOGICAL_APPLY_PARALLEL_H
+#define PGLOGICAL_APPLY_PARALLEL_H
+
+#include "access/xlogdefs.h"
+
+#include "lib/stringinfo.h"
+
+#include "nodes/pg_list.h"
+
+#include "replication/origin.h"
+
+#include "storage/dsm.h"
+
+/* Leader (the apply worker) side. */
+extern void pglogical_parallel_apply_start(int nworkers, RepOriginId originid);
+extern bool pglogical_parallel_apply_enabled(void);
+extern void pglogical_parallel_apply_dispatch(List *messages, List *relids);
+extern void pglogical_parallel_apply_broadcast(StringInfo message);
+extern void pglogical_parallel_apply_wait_all(void);
+extern bool pglogical_parallel_apply_progress(XLogRecPtr *remote_end,
+											  XLogRecPtr *local_end);
+
+/* Parallel apply worker side. */
+extern void pglogical_parallel_apply_attach(dsm_handle handle, int index);
+extern bool pglogical_parallel_apply_worker(void);
+extern RepOriginId pglogical_parallel_apply_origin(void);
+extern void pglogical_parallel_apply_receive(StringInfo message);
+extern void pglogical_parallel_apply_commit_start(void);
+extern void pglogical_parallel_apply_commit_finish(XLogRecPtr remote_end,
+												   XLogRecPtr local_end);
+
+#endif /* PGLOGICAL_APPLY_PARALLEL_H */
@@ -110,26 +110,37 @@ build_index_scan_key(ScanKey skey, Relation rel, Relation idxrel, PGLogicalTuple
 }
 
 /*
- * Search the index 'idxrel' for a tuple identified by 'skey' in 'rel'.
+ * Start a SnapshotDirty scan of the index 'idxrel' on 'rel'.
+ *
+ * The scan can be used for any number of lookups.
+ */
+static void
+index_scan_begin(PGLogicalIndexScan *iscan, Relation rel, Relation idxrel)
+{
+	iscan->idxrel = idxrel;
+	InitDirtySnapshot(iscan->snap);
+	iscan->scan = index_beginscan(rel, idxrel, &iscan->snap,
+								  RelationGetNumberOfAttributes(idxrel),
+								  0);
+}
+
+/*
+ * Search the index scanned by 'iscan' for a tuple identified by 'skey' in
+ * 'rel'.
  *
  * If a matching tuple is found lock it with lockmode, fill the slot with its
  * contents and return true, return false is returned otherwise.
  */
 static bool
-find_index_tuple(ScanKey skey, Relation rel, Relation idxrel,
+find_index_tuple(PGLogicalIndexScan *iscan, ScanKey skey, Relation rel,
 				 LockTupleMode lockmode, TupleTableSlot *slot)
 {
 	HeapTuple	scantuple;
 	bool		found;
-	IndexScanDesc scan;
-	SnapshotData snap;
+	Relation	idxrel = iscan->idxrel;
+	IndexScanDesc scan = iscan->scan;
 	TransactionId xwait;
 
-	InitDirtySnapshot(snap);
-	scan = index_beginscan(rel, idxrel, &snap,
-						   RelationGetNumberOfAttributes(idxrel),
-						   0);
-
 retry:
 	found = false;
 
@@ -142,8 +153,8 @@ retry:
 		ExecStoreTuple(scantuple, slot, InvalidBuffer, false);
 		ExecMaterializeSlot(slot);
 
-		xwait = TransactionIdIsValid(snap.xmin) ?
-			snap.xmin : snap.xmax;
+		xwait = TransactionIdIsValid(iscan->snap.xmin) ?
+			iscan->snap.xmin : iscan->snap.xmax;
 
 		if (TransactionIdIsValid(xwait))
 		{
@@ -189,8 +200,6 @@ retry:
 		}
 	}
 
-	index_endscan(scan);
-
 	return found;
 }
 
@@ -216,6 +225,50 @@ replindex_open(Relation rel, LOCKMODE lockmode)
 	return index_open(idxoid, lockmode);
 }
 
+/*
+ * Start scan of the REPLICA IDENTITY index of 'rel'.
+ *
+ * The scan is meant to be reused for lookups of multiple tuples, it has to be
+ * ended by pglogical_replidx_scan_end().
+ */
+PGLogicalIndexScan *
+pglogical_replidx_scan_begin(Relation rel)
+{
+	PGLogicalIndexScan *iscan = palloc(sizeof(PGLogicalIndexScan));
+
+	index_scan_begin(iscan, rel, replindex_open(rel, RowExclusiveLock));
+
+	return iscan;
+}
+
+void
+pglogical_replidx_scan_end(PGLogicalIndexScan *iscan)
+{
+	index_endscan(iscan->scan);
+
+	/* Don't release lock until commit. */
+	index_close(iscan->idxrel, NoLock);
+
+	pfree(iscan);
+}
+
+/*
+ * Find tuple using already open scan of REPLICA IDENTITY index.
+ */
+bool
+pglogical_tuple_find_replidx_scan(PGLogicalIndexScan *iscan, Relation rel,
+								  PGLogicalTupleData *tuple,
+								  TupleTableSlot *oldslot)
+{
+	ScanKeyData		index_key[INDEX_MAX_KEYS];
+
+	build_index_scan_key(index_key, rel, iscan->idxrel, tuple);
+
+	/* Try to find the row. */
+	return find_index_tuple(iscan, index_key, rel, LockTupleExclusive,
+							oldslot);
+}
+
 /*
  * Find tuple using REPLICA IDENTITY index.
  */
@@ -224,19 +277,13 @@ pglogical_tuple_find_replidx(EState *estate, PGLogicalTupleData *tuple,
 							 TupleTableSlot *oldslot)
 {
 	ResultRelInfo  *relinfo = estate->es_result_relation_info;
-	Relation		idxrel = replindex_open(relinfo->ri_RelationDesc,
-											RowExclusiveLock);
-	ScanKeyData		index_key[INDEX_MAX_KEYS];
+	PGLogicalIndexScan *iscan;
 	bool			found;
 
-	build_index_scan_key(index_key, relinfo->ri_RelationDesc, idxrel, tuple);
-
-	/* Try to find the row. */
-	found = find_index_tuple(index_key, relinfo->ri_RelationDesc, idxrel,
-							 LockTupleExclusive, oldslot);
-
-	/* Don't release lock until commit. */
-	index_close(idxrel, NoLock);
+	iscan = pglogical_replidx_scan_begin(relinfo->ri_RelationDesc);
+	found = pglogical_tuple_find_replidx_scan(iscan, relinfo->ri_RelationDesc,
+											  tuple, oldslot);
+	pglogical_replidx_scan_end(iscan);
 
 	return found;
 }
@@ -263,6 +310,7 @@ pglogical_tuple_find_conflict(EState *estate, PGLogicalTupleData *tuple,
 	{
 		IndexInfo  *ii = relinfo->ri_IndexRelationInfo[i];
 		Relation	idxrel;
+		PGLogicalIndexScan iscan;
 		bool found = false;
 
 		/*
@@ -280,8 +328,10 @@ pglogical_tuple_find_conflict(EState *estate, PGLogicalTupleData *tuple,
 			continue;
 
 		/* Try to find conflicting row. */
-		found = find_index_tuple(index_key, relinfo->ri_RelationDesc,
-								 idxrel, LockTupleExclusive, oldslot);
+		index_scan_begin(&iscan, relinfo->ri_RelationDesc, idxrel);
+		found = find_index_tuple(&iscan, index_key, relinfo->ri_RelationDesc,
+								 LockTupleExclusive, oldslot);
+		index_endscan(iscan.scan);
 
 		/* Alert if there's more than one conflicting unique key, we can't
 		 * currently handle that situation. */
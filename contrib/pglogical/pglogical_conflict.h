@@ -13,11 +13,14 @@
 #ifndef PGLOGICAL_CONGLICT_H
 #define PGLOGICAL_CONGLICT_H
 
+#include "access/genam.h"
+
 #include "nodes/execnodes.h"
 
 #include "replication/origin.h"
 
 #include "utils/guc.h"
+#include "utils/snapshot.h"
 
 #include "pglogical_proto.h"
 
@@ -47,6 +50,23 @@ typedef enum PGLogicalConflictType
 	CONFLICT_DELETE_DELETE
 } PGLogicalConflictType;
 
+/*
+ * SnapshotDirty scan of an index which can be reused for multiple lookups.
+ */
+typedef struct PGLogicalIndexScan
+{
+	Relation		idxrel;
+	IndexScanDesc	scan;
+	SnapshotData	snap;
+} PGLogicalIndexScan;
+
+extern PGLogicalIndexScan *pglogical_replidx_scan_begin(Relation rel);
+extern void pglogical_replidx_scan_end(PGLogicalIndexScan *iscan);
+extern bool pglogical_tuple_find_replidx_scan(PGLogicalIndexScan *iscan,
+											  Relation rel,
+											  PGLogicalTupleData *tuple,
+											  TupleTableSlot *oldslot);
+
 extern bool pglogical_tuple_find_replidx(EState *estate,
 										 PGLogicalTupleData *tuple,
 										 TupleTableSlot *oldslot);
@@ -57,8 +57,12 @@ typedef struct PGLogicalHooksPrivate
 	/* List of PGLogicalRepSet */
 	List	   *replication_sets;
 	RangeVar   *replicate_only_table;
+	Oid			replicate_only_nspid;
 	/* List of origin names */
     List	   *forward_origins;
+	/* Our special tables, looked up once so that filtering is cheap. */
+	Oid			queue_relid;
+	Oid			repset_table_relid;
 } PGLogicalHooksPrivate;
 
 void
@@ -77,6 +81,8 @@ pglogical_startup_hook(struct PGLogicalStartupHookArgs *startup_args)
 	startup_args->private_data = private = (PGLogicalHooksPrivate*)palloc0(sizeof(PGLogicalHooksPrivate));
 
 	private->local_node_id = node->node->id;
+	private->queue_relid = get_queue_table_oid();
+	private->repset_table_relid = get_replication_set_table_oid();
 
 	foreach(option, startup_args->in_params)
 	{
@@ -142,6 +148,9 @@ pglogical_startup_hook(struct PGLogicalStartupHookArgs *startup_args)
 
 			private->replicate_only_table = makeRangeVar(pstrdup(linitial(replicate_only_table)),
 													pstrdup(lsecond(replicate_only_table)), -1);
+			private->replicate_only_nspid =
+				get_namespace_oid(private->replicate_only_table->schemaname,
+								  true);
 
 			continue;
 		}
@@ -156,16 +165,13 @@ pglogical_row_filter_hook(struct PGLogicalRowFilterArgs *rowfilter_args)
 
 	if (private->replicate_only_table)
 	{
-		/*
-		 * Special case - we are catching up just one table.
-		 * TODO: performance
-		 */
-		return strcmp(RelationGetRelationName(rowfilter_args->changed_rel),
-					  private->replicate_only_table->relname) == 0 &&
-			RelationGetNamespace(rowfilter_args->changed_rel) ==
-			get_namespace_oid(private->replicate_only_table->schemaname, true);
+		/* Special case - we are catching up just one table. */
+		return RelationGetNamespace(rowfilter_args->changed_rel) ==
+			private->replicate_only_nspid &&
+			strcmp(RelationGetRelationName(rowfilter_args->changed_rel),
+				   private->replicate_only_table->relname) == 0;
 	}
-	else if (RelationGetRelid(rowfilter_args->changed_rel) == get_queue_table_oid())
+	else if (RelationGetRelid(rowfilter_args->changed_rel) == private->queue_relid)
 	{
 		/* Special case - queue table */
 		if (rowfilter_args->change_type == REORDER_BUFFER_CHANGE_INSERT)
@@ -201,7 +207,7 @@ pglogical_row_filter_hook(struct PGLogicalRowFilterArgs *rowfilter_args)
 
 		return false;
 	}
-	else if (RelationGetRelid(rowfilter_args->changed_rel) == get_replication_set_table_oid())
+	else if (RelationGetRelid(rowfilter_args->changed_rel) == private->repset_table_relid)
 	{
 		/*
 		 * Special case - replication set table.
@@ -243,6 +249,9 @@ pglogical_row_filter_hook(struct PGLogicalRowFilterArgs *rowfilter_args)
 				rs->replicate_delete = replicated_set->replicate_delete;
 				rs->replicate_truncate = replicated_set->replicate_truncate;
 
+				/* The cached relation info was built from the old settings. */
+				replication_set_invalidate_relations();
+
 				return false;
 			}
 		}
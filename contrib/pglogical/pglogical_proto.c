@@ -32,6 +32,8 @@
 
 #include "commands/dbcommands.h"
 
+#include "common/pg_lzcompress.h"
+
 #include "executor/spi.h"
 
 #include "libpq/pqformat.h"
@@ -119,6 +121,69 @@ pglogical_read_origin(StringInfo in, XLogRecPtr *origin_lsn)
 	return pnstrdup(pq_getmsgbytes(in, len), len);
 }
 
+/*
+ * Read BATCH from the output stream.
+ *
+ * Returns the list of INSERT, UPDATE and DELETE messages the batch consists
+ * of, in the same format as if they were sent individually.
+ */
+List *
+pglogical_read_batch(StringInfo in)
+{
+	uint8			flags;
+	uint32			relid;
+	int				nchanges;
+	int				rawlen;
+	StringInfoData	changes;
+	List		   *res = NIL;
+	int				i;
+
+	/* read the flags */
+	flags = pq_getmsgbyte(in);
+	if (flags & ~PGLOGICAL_BATCH_COMPRESSED)
+		elog(ERROR, "unknown flags %u in batch of changes",
+			 flags & ~PGLOGICAL_BATCH_COMPRESSED);
+
+	/* fixed fields */
+	relid = pq_getmsgint(in, 4);
+	nchanges = pq_getmsgint(in, 4);
+	rawlen = pq_getmsgint(in, 4);
+
+	if (flags & PGLOGICAL_BATCH_COMPRESSED)
+	{
+		int			len = pq_getmsgint(in, 4);
+		const char *compressed = pq_getmsgbytes(in, len);
+
+		changes.data = palloc(rawlen + 1);
+		if (pglz_decompress(compressed, len, changes.data, rawlen) != rawlen)
+			elog(ERROR, "compressed batch of changes is corrupted");
+	}
+	else
+		changes.data = (char *) pq_getmsgbytes(in, rawlen);
+
+	changes.len = rawlen;
+	changes.maxlen = -1;
+	changes.cursor = 0;
+
+	for (i = 0; i < nchanges; i++)
+	{
+		StringInfo	message = makeStringInfo();
+		char		action = pq_getmsgbyte(&changes);
+		int			len = pq_getmsgint(&changes, 4);
+
+		pq_sendbyte(message, action);
+		pq_sendbyte(message, 0);		/* flags */
+		pq_sendint(message, relid, 4);
+		pq_sendbytes(message, pq_getmsgbytes(&changes, len), len);
+
+		res = lappend(res, message);
+	}
+
+	if (changes.cursor != changes.len)
+		elog(ERROR, "invalid batch of changes");
+
+	return res;
+}
 
 /*
  * Read INSERT from stream.
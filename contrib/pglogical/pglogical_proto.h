@@ -31,6 +31,8 @@ typedef struct PGLogicalTupleData
 
 #define PGLOGICAL_XACT_EVENT(flags)	(flags & 0x03)
 
+#define PGLOGICAL_BATCH_COMPRESSED	0x01
+
 extern void pglogical_read_begin(StringInfo in, XLogRecPtr *remote_lsn,
 					  TimestampTz *committime, TransactionId *remote_xid);
 extern void pglogical_read_commit(StringInfo in, XLogRecPtr *commit_lsn,
@@ -47,4 +49,6 @@ extern PGLogicalRelation *pglogical_read_update(StringInfo in, LOCKMODE lockmode
 extern PGLogicalRelation *pglogical_read_delete(StringInfo in, LOCKMODE lockmode,
 												 PGLogicalTupleData *oldtup);
 
+extern List *pglogical_read_batch(StringInfo in);
+
 #endif /* PGLOGICAL_PROTO_H */
@@ -93,6 +93,22 @@ pglogical_relation_open(uint32 remoteid, LOCKMODE lockmode)
 	return entry;
 }
 
+/*
+ * Find the relation cache entry for the remote relation without opening the
+ * local relation.
+ *
+ * Returns NULL if we don't know the remote relation.
+ */
+PGLogicalRelation *
+pglogical_relation_find(uint32 remoteid)
+{
+	if (PGLogicalRelationHash == NULL)
+		return NULL;
+
+	return hash_search(PGLogicalRelationHash, (void *) &remoteid,
+					   HASH_FIND, NULL);
+}
+
 void
 pglogical_relation_cache_update(uint32 remoteid, char *schemaname,
 								 char *relname, int natts, char **attnames)
@@ -34,6 +34,7 @@ extern void pglogical_relation_cache_update(uint32 remoteid,
 
 extern PGLogicalRelation *pglogical_relation_open(uint32 remoteid,
 												   LOCKMODE lockmode);
+extern PGLogicalRelation *pglogical_relation_find(uint32 remoteid);
 extern void pglogical_relation_close(PGLogicalRelation * rel,
 									  LOCKMODE lockmode);
 extern void pglogical_relation_invalidate_cb(Datum arg, Oid reloid);
@@ -168,6 +168,26 @@ get_replication_set_by_name(Oid nodeid, const char *setname, bool missing_ok)
 	return repset;
 }
 
+/*
+ * Bitmap of the change types replicated by the replication set.
+ */
+static uint8
+replication_set_change_bits(PGLogicalRepSet *repset)
+{
+	uint8		bits = 0;
+
+	if (repset->replicate_insert)
+		bits |= REPSET_CHANGE_BIT(PGLogicalChangeInsert);
+	if (repset->replicate_update)
+		bits |= REPSET_CHANGE_BIT(PGLogicalChangeUpdate);
+	if (repset->replicate_delete)
+		bits |= REPSET_CHANGE_BIT(PGLogicalChangeDelete);
+	if (repset->replicate_truncate)
+		bits |= REPSET_CHANGE_BIT(PGLogicalChangeTruncate);
+
+	return bits;
+}
+
 static void
 repset_relcache_invalidate_callback(Datum arg, Oid reloid)
 {
@@ -386,10 +406,14 @@ get_repset_relation(Oid nodeid, Oid reloid, List *subs_replication_sets)
 
 	/* Fill the entry */
 	entry->reloid = reloid;
-	entry->replicate_insert = false;
-	entry->replicate_update = false;
-	entry->replicate_delete = false;
-	entry->replicate_truncate = false;
+	entry->replicate = 0;
+
+	/* Our own catalogs are never replicated. */
+	if (get_rel_namespace(reloid) == get_namespace_oid(EXTENSION_NAME, false))
+	{
+		entry->isvalid = true;
+		return entry;
+	}
 
 	/* Get replication sets for a table. */
 	table_replication_sets = get_relation_replication_sets(nodeid, reloid);
@@ -413,24 +437,14 @@ get_repset_relation(Oid nodeid, Oid reloid, List *subs_replication_sets)
 			PGLogicalRepSet	   *srepset = lfirst(slc);
 
 			if (trepset->id == srepset->id)
-			{
-				if (srepset->replicate_insert)
-					entry->replicate_insert = true;
-				if (srepset->replicate_update)
-					entry->replicate_update = true;
-				if (srepset->replicate_delete)
-					entry->replicate_delete = true;
-				if (srepset->replicate_truncate)
-					entry->replicate_truncate = true;
-			}
+				entry->replicate |= replication_set_change_bits(srepset);
 		}
 
 		/*
 		 * Now we now everything is replicated, no point in trying to check
 		 * more replication sets.
 		 */
-		if (entry->replicate_insert && entry->replicate_update &&
-			entry->replicate_delete && entry->replicate_truncate)
+		if (entry->replicate == REPSET_CHANGE_ALL)
 			break;
 	}
 
@@ -466,28 +480,20 @@ relation_is_replicated(Relation rel, Oid nodeid, List *replication_sets,
 {
 	PGLogicalRepSetRelation *r;
 
-	/* TODO: cache */
-	if (RelationGetNamespace(rel) == get_namespace_oid(EXTENSION_NAME, false))
-		return false;
-
 	r = get_repset_relation(nodeid, RelationGetRelid(rel), replication_sets);
 
-	switch (change_type)
-	{
-		case PGLogicalChangeInsert:
-			return r->replicate_insert;
-		case PGLogicalChangeUpdate:
-			return r->replicate_update;
-		case PGLogicalChangeDelete:
-			return r->replicate_delete;
-		case PGLogicalChangeTruncate:
-			return r->replicate_truncate;
-		default:
-			elog(ERROR, "should be unreachable");
-	}
+	return (r->replicate & REPSET_CHANGE_BIT(change_type)) != 0;
+}
 
-	/* Not reachable. */
-	return false;
+/*
+ * Forget the cached replication info of all relations.
+ *
+ * Used by the output plugin when the replication sets it uses change.
+ */
+void
+replication_set_invalidate_relations(void)
+{
+	repset_relcache_invalidate_callback((Datum) 0, InvalidOid);
 }
 
 /*
@@ -30,19 +30,6 @@ typedef struct PGLogicalRepSet
 #define DEFAULT_INSONLY_REPSET_NAME "default_insert_only"
 #define DDL_SQL_REPSET_NAME "ddl_sql"
 
-/* This is only valid within one output plugin instance/walsender. */
-typedef struct PGLogicalRepSetRelation
-{
-	Oid				reloid;				/* key */
-
-	bool			isvalid;			/* is this entry valid? */
-
-	bool			replicate_insert;	/* should insert be replicated? */
-	bool			replicate_update;	/* should update be replicated? */
-	bool			replicate_delete;	/* should delete be replicated? */
-	bool			replicate_truncate; /* should truncate be replicated? */
-} PGLogicalRepSetRelation;
-
 /* Change types, can't use ReorderBufferChangeType as it's missing TRUNCATE. */
 typedef enum PGLogicalChangeType
 {
@@ -52,6 +39,24 @@ typedef enum PGLogicalChangeType
 	PGLogicalChangeTruncate
 } PGLogicalChangeType;
 
+/* Bit of given change type in PGLogicalRepSetRelation.replicate. */
+#define REPSET_CHANGE_BIT(change_type)	(1 << (change_type))
+#define REPSET_CHANGE_ALL \
+	(REPSET_CHANGE_BIT(PGLogicalChangeInsert) | \
+	 REPSET_CHANGE_BIT(PGLogicalChangeUpdate) | \
+	 REPSET_CHANGE_BIT(PGLogicalChangeDelete) | \
+	 REPSET_CHANGE_BIT(PGLogicalChangeTruncate))
+
+/* This is only valid within one output plugin instance/walsender. */
+typedef struct PGLogicalRepSetRelation
+{
+	Oid				reloid;				/* key */
+
+	bool			isvalid;			/* is this entry valid? */
+
+	uint8			replicate;			/* bitmap of replicated change types */
+} PGLogicalRepSetRelation;
+
 extern PGLogicalRepSet *get_replication_set(Oid setid);
 extern PGLogicalRepSet *get_replication_set_by_name(Oid nodeid,
 													const char *setname,
@@ -65,6 +70,7 @@ extern List *get_relation_replication_sets(Oid nodeid, Oid reloid);
 extern bool relation_is_replicated(Relation rel, Oid nodeid,
 								   List *replication_set_names,
 								   PGLogicalChangeType change_type);
+extern void replication_set_invalidate_relations(void);
 
 extern void create_replication_set(PGLogicalRepSet *repset);
 extern void alter_replication_set(PGLogicalRepSet *repset);
@@ -13,6 +13,7 @@
 
 #include "postgres.h"
 
+#include <poll.h>
 #include <unistd.h>
 
 #include "libpq-fe.h"
@@ -24,10 +25,12 @@
 #include "access/heapam.h"
 #include "access/skey.h"
 #include "access/stratnum.h"
+#include "access/transam.h"
 #include "access/xact.h"
 
 #include "catalog/indexing.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_type.h"
 
 #include "commands/dbcommands.h"
 #include "commands/tablecmds.h"
@@ -47,6 +50,7 @@
 
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
+#include "utils/int8.h"
 #include "utils/pg_lsn.h"
 #include "utils/rel.h"
 #include "utils/resowner.h"
@@ -268,128 +272,567 @@ finish_copy_target_tx(PGconn *conn)
 
 
 /*
- * COPY single table over wire.
+ * One unit of work of the table copy, either a whole table or a key range
+ * of a table that was big enough to be split.
  */
+typedef struct CopyJob
+{
+	RangeVar   *rv;
+	char	   *qualname;		/* quoted schema qualified name */
+	char	   *where_clause;	/* key range to copy, NULL for whole table */
+	bool		binary;			/* use binary COPY format */
+	int64		pages;			/* estimated size, used for scheduling */
+} CopyJob;
+
+/*
+ * Connection pair used to copy data. Every stream runs its own transaction
+ * on both sides, the origin ones all share the exported slot snapshot.
+ */
+typedef struct CopyStream
+{
+	PGconn	   *origin_conn;
+	PGconn	   *target_conn;
+	CopyJob	   *job;			/* job in progress, NULL if idle */
+} CopyStream;
+
+/* Tables at least this big (in pages) are split into key ranges. */
+#define COPY_SPLIT_PAGES		16384
+
+/* Maximum number of jobs a single table is split into, per stream. */
+#define COPY_SPLIT_PER_STREAM	4
+
+/*
+ * Maximum amount of data forwarded by one stream before other streams get
+ * their turn.
+ */
+#define COPY_STREAM_CHUNK		(1024 * 1024)
+
 static void
-copy_table_data(PGconn *origin_conn, PGconn *target_conn,
-				const char *nspname, const char *relname)
+start_copy_stream(CopyStream *stream, const char *origin_dsn,
+				  const char *target_dsn, const char *origin_snapshot)
+{
+	/* Connect to origin node. */
+	stream->origin_conn = pglogical_connect(origin_dsn, EXTENSION_NAME "_copy");
+	start_copy_origin_tx(stream->origin_conn, origin_snapshot);
+
+	/* Connect to target node. */
+	stream->target_conn = pglogical_connect(target_dsn, EXTENSION_NAME "_copy");
+	start_copy_target_tx(stream->target_conn);
+
+	stream->job = NULL;
+}
+
+static void
+finish_copy_stream(CopyStream *stream)
+{
+	/* Finish the transactions and disconnect. */
+	finish_copy_origin_tx(stream->origin_conn);
+	finish_copy_target_tx(stream->target_conn);
+}
+
+static CopyJob *
+make_copy_job(RangeVar *rv, char *where_clause, bool binary, int64 pages)
+{
+	CopyJob	   *job = palloc(sizeof(CopyJob));
+
+	job->rv = rv;
+	job->qualname = quote_qualified_identifier(rv->schemaname, rv->relname);
+	job->where_clause = where_clause;
+	job->binary = binary;
+	job->pages = pages;
+
+	return job;
+}
+
+/*
+ * Split table into key ranges using its integer primary key.
+ *
+ * The ranges are computed from the minimum and maximum key value, which
+ * the primary key index gives us cheaply. Returns NIL if the table can't
+ * be split.
+ */
+static List *
+split_table_copy(PGconn *origin_conn, RangeVar *rv, const char *keyname,
+				 bool binary, int64 pages, int nsplits)
+{
+	PGresult   *res;
+	StringInfoData	query;
+	const char *quoted_key = quote_identifier(keyname);
+	int64		minval;
+	int64		maxval;
+	uint64		span;
+	uint64		step;
+	int64		lower;
+	List	   *jobs = NIL;
+	int			i;
+
+	initStringInfo(&query);
+	appendStringInfo(&query, "SELECT min(%s)::int8, max(%s)::int8 FROM %s",
+					 quoted_key, quoted_key,
+					 quote_qualified_identifier(rv->schemaname, rv->relname));
+
+	res = PQexec(origin_conn, query.data);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK)
+		ereport(ERROR,
+				(errmsg("could not get key range of table %s.%s",
+						rv->schemaname, rv->relname),
+				 errdetail("Query '%s': %s", query.data,
+						   PQerrorMessage(origin_conn))));
+
+	/* Empty table. */
+	if (PQgetisnull(res, 0, 0) || PQgetisnull(res, 0, 1))
+	{
+		PQclear(res);
+		return NIL;
+	}
+
+	(void) scanint8(PQgetvalue(res, 0, 0), false, &minval);
+	(void) scanint8(PQgetvalue(res, 0, 1), false, &maxval);
+	PQclear(res);
+
+	span = (uint64) maxval - (uint64) minval;
+	if (span < (uint64) nsplits)
+		nsplits = (int) span + 1;
+	if (nsplits < 2)
+		return NIL;
+
+	step = span / nsplits + 1;
+	lower = minval;
+	for (i = 0; i < nsplits; i++)
+	{
+		int64		upper = (int64) ((uint64) lower + step);
+
+		resetStringInfo(&query);
+		if (i > 0)
+			appendStringInfo(&query, "%s >= " INT64_FORMAT, quoted_key, lower);
+		if (i > 0 && i < nsplits - 1)
+			appendStringInfoString(&query, " AND ");
+		if (i < nsplits - 1)
+			appendStringInfo(&query, "%s < " INT64_FORMAT, quoted_key, upper);
+
+		jobs = lappend(jobs, make_copy_job(rv, pstrdup(query.data), binary,
+										   pages / nsplits));
+		lower = upper;
+	}
+
+	return jobs;
+}
+
+/*
+ * Build list of copy jobs for given tables.
+ *
+ * Binary format is only used when requested by caller (i.e. the structure
+ * on target was restored from the origin, so the types match) and when all
+ * column types of the table (and their element types) are built-in ones
+ * supporting it.  The binary format of arrays, composites and enums embeds
+ * type OIDs, which only the built-in types share between nodes.
+ */
+static List *
+plan_copy_jobs(PGconn *origin_conn, List *tables, int max_streams,
+			   bool binary)
+{
+	List	   *jobs = NIL;
+	ListCell   *lc;
+	Oid			types[2] = { TEXTOID, TEXTOID };
+	const char *info_query =
+		"SELECT c.relpages,"
+		"       NOT EXISTS ("
+		"           SELECT 1 FROM pg_catalog.pg_attribute a"
+		"             JOIN pg_catalog.pg_type t ON t.oid = a.atttypid"
+		"             LEFT JOIN pg_catalog.pg_type e ON e.oid = t.typelem"
+		"            WHERE a.attrelid = c.oid AND a.attnum > 0"
+		"              AND NOT a.attisdropped"
+		"              AND (t.oid >= " CppAsString2(FirstNormalObjectId)
+		"                   OR e.oid >= " CppAsString2(FirstNormalObjectId)
+		"                   OR t.typsend::oid = 0 OR t.typreceive::oid = 0"
+		"                   OR e.typsend::oid = 0 OR e.typreceive::oid = 0)),"
+		"       (SELECT a.attname FROM pg_catalog.pg_index i"
+		"          JOIN pg_catalog.pg_attribute a"
+		"            ON a.attrelid = i.indrelid AND a.attnum = i.indkey[0]"
+		"         WHERE i.indrelid = c.oid AND i.indisprimary"
+		"           AND i.indnatts = 1"
+		"           AND a.atttypid IN ('pg_catalog.int2'::pg_catalog.regtype,"
+		"                              'pg_catalog.int4'::pg_catalog.regtype,"
+		"                              'pg_catalog.int8'::pg_catalog.regtype))"
+		"  FROM pg_catalog.pg_class c"
+		"  JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace"
+		" WHERE n.nspname = $1 AND c.relname = $2";
+
+	foreach (lc, tables)
+	{
+		RangeVar   *rv = lfirst(lc);
+		const char *values[2];
+		PGresult   *res;
+		int64		pages = 0;
+		bool		table_binary = false;
+		List	   *table_jobs = NIL;
+
+		values[0] = rv->schemaname;
+		values[1] = rv->relname;
+
+		res = PQexecParams(origin_conn, info_query, 2, types, values,
+						   NULL, NULL, 0);
+		if (PQresultStatus(res) != PGRES_TUPLES_OK)
+			ereport(ERROR,
+					(errmsg("could not get info about table %s.%s",
+							rv->schemaname, rv->relname),
+					 errdetail("%s", PQerrorMessage(origin_conn))));
+
+		if (PQntuples(res) > 0)
+		{
+			pages = atoi(PQgetvalue(res, 0, 0));
+			table_binary = binary && strcmp(PQgetvalue(res, 0, 1), "t") == 0;
+
+			if (!PQgetisnull(res, 0, 2) && max_streams > 1 &&
+				pages >= COPY_SPLIT_PAGES)
+			{
+				int		nsplits;
+
+				nsplits = Min(pages / COPY_SPLIT_PAGES + 1,
+							  max_streams * COPY_SPLIT_PER_STREAM);
+				table_jobs = split_table_copy(origin_conn, rv,
+											  PQgetvalue(res, 0, 2),
+											  table_binary, pages, nsplits);
+			}
+		}
+		PQclear(res);
+
+		if (table_jobs == NIL)
+			table_jobs = list_make1(make_copy_job(rv, NULL, table_binary,
+												  pages));
+
+		jobs = list_concat(jobs, table_jobs);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	return jobs;
+}
+
+/* qsort comparator ordering copy jobs from biggest to smallest. */
+static int
+copy_job_cmp(const void *a, const void *b)
+{
+	const CopyJob *ja = *(CopyJob * const *) a;
+	const CopyJob *jb = *(CopyJob * const *) b;
+
+	if (ja->pages > jb->pages)
+		return -1;
+	if (ja->pages < jb->pages)
+		return 1;
+	return 0;
+}
+
+/*
+ * Start COPY of the job on both ends of the stream.
+ */
+static void
+start_copy_job(CopyStream *stream, CopyJob *job)
 {
 	PGresult   *res;
-	int			bytes;
-	char	   *copybuf;
 	StringInfoData	query;
+	const char *format = job->binary ? " WITH (FORMAT binary)" : "";
 
 	/* Build COPY TO query. */
 	initStringInfo(&query);
-	appendStringInfo(&query, "COPY %s.%s TO stdout",
-					 PQescapeIdentifier(origin_conn, nspname,
-										strlen(nspname)),
-					 PQescapeIdentifier(origin_conn, relname,
-										strlen(relname)));
+	if (job->where_clause)
+		appendStringInfo(&query, "COPY (SELECT * FROM ONLY %s WHERE %s) TO stdout%s",
+						 job->qualname, job->where_clause, format);
+	else
+		appendStringInfo(&query, "COPY %s TO stdout%s",
+						 job->qualname, format);
 
 	/* Execute COPY TO. */
-	res = PQexec(origin_conn, query.data);
+	res = PQexec(stream->origin_conn, query.data);
 	if (PQresultStatus(res) != PGRES_COPY_OUT)
 	{
 		ereport(ERROR,
 				(errmsg("table copy failed"),
 				 errdetail("Query '%s': %s", query.data,
-					 PQerrorMessage(origin_conn))));
+					 PQerrorMessage(stream->origin_conn))));
 	}
+	PQclear(res);
 
 	/* Build COPY FROM query. */
 	resetStringInfo(&query);
-	appendStringInfo(&query, "COPY %s.%s FROM stdin",
-					 PQescapeIdentifier(origin_conn, nspname,
-										strlen(nspname)),
-					 PQescapeIdentifier(origin_conn, relname,
-										strlen(relname)));
+	appendStringInfo(&query, "COPY %s FROM stdin%s", job->qualname, format);
 
 	/* Execute COPY FROM. */
-	res = PQexec(target_conn, query.data);
+	res = PQexec(stream->target_conn, query.data);
 	if (PQresultStatus(res) != PGRES_COPY_IN)
 	{
 		ereport(ERROR,
 				(errmsg("table copy failed"),
 				 errdetail("Query '%s': %s", query.data,
-					 PQerrorMessage(origin_conn))));
+					 PQerrorMessage(stream->target_conn))));
+	}
+	PQclear(res);
+
+	stream->job = job;
+}
+
+/*
+ * Finish COPY of the current job on both ends of the stream.
+ */
+static void
+finish_copy_job(CopyStream *stream)
+{
+	PGresult   *res;
+
+	/* Check result of the COPY TO. */
+	while ((res = PQgetResult(stream->origin_conn)) != NULL)
+	{
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			ereport(ERROR,
+					(errmsg("reading from origin table failed"),
+					 errdetail("source connection reported: %s",
+						 PQerrorMessage(stream->origin_conn))));
+		PQclear(res);
 	}
 
-	while ((bytes = PQgetCopyData(origin_conn, &copybuf, false)) > 0)
+	/* Send local finish */
+	if (PQputCopyEnd(stream->target_conn, NULL) != 1)
 	{
-		if (PQputCopyData(target_conn, copybuf, bytes) != 1)
+		ereport(ERROR,
+				(errmsg("sending copy-completion to destination connection failed"),
+				 errdetail("destination connection reported: %s",
+					 PQerrorMessage(stream->target_conn))));
+	}
+
+	/* And wait for the target to process the data. */
+	while ((res = PQgetResult(stream->target_conn)) != NULL)
+	{
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+			ereport(ERROR,
+					(errmsg("writing to target table failed"),
+					 errdetail("destination connection reported: %s",
+						 PQerrorMessage(stream->target_conn))));
+		PQclear(res);
+	}
+
+	stream->job = NULL;
+}
+
+/*
+ * Forward whatever data the origin has already sent to the target.
+ *
+ * Returns false if the stream has to wait for more data from origin.
+ */
+static bool
+forward_copy_data(CopyStream *stream)
+{
+	int			bytes;
+	int			forwarded = 0;
+	char	   *copybuf;
+
+	while ((bytes = PQgetCopyData(stream->origin_conn, &copybuf, true)) > 0)
+	{
+		if (PQputCopyData(stream->target_conn, copybuf, bytes) != 1)
 		{
 			ereport(ERROR,
 					(errmsg("writing to target table failed"),
 					 errdetail("destination connection reported: %s",
-						 PQerrorMessage(target_conn))));
+						 PQerrorMessage(stream->target_conn))));
 		}
 		PQfreemem(copybuf);
 
 		CHECK_FOR_INTERRUPTS();
+
+		/* Give other streams a chance. */
+		forwarded += bytes;
+		if (forwarded >= COPY_STREAM_CHUNK)
+			return true;
 	}
 
+	if (bytes == 0)
+		return false;
+
 	if (bytes != -1)
 	{
 		ereport(ERROR,
 				(errmsg("reading from origin table failed"),
 				 errdetail("source connection returned %d: %s",
-					bytes, PQerrorMessage(origin_conn))));
+					bytes, PQerrorMessage(stream->origin_conn))));
 	}
 
-	/* Send local finish */
-	if (PQputCopyEnd(target_conn, NULL) != 1)
+	finish_copy_job(stream);
+
+	return true;
+}
+
+/*
+ * Run the copy jobs over the streams.
+ *
+ * The streams are driven from single process, we read from all the origin
+ * connections asynchronously and wait on their sockets when none of them
+ * has any data ready.
+ */
+static void
+run_copy_jobs(CopyStream *streams, int nstreams, CopyJob **jobs, int njobs)
+{
+	struct pollfd  *fds = palloc(sizeof(struct pollfd) * nstreams);
+	int				next_job = 0;
+
+	for (;;)
 	{
-		ereport(ERROR,
-				(errmsg("sending copy-completion to destination connection failed"),
-				 errdetail("destination connection reported: %s",
-					 PQerrorMessage(target_conn))));
+		bool	progress = false;
+		int		nfds = 0;
+		int		i;
+
+		for (i = 0; i < nstreams; i++)
+		{
+			CopyStream *stream = &streams[i];
+
+			if (stream->job == NULL && next_job < njobs)
+				start_copy_job(stream, jobs[next_job++]);
+
+			if (stream->job == NULL)
+				continue;
+
+			if (forward_copy_data(stream))
+				progress = true;
+			else
+			{
+				fds[nfds].fd = PQsocket(stream->origin_conn);
+				fds[nfds].events = POLLIN;
+				fds[nfds].revents = 0;
+				nfds++;
+			}
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		/* All done? */
+		if (!progress && nfds == 0)
+			break;
+
+		if (progress)
+			continue;
+
+		/* Nothing to do, wait for some data to arrive. */
+		if (poll(fds, nfds, 1000) < 0 && errno != EINTR)
+			elog(ERROR, "poll() failed while copying data: %m");
+
+		for (i = 0; i < nstreams; i++)
+		{
+			CopyStream *stream = &streams[i];
+
+			if (stream->job != NULL && PQconsumeInput(stream->origin_conn) != 1)
+				ereport(ERROR,
+						(errmsg("reading from origin table failed"),
+						 errdetail("source connection reported: %s",
+							 PQerrorMessage(stream->origin_conn))));
+		}
 	}
 
-	PQclear(res);
+	pfree(fds);
 }
 
 /*
- * Copy data from origin node to target node.
- *
- * Creates new connection to origin and target.
+ * Copy the tables using the first (already open) stream and up to
+ * max_streams - 1 additional streams.
  */
 static void
-copy_tables_data(const char *origin_dsn, const char *target_dsn,
-				 const char *origin_snapshot, List *tables)
+copy_tables_with_streams(CopyStream *streams, int max_streams,
+						 const char *origin_dsn, const char *target_dsn,
+						 const char *origin_snapshot, List *tables,
+						 bool binary)
 {
-	PGconn	   *origin_conn;
-	PGconn	   *target_conn;
+	List	   *joblist;
+	CopyJob	  **jobs;
+	int			njobs;
+	int			nstreams;
+	int			i;
 	ListCell   *lc;
 
-	/* Connect to origin node. */
-	origin_conn = pglogical_connect(origin_dsn, EXTENSION_NAME "_copy");
-	start_copy_origin_tx(origin_conn, origin_snapshot);
+	/* Split the work and schedule biggest jobs first. */
+	joblist = plan_copy_jobs(streams[0].origin_conn, tables, max_streams,
+							 binary);
+	njobs = list_length(joblist);
+	jobs = palloc(sizeof(CopyJob *) * Max(njobs, 1));
+	i = 0;
+	foreach (lc, joblist)
+		jobs[i++] = lfirst(lc);
+	qsort(jobs, njobs, sizeof(CopyJob *), copy_job_cmp);
 
-	/* Connect to target node. */
-	target_conn = pglogical_connect(target_dsn, EXTENSION_NAME "_copy");
-	start_copy_target_tx(target_conn);
+	/* Open the rest of the streams, no point having more than jobs. */
+	nstreams = Max(Min(max_streams, njobs), 1);
+	for (i = 1; i < nstreams; i++)
+		start_copy_stream(&streams[i], origin_dsn, target_dsn,
+						  origin_snapshot);
+
+	run_copy_jobs(streams, nstreams, jobs, njobs);
+
+	/*
+	 * The streams commit one after another, so if a later COMMIT fails the
+	 * data of the earlier streams stays.  Callers retrying the copy must
+	 * empty the tables first, see truncate_target_tables.
+	 */
+	for (i = 0; i < nstreams; i++)
+		finish_copy_stream(&streams[i]);
+}
+
+/*
+ * Remove rows left over on target by a failed copy of the given tables.
+ */
+static void
+truncate_target_tables(const char *target_dsn, List *tables)
+{
+	PGconn	   *conn;
+	PGresult   *res;
+	StringInfoData	query;
+	ListCell   *lc;
 
-	/* Copy every table. */
+	initStringInfo(&query);
+	appendStringInfoString(&query, "TRUNCATE ONLY ");
 	foreach (lc, tables)
 	{
-		RangeVar	*rv = lfirst(lc);
-
-		copy_table_data(origin_conn, target_conn,
-						rv->schemaname, rv->relname);
+		RangeVar   *rv = lfirst(lc);
 
-		CHECK_FOR_INTERRUPTS();
+		if (lc != list_head(tables))
+			appendStringInfoString(&query, ", ");
+		appendStringInfoString(&query,
+							   quote_qualified_identifier(rv->schemaname,
+														  rv->relname));
 	}
 
-	/* Finish the transactions and disconnect. */
-	finish_copy_origin_tx(origin_conn);
-	finish_copy_target_tx(target_conn);
+	conn = pglogical_connect(target_dsn, EXTENSION_NAME "_copy");
+	start_copy_target_tx(conn);
+
+	res = PQexec(conn, query.data);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		ereport(ERROR,
+				(errmsg("could not truncate tables before copy"),
+				 errdetail("Query '%s': %s", query.data,
+						   PQerrorMessage(conn))));
+	PQclear(res);
+
+	finish_copy_target_tx(conn);
 }
 
 /*
  * Copy data from origin node to target node.
  *
- * Creates new connection to origin and target.
+ * Creates new connections to origin and target.
+ */
+static void
+copy_tables_data(const char *origin_dsn, const char *target_dsn,
+				 const char *origin_snapshot, List *tables, bool binary)
+{
+	int			max_streams = pglogical_copy_streams;
+	CopyStream *streams;
+
+	streams = palloc0(sizeof(CopyStream) * max_streams);
+	start_copy_stream(&streams[0], origin_dsn, target_dsn, origin_snapshot);
+
+	copy_tables_with_streams(streams, max_streams, origin_dsn, target_dsn,
+							 origin_snapshot, tables, binary);
+}
+
+/*
+ * Copy data from origin node to target node.
+ *
+ * Creates new connections to origin and target.
  *
  * This is basically same as the copy_tables_data, but it can't be easily
  * merged to single function because we need to get list of tables here after
@@ -397,39 +840,22 @@ copy_tables_data(const char *origin_dsn, const char *target_dsn,
  */
 static List *
 copy_replication_sets_data(const char *origin_dsn, const char *target_dsn,
-						   const char *origin_snapshot, List *replication_sets)
+						   const char *origin_snapshot, List *replication_sets,
+						   bool binary)
 {
-	PGconn	   *origin_conn;
-	PGconn	   *target_conn;
+	int			max_streams = pglogical_copy_streams;
+	CopyStream *streams;
 	List	   *tables;
-	ListCell   *lc;
 
-	/* Connect to origin node. */
-	origin_conn = pglogical_connect(origin_dsn, EXTENSION_NAME "_copy");
-	start_copy_origin_tx(origin_conn, origin_snapshot);
+	streams = palloc0(sizeof(CopyStream) * max_streams);
+	start_copy_stream(&streams[0], origin_dsn, target_dsn, origin_snapshot);
 
 	/* Get tables to copy from origin node. */
-	tables = pg_logical_get_remote_repset_tables(origin_conn,
+	tables = pg_logical_get_remote_repset_tables(streams[0].origin_conn,
 												 replication_sets);
 
-	/* Connect to target node. */
-	target_conn = pglogical_connect(target_dsn, EXTENSION_NAME "_copy");
-	start_copy_target_tx(target_conn);
-
-	/* Copy every table. */
-	foreach (lc, tables)
-	{
-		RangeVar	*rv = lfirst(lc);
-
-		copy_table_data(origin_conn, target_conn,
-						rv->schemaname, rv->relname);
-
-		CHECK_FOR_INTERRUPTS();
-	}
-
-	/* Finish the transactions and disconnect. */
-	finish_copy_origin_tx(origin_conn);
-	finish_copy_target_tx(target_conn);
+	copy_tables_with_streams(streams, max_streams, origin_dsn, target_dsn,
+							 origin_snapshot, tables, binary);
 
 	return tables;
 }
@@ -580,7 +1006,8 @@ pglogical_sync_subscription(PGLogicalSubscription *sub)
 					tables = copy_replication_sets_data(sub->origin_if->dsn,
 														sub->target_if->dsn,
 														snapshot,
-														sub->replication_sets);
+														sub->replication_sets,
+														SyncKindStructure(sync->kind));
 
 					/* Store info about all the synchronized tables. */
 					StartTransactionCommand();
@@ -664,6 +1091,7 @@ pglogical_sync_table(PGLogicalSubscription *sub, RangeVar *table)
 	RepOriginId	originid;
 	char	   *snapshot;
 	PGLogicalSyncStatus	   *sync;
+	bool		truncate;
 
 	StartTransactionCommand();
 
@@ -682,12 +1110,20 @@ pglogical_sync_table(PGLogicalSubscription *sub, RangeVar *table)
 	if (sync->status == SYNC_STATUS_READY)
 		proc_exit(0);
 
-	/* If previous sync attempt failed, we need to start from beginning. */
+	/*
+	 * If previous sync attempt failed, we need to start from beginning.
+	 * When it failed while copying, some of the copy streams may have
+	 * committed already, so their rows have to go first.
+	 */
 	if (sync->status != SYNC_STATUS_INIT)
 		set_table_sync_status(sub->id, table->schemaname, table->relname, SYNC_STATUS_INIT);
+	truncate = (sync->status == SYNC_STATUS_DATA);
 
 	CommitTransactionCommand();
 
+	if (truncate)
+		truncate_target_tables(sub->target_if->dsn, list_make1(table));
+
 	origin_conn_repl = pglogical_connect_replica(sub->origin_if->dsn,
 												 EXTENSION_NAME "_copy");
 
@@ -708,7 +1144,7 @@ pglogical_sync_table(PGLogicalSubscription *sub, RangeVar *table)
 
 		/* Copy data. */
 		copy_tables_data(sub->origin_if->dsn,sub->target_if->dsn, snapshot,
-						 list_make1(table));
+						 list_make1(table), false);
 	}
 	PG_END_ENSURE_ERROR_CLEANUP(pglogical_sync_worker_cleanup_cb,
 								PointerGetDatum(sub));
@@ -120,6 +120,15 @@ pglogical_worker_register(PGLogicalWorker *worker)
 				 NameStr(worker->worker.sync.relname),
 				 worker->dboid, worker->worker.sync.apply.subid);
 	}
+	else if (worker->worker_type == PGLOGICAL_WORKER_APPLY_PARALLEL)
+	{
+		snprintf(bgw.bgw_function_name, BGW_MAXLEN,
+				 "pglogical_apply_parallel_main");
+		snprintf(bgw.bgw_name, BGW_MAXLEN,
+				 "pglogical apply %u:%u parallel %d", worker->dboid,
+				 worker->worker.parallel.apply.subid,
+				 worker->worker.parallel.index);
+	}
 	else
 	{
 		snprintf(bgw.bgw_function_name, BGW_MAXLEN,
@@ -13,14 +13,18 @@
 #ifndef PGLOGICAL_WORKER_H
 #define PGLOGICAL_WORKER_H
 
+#include "storage/dsm.h"
+
 #include "pglogical.h"
 
 typedef enum {
 	PGLOGICAL_WORKER_NONE,		/* Unused slot. */
 	PGLOGICAL_WORKER_MANAGER,	/* Manager. */
 	PGLOGICAL_WORKER_APPLY,		/* Apply. */
-	PGLOGICAL_WORKER_SYNC		/* Special type of Apply that synchronizes
+	PGLOGICAL_WORKER_SYNC,		/* Special type of Apply that synchronizes
 								 * one table. */
+	PGLOGICAL_WORKER_APPLY_PARALLEL	/* Applies transactions dispatched by
+									 * the apply worker. */
 } PGLogicalWorkerType;
 
 typedef struct PGLogicalApplyWorker
@@ -37,6 +41,13 @@ typedef struct PGLogicalSyncWorker
 	NameData	relname;	/* Name of the table to copy if any. */
 } PGLogicalSyncWorker;
 
+typedef struct PGLogicalParallelApplyWorker
+{
+	PGLogicalApplyWorker	apply; /* Apply worker info, must be first. */
+	dsm_handle	dsm;		/* Segment shared with the apply worker. */
+	int			index;		/* Index of this worker in the segment. */
+} PGLogicalParallelApplyWorker;
+
 typedef struct PGLogicalWorker {
 	PGLogicalWorkerType	worker_type;
 
@@ -51,6 +62,7 @@ typedef struct PGLogicalWorker {
 	{
 		PGLogicalApplyWorker apply;
 		PGLogicalSyncWorker sync;
+		PGLogicalParallelApplyWorker parallel;
 	} worker;
 
 } PGLogicalWorker;
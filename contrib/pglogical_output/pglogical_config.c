@@ -75,7 +75,10 @@ enum {
 	PARAM_PG_VERSION,
 	PARAM_HOOKS_SETUP_FUNCTION,
 	PARAM_NO_TXINFO,
-	PARAM_RELMETA_CACHE_SIZE
+	PARAM_RELMETA_CACHE_SIZE,
+	PARAM_BATCH_CHANGES,
+	PARAM_BATCH_COMPRESSION,
+	PARAM_STREAM_CHANGES
 } OutputPluginParamKey;
 
 typedef struct {
@@ -103,6 +106,9 @@ static OutputPluginParam param_lookup[] = {
 	{"hooks.setup_function", PARAM_HOOKS_SETUP_FUNCTION},
 	{"no_txinfo", PARAM_NO_TXINFO},
 	{"relmeta_cache_size", PARAM_RELMETA_CACHE_SIZE},
+	{"batch_changes", PARAM_BATCH_CHANGES},
+	{"batch_compression", PARAM_BATCH_COMPRESSION},
+	{"stream_changes", PARAM_STREAM_CHANGES},
 	{NULL, PARAM_UNRECOGNISED}
 };
 
@@ -244,6 +250,21 @@ process_parameters_v1(List *options, PGLogicalOutputData *data)
 				data->client_relmeta_cache_size = DatumGetInt32(val);
 				break;
 
+			case PARAM_BATCH_CHANGES:
+				val = get_param_value(elem, false, OUTPUT_PARAM_TYPE_BOOL);
+				data->client_batch_changes = DatumGetBool(val);
+				break;
+
+			case PARAM_BATCH_COMPRESSION:
+				val = get_param_value(elem, false, OUTPUT_PARAM_TYPE_BOOL);
+				data->client_batch_compression = DatumGetBool(val);
+				break;
+
+			case PARAM_STREAM_CHANGES:
+				val = get_param_value(elem, false, OUTPUT_PARAM_TYPE_BOOL);
+				data->client_stream_changes = DatumGetBool(val);
+				break;
+
 			case PARAM_UNRECOGNISED:
 				ereport(DEBUG1,
 						(errmsg("Unrecognised pglogical parameter %s ignored", elem->defname)));
@@ -512,6 +533,9 @@ prepare_startup_message(PGLogicalOutputData *data)
 	/* Cache control and other misc options */
 	l = add_startup_msg_i(l, "relmeta_cache_size",
 			data->relmeta_cache_size);
+	l = add_startup_msg_b(l, "batch_changes", data->batch_changes);
+	l = add_startup_msg_b(l, "batch_compression", data->batch_compression);
+	l = add_startup_msg_b(l, "stream_changes", data->stream_changes);
 
 
 	/*
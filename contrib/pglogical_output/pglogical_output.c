@@ -27,6 +27,8 @@
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
 
+#include "libpq/pqformat.h"
+
 #include "mb/pg_wchar.h"
 
 #include "nodes/parsenodes.h"
@@ -66,6 +68,17 @@ static void pg_decode_commit_txn(LogicalDecodingContext *ctx,
 static void pg_decode_change(LogicalDecodingContext *ctx,
 				 ReorderBufferTXN *txn, Relation rel,
 				 ReorderBufferChange *change);
+static void pg_decode_stream_start(LogicalDecodingContext *ctx,
+					   ReorderBufferTXN *txn);
+static void pg_decode_stream_stop(LogicalDecodingContext *ctx,
+					  ReorderBufferTXN *txn);
+static void pg_decode_stream_change(LogicalDecodingContext *ctx,
+						ReorderBufferTXN *txn, Relation rel,
+						ReorderBufferChange *change);
+static void pg_decode_stream_abort(LogicalDecodingContext *ctx,
+					   ReorderBufferTXN *txn, XLogRecPtr abort_lsn);
+static void pg_decode_stream_commit(LogicalDecodingContext *ctx,
+						ReorderBufferTXN *txn, XLogRecPtr commit_lsn);
 
 #ifdef HAVE_REPLICATION_ORIGINS
 static bool pg_decode_origin_filter(LogicalDecodingContext *ctx,
@@ -74,6 +87,9 @@ static bool pg_decode_origin_filter(LogicalDecodingContext *ctx,
 
 static void send_startup_message(LogicalDecodingContext *ctx,
 		PGLogicalOutputData *data, bool last_message);
+static void add_batch_change(PGLogicalOutputData *data, Relation relation);
+static void send_batch(LogicalDecodingContext *ctx,
+		PGLogicalOutputData *data, bool last_message);
 
 static bool startup_message_sent = false;
 
@@ -91,6 +107,13 @@ _PG_output_plugin_init(OutputPluginCallbacks *cb)
 	cb->filter_by_origin_cb = pg_decode_origin_filter;
 #endif
 	cb->shutdown_cb = pg_decode_shutdown;
+	cb->stream_start_cb = pg_decode_stream_start;
+	cb->stream_stop_cb = pg_decode_stream_stop;
+	cb->stream_change_cb = pg_decode_stream_change;
+	cb->stream_abort_cb = pg_decode_stream_abort;
+	cb->stream_commit_cb = pg_decode_stream_commit;
+	/* the writer tells PREPARE TRANSACTION apart by txn->xact_action */
+	cb->stream_prepare_cb = pg_decode_stream_commit;
 }
 
 static bool
@@ -235,6 +258,12 @@ pg_decode_startup(LogicalDecodingContext * ctx, OutputPluginOptions *opt,
 		{
 			data->api = pglogical_init_api(PGLogicalProtoJson);
 			opt->output_type = OUTPUT_PLUGIN_TEXTUAL_OUTPUT;
+
+			if (data->client_batch_changes)
+				elog(WARNING, "batch_changes option ignored for protocols other than native");
+
+			if (data->client_stream_changes)
+				elog(WARNING, "stream_changes option ignored for protocols other than native");
 		}
 		else if ((data->client_protocol_format != NULL
 			     && strcmp(data->client_protocol_format, "native") == 0)
@@ -248,6 +277,11 @@ pg_decode_startup(LogicalDecodingContext * ctx, OutputPluginOptions *opt,
 				elog(WARNING, "no_txinfo option ignored for protocols other than json");
 				data->client_no_txinfo = false;
 			}
+
+			data->batch_changes = data->client_batch_changes;
+			data->batch_compression = data->client_batch_changes &&
+				data->client_batch_compression;
+			data->stream_changes = data->client_stream_changes;
 		}
 		else
 		{
@@ -377,7 +411,16 @@ pg_decode_startup(LogicalDecodingContext * ctx, OutputPluginOptions *opt,
 		/* if cache enabled, init it */
 		if (data->relmeta_cache_size != 0)
 			pglogical_init_relmetacache(ctx->context);
+
+		if (data->batch_changes)
+		{
+			data->batch = makeStringInfo();
+			data->batch_change = makeStringInfo();
+		}
 	}
+
+	/* only stream in-progress transactions if the client asked for it */
+	ctx->streaming = data->stream_changes;
 }
 
 /*
@@ -436,6 +479,9 @@ pg_decode_commit_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 {
 	PGLogicalOutputData* data = (PGLogicalOutputData*)ctx->output_plugin_private;
 
+	if (data->batch_changes)
+		send_batch(ctx, data, false);
+
 	OutputPluginPrepareWrite(ctx, true);
 	data->api->write_commit(ctx->out, data, txn, commit_lsn);
 	OutputPluginWrite(ctx, true);
@@ -457,6 +503,11 @@ pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	/* Avoid leaking memory by using and resetting our own context */
 	old = MemoryContextSwitchTo(data->context);
 
+	/* The batch can only contain changes to one relation. */
+	if (data->batch_changes &&
+		data->batch_relid != RelationGetRelid(relation))
+		send_batch(ctx, data, false);
+
 	/*
 	 * If the protocol wants to write relation information and the client
 	 * isn't known to have metadata cached for this relation already,
@@ -467,11 +518,58 @@ pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	if (data->api->write_rel != NULL &&
 			!pglogical_cache_relmeta(data, relation, &cached_relmeta))
 	{
+		/* Changes already in batch were made with the old metadata. */
+		if (data->batch_changes)
+			send_batch(ctx, data, false);
+
 		OutputPluginPrepareWrite(ctx, false);
 		data->api->write_rel(ctx->out, data, relation, cached_relmeta);
 		OutputPluginWrite(ctx, false);
 	}
 
+	/*
+	 * When batching, the change is encoded into a separate buffer and added
+	 * to the batch, which is sent once it's big enough or before anything
+	 * else is sent.
+	 */
+	if (data->batch_changes)
+	{
+		resetStringInfo(data->batch_change);
+
+		switch (change->action)
+		{
+			case REORDER_BUFFER_CHANGE_INSERT:
+				data->api->write_insert(data->batch_change, data, relation,
+										&change->data.tp.newtuple->tuple);
+				break;
+			case REORDER_BUFFER_CHANGE_UPDATE:
+				data->api->write_update(data->batch_change, data, relation,
+										change->data.tp.oldtuple ?
+										&change->data.tp.oldtuple->tuple : NULL,
+										&change->data.tp.newtuple->tuple);
+				break;
+			case REORDER_BUFFER_CHANGE_DELETE:
+				if (change->data.tp.oldtuple)
+					data->api->write_delete(data->batch_change, data, relation,
+											&change->data.tp.oldtuple->tuple);
+				else
+					elog(DEBUG1, "didn't send DELETE change because of missing oldtuple");
+				break;
+			default:
+				Assert(false);
+		}
+
+		if (data->batch_change->len > 0)
+			add_batch_change(data, relation);
+
+		if (data->batch->len >= PGLOGICAL_BATCH_MAX_SIZE)
+			send_batch(ctx, data, true);
+
+		MemoryContextSwitchTo(old);
+		MemoryContextReset(data->context);
+		return;
+	}
+
 	/* Send the data */
 	switch (change->action)
 	{
@@ -512,6 +610,101 @@ pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	MemoryContextReset(data->context);
 }
 
+/*
+ * STREAM START callback
+ *
+ * Changes of a large in-progress transaction are sent in blocks enclosed by
+ * STREAM START and STREAM STOP, and the transaction ends with a STREAM COMMIT
+ * or STREAM ABORT instead of the usual BEGIN ... COMMIT.
+ */
+static void
+pg_decode_stream_start(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+{
+	PGLogicalOutputData *data = ctx->output_plugin_private;
+
+	if (!startup_message_sent)
+		send_startup_message(ctx, data, false /* can't be last message */);
+
+	/* changes of the toplevel transaction need no STREAM SUBXACT */
+	data->stream_xid = txn->xid;
+
+	OutputPluginPrepareWrite(ctx, true);
+	data->api->write_stream_start(ctx->out, data, txn);
+	OutputPluginWrite(ctx, true);
+}
+
+/*
+ * STREAM STOP callback
+ */
+static void
+pg_decode_stream_stop(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+{
+	PGLogicalOutputData *data = ctx->output_plugin_private;
+
+	/* A batch must not span blocks. */
+	if (data->batch_changes)
+		send_batch(ctx, data, false);
+
+	OutputPluginPrepareWrite(ctx, true);
+	data->api->write_stream_stop(ctx->out, data, txn);
+	OutputPluginWrite(ctx, true);
+}
+
+/*
+ * Changes within a streamed block are sent like in pg_decode_change, but the
+ * client has to be told which subtransaction they belong to, since it may
+ * abort independently of the toplevel transaction.
+ */
+static void
+pg_decode_stream_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+						Relation relation, ReorderBufferChange *change)
+{
+	PGLogicalOutputData *data = ctx->output_plugin_private;
+
+	if (change->txn->xid != data->stream_xid)
+	{
+		/* The batch can only contain changes of one subtransaction. */
+		if (data->batch_changes)
+			send_batch(ctx, data, false);
+
+		OutputPluginPrepareWrite(ctx, true);
+		data->api->write_stream_subxact(ctx->out, data, change->txn->xid);
+		OutputPluginWrite(ctx, true);
+
+		data->stream_xid = change->txn->xid;
+	}
+
+	pg_decode_change(ctx, txn, relation, change);
+}
+
+/*
+ * STREAM ABORT callback, for the toplevel transaction or a subtransaction.
+ */
+static void
+pg_decode_stream_abort(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+					   XLogRecPtr abort_lsn)
+{
+	PGLogicalOutputData *data = ctx->output_plugin_private;
+
+	OutputPluginPrepareWrite(ctx, true);
+	data->api->write_stream_abort(ctx->out, data, txn, abort_lsn);
+	OutputPluginWrite(ctx, true);
+}
+
+/*
+ * STREAM COMMIT callback, also used for PREPARE TRANSACTION.
+ */
+static void
+pg_decode_stream_commit(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+						XLogRecPtr commit_lsn)
+{
+	PGLogicalOutputData *data = ctx->output_plugin_private;
+
+	OutputPluginPrepareWrite(ctx, true);
+	data->api->write_stream_commit(ctx->out, data, txn, commit_lsn);
+	OutputPluginWrite(ctx, true);
+}
+
 #ifdef HAVE_REPLICATION_ORIGINS
 /*
  * Decide if the whole transaction with specific origin should be filtered out.
@@ -529,6 +722,49 @@ pg_decode_origin_filter(LogicalDecodingContext *ctx,
 }
 #endif
 
+/*
+ * Add the change encoded in batch_change to the batch.
+ *
+ * The message header (action, flags and relation identifier) is replaced by
+ * the action and length of the change, the flags and relation identifier
+ * are sent only once for the whole batch.
+ */
+static void
+add_batch_change(PGLogicalOutputData *data, Relation relation)
+{
+	StringInfo	change = data->batch_change;
+	int			hdrlen = 1 + 1 + 4;
+
+	Assert(change->len > hdrlen);
+
+	data->batch_relid = RelationGetRelid(relation);
+	data->batch_nchanges++;
+
+	pq_sendbyte(data->batch, change->data[0]);	/* action */
+	pq_sendint(data->batch, change->len - hdrlen, 4);
+	pq_sendbytes(data->batch, change->data + hdrlen, change->len - hdrlen);
+}
+
+/*
+ * Send the batched changes, if any.
+ */
+static void
+send_batch(LogicalDecodingContext *ctx, PGLogicalOutputData *data,
+		   bool last_message)
+{
+	if (data->batch_nchanges == 0)
+		return;
+
+	OutputPluginPrepareWrite(ctx, last_message);
+	data->api->write_batch(ctx->out, data, data->batch_relid,
+						   data->batch_nchanges, data->batch);
+	OutputPluginWrite(ctx, last_message);
+
+	resetStringInfo(data->batch);
+	data->batch_relid = InvalidOid;
+	data->batch_nchanges = 0;
+}
+
 static void
 send_startup_message(LogicalDecodingContext *ctx,
 		PGLogicalOutputData *data, bool last_message)
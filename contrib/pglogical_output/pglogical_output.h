@@ -50,6 +50,9 @@
  */
 #define PGLOGICAL_STARTUP_PARAM_FORMAT_FLAT 1
 
+/* Batched changes are sent once the batch reaches this size. */
+#define PGLOGICAL_BATCH_MAX_SIZE (64 * 1024)
+
 struct PGLogicalProtoAPI;
 
 typedef struct PGLogicalOutputData
@@ -64,6 +67,24 @@ typedef struct PGLogicalOutputData
 	bool	forward_changeset_origins;
 	int		field_datum_encoding;
 	int		relmeta_cache_size;
+	bool	batch_changes;
+	bool	batch_compression;
+	bool	stream_changes;
+
+	/*
+	 * Consecutive changes to one relation which weren't sent yet, see
+	 * pg_decode_change. The change buffer is used to encode a single change.
+	 */
+	StringInfo	batch;
+	Oid			batch_relid;
+	int			batch_nchanges;
+	StringInfo	batch_change;
+
+	/*
+	 * (Sub)transaction the changes sent in the current stream block belong
+	 * to, see pg_decode_stream_change.
+	 */
+	TransactionId stream_xid;
 
 	/*
 	 * client info
@@ -95,6 +116,9 @@ typedef struct PGLogicalOutputData
 	bool	client_binary_intdatetimes;
 	bool	client_no_txinfo;
 	int   client_relmeta_cache_size;
+	bool	client_batch_changes;
+	bool	client_batch_compression;
+	bool	client_stream_changes;
 
 	/* hooks */
 	List *hooks_setup_funcname;
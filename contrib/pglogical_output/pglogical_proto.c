@@ -31,6 +31,12 @@ pglogical_init_api(PGLogicalProtoType typ)
 		res->write_insert = pglogical_json_write_insert;
 		res->write_update = pglogical_json_write_update;
 		res->write_delete = pglogical_json_write_delete;
+		res->write_batch = NULL;
+		res->write_stream_start = NULL;
+		res->write_stream_stop = NULL;
+		res->write_stream_subxact = NULL;
+		res->write_stream_commit = NULL;
+		res->write_stream_abort = NULL;
 		res->write_startup_message = json_write_startup_message;
 	}
 	else
@@ -42,6 +48,12 @@ pglogical_init_api(PGLogicalProtoType typ)
 		res->write_insert = pglogical_write_insert;
 		res->write_update = pglogical_write_update;
 		res->write_delete = pglogical_write_delete;
+		res->write_batch = pglogical_write_batch;
+		res->write_stream_start = pglogical_write_stream_start;
+		res->write_stream_stop = pglogical_write_stream_stop;
+		res->write_stream_subxact = pglogical_write_stream_subxact;
+		res->write_stream_commit = pglogical_write_stream_commit;
+		res->write_stream_abort = pglogical_write_stream_abort;
 		res->write_startup_message = write_startup_message;
 	}
 
@@ -35,6 +35,20 @@ typedef void (*pglogical_write_update_fn)(StringInfo out, struct PGLogicalOutput
 typedef void (*pglogical_write_delete_fn)(StringInfo out, struct PGLogicalOutputData *data,
 							 Relation rel, HeapTuple oldtuple);
 
+typedef void (*pglogical_write_batch_fn)(StringInfo out, struct PGLogicalOutputData *data,
+							 Oid relid, int nchanges, StringInfo changes);
+
+typedef void (*pglogical_write_stream_start_fn)(StringInfo out, struct PGLogicalOutputData *data,
+							 ReorderBufferTXN *txn);
+typedef void (*pglogical_write_stream_stop_fn)(StringInfo out, struct PGLogicalOutputData *data,
+							 ReorderBufferTXN *txn);
+typedef void (*pglogical_write_stream_subxact_fn)(StringInfo out, struct PGLogicalOutputData *data,
+							 TransactionId xid);
+typedef void (*pglogical_write_stream_commit_fn)(StringInfo out, struct PGLogicalOutputData *data,
+							 ReorderBufferTXN *txn, XLogRecPtr commit_lsn);
+typedef void (*pglogical_write_stream_abort_fn)(StringInfo out, struct PGLogicalOutputData *data,
+							 ReorderBufferTXN *txn, XLogRecPtr abort_lsn);
+
 typedef void (*write_startup_message_fn)(StringInfo out, List *msg);
 
 typedef struct PGLogicalProtoAPI
@@ -46,6 +60,12 @@ typedef struct PGLogicalProtoAPI
 	pglogical_write_insert_fn	write_insert;
 	pglogical_write_update_fn	write_update;
 	pglogical_write_delete_fn	write_delete;
+	pglogical_write_batch_fn	write_batch;
+	pglogical_write_stream_start_fn	write_stream_start;
+	pglogical_write_stream_stop_fn	write_stream_stop;
+	pglogical_write_stream_subxact_fn	write_stream_subxact;
+	pglogical_write_stream_commit_fn	write_stream_commit;
+	pglogical_write_stream_abort_fn	write_stream_abort;
 	write_startup_message_fn	write_startup_message;
 } PGLogicalProtoAPI;
 
@@ -34,6 +34,8 @@
 
 #include "commands/dbcommands.h"
 
+#include "common/pg_lzcompress.h"
+
 #include "executor/spi.h"
 
 #include "libpq/pqformat.h"
@@ -334,6 +336,163 @@ pglogical_write_delete(StringInfo out, PGLogicalOutputData *data,
 	pglogical_write_tuple(out, data, rel, oldtuple);
 }
 
+/*
+ * Write BATCH of changes to the same relation to the output stream.
+ *
+ * The changes are INSERT, UPDATE and DELETE messages stripped of the flags
+ * and relation identifier, which are only sent once for the whole batch.
+ */
+void
+pglogical_write_batch(StringInfo out, PGLogicalOutputData *data,
+					  Oid relid, int nchanges, StringInfo changes)
+{
+	uint8	flags = 0;
+	char   *compressed = NULL;
+	int32	compressed_len = -1;
+
+	if (data->batch_compression)
+	{
+		compressed = palloc(PGLZ_MAX_OUTPUT(changes->len));
+		compressed_len = pglz_compress(changes->data, changes->len,
+									   compressed, PGLZ_strategy_default);
+
+		/* Only send compressed data if it's actually smaller. */
+		if (compressed_len >= 0)
+			flags |= PGLOGICAL_BATCH_COMPRESSED;
+	}
+
+	pq_sendbyte(out, 'X');		/* BATCH */
+
+	/* send the flags field */
+	pq_sendbyte(out, flags);
+
+	/* use Oid as relation identifier */
+	pq_sendint(out, relid, 4);
+
+	pq_sendint(out, nchanges, 4);
+	pq_sendint(out, changes->len, 4);	/* uncompressed length */
+
+	if (flags & PGLOGICAL_BATCH_COMPRESSED)
+	{
+		pq_sendint(out, compressed_len, 4);
+		pq_sendbytes(out, compressed, compressed_len);
+	}
+	else
+		pq_sendbytes(out, changes->data, changes->len);
+
+	if (compressed != NULL)
+		pfree(compressed);
+}
+
+/*
+ * Write STREAM START to the output stream. The changes up to the following
+ * STREAM STOP belong to the in-progress transaction, or to the subtransaction
+ * of it last announced by a STREAM SUBXACT message.
+ */
+void
+pglogical_write_stream_start(StringInfo out, PGLogicalOutputData *data,
+							 ReorderBufferTXN *txn)
+{
+	uint8	flags = 0;
+
+	pq_sendbyte(out, 'T');		/* STREAM START */
+
+	/* send the flags field */
+	pq_sendbyte(out, flags);
+
+	/* fixed fields */
+	pq_sendint(out, txn->xid, 4);
+}
+
+/*
+ * Write STREAM STOP to the output stream.
+ */
+void
+pglogical_write_stream_stop(StringInfo out, PGLogicalOutputData *data,
+							ReorderBufferTXN *txn)
+{
+	uint8	flags = 0;
+
+	pq_sendbyte(out, 'E');		/* STREAM STOP */
+
+	/* send the flags field */
+	pq_sendbyte(out, flags);
+
+	/* fixed fields */
+	pq_sendint(out, txn->xid, 4);
+}
+
+/*
+ * Write STREAM SUBXACT to the output stream.
+ */
+void
+pglogical_write_stream_subxact(StringInfo out, PGLogicalOutputData *data,
+							   TransactionId xid)
+{
+	uint8	flags = 0;
+
+	pq_sendbyte(out, 'Y');		/* STREAM SUBXACT */
+
+	/* send the flags field */
+	pq_sendbyte(out, flags);
+
+	/* fixed fields */
+	pq_sendint(out, xid, 4);
+}
+
+/*
+ * Write STREAM COMMIT to the output stream, either for the commit or for the
+ * PREPARE TRANSACTION of a streamed transaction. COMMIT PREPARED and ROLLBACK
+ * PREPARED are sent as plain COMMIT messages.
+ */
+void
+pglogical_write_stream_commit(StringInfo out, PGLogicalOutputData *data,
+							  ReorderBufferTXN *txn, XLogRecPtr commit_lsn)
+{
+	uint8	flags = 0;
+
+	pq_sendbyte(out, 'Z');		/* STREAM COMMIT */
+
+	if (txn->xact_action == XLOG_XACT_PREPARE)
+		flags = PGLOGICAL_PREPARE;
+	else
+		flags = PGLOGICAL_COMMIT;
+
+	/* send the flags field */
+	pq_sendbyte(out, flags);
+
+	/* send fixed fields */
+	pq_sendint(out, txn->xid, 4);
+	pq_sendint64(out, commit_lsn);
+	pq_sendint64(out, txn->end_lsn);
+	pq_sendint64(out, txn->commit_time);
+
+	if (flags == PGLOGICAL_PREPARE)
+		pq_sendstring(out, txn->gid);
+}
+
+/*
+ * Write STREAM ABORT to the output stream. The client discards the changes
+ * streamed for the (sub)transaction, and for a toplevel transaction the
+ * changes of all its subtransactions.
+ */
+void
+pglogical_write_stream_abort(StringInfo out, PGLogicalOutputData *data,
+							 ReorderBufferTXN *txn, XLogRecPtr abort_lsn)
+{
+	uint8	flags = 0;
+
+	pq_sendbyte(out, 'Q');		/* STREAM ABORT */
+
+	/* send the flags field */
+	pq_sendbyte(out, flags);
+
+	/* fixed fields */
+	pq_sendint(out, txn->toptxn != NULL ? txn->toptxn->xid : txn->xid, 4);
+	pq_sendint(out, txn->xid, 4);
+	pq_sendint64(out, abort_lsn);
+}
+
 /*
  * Most of the brains for startup message creation lives in
  * pglogical_config.c, so this presently just sends the set of key/value pairs.
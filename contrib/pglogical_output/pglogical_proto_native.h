@@ -30,6 +30,9 @@
 
 #define PGLOGICAL_XACT_EVENT(flags)	(flags & 0x03)
 
+/* Flags of the BATCH message. */
+#define PGLOGICAL_BATCH_COMPRESSED	0x01
+
 extern void pglogical_write_rel(StringInfo out, PGLogicalOutputData *data, Relation rel,
 							struct PGLRelMetaCacheEntry *cache_entry);
 
@@ -48,6 +51,19 @@ extern void pglogical_write_update(StringInfo out, PGLogicalOutputData *data,
 							HeapTuple newtuple);
 extern void pglogical_write_delete(StringInfo out, PGLogicalOutputData *data,
 							Relation rel, HeapTuple oldtuple);
+extern void pglogical_write_batch(StringInfo out, PGLogicalOutputData *data,
+							Oid relid, int nchanges, StringInfo changes);
+
+extern void pglogical_write_stream_start(StringInfo out, PGLogicalOutputData *data,
+							ReorderBufferTXN *txn);
+extern void pglogical_write_stream_stop(StringInfo out, PGLogicalOutputData *data,
+							ReorderBufferTXN *txn);
+extern void pglogical_write_stream_subxact(StringInfo out, PGLogicalOutputData *data,
+							TransactionId xid);
+extern void pglogical_write_stream_commit(StringInfo out, PGLogicalOutputData *data,
+							ReorderBufferTXN *txn, XLogRecPtr commit_lsn);
+extern void pglogical_write_stream_abort(StringInfo out, PGLogicalOutputData *data,
+							ReorderBufferTXN *txn, XLogRecPtr abort_lsn);
 
 extern void write_startup_message(StringInfo out, List *msg);
 
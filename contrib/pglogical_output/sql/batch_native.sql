@@ -0,0 +1,64 @@
+\i sql/basic_setup.sql
+
+-- A transaction whose changes are worth compressing
+INSERT INTO demo(tx) SELECT repeat('compressible', 10) FROM generate_series(1, 100);
+
+-- Consecutive changes to the same relation are sent as one BATCH ('X')
+-- message per transaction, the relation metadata message is sent before it.
+SELECT count(data) AS messages,
+	count(*) FILTER (WHERE get_byte(data, 0) = ascii('X')) AS batches,
+	bool_or(get_byte(data, 0) = ascii('X') AND get_byte(data, 1) & 1 = 1) AS compressed
+FROM pg_logical_slot_peek_binary_changes('regression_slot',
+	NULL, NULL,
+	'expected_encoding', 'UTF8',
+	'min_proto_version', '1',
+	'max_proto_version', '1',
+	'startup_params_format', '1',
+	'relmeta_cache_size', '-1',
+	'batch_changes', 't');
+
+-- Same with compression, only the big batch is worth compressing.
+SELECT count(data) AS messages,
+	count(*) FILTER (WHERE get_byte(data, 0) = ascii('X')) AS batches,
+	bool_or(get_byte(data, 0) = ascii('X') AND get_byte(data, 1) & 1 = 1) AS compressed
+FROM pg_logical_slot_peek_binary_changes('regression_slot',
+	NULL, NULL,
+	'expected_encoding', 'UTF8',
+	'min_proto_version', '1',
+	'max_proto_version', '1',
+	'startup_params_format', '1',
+	'relmeta_cache_size', '-1',
+	'batch_changes', 't',
+	'batch_compression', 't');
+
+SELECT (SELECT sum(length(data)) FROM pg_logical_slot_peek_binary_changes('regression_slot',
+			NULL, NULL,
+			'expected_encoding', 'UTF8',
+			'min_proto_version', '1',
+			'max_proto_version', '1',
+			'startup_params_format', '1',
+			'relmeta_cache_size', '-1',
+			'batch_changes', 't',
+			'batch_compression', 't'))
+	< (SELECT sum(length(data)) FROM pg_logical_slot_peek_binary_changes('regression_slot',
+			NULL, NULL,
+			'expected_encoding', 'UTF8',
+			'min_proto_version', '1',
+			'max_proto_version', '1',
+			'startup_params_format', '1',
+			'relmeta_cache_size', '-1',
+			'batch_changes', 't')) AS smaller;
+
+-- Compression is only used together with batching.
+SELECT count(data) AS messages,
+	count(*) FILTER (WHERE get_byte(data, 0) = ascii('X')) AS batches
+FROM pg_logical_slot_peek_binary_changes('regression_slot',
+	NULL, NULL,
+	'expected_encoding', 'UTF8',
+	'min_proto_version', '1',
+	'max_proto_version', '1',
+	'startup_params_format', '1',
+	'relmeta_cache_size', '-1',
+	'batch_compression', 't');
+
+\i sql/basic_teardown.sql
@@ -0,0 +1,91 @@
+SET synchronous_commit = on;
+SET logical_decoding_work_mem = '64kB';
+
+CREATE TABLE stream_test(data text);
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'pglogical_output');
+
+-- A large transaction is sent in STREAM START ('T') / STREAM STOP ('E')
+-- blocks before it commits, and ends with a STREAM COMMIT ('Z').
+BEGIN;
+INSERT INTO stream_test SELECT 'stream-topbig:'||g.i FROM generate_series(1, 5000) g(i);
+COMMIT;
+
+SELECT count(*) FILTER (WHERE get_byte(data, 0) = ascii('T')) > 1 AS streamed,
+	count(*) FILTER (WHERE get_byte(data, 0) = ascii('T'))
+		= count(*) FILTER (WHERE get_byte(data, 0) = ascii('E')) AS closed,
+	count(*) FILTER (WHERE get_byte(data, 0) = ascii('I')) AS inserts,
+	count(*) FILTER (WHERE get_byte(data, 0) = ascii('Z') AND get_byte(data, 1) = 0) AS commits,
+	count(*) FILTER (WHERE get_byte(data, 0) IN (ascii('B'), ascii('C'))) AS plain
+FROM pg_logical_slot_get_binary_changes('regression_slot',
+	NULL, NULL,
+	'expected_encoding', 'UTF8',
+	'min_proto_version', '1',
+	'max_proto_version', '1',
+	'startup_params_format', '1',
+	'stream_changes', 't');
+
+-- Changes of a subtransaction follow a STREAM SUBXACT ('Y'), a rolled back
+-- subtransaction gets a STREAM ABORT ('Q').
+BEGIN;
+INSERT INTO stream_test SELECT 'stream-subbig-top:'||g.i FROM generate_series(1, 5) g(i);
+SAVEPOINT s;
+INSERT INTO stream_test SELECT 'stream-subbig-abort:'||g.i FROM generate_series(1, 5000) g(i);
+ROLLBACK TO SAVEPOINT s;
+COMMIT;
+
+SELECT count(*) FILTER (WHERE get_byte(data, 0) = ascii('Y')) > 0 AS subxact,
+	count(*) FILTER (WHERE get_byte(data, 0) = ascii('Q')) AS aborts,
+	count(*) FILTER (WHERE get_byte(data, 0) = ascii('Z') AND get_byte(data, 1) = 0) AS commits
+FROM pg_logical_slot_get_binary_changes('regression_slot',
+	NULL, NULL,
+	'expected_encoding', 'UTF8',
+	'min_proto_version', '1',
+	'max_proto_version', '1',
+	'startup_params_format', '1',
+	'stream_changes', 't');
+
+-- PREPARE TRANSACTION of a streamed transaction is a STREAM COMMIT with the
+-- prepare flag, ROLLBACK PREPARED is the usual COMMIT ('C') message.
+BEGIN;
+INSERT INTO stream_test SELECT 'stream-prepared:'||g.i FROM generate_series(1, 5000) g(i);
+PREPARE TRANSACTION 'stream_native';
+
+SELECT count(*) FILTER (WHERE get_byte(data, 0) = ascii('Z') AND get_byte(data, 1) = 1) AS prepares,
+	count(*) FILTER (WHERE get_byte(data, 0) IN (ascii('B'), ascii('C'))) AS plain
+FROM pg_logical_slot_get_binary_changes('regression_slot',
+	NULL, NULL,
+	'expected_encoding', 'UTF8',
+	'min_proto_version', '1',
+	'max_proto_version', '1',
+	'startup_params_format', '1',
+	'stream_changes', 't');
+
+ROLLBACK PREPARED 'stream_native';
+
+SELECT get_byte(data, 0) = ascii('C') AS commit_message,
+	get_byte(data, 1) AS flags
+FROM pg_logical_slot_get_binary_changes('regression_slot',
+	NULL, NULL,
+	'expected_encoding', 'UTF8',
+	'min_proto_version', '1',
+	'max_proto_version', '1',
+	'startup_params_format', '1',
+	'stream_changes', 't');
+
+-- Small transactions aren't streamed.
+INSERT INTO stream_test VALUES ('stream-small');
+
+SELECT count(*) FILTER (WHERE get_byte(data, 0) IN (ascii('T'), ascii('E'), ascii('Z'))) AS stream,
+	count(*) FILTER (WHERE get_byte(data, 0) IN (ascii('B'), ascii('C'))) AS plain
+FROM pg_logical_slot_get_binary_changes('regression_slot',
+	NULL, NULL,
+	'expected_encoding', 'UTF8',
+	'min_proto_version', '1',
+	'max_proto_version', '1',
+	'startup_params_format', '1',
+	'stream_changes', 't');
+
+SELECT 'drop' FROM pg_drop_replication_slot('regression_slot');
+
+DROP TABLE stream_test;
@@ -0,0 +1,40 @@
+-- predictability
+SET synchronous_commit = on;
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'test_decoding');
+
+CREATE TABLE read_ahead_test(data text);
+
+-- write more than a WAL segment for decoding to catch up on
+INSERT INTO read_ahead_test SELECT 'read-ahead-1:'||g.i||':'||repeat('x', 1000) FROM generate_series(1, 5000) g(i);
+INSERT INTO read_ahead_test SELECT 'read-ahead-2:'||g.i||':'||repeat('x', 1000) FROM generate_series(1, 5000) g(i);
+INSERT INTO read_ahead_test SELECT 'read-ahead-3:'||g.i||':'||repeat('x', 1000) FROM generate_series(1, 5000) g(i);
+INSERT INTO read_ahead_test SELECT 'read-ahead-4:'||g.i||':'||repeat('x', 1000) FROM generate_series(1, 5000) g(i);
+
+SELECT pg_xlog_location_diff(pg_current_xlog_location(), restart_lsn) > 16 * 1024 * 1024 AS more_than_a_segment
+FROM pg_replication_slots WHERE slot_name = 'regression_slot';
+
+-- decode serially
+SET logical_decoding_read_ahead = off;
+CREATE TEMP TABLE read_ahead_off AS
+SELECT * FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1')
+	WITH ORDINALITY AS c(location, xid, data, n);
+
+-- decode with the read-ahead worker, the output must be the same
+SET logical_decoding_read_ahead = on;
+CREATE TEMP TABLE read_ahead_on AS
+SELECT * FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1')
+	WITH ORDINALITY AS c(location, xid, data, n);
+
+SELECT count(*) FROM read_ahead_off WHERE data ~ 'INSERT';
+SELECT count(*) AS mismatches
+FROM read_ahead_off f FULL JOIN read_ahead_on o USING (n)
+WHERE f.location IS DISTINCT FROM o.location OR f.xid IS DISTINCT FROM o.xid OR
+	f.data IS DISTINCT FROM o.data;
+
+-- and consuming the changes with it works as well
+SELECT count(*) FROM pg_logical_slot_get_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1') WHERE data ~ 'INSERT';
+RESET logical_decoding_read_ahead;
+
+DROP TABLE read_ahead_test;
+SELECT pg_drop_replication_slot('regression_slot');
@@ -1,5 +1,6 @@
 -- predictability
 SET synchronous_commit = on;
+SET logical_decoding_work_mem = '64kB';
 
 SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'test_decoding');
 
@@ -174,6 +175,10 @@ SELECT (regexp_split_to_array(data, ':'))[4] COLLATE "C", COUNT(*), (array_agg(d
 FROM pg_logical_slot_get_changes('regression_slot', NULL,NULL) WHERE data ~ 'INSERT'
 GROUP BY 1 ORDER BY 1;
 
+-- the spilled transactions show up in the slot's statistics
+SELECT spill_txns > 0 AS spill_txns, spill_count >= spill_txns AS spill_count, spill_bytes > 0 AS spill_bytes
+FROM pg_replication_slots WHERE slot_name = 'regression_slot';
+
 DROP TABLE spill_test;
 
 SELECT pg_drop_replication_slot('regression_slot');
@@ -0,0 +1,65 @@
+-- predictability
+SET synchronous_commit = on;
+SET logical_decoding_work_mem = '64kB';
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'test_decoding');
+
+CREATE TABLE stream_test(data text);
+
+-- consume DDL
+SELECT data FROM pg_logical_slot_get_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1');
+
+-- large committed xact, streamed before the commit is decoded
+BEGIN;
+INSERT INTO stream_test SELECT 'stream-topbig--1:'||g.i FROM generate_series(1, 5000) g(i);
+COMMIT;
+
+SELECT count(*) FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1', 'stream-changes', '1')
+WHERE data ~ '^streaming change';
+
+SELECT data, count(*) > 1 AS repeated
+FROM pg_logical_slot_get_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1', 'stream-changes', '1')
+GROUP BY data ORDER BY data;
+
+-- large aborted xact, the streamed part is discarded
+BEGIN;
+INSERT INTO stream_test SELECT 'stream-topbig-abort--1:'||g.i FROM generate_series(1, 5000) g(i);
+ROLLBACK;
+
+SELECT data, count(*) > 1 AS repeated
+FROM pg_logical_slot_get_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1', 'stream-changes', '1')
+GROUP BY data ORDER BY data;
+
+-- large subxact rolled back, small main xact
+BEGIN;
+SAVEPOINT s;
+INSERT INTO stream_test SELECT 'stream-subbig-abort--1:'||g.i FROM generate_series(1, 5000) g(i);
+ROLLBACK TO SAVEPOINT s;
+INSERT INTO stream_test SELECT 'stream-subbig-abort--2:'||g.i FROM generate_series(1, 5) g(i);
+COMMIT;
+
+SELECT data, count(*) > 1 AS repeated
+FROM pg_logical_slot_get_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1', 'stream-changes', '1')
+GROUP BY data ORDER BY data;
+
+-- large prepared xact, the streamed part isn't committed until COMMIT PREPARED
+BEGIN;
+INSERT INTO stream_test SELECT 'stream-prepared--1:'||g.i FROM generate_series(1, 5000) g(i);
+PREPARE TRANSACTION 'stream-prepared';
+
+SELECT data, count(*) > 1 AS repeated
+FROM pg_logical_slot_get_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1', 'stream-changes', '1')
+GROUP BY data ORDER BY data;
+
+ROLLBACK PREPARED 'stream-prepared';
+
+SELECT data FROM pg_logical_slot_get_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1', 'stream-changes', '1');
+
+-- small xacts aren't streamed
+INSERT INTO stream_test VALUES ('stream-small--1');
+
+SELECT data FROM pg_logical_slot_get_changes('regression_slot', NULL, NULL, 'include-xids', '0', 'skip-empty-xacts', '1', 'stream-changes', '1');
+
+DROP TABLE stream_test;
+
+SELECT pg_drop_replication_slot('regression_slot');
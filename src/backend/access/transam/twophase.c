@@ -38,7 +38,10 @@
  *
  *		* On PREPARE TRANSACTION backend writes state data only to the WAL and
  *		  stores pointer to the start of the WAL record in
- *		  gxact->prepare_start_lsn.
+ *		  gxact->prepare_start_lsn.  If the data fits, a copy is also kept
+ *		  in the gxact's slot of the shared state cache.
+ *		* If the state data is cached, COMMIT uses the cached copy no matter
+ *		  where else the data lives.
  *		* If COMMIT occurs before checkpoint then backend reads data from WAL
  *		  using prepare_start_lsn.
  *		* On checkpoint state data copied to files in pg_twophase directory and
@@ -96,8 +99,13 @@
  */
 #define TWOPHASE_DIR "pg_twophase"
 
-/* GUC variable, can't be changed after startup */
+/* GUC variables, can't be changed after startup */
 int			max_prepared_xacts = 0;
+int			twophase_state_cache_size = 4;
+
+/* Size of each gxact's slot in the shared state cache */
+#define TWOPHASE_STATE_CACHE_SLOT_SIZE \
+	MAXALIGN((Size) twophase_state_cache_size * 1024)
 
 /*
  * This struct describes one global transaction that is in prepared state
@@ -153,19 +161,38 @@ typedef struct GlobalTransactionData
 	int 	    locking_pid;	/* backend currently working on the xact */
 	bool		valid;			/* TRUE if PGPROC entry is in proc array */
 	bool		ondisk;			/* TRUE if prepare state file is on disk */
+	char	   *state_cache;	/* slot of the shared state cache */
+	int			state_cache_len;	/* length of cached state data, or 0 */
 	int         prep_index;     /* Index of prepXacts array */
 	char		gid[GIDSIZE];	/* The GID assigned to the prepared xact */
 	char        state_3pc[MAX_3PC_STATE_SIZE]; /* 3PC transaction state  */
 }	GlobalTransactionData;
 
 /*
- * Two Phase Commit shared state.  Access to this struct is protected
- * by TwoPhaseStateLock.
+ * Free GlobalTransactionData structs are kept in one list per partition of
+ * the GID hash table, so that preparing transactions with GIDs in different
+ * partitions don't contend for a single list head.  A partition whose list
+ * runs dry borrows an entry from another partition.
+ */
+typedef struct TwoPhaseFreeList
+{
+	slock_t		mutex;			/* protects freeGXacts */
+	GlobalTransaction freeGXacts;	/* head of linked list of free gxacts */
+} TwoPhaseFreeList;
+
+/*
+ * Two Phase Commit shared state.
+ *
+ * The GID hash table is divided into NUM_TWOPHASE_PARTITIONS partitions;
+ * the collision chain of a bucket is protected by the LWLock of the
+ * bucket's partition (see TwoPhaseHashPartitionLock).  prepXacts and
+ * numPrepXacts are protected by TwoPhaseStateLock.  When both are needed,
+ * the partition lock must be acquired first.
  */
 typedef struct TwoPhaseStateData
 {
-	/* Head of linked list of free GlobalTransactionData structs */
-	GlobalTransaction freeGXacts;
+	/* Per-partition lists of free GlobalTransactionData structs */
+	TwoPhaseFreeList freeLists[NUM_TWOPHASE_PARTITIONS];
 
 	/* Number of valid prepXacts entries. */
 	int			numPrepXacts;
@@ -253,6 +280,18 @@ static struct xllist
 
 static TwoPhaseStateData *TwoPhaseState;
 
+/*
+ * A GID hashes to a bucket of TwoPhaseState->hashTable; the bucket
+ * determines the partition, and so the LWLock protecting its chain.
+ */
+#define TwoPhaseHashBucket(gid) \
+	(string_hash(gid, 0) % max_prepared_xacts)
+#define TwoPhaseHashPartition(bucket) \
+	((bucket) % NUM_TWOPHASE_PARTITIONS)
+#define TwoPhaseHashPartitionLock(bucket) \
+	(&MainLWLockArray[TWOPHASE_STATE_LWLOCK_OFFSET + \
+		TwoPhaseHashPartition(bucket)].lock)
+
 /*
  * Global transaction entry currently locked by us, if any.
  */
@@ -284,6 +323,10 @@ static void RecordTransactionAbortPrepared(TransactionId xid,
 static void ProcessRecords(char *bufptr, TransactionId xid,
 			   const TwoPhaseCallback callbacks[]);
 static void RemoveGXact(GlobalTransaction gxact);
+static GlobalTransaction GetFreeGXact(int partition);
+static void PutFreeGXact(int partition, GlobalTransaction gxact);
+static char *ReadTwoPhaseData(GlobalTransaction gxact, TransactionId xid,
+				 int *len);
 
 static void XlogReadTwoPhaseData(XLogRecPtr lsn, char **buf, int *len);
 
@@ -295,13 +338,19 @@ TwoPhaseShmemSize(void)
 {
 	Size		size;
 
-	/* Need the fixed struct, the array of pointers, and the GTD structs */
+	/*
+	 * Need the fixed struct, the array of pointers, the GTD structs and a
+	 * state cache slot for each of them
+	 */
 	size = offsetof(TwoPhaseStateData, prepXacts);
 	size = add_size(size, mul_size(max_prepared_xacts*2,
 								   sizeof(GlobalTransaction)));
 	size = MAXALIGN(size);
 	size = add_size(size, mul_size(max_prepared_xacts,
 								   sizeof(GlobalTransactionData)));
+	size = MAXALIGN(size);
+	size = add_size(size, mul_size(max_prepared_xacts,
+								   TWOPHASE_STATE_CACHE_SLOT_SIZE));
 
 	return size;
 }
@@ -317,27 +366,38 @@ TwoPhaseShmemInit(void)
 	if (!IsUnderPostmaster)
 	{
 		GlobalTransaction gxacts;
+		char	   *stateCache;
 		int			i;
 
 		Assert(!found);
-		TwoPhaseState->freeGXacts = NULL;
+		for (i = 0; i < NUM_TWOPHASE_PARTITIONS; i++)
+		{
+			SpinLockInit(&TwoPhaseState->freeLists[i].mutex);
+			TwoPhaseState->freeLists[i].freeGXacts = NULL;
+		}
 		TwoPhaseState->numPrepXacts = 0;
 
 		/*
-		 * Initialize the linked list of free GlobalTransactionData structs
+		 * Initialize the linked lists of free GlobalTransactionData structs,
+		 * spreading the entries evenly over the partitions
 		 */
 		gxacts = (GlobalTransaction)
 			((char *) TwoPhaseState +
 			 MAXALIGN(offsetof(TwoPhaseStateData, prepXacts) +
 					  sizeof(GlobalTransaction) * 2 * max_prepared_xacts));
+		stateCache = (char *) gxacts +
+			MAXALIGN(sizeof(GlobalTransactionData) * max_prepared_xacts);
 		
 		TwoPhaseState->hashTable = &TwoPhaseState->prepXacts[max_prepared_xacts];
 
 		for (i = 0; i < max_prepared_xacts; i++)
 		{
+			TwoPhaseFreeList *freeList =
+				&TwoPhaseState->freeLists[i % NUM_TWOPHASE_PARTITIONS];
+
 			/* insert into linked list */
-			gxacts[i].next = TwoPhaseState->freeGXacts;
-			TwoPhaseState->freeGXacts = &gxacts[i];
+			gxacts[i].next = freeList->freeGXacts;
+			freeList->freeGXacts = &gxacts[i];
 
 			TwoPhaseState->hashTable[i] = NULL;
 
@@ -359,6 +419,9 @@ TwoPhaseShmemInit(void)
 			gxacts[i].dummyBackendId = MaxBackends + 1 + i;
 			SpinLockInit(&gxacts[i].spinlock);
 			gxacts[i].locking_pid = -1;
+			gxacts[i].state_cache = stateCache +
+				i * TWOPHASE_STATE_CACHE_SLOT_SIZE;
+			gxacts[i].state_cache_len = 0;
 		}
 	}
 	else
@@ -443,8 +506,11 @@ MarkAsPreparing(TransactionId xid, const char *gid,
 				TimestampTz prepared_at, Oid owner, Oid databaseid)
 {
 	GlobalTransaction gxact;
+	GlobalTransaction other;
 	PGPROC	   *proc;
 	PGXACT	   *pgxact;
+	uint32		bucket;
+	LWLock	   *partitionLock;
 	int			i;
 
 	if (strlen(gid) >= GIDSIZE)
@@ -467,15 +533,34 @@ MarkAsPreparing(TransactionId xid, const char *gid,
 		twophaseExitRegistered = true;
 	}
 
-	LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
+	bucket = TwoPhaseHashBucket(gid);
+	partitionLock = TwoPhaseHashPartitionLock(bucket);
+
+	/* Get a free gxact from the freelist */
+	gxact = GetFreeGXact(TwoPhaseHashPartition(bucket));
+	if (gxact == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("maximum number of prepared transactions reached"),
+				 errhint("Increase max_prepared_transactions (currently %d).",
+						 max_prepared_xacts)));
+
+	/*
+	 * Lock gxact using its spinlock.  A backend that has just returned it to
+	 * the freelist may still hold the spinlock, so take it before the
+	 * partition lock to avoid deadlock.
+	 */
+	SpinLockAcquire(&gxact->spinlock);
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
 
 	/* Check for conflicting GID */
-	i = string_hash(gid, 0)  % max_prepared_xacts;
-	for (gxact = TwoPhaseState->hashTable[i]; gxact != NULL; gxact = gxact->next)
+	for (other = TwoPhaseState->hashTable[bucket]; other != NULL; other = other->next)
 	{
-		if (strcmp(gxact->gid, gid) == 0)
+		if (strcmp(other->gid, gid) == 0)
 		{
-			LWLockRelease(TwoPhaseStateLock);
+			LWLockRelease(partitionLock);
+			PutFreeGXact(TwoPhaseHashPartition(bucket), gxact);
+			SpinLockRelease(&gxact->spinlock);
 			ereport(ERROR,
 					(errcode(ERRCODE_DUPLICATE_OBJECT),
 					 errmsg("transaction identifier \"%s\" is already in use",
@@ -483,29 +568,11 @@ MarkAsPreparing(TransactionId xid, const char *gid,
 		}
 	}
 
-	/* Get a free gxact from the freelist */
-	if (TwoPhaseState->freeGXacts == NULL)
-	{
-		LWLockRelease(TwoPhaseStateLock);
-		ereport(ERROR,
-				(errcode(ERRCODE_OUT_OF_MEMORY),
-				 errmsg("maximum number of prepared transactions reached"),
-				 errhint("Increase max_prepared_transactions (currently %d).",
-						 max_prepared_xacts)));
-	}
-	gxact = TwoPhaseState->freeGXacts;
-	TwoPhaseState->freeGXacts = gxact->next;
-
-	/* Lock gxact usnig spinlock. We have to release TwoPhaseStateLock LWLock to avoid deadlock and reobtain it after holding spinlock */
-	LWLockRelease(TwoPhaseStateLock);
-	SpinLockAcquire(&gxact->spinlock);
-	LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
-
 	Assert(gxact->locking_pid < 0);
 
 	/* Include in collision chain */
-	gxact->next = TwoPhaseState->hashTable[i];
-	TwoPhaseState->hashTable[i] = gxact;
+	gxact->next = TwoPhaseState->hashTable[bucket];
+	TwoPhaseState->hashTable[bucket] = gxact;
 
 	proc = &ProcGlobal->allProcs[gxact->pgprocno];
 	pgxact = &ProcGlobal->allPgXact[gxact->pgprocno];
@@ -548,13 +615,16 @@ MarkAsPreparing(TransactionId xid, const char *gid,
 	gxact->locking_pid = MyProcPid;
 	gxact->valid = false;
 	gxact->ondisk = false;	
-	gxact->prep_index = TwoPhaseState->numPrepXacts;
+	gxact->state_cache_len = 0;
 	strcpy(gxact->gid, gid);
 	*gxact->state_3pc = '\0';
 
 	/* And insert it into the active array */
+	LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
 	Assert(TwoPhaseState->numPrepXacts < max_prepared_xacts);
+	gxact->prep_index = TwoPhaseState->numPrepXacts;
 	TwoPhaseState->prepXacts[TwoPhaseState->numPrepXacts++] = gxact;
+	LWLockRelease(TwoPhaseStateLock);
 	
 	/*
 	 * Remember that we have this GlobalTransaction entry locked for us. If we
@@ -562,7 +632,7 @@ MarkAsPreparing(TransactionId xid, const char *gid,
 	 */
 	MyLockedGxact = gxact;
 
-	LWLockRelease(TwoPhaseStateLock);
+	LWLockRelease(partitionLock);
 
 	return gxact;
 }
@@ -602,11 +672,15 @@ GXactLoadSubxactData(GlobalTransaction gxact, int nsubxacts,
 static void
 MarkAsPrepared(GlobalTransaction gxact)
 {
+	LWLock	   *partitionLock;
+
+	partitionLock = TwoPhaseHashPartitionLock(TwoPhaseHashBucket(gxact->gid));
+
 	/* Lock here may be overkill, but I'm not convinced of that ... */
-	LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
 	Assert(!gxact->valid);
 	gxact->valid = true;
-	LWLockRelease(TwoPhaseStateLock);
+	LWLockRelease(partitionLock);
 
 	/*
 	 * Put it into the global ProcArray so TransactionIdIsInProgress considers
@@ -623,7 +697,8 @@ MarkAsPrepared(GlobalTransaction gxact)
 static GlobalTransaction
 LockGXact(const char *gid, Oid user)
 {
-	int			i;
+	uint32		bucket;
+	LWLock	   *partitionLock;
 	GlobalTransaction gxact;
 
 	/* on first call, register the exit hook */
@@ -633,18 +708,23 @@ LockGXact(const char *gid, Oid user)
 		twophaseExitRegistered = true;
 	}
 	MyLockedGxact = NULL;
-	i = string_hash(gid, 0) % max_prepared_xacts;
+	bucket = TwoPhaseHashBucket(gid);
+	partitionLock = TwoPhaseHashPartitionLock(bucket);
   Retry:
-	LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
-	for (gxact = TwoPhaseState->hashTable[i]; gxact != NULL; gxact = gxact->next)
+	/*
+	 * The chain is only read here, and the entry itself is protected by its
+	 * spinlock, so a shared partition lock is enough.
+	 */
+	LWLockAcquire(partitionLock, LW_SHARED);
+	for (gxact = TwoPhaseState->hashTable[bucket]; gxact != NULL; gxact = gxact->next)
 	{
 		if (strcmp(gxact->gid, gid) == 0)
 		{
 			PGPROC	   *proc = &ProcGlobal->allProcs[gxact->pgprocno];
 
-			/* Lock gxact. We have to release TwoPhaseStateLock LW-Lock to avoid deadlock */
+			/* Lock gxact. We have to release the partition lock to avoid deadlock */
 
-			LWLockRelease(TwoPhaseStateLock);
+			LWLockRelease(partitionLock);
 
 			if (MyLockedGxact != gxact) {
 				if (MyLockedGxact != NULL) { 
@@ -692,7 +772,7 @@ LockGXact(const char *gid, Oid user)
 		}		
 	}
 
-	LWLockRelease(TwoPhaseStateLock);
+	LWLockRelease(partitionLock);
 	if (MyLockedGxact != NULL) { 
 		SpinLockRelease(&MyLockedGxact->spinlock);
 		MyLockedGxact = NULL;
@@ -716,43 +796,92 @@ LockGXact(const char *gid, Oid user)
 static void
 RemoveGXact(GlobalTransaction gxact)
 {
-	int			i;
+	uint32		bucket;
+	LWLock	   *partitionLock;
 	GlobalTransaction* prev;
 
-	LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
+	bucket = TwoPhaseHashBucket(gxact->gid);
+	partitionLock = TwoPhaseHashPartitionLock(bucket);
 
-	i = string_hash(gxact->gid, 0) % max_prepared_xacts;
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
 
-	for (prev = &TwoPhaseState->hashTable[i]; *prev != NULL; prev = &(*prev)->next)
+	for (prev = &TwoPhaseState->hashTable[bucket]; *prev != NULL; prev = &(*prev)->next)
 	{
 		if (gxact == *prev)
 		{
+			/* remove from collision list */
+			*prev = gxact->next;
+
 			/* remove from the active array */
+			LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
 			TwoPhaseState->numPrepXacts--;
 			TwoPhaseState->prepXacts[gxact->prep_index] = TwoPhaseState->prepXacts[TwoPhaseState->numPrepXacts];
 			TwoPhaseState->prepXacts[gxact->prep_index]->prep_index = gxact->prep_index;
+			LWLockRelease(TwoPhaseStateLock);
 
-			/* remove from collision list */
-			*prev = gxact->next;
+			LWLockRelease(partitionLock);
 
 			/* and put it back in the freelist */
-			gxact->next = TwoPhaseState->freeGXacts;
-			TwoPhaseState->freeGXacts = gxact;
-
 			gxact->locking_pid = -1;
+			PutFreeGXact(TwoPhaseHashPartition(bucket), gxact);
 
-			LWLockRelease(TwoPhaseStateLock);
 			SpinLockRelease(&gxact->spinlock);
 
 			return;
 		}
 	}
 
-	LWLockRelease(TwoPhaseStateLock);
+	LWLockRelease(partitionLock);
 
 	elog(ERROR, "failed to find %p in GlobalTransaction array", gxact);
 }
 
+/*
+ * GetFreeGXact
+ *		Pop an entry off the freelist of the given partition.
+ *
+ * If that freelist is empty, borrow an entry from the other partitions'
+ * lists instead.  Returns NULL if all of them are empty.
+ */
+static GlobalTransaction
+GetFreeGXact(int partition)
+{
+	int			i;
+
+	for (i = 0; i < NUM_TWOPHASE_PARTITIONS; i++)
+	{
+		TwoPhaseFreeList *freeList =
+			&TwoPhaseState->freeLists[(partition + i) % NUM_TWOPHASE_PARTITIONS];
+		GlobalTransaction gxact;
+
+		SpinLockAcquire(&freeList->mutex);
+		gxact = freeList->freeGXacts;
+		if (gxact != NULL)
+			freeList->freeGXacts = gxact->next;
+		SpinLockRelease(&freeList->mutex);
+
+		if (gxact != NULL)
+			return gxact;
+	}
+
+	return NULL;
+}
+
+/*
+ * PutFreeGXact
+ *		Return an entry to the freelist of the given partition.
+ */
+static void
+PutFreeGXact(int partition, GlobalTransaction gxact)
+{
+	TwoPhaseFreeList *freeList = &TwoPhaseState->freeLists[partition];
+
+	SpinLockAcquire(&freeList->mutex);
+	gxact->next = freeList->freeGXacts;
+	freeList->freeGXacts = gxact;
+	SpinLockRelease(&freeList->mutex);
+}
+
 /*
  * Returns an array of all prepared transactions for the user-level
  * function pg_prepared_xact.
@@ -796,13 +925,16 @@ GetPreparedTransactionList(GlobalTransaction *gxacts)
 
 bool GetPreparedTransactionState(char const* gid, char* state)
 {
-	int i;
+	uint32 bucket;
+	LWLock* partitionLock;
 	GlobalTransaction gxact;
 	bool result = false;
 
-	LWLockAcquire(TwoPhaseStateLock, LW_SHARED);
-	i = string_hash(gid, 0)  % max_prepared_xacts;
-	for (gxact = TwoPhaseState->hashTable[i]; gxact != NULL; gxact = gxact->next)
+	bucket = TwoPhaseHashBucket(gid);
+	partitionLock = TwoPhaseHashPartitionLock(bucket);
+
+	LWLockAcquire(partitionLock, LW_SHARED);
+	for (gxact = TwoPhaseState->hashTable[bucket]; gxact != NULL; gxact = gxact->next)
 	{
 		if (strcmp(gxact->gid, gid) == 0)
 		{
@@ -811,7 +943,7 @@ bool GetPreparedTransactionState(char const* gid, char* state)
 			break;
 		}
 	}
-	LWLockRelease(TwoPhaseStateLock);
+	LWLockRelease(partitionLock);
 	return result;
 }
 
@@ -842,10 +974,7 @@ void SetPreparedTransactionState(char const* gid, char const* state)
 	pgxact = &ProcGlobal->allPgXact[gxact->pgprocno];
 	strcpy(gxact->state_3pc, state);
 
-	if (gxact->ondisk)
-		buf = ReadTwoPhaseFile(pgxact->xid, true);
-	else
-		XlogReadTwoPhaseData(gxact->prepare_start_lsn, &buf, NULL);
+	buf = ReadTwoPhaseData(gxact, pgxact->xid, NULL);
 	hdr = (TwoPhaseFileHeader *)buf;
 	strcpy(hdr->state_3pc, state);
 
@@ -868,6 +997,18 @@ void SetPreparedTransactionState(char const* gid, char const* state)
 
 	XLogFlush(gxact->prepare_end_lsn);
 	gxact->prepare_start_lsn = ProcLastRecPtr;
+
+	/*
+	 * Keep the cached copy in sync with the new record.  CheckPointTwoPhase
+	 * reads the cache holding only TwoPhaseStateLock, so we must take it
+	 * exclusively to keep the checkpoint from writing out a torn copy.
+	 */
+	if (gxact->state_cache_len > 0)
+	{
+		LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
+		memcpy(gxact->state_cache, buf, gxact->state_cache_len);
+		LWLockRelease(TwoPhaseStateLock);
+	}
 	MyPgXact->delayChkpt = false;
 
 	END_CRIT_SECTION();
@@ -1220,6 +1361,23 @@ EndPrepare(GlobalTransaction gxact)
 				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
 				 errmsg("two-phase state file maximum length exceeded")));
 
+	/*
+	 * Keep a copy of the state data in our cache slot if it fits, so that
+	 * COMMIT/ROLLBACK PREPARED needn't read it back.  Nobody else looks at
+	 * the gxact before it is marked valid.
+	 */
+	if (records.total_len <= twophase_state_cache_size * 1024)
+	{
+		char	   *ptr = gxact->state_cache;
+
+		for (record = records.head; record != NULL; record = record->next)
+		{
+			memcpy(ptr, record->data, record->len);
+			ptr += record->len;
+		}
+		gxact->state_cache_len = records.total_len;
+	}
+
 	/*
 	 * Now writing 2PC state data to WAL. We let the WAL's CRC protection
 	 * cover us, so no need to calculate a separate CRC.
@@ -1514,6 +1672,42 @@ XlogReadTwoPhaseData(XLogRecPtr lsn, char **buf, int *len)
 	XLogReaderFree(xlogreader);
 }
 
+/*
+ * ReadTwoPhaseData
+ *		Fetch the 2PC state data of a prepared transaction.
+ *
+ * The copy cached in shared memory is used if there is one; otherwise the
+ * data is read from the state file or from the PREPARE record in WAL.  The
+ * caller must have the gxact locked, or hold TwoPhaseStateLock so that it
+ * can't be removed meanwhile; the cache is only rewritten while holding
+ * TwoPhaseStateLock exclusively.  Returns a palloc'd buffer; if len
+ * isn't NULL, the length of the data (excluding the state file's CRC) is
+ * stored there.
+ */
+static char *
+ReadTwoPhaseData(GlobalTransaction gxact, TransactionId xid, int *len)
+{
+	char	   *buf;
+
+	if (gxact->state_cache_len > 0)
+	{
+		buf = palloc(gxact->state_cache_len);
+		memcpy(buf, gxact->state_cache, gxact->state_cache_len);
+		if (len != NULL)
+			*len = gxact->state_cache_len;
+	}
+	else if (gxact->ondisk)
+	{
+		buf = ReadTwoPhaseFile(xid, true);
+		if (len != NULL)
+			*len = ((TwoPhaseFileHeader *) buf)->total_len - sizeof(pg_crc32c);
+	}
+	else
+		XlogReadTwoPhaseData(gxact->prepare_start_lsn, &buf, len);
+
+	return buf;
+}
+
 
 /*
  * Confirms an xid is prepared, during recovery
@@ -1583,12 +1777,10 @@ FinishPreparedTransaction(const char *gid, bool isCommit)
 	/*
 	 * Read and validate 2PC state data. State data will typically be stored
 	 * in WAL files if the LSN is after the last checkpoint record, or moved
-	 * to disk if for some reason they have lived for a long time.
+	 * to disk if for some reason they have lived for a long time.  Either
+	 * way, a copy is usually cached in shared memory.
 	 */
-	if (gxact->ondisk)
-		buf = ReadTwoPhaseFile(xid, true);
-	else
-		XlogReadTwoPhaseData(gxact->prepare_start_lsn, &buf, NULL);
+	buf = ReadTwoPhaseData(gxact, xid, NULL);
 
 
 	/*
@@ -1878,7 +2070,7 @@ CheckPointTwoPhase(XLogRecPtr redo_horizon)
 			char	   *buf;
 			int			len;
 
-			XlogReadTwoPhaseData(gxact->prepare_start_lsn, &buf, &len);
+			buf = ReadTwoPhaseData(gxact, pgxact->xid, &len);
 			RecreateTwoPhaseFile(pgxact->xid, buf, len);
 			gxact->ondisk = true;
 			pfree(buf);
@@ -185,6 +185,8 @@ typedef struct TransactionStateData
 	bool		prevXactReadOnly;		/* entry-time xact r/o state */
 	bool		startedInRecovery;		/* did we start in recovery? */
 	bool		didLogXid;		/* has xid been included in WAL record? */
+	bool		assigned;		/* has toplevel xid been included in WAL
+								 * record of this subxact? */
 	int			parallelModeLevel;		/* Enter/ExitParallelMode counter */
 	struct TransactionStateData *parent;		/* back link to parent */
 } TransactionStateData;
@@ -216,6 +218,7 @@ static TransactionStateData TopTransactionStateData = {
 	false,						/* entry-time xact r/o state */
 	false,						/* startedInRecovery */
 	false,						/* didLogXid */
+	false,						/* assigned */
 	0,							/* parallelMode */
 	NULL						/* link to parent state block */
 };
@@ -445,6 +448,47 @@ MarkCurrentTransactionIdLoggedIfAny(void)
 		CurrentTransactionState->didLogXid = true;
 }
 
+/*
+ *	IsSubTransactionAssignmentPending
+ *
+ * Should the next WAL record of the current subtransaction carry the xid of
+ * its toplevel transaction?  With wal_level = logical we tell the decoding
+ * side about the subxact -> toplevel association in the first record the
+ * subtransaction writes, so that changes of in-progress transactions can be
+ * streamed without waiting for the commit record.
+ */
+bool
+IsSubTransactionAssignmentPending(void)
+{
+	/* the association only matters for logical decoding */
+	if (!XLogLogicalInfoActive())
+		return false;
+
+	/* toplevel transactions don't need any assignment */
+	if (!IsSubTransaction())
+		return false;
+
+	/* nothing to associate unless the subxact has an xid */
+	if (!TransactionIdIsValid(GetCurrentTransactionIdIfAny()))
+		return false;
+
+	return !CurrentTransactionState->assigned;
+}
+
+/*
+ *	MarkSubTransactionAssigned
+ *
+ * Remember that the toplevel xid has been written out for the current
+ * subtransaction.
+ */
+void
+MarkSubTransactionAssigned(void)
+{
+	Assert(IsSubTransactionAssignmentPending());
+
+	CurrentTransactionState->assigned = true;
+}
+
 
 /*
  *	GetStableLatestTransactionId
@@ -17,6 +17,7 @@
  */
 #include "postgres.h"
 
+#include <fcntl.h>
 #include <unistd.h>
 
 #include "access/xlog.h"
@@ -702,6 +703,11 @@ XLogRead(char *buf, TimeLineID tli, XLogRecPtr startptr, Size count)
 									path)));
 			}
 			sendOff = 0;
+
+			/* read the rest ahead, as XLogRead() in walsender.c does */
+#if defined(USE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+			(void) posix_fadvise(sendFile, startoff, 0, POSIX_FADV_WILLNEED);
+#endif
 		}
 
 		/* Need to seek in the file? */
@@ -19,6 +19,7 @@
 #include "access/parallel.h"
 #include "postmaster/bgworker_internals.h"
 #include "postmaster/postmaster.h"
+#include "replication/readahead.h"
 #include "storage/barrier.h"
 #include "storage/dsm.h"
 #include "storage/ipc.h"
@@ -107,6 +108,9 @@ static const struct
 {
 	{
 		"ParallelWorkerMain", ParallelWorkerMain
+	},
+	{
+		"XLogReadAheadWorkerMain", XLogReadAheadWorkerMain
 	}
 };
 
@@ -104,6 +104,17 @@ LogicalDecodingProcessRecord(LogicalDecodingContext *ctx, XLogReaderState *recor
 	buf.endptr = ctx->reader->EndRecPtr;
 	buf.record = record;
 
+	/*
+	 * If the record carries the toplevel xid of a subtransaction, tell the
+	 * reorderbuffer about the association right away. That way changes of
+	 * subtransactions are known to belong to their toplevel transaction
+	 * before it commits, which is what streaming of in-progress transactions
+	 * relies on.
+	 */
+	if (TransactionIdIsValid(XLogRecGetTopXid(record)))
+		ReorderBufferAssignChild(ctx->reorder, XLogRecGetTopXid(record),
+								 XLogRecGetXid(record), buf.origptr);
+
 	/* cast so we get a warning when new rmgrs are added */
 	switch ((RmgrIds) XLogRecGetRmid(record))
 	{
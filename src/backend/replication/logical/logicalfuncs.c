@@ -285,7 +285,7 @@ pg_logical_slot_get_changes_guts(FunctionCallInfo fcinfo, bool confirm, bool bin
 			XLogRecord *record;
 			char	   *errm = NULL;
 
-			record = XLogReadRecord(ctx->reader, startptr, &errm);
+			record = LogicalDecodingReadRecord(ctx, startptr, &errm);
 			if (errm)
 				elog(ERROR, "%s", errm);
 
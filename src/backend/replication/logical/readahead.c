@@ -0,0 +1,363 @@
+/*-------------------------------------------------------------------------
+ *
+ * readahead.c
+ *	  Reading WAL ahead of logical decoding in a background worker
+ *
+ * Copyright (c) 2012-2016, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *	  src/backend/replication/logical/readahead.c
+ *
+ * NOTES
+ *
+ * When a decoding session is far behind the flushed WAL, its process spends
+ * a good part of its time reading WAL pages, reassembling records that span
+ * pages and checking their CRCs, before any of the records is decoded. The
+ * functions here move that work into a background worker which reads the
+ * records ahead of the decoding process and passes them over a shared memory
+ * queue; the decoding process only has to decode the record headers again
+ * and run the records through decode.c.
+ *
+ * Decoding itself stays in the decoding process: the reorder buffer and the
+ * snapshot builder are private to it, and they have to see every record in
+ * LSN order.
+ *
+ * The worker never waits for WAL to be flushed. Once it reaches the flushed
+ * WAL, or runs into anything it cannot read, it detaches from the queue; the
+ * decoding process then goes on reading serially from the last record it
+ * received, which also reports any real problem with the WAL.
+ *
+ * ---------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "access/xlog.h"
+#include "access/xlogutils.h"
+#include "libpq/pqsignal.h"
+#include "postmaster/bgworker.h"
+#include "replication/readahead.h"
+#include "storage/dsm.h"
+#include "storage/dsm_impl.h"
+#include "storage/ipc.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "tcop/tcopprot.h"
+#include "utils/memutils.h"
+#include "utils/resowner.h"
+
+/* size of the queue between the worker and the decoding process */
+#define XLOG_READ_AHEAD_QUEUE_SIZE		(4 * 1024 * 1024)
+
+/* GUC */
+bool		logical_decoding_read_ahead = false;
+
+/*
+ * Contents of the shared memory segment, followed by the queue.
+ */
+typedef struct XLogReadAheadShared
+{
+	XLogRecPtr	startptr;		/* where the worker starts reading */
+} XLogReadAheadShared;
+
+#define XLOG_READ_AHEAD_QUEUE_OFFSET	MAXALIGN(sizeof(XLogReadAheadShared))
+
+/*
+ * Every message on the queue is one of these followed by the record.
+ */
+typedef struct XLogReadAheadHeader
+{
+	XLogRecPtr	ReadRecPtr;
+	XLogRecPtr	EndRecPtr;
+} XLogReadAheadHeader;
+
+/*
+ * State of the decoding process.
+ */
+struct XLogReadAhead
+{
+	ResourceOwner owner;		/* owns the segment */
+	dsm_segment *seg;
+	shm_mq_handle *mqh;
+	BackgroundWorkerHandle *handle;
+
+	/* the record last returned, which the reader's decoded state points to */
+	char	   *buf;
+	Size		buflen;
+};
+
+static int read_ahead_xlog_page(XLogReaderState *state,
+					 XLogRecPtr targetPagePtr, int reqLen,
+					 XLogRecPtr targetRecPtr, char *cur_page,
+					 TimeLineID *pageTLI);
+
+/*
+ * Start a worker reading WAL from startptr.
+ *
+ * Returns NULL if no worker can be started, in which case the caller just
+ * reads the WAL itself.
+ */
+XLogReadAhead *
+XLogReadAheadStart(XLogRecPtr startptr)
+{
+	XLogReadAhead *ra;
+	XLogReadAheadShared *shared;
+	ResourceOwner oldowner;
+	BackgroundWorker worker;
+	shm_mq	   *mq;
+
+	if (dynamic_shared_memory_type == DSM_IMPL_NONE)
+		return NULL;
+
+	ra = palloc0(sizeof(XLogReadAhead));
+
+	/*
+	 * The segment has to survive the transactions the decoding process
+	 * starts and ends while replaying changes, so give it an owner of its
+	 * own. If there is an owner already, tie it to that, so that an error
+	 * gets rid of the segment, and with it the worker.
+	 */
+	ra->owner = ResourceOwnerCreate(CurrentResourceOwner,
+									"logical decoding read-ahead");
+	oldowner = CurrentResourceOwner;
+	CurrentResourceOwner = ra->owner;
+	ra->seg = dsm_create(XLOG_READ_AHEAD_QUEUE_OFFSET +
+						 XLOG_READ_AHEAD_QUEUE_SIZE,
+						 DSM_CREATE_NULL_IF_MAXSEGMENTS);
+	CurrentResourceOwner = oldowner;
+
+	if (ra->seg == NULL)
+	{
+		elog(DEBUG1, "could not create shared memory segment for WAL read-ahead");
+		ResourceOwnerDelete(ra->owner);
+		pfree(ra);
+		return NULL;
+	}
+
+	shared = dsm_segment_address(ra->seg);
+	shared->startptr = startptr;
+
+	mq = shm_mq_create((char *) shared + XLOG_READ_AHEAD_QUEUE_OFFSET,
+					   XLOG_READ_AHEAD_QUEUE_SIZE);
+	shm_mq_set_receiver(mq, MyProc);
+	ra->mqh = shm_mq_attach(mq, ra->seg, NULL);
+
+	memset(&worker, 0, sizeof(worker));
+	snprintf(worker.bgw_name, BGW_MAXLEN, "WAL read-ahead for PID %d",
+			 MyProcPid);
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	worker.bgw_main = NULL;
+	sprintf(worker.bgw_library_name, "postgres");
+	sprintf(worker.bgw_function_name, "XLogReadAheadWorkerMain");
+	worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(ra->seg));
+	worker.bgw_notify_pid = MyProcPid;
+
+	if (!RegisterDynamicBackgroundWorker(&worker, &ra->handle))
+	{
+		elog(DEBUG1, "could not register background worker for WAL read-ahead");
+		XLogReadAheadEnd(ra);
+		return NULL;
+	}
+
+	/* if the worker does not start or dies, reading reports a detach */
+	shm_mq_set_handle(ra->mqh, ra->handle);
+
+	elog(DEBUG1, "started WAL read-ahead at %X/%X",
+		 (uint32) (startptr >> 32), (uint32) startptr);
+
+	return ra;
+}
+
+/*
+ * Return the next record read by the worker, decoded into reader as if
+ * XLogReadRecord() had read it.
+ *
+ * Returns NULL once the worker has stopped. The caller then ends the
+ * read-ahead and goes on reading after the reader's EndRecPtr.
+ */
+XLogRecord *
+XLogReadAheadNext(XLogReadAhead *ra, XLogReaderState *reader)
+{
+	shm_mq_result res;
+	Size		nbytes;
+	void	   *data;
+	XLogReadAheadHeader hdr;
+	XLogRecPtr	prevReadRecPtr = reader->ReadRecPtr;
+	XLogRecPtr	prevEndRecPtr = reader->EndRecPtr;
+	XLogRecord *record;
+	char	   *errm;
+
+	res = shm_mq_receive(ra->mqh, &nbytes, &data, false);
+	if (res != SHM_MQ_SUCCESS)
+	{
+		/* the page the reader has cached predates the worker's reads */
+		XLogReaderInvalReadState(reader);
+		return NULL;
+	}
+
+	if (nbytes < sizeof(XLogReadAheadHeader) + SizeOfXLogRecord)
+		elog(ERROR, "invalid message from WAL read-ahead worker");
+
+	memcpy(&hdr, data, sizeof(XLogReadAheadHeader));
+	nbytes -= sizeof(XLogReadAheadHeader);
+
+	/*
+	 * The message is only valid until the next receive, and the queue gives
+	 * no alignment guarantees decode.c could rely on, so copy the record.
+	 */
+	if (nbytes > ra->buflen)
+	{
+		if (ra->buf != NULL)
+			pfree(ra->buf);
+		ra->buflen = Max(nbytes, XLOG_BLCKSZ);
+		ra->buf = palloc(ra->buflen);
+	}
+	memcpy(ra->buf, (char *) data + sizeof(XLogReadAheadHeader), nbytes);
+	record = (XLogRecord *) ra->buf;
+
+	reader->ReadRecPtr = hdr.ReadRecPtr;
+	reader->EndRecPtr = hdr.EndRecPtr;
+
+	if (!DecodeXLogRecord(reader, record, &errm))
+	{
+		elog(DEBUG1, "could not decode record from WAL read-ahead: %s", errm);
+		reader->ReadRecPtr = prevReadRecPtr;
+		reader->EndRecPtr = prevEndRecPtr;
+		XLogReaderInvalReadState(reader);
+		return NULL;
+	}
+
+	return record;
+}
+
+/*
+ * Stop the worker and release its resources.
+ */
+void
+XLogReadAheadEnd(XLogReadAhead *ra)
+{
+	if (ra->handle != NULL)
+	{
+		TerminateBackgroundWorker(ra->handle);
+		pfree(ra->handle);
+	}
+
+	/* detaching also detaches the queue */
+	dsm_detach(ra->seg);
+	ResourceOwnerDelete(ra->owner);
+
+	pfree(ra->mqh);
+	if (ra->buf != NULL)
+		pfree(ra->buf);
+	pfree(ra);
+}
+
+/*
+ * Main entry point of the worker.
+ */
+void
+XLogReadAheadWorkerMain(Datum main_arg)
+{
+	dsm_segment *seg;
+	XLogReadAheadShared *shared;
+	shm_mq	   *mq;
+	shm_mq_handle *mqh;
+	XLogReaderState *reader;
+
+	/* Establish signal handlers. */
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	/* Set up a memory context and resource owner. */
+	Assert(CurrentResourceOwner == NULL);
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "WAL read-ahead");
+	CurrentMemoryContext = AllocSetContextCreate(TopMemoryContext,
+												 "WAL read-ahead",
+												 ALLOCSET_DEFAULT_SIZES);
+
+	seg = dsm_attach(DatumGetUInt32(main_arg));
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("could not map dynamic shared memory segment")));
+	shared = dsm_segment_address(seg);
+
+	mq = (shm_mq *) ((char *) shared + XLOG_READ_AHEAD_QUEUE_OFFSET);
+	shm_mq_set_sender(mq, MyProc);
+	mqh = shm_mq_attach(mq, seg, NULL);
+
+	reader = XLogReaderAllocate(read_ahead_xlog_page, NULL);
+	if (reader == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of memory")));
+
+	/*
+	 * Start like after a previous record ending at startptr, which may be on
+	 * a page boundary; XLogReadRecord() skips the page header then.
+	 */
+	reader->EndRecPtr = shared->startptr;
+
+	for (;;)
+	{
+		XLogRecord *record;
+		XLogReadAheadHeader hdr;
+		shm_mq_iovec iov[2];
+		char	   *errm;
+
+		CHECK_FOR_INTERRUPTS();
+
+		record = XLogReadRecord(reader, InvalidXLogRecPtr, &errm);
+		if (record == NULL)
+		{
+			if (errm != NULL)
+				elog(DEBUG1, "WAL read-ahead stopped: %s", errm);
+			break;
+		}
+
+		hdr.ReadRecPtr = reader->ReadRecPtr;
+		hdr.EndRecPtr = reader->EndRecPtr;
+
+		iov[0].data = (char *) &hdr;
+		iov[0].len = sizeof(hdr);
+		iov[1].data = (char *) record;
+		iov[1].len = record->xl_tot_len;
+
+		/* the decoding process went away */
+		if (shm_mq_sendv(mqh, iov, 2, false) != SHM_MQ_SUCCESS)
+			break;
+	}
+
+	elog(DEBUG1, "WAL read-ahead stopped at %X/%X",
+		 (uint32) (reader->EndRecPtr >> 32), (uint32) reader->EndRecPtr);
+
+	XLogReaderFree(reader);
+	dsm_detach(seg);
+	proc_exit(0);
+}
+
+/*
+ * read_page callback of the worker.
+ *
+ * Reads like read_local_xlog_page(), but gives up instead of waiting for WAL
+ * that has not been flushed yet; waiting is left to the decoding process.
+ */
+static int
+read_ahead_xlog_page(XLogReaderState *state,
+					 XLogRecPtr targetPagePtr, int reqLen,
+					 XLogRecPtr targetRecPtr, char *cur_page,
+					 TimeLineID *pageTLI)
+{
+	/* this also sets ThisTimeLineID, which read_local_xlog_page() uses */
+	if (RecoveryInProgress())
+		return -1;
+
+	if (targetPagePtr + reqLen > GetFlushRecPtr())
+		return -1;
+
+	return read_local_xlog_page(state, targetPagePtr, reqLen, targetRecPtr,
+								cur_page, pageTLI);
+}
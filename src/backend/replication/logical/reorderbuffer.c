@@ -32,9 +32,19 @@
  *
  *	  In order to cope with large transactions - which can be several times as
  *	  big as the available memory - this module supports spooling the contents
- *	  of a large transactions to disk. When the transaction is replayed the
- *	  contents of individual (sub-)transactions will be read from disk in
- *	  chunks.
+ *	  of a large transactions to disk. The memory used by the changes of all
+ *	  transactions together is limited by logical_decoding_work_mem; once it
+ *	  is exceeded, the largest transactions are spooled first. When the
+ *	  transaction is replayed the contents of individual (sub-)transactions
+ *	  will be read from disk in chunks.
+ *
+ *	  If the output plugin supports it, large transactions are instead
+ *	  streamed to it while they are still in progress: once the memory limit
+ *	  is reached, the changes queued so far are passed to the stream
+ *	  callbacks and freed (c.f. ReorderBufferStreamTXN()). The output plugin is
+ *	  told about the commit or abort of the transaction later on. That is only
+ *	  possible for transactions which did not modify the catalog, because
+ *	  their cache invalidations are not known before the commit record.
  *
  *	  This module also has to deal with reassembling toast records from the
  *	  individual chunks stored in WAL. When a new (or initial) version of a
@@ -136,16 +146,15 @@ typedef struct ReorderBufferDiskChange
 } ReorderBufferDiskChange;
 
 /*
- * Maximum number of changes kept in memory, per transaction. After that,
- * changes are spooled to disk.
- *
- * The current value should be sufficient to decode the entire transaction
- * without hitting disk in OLTP workloads, while starting to spool to disk in
- * other workloads reasonably fast.
- *
- * At some point in the future it probably makes sense to have a more elaborate
- * resource management here, but it's not entirely clear what that would look
- * like.
+ * Memory for the changes of all transactions being decoded, in kilobytes.
+ * Once it's used up, the largest transaction is spooled to disk (or streamed,
+ * see ReorderBufferCanStreamTXN()) until we're below the limit again.
+ */
+int			logical_decoding_work_mem;
+
+/*
+ * Maximum number of changes restored from disk into memory at once, per
+ * transaction.
  */
 static const Size max_changes_in_memory = 4096;
 
@@ -186,13 +195,28 @@ static ReorderBufferChange *
 static void ReorderBufferIterTXNFinish(ReorderBuffer *rb,
 						   ReorderBufferIterTXNState *state);
 static void ReorderBufferExecuteInvalidations(ReorderBuffer *rb, ReorderBufferTXN *txn);
+static void ReorderBufferProcessTXN(ReorderBuffer *rb, ReorderBufferTXN *txn,
+						XLogRecPtr commit_lsn, bool streaming);
+
+/*
+ * ---------------------------------------
+ * Streaming support functions
+ * ---------------------------------------
+ */
+static bool ReorderBufferCanStreamTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
+static void ReorderBufferStreamTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
+static void ReorderBufferTruncateTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
 
 /*
  * ---------------------------------------
  * Disk serialization support functions
  * ---------------------------------------
  */
-static void ReorderBufferCheckSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
+static Size ReorderBufferChangeSize(ReorderBufferChange *change);
+static void ReorderBufferChangeMemoryUpdate(ReorderBuffer *rb,
+								ReorderBufferChange *change, bool addition);
+static ReorderBufferTXN *ReorderBufferLargestTXN(ReorderBuffer *rb);
+static void ReorderBufferCheckMemoryLimit(ReorderBuffer *rb);
 static void ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn);
 static void ReorderBufferSerializeChange(ReorderBuffer *rb, ReorderBufferTXN *txn,
 							 int fd, ReorderBufferChange *change);
@@ -203,6 +227,8 @@ static void ReorderBufferRestoreChange(ReorderBuffer *rb, ReorderBufferTXN *txn,
 static void ReorderBufferRestoreCleanup(ReorderBuffer *rb, ReorderBufferTXN *txn);
 
 static void ReorderBufferFreeSnap(ReorderBuffer *rb, Snapshot snap);
+static void ReorderBufferTransferSnapToParent(ReorderBufferTXN *txn,
+								  ReorderBufferTXN *subtxn);
 static Snapshot ReorderBufferCopySnap(ReorderBuffer *rb, Snapshot orig_snap,
 					  ReorderBufferTXN *txn, CommandId cid);
 
@@ -392,6 +418,10 @@ ReorderBufferGetChange(ReorderBuffer *rb)
 void
 ReorderBufferReturnChange(ReorderBuffer *rb, ReorderBufferChange *change)
 {
+	/* no longer accounted to the transaction holding it */
+	if (change->txn != NULL)
+		ReorderBufferChangeMemoryUpdate(rb, change, false);
+
 	/* free contained data */
 	switch (change->action)
 	{
@@ -624,12 +654,15 @@ ReorderBufferQueueChange(ReorderBuffer *rb, TransactionId xid, XLogRecPtr lsn,
 	txn = ReorderBufferTXNByXid(rb, xid, true, NULL, lsn, true);
 
 	change->lsn = lsn;
+	change->txn = txn;
 	Assert(InvalidXLogRecPtr != lsn);
 	dlist_push_tail(&txn->changes, &change->node);
 	txn->nentries++;
 	txn->nentries_mem++;
 
-	ReorderBufferCheckSerializeTXN(rb, txn);
+	ReorderBufferChangeMemoryUpdate(rb, change, true);
+
+	ReorderBufferCheckMemoryLimit(rb);
 }
 
 /*
@@ -756,12 +789,15 @@ ReorderBufferAssignChild(ReorderBuffer *rb, TransactionId xid,
 		 * that have not yet produced any records. Knowing those aren't top
 		 * level xids allows us to make processing cheaper in some places.
 		 */
+		subtxn->is_known_as_subxact = true;
+		subtxn->toptxn = txn;
 		dlist_push_tail(&txn->subtxns, &subtxn->node);
 		txn->nsubtxns++;
 	}
 	else if (!subtxn->is_known_as_subxact)
 	{
 		subtxn->is_known_as_subxact = true;
+		subtxn->toptxn = txn;
 		Assert(subtxn->nsubtxns == 0);
 
 		/* remove from lsn order list of top-level transactions */
@@ -770,6 +806,9 @@ ReorderBufferAssignChild(ReorderBuffer *rb, TransactionId xid,
 		/* add to toplevel transaction */
 		dlist_push_tail(&txn->subtxns, &subtxn->node);
 		txn->nsubtxns++;
+
+		/* from now on the toplevel transaction's base snapshot is used */
+		ReorderBufferTransferSnapToParent(txn, subtxn);
 	}
 	else if (new_top)
 	{
@@ -803,21 +842,7 @@ ReorderBufferCommitChild(ReorderBuffer *rb, TransactionId xid,
 	if (txn == NULL)
 		elog(ERROR, "subxact logged without previous toplevel record");
 
-	/*
-	 * Pass our base snapshot to the parent transaction if it doesn't have
-	 * one, or ours is older. That can happen if there are no changes in the
-	 * toplevel transaction but in one of the child transactions. This allows
-	 * the parent to simply use its base snapshot initially.
-	 */
-	if (subtxn->base_snapshot != NULL &&
-		(txn->base_snapshot == NULL ||
-		 txn->base_snapshot_lsn > subtxn->base_snapshot_lsn))
-	{
-		txn->base_snapshot = subtxn->base_snapshot;
-		txn->base_snapshot_lsn = subtxn->base_snapshot_lsn;
-		subtxn->base_snapshot = NULL;
-		subtxn->base_snapshot_lsn = InvalidXLogRecPtr;
-	}
+	ReorderBufferTransferSnapToParent(txn, subtxn);
 
 	subtxn->final_lsn = commit_lsn;
 	subtxn->end_lsn = end_lsn;
@@ -825,6 +850,7 @@ ReorderBufferCommitChild(ReorderBuffer *rb, TransactionId xid,
 	if (!subtxn->is_known_as_subxact)
 	{
 		subtxn->is_known_as_subxact = true;
+		subtxn->toptxn = txn;
 		Assert(subtxn->nsubtxns == 0);
 
 		/* remove from lsn order list of top-level transactions */
@@ -836,6 +862,31 @@ ReorderBufferCommitChild(ReorderBuffer *rb, TransactionId xid,
 	}
 }
 
+/*
+ * Pass the base snapshot of a subtransaction to its parent transaction if the
+ * parent doesn't have one, or the subtransaction's is older. That can happen
+ * if there are no changes in the toplevel transaction but in one of the child
+ * transactions. This allows the parent to simply use its base snapshot
+ * initially.
+ */
+static void
+ReorderBufferTransferSnapToParent(ReorderBufferTXN *txn,
+								  ReorderBufferTXN *subtxn)
+{
+	if (subtxn->base_snapshot != NULL &&
+		(txn->base_snapshot == NULL ||
+		 txn->base_snapshot_lsn > subtxn->base_snapshot_lsn))
+	{
+		if (txn->base_snapshot != NULL)
+			SnapBuildSnapDecRefcount(txn->base_snapshot);
+
+		txn->base_snapshot = subtxn->base_snapshot;
+		txn->base_snapshot_lsn = subtxn->base_snapshot_lsn;
+		subtxn->base_snapshot = NULL;
+		subtxn->base_snapshot_lsn = InvalidXLogRecPtr;
+	}
+}
+
 
 /*
  * Support for efficiently iterating over a transaction's and its
@@ -1164,6 +1215,17 @@ ReorderBufferCleanupTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 		txn->base_snapshot_lsn = InvalidXLogRecPtr;
 	}
 
+	/* snapshot remembered by streaming */
+	if (txn->snapshot_now != NULL)
+	{
+		ReorderBufferFreeSnap(rb, txn->snapshot_now);
+		txn->snapshot_now = NULL;
+	}
+
+	/* toast chunks left over by streaming */
+	if (txn->toast_hash != NULL)
+		ReorderBufferToastReset(rb, txn);
+
 	/* delete from list of known subxacts */
 	if (txn->is_known_as_subxact)
 	{
@@ -1348,7 +1410,8 @@ ReorderBufferFreeSnap(ReorderBuffer *rb, Snapshot snap)
  * record is read because that's currently the only place where we know about
  * cache invalidati ons. Thus, once a toplevel commit is read, we iterate over
  * the top and subtransactions (using a k-way merge) and replay the changes in
- * lsn order.
+ * lsn order. Transactions without catalog changes may have been streamed
+ * before, in that case only the remaining changes are sent.
  */
 void
 ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
@@ -1357,10 +1420,6 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 					RepOriginId origin_id, XLogRecPtr origin_lsn)
 {
 	ReorderBufferTXN *txn;
-	volatile Snapshot snapshot_now;
-	volatile CommandId command_id = FirstCommandId;
-	bool		using_subtxn;
-	ReorderBufferIterTXNState *volatile iterstate = NULL;
 
 	txn = ReorderBufferTXNByXid(rb, xid, false, NULL, InvalidXLogRecPtr,
 								false);
@@ -1391,7 +1450,67 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		return;
 	}
 
-	snapshot_now = txn->base_snapshot;
+	/*
+	 * Parts of the transaction have already been streamed. Stream the rest
+	 * and let the output plugin know the transaction committed or was
+	 * prepared. A later COMMIT PREPARED or ROLLBACK PREPARED reaches the
+	 * plugin through ReorderBufferCommitBareXact(), as for any other
+	 * prepared transaction.
+	 */
+	if (txn->streamed)
+	{
+		ReorderBufferStreamTXN(rb, txn);
+
+		if (txn->xact_action == XLOG_XACT_PREPARE)
+			rb->stream_prepare(rb, txn, commit_lsn);
+		else
+			rb->stream_commit(rb, txn, commit_lsn);
+
+		/* deallocate */
+		ReorderBufferCleanupTXN(rb, txn);
+		return;
+	}
+
+	ReorderBufferProcessTXN(rb, txn, commit_lsn, false);
+}
+
+/*
+ * Pass the changes of a transaction and its subtransactions queued so far to
+ * the output plugin, in lsn order.
+ *
+ * When the transaction has been committed, it's passed as a whole between
+ * the begin and commit callbacks and deallocated afterwards.
+ *
+ * When streaming an in-progress transaction (c.f. ReorderBufferStreamTXN())
+ * the changes are put between the stream_start and stream_stop callbacks
+ * instead. They are freed afterwards, and the snapshot state is remembered
+ * in the transaction, so that the next block of changes continues where this
+ * one left off.
+ */
+static void
+ReorderBufferProcessTXN(ReorderBuffer *rb, ReorderBufferTXN *txn,
+						XLogRecPtr commit_lsn, bool streaming)
+{
+	volatile Snapshot snapshot_now;
+	volatile CommandId command_id = FirstCommandId;
+	volatile XLogRecPtr last_lsn = InvalidXLogRecPtr;
+	bool		using_subtxn;
+	ReorderBufferIterTXNState *volatile iterstate = NULL;
+
+	if (txn->snapshot_now != NULL)
+	{
+		/*
+		 * Continue with the state of the previously streamed block. Copy the
+		 * snapshot again, so it knows about subtransactions seen since.
+		 */
+		command_id = txn->command_id;
+		snapshot_now = ReorderBufferCopySnap(rb, txn->snapshot_now,
+											 txn, command_id);
+		ReorderBufferFreeSnap(rb, txn->snapshot_now);
+		txn->snapshot_now = NULL;
+	}
+	else
+		snapshot_now = txn->base_snapshot;
 
 	/* build data to be able to lookup the CommandIds of catalog tuples */
 	ReorderBufferBuildTupleCidHash(rb, txn);
@@ -1421,7 +1540,8 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		else
 			StartTransactionCommand();
 
-		rb->begin(rb, txn);
+		if (!streaming)
+			rb->begin(rb, txn);
 
 		iterstate = ReorderBufferIterTXNInit(rb, txn);
 		while ((change = ReorderBufferIterTXNNext(rb, iterstate)) != NULL)
@@ -1429,6 +1549,11 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 			Relation	relation = NULL;
 			Oid			reloid;
 
+			/* the block of streamed changes starts with its first change */
+			if (streaming && last_lsn == InvalidXLogRecPtr)
+				rb->stream_start(rb, txn, change->lsn);
+			last_lsn = change->lsn;
+
 			switch (change->action)
 			{
 				case REORDER_BUFFER_CHANGE_INTERNAL_SPEC_CONFIRM:
@@ -1489,7 +1614,10 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 					if (!IsToastRelation(relation))
 					{
 						ReorderBufferToastReplace(rb, txn, relation, change);
-						rb->apply_change(rb, txn, relation, change);
+						if (streaming)
+							rb->stream_change(rb, txn, relation, change);
+						else
+							rb->apply_change(rb, txn, relation, change);
 
 						/*
 						 * Only clear reassembled toast chunks if we're sure
@@ -1562,10 +1690,16 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 					break;
 
 				case REORDER_BUFFER_CHANGE_MESSAGE:
-					rb->message(rb, txn, change->lsn, true,
-								change->data.msg.prefix,
-								change->data.msg.message_size,
-								change->data.msg.message);
+					if (streaming)
+						rb->stream_message(rb, txn, change->lsn, true,
+										   change->data.msg.prefix,
+										   change->data.msg.message_size,
+										   change->data.msg.message);
+					else
+						rb->message(rb, txn, change->lsn, true,
+									change->data.msg.prefix,
+									change->data.msg.message_size,
+									change->data.msg.message);
 					break;
 
 				case REORDER_BUFFER_CHANGE_INTERNAL_SNAPSHOT:
@@ -1639,9 +1773,10 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		/*
 		 * There's a speculative insertion remaining, just clean in up, it
 		 * can't have been successful, otherwise we'd gotten a confirmation
-		 * record.
+		 * record. Unless we're streaming, the confirmation may still follow
+		 * then.
 		 */
-		if (specinsert)
+		if (specinsert && !streaming)
 		{
 			ReorderBufferReturnChange(rb, specinsert);
 			specinsert = NULL;
@@ -1651,8 +1786,17 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		ReorderBufferIterTXNFinish(rb, iterstate);
 		iterstate = NULL;
 
-		/* call commit callback */
-		rb->commit(rb, txn, commit_lsn);
+		/* call stream stop or commit callback */
+		if (streaming)
+		{
+			if (last_lsn != InvalidXLogRecPtr)
+			{
+				rb->stream_stop(rb, txn, last_lsn);
+				txn->streamed = true;
+			}
+		}
+		else
+			rb->commit(rb, txn, commit_lsn);
 
 		/* this is just a sanity check against bad output plugin behaviour */
 		if (GetCurrentTransactionIdIfAny() != InvalidTransactionId)
@@ -1676,11 +1820,45 @@ ReorderBufferCommit(ReorderBuffer *rb, TransactionId xid,
 		if (using_subtxn)
 			RollbackAndReleaseCurrentSubTransaction();
 
-		if (snapshot_now->copied)
-			ReorderBufferFreeSnap(rb, snapshot_now);
+		if (streaming)
+		{
+			/* remember the snapshot to continue with */
+			if (snapshot_now->copied)
+				txn->snapshot_now = snapshot_now;
+			else
+				txn->snapshot_now = ReorderBufferCopySnap(rb, snapshot_now,
+														  txn, command_id);
+			txn->command_id = command_id;
 
-		/* remove potential on-disk data, and deallocate */
-		ReorderBufferCleanupTXN(rb, txn);
+			/* the streamed changes are not needed anymore */
+			ReorderBufferTruncateTXN(rb, txn);
+
+			/*
+			 * Keep a pending speculative insertion for its confirmation. It
+			 * may come from a subtransaction that aborts before that, so
+			 * move it, and the memory it is accounted for, to the toplevel
+			 * transaction.
+			 */
+			if (specinsert != NULL)
+			{
+				ReorderBufferChangeMemoryUpdate(rb, specinsert, false);
+				specinsert->txn = txn;
+				ReorderBufferChangeMemoryUpdate(rb, specinsert, true);
+
+				dlist_push_tail(&txn->changes, &specinsert->node);
+				txn->nentries++;
+				txn->nentries_mem++;
+				specinsert = NULL;
+			}
+		}
+		else
+		{
+			if (snapshot_now->copied)
+				ReorderBufferFreeSnap(rb, snapshot_now);
+
+			/* remove potential on-disk data, and deallocate */
+			ReorderBufferCleanupTXN(rb, txn);
+		}
 	}
 	PG_CATCH();
 	{
@@ -1767,6 +1945,10 @@ ReorderBufferAbort(ReorderBuffer *rb, TransactionId xid, XLogRecPtr lsn)
 	/* cosmetic... */
 	txn->final_lsn = lsn;
 
+	/* the output plugin has seen parts of it, tell it to discard them */
+	if (txn->streamed)
+		rb->stream_abort(rb, txn, lsn);
+
 	/* remove potential on-disk data, and deallocate */
 	ReorderBufferCleanupTXN(rb, txn);
 }
@@ -1800,6 +1982,9 @@ ReorderBufferAbortOld(ReorderBuffer *rb, TransactionId oldestRunningXid)
 		{
 			elog(DEBUG2, "aborting old transaction %u", txn->xid);
 
+			if (txn->streamed)
+				rb->stream_abort(rb, txn, InvalidXLogRecPtr);
+
 			/* remove potential on-disk data, and deallocate this tx */
 			ReorderBufferCleanupTXN(rb, txn);
 		}
@@ -1836,6 +2021,10 @@ ReorderBufferForget(ReorderBuffer *rb, TransactionId xid, XLogRecPtr lsn)
 	/* cosmetic... */
 	txn->final_lsn = lsn;
 
+	/* streamed changes won't be committed as far as the plugin is concerned */
+	if (txn->streamed)
+		rb->stream_abort(rb, txn, lsn);
+
 	/*
 	 * Process cache invalidation messages if there are any. Even if we're not
 	 * interested in the transaction's contents, it could have manipulated the
@@ -1934,6 +2123,11 @@ ReorderBufferSetBaseSnapshot(ReorderBuffer *rb, TransactionId xid,
 	bool		is_new;
 
 	txn = ReorderBufferTXNByXid(rb, xid, true, &is_new, lsn, true);
+
+	/* the base snapshot of a known subtransaction is its parent's */
+	if (txn->is_known_as_subxact && txn->toptxn != NULL)
+		txn = txn->toptxn;
+
 	Assert(txn->base_snapshot == NULL);
 	Assert(snap != NULL);
 
@@ -2071,15 +2265,132 @@ ReorderBufferXidHasBaseSnapshot(ReorderBuffer *rb, TransactionId xid)
 	if (txn == NULL)
 		return false;
 
-	/*
-	 * TODO: It would be a nice improvement if we would check the toplevel
-	 * transaction in subtransactions, but we'd need to keep track of a bit
-	 * more state.
-	 */
+	/* a known subtransaction uses the snapshot of its toplevel transaction */
+	if (txn->is_known_as_subxact && txn->toptxn != NULL)
+		txn = txn->toptxn;
+
 	return txn->base_snapshot != NULL;
 }
 
 
+/*
+ * ---------------------------------------
+ * Streaming support
+ * ---------------------------------------
+ */
+
+/*
+ * Can the changes of the toplevel transaction txn be passed to the output
+ * plugin before it has committed?
+ *
+ * That requires the plugin to support streaming, and the transaction to be
+ * decodable with the snapshot it has now. Transactions that change the
+ * catalog can't be streamed, the invalidations they need are only known at
+ * commit time.
+ */
+static bool
+ReorderBufferCanStreamTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
+{
+	LogicalDecodingContext *ctx = rb->private_data;
+	dlist_iter	iter;
+
+	if (!ctx->streaming)
+		return false;
+
+	/* subtransactions are streamed together with their toplevel one */
+	if (txn->is_known_as_subxact)
+		return false;
+
+	if (txn->base_snapshot == NULL)
+		return false;
+
+	/* we can't send anything before reaching a consistent state */
+	if (SnapBuildCurrentState(ctx->snapshot_builder) < SNAPBUILD_CONSISTENT)
+		return false;
+
+	/* nor changes the client has already confirmed */
+	if (SnapBuildXactNeedsSkip(ctx->snapshot_builder, ctx->reader->EndRecPtr))
+		return false;
+
+	if (txn->has_catalog_changes)
+		return false;
+
+	dlist_foreach(iter, &txn->subtxns)
+	{
+		ReorderBufferTXN *subtxn;
+
+		subtxn = dlist_container(ReorderBufferTXN, node, iter.cur);
+		if (subtxn->has_catalog_changes)
+			return false;
+	}
+
+	/* don't stream transactions the output plugin isn't interested in */
+	if (!dlist_is_empty(&txn->changes))
+	{
+		ReorderBufferChange *change;
+
+		change = dlist_tail_element(ReorderBufferChange, node, &txn->changes);
+		if (ctx->callbacks.filter_by_origin_cb &&
+			filter_by_origin_cb_wrapper(ctx, change->origin_id))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Send the changes of an in-progress toplevel transaction and its
+ * subtransactions queued so far to the output plugin, and free them.
+ */
+static void
+ReorderBufferStreamTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
+{
+	Assert(!txn->is_known_as_subxact);
+	Assert(txn->base_snapshot != NULL);
+
+	ReorderBufferProcessTXN(rb, txn, InvalidXLogRecPtr, true);
+}
+
+/*
+ * Discard the changes of a transaction and its subtransactions after they
+ * have been streamed, keeping the transactions themselves.
+ */
+static void
+ReorderBufferTruncateTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
+{
+	dlist_mutable_iter iter;
+
+	dlist_foreach_modify(iter, &txn->subtxns)
+	{
+		ReorderBufferTXN *subtxn;
+
+		subtxn = dlist_container(ReorderBufferTXN, node, iter.cur);
+		ReorderBufferTruncateTXN(rb, subtxn);
+	}
+
+	dlist_foreach_modify(iter, &txn->changes)
+	{
+		ReorderBufferChange *change;
+
+		change = dlist_container(ReorderBufferChange, node, iter.cur);
+		dlist_delete(&change->node);
+		ReorderBufferReturnChange(rb, change);
+	}
+
+	/* everything spilled to disk has been streamed as well */
+	if (txn->serialized)
+	{
+		ReorderBufferRestoreCleanup(rb, txn);
+		txn->serialized = false;
+	}
+
+	if (txn->nentries > 0)
+		txn->streamed = true;
+
+	txn->nentries = 0;
+	txn->nentries_mem = 0;
+}
+
 /*
  * ---------------------------------------
  * Disk serialization support
@@ -2105,19 +2416,145 @@ ReorderBufferSerializeReserve(ReorderBuffer *rb, Size sz)
 }
 
 /*
- * Check whether the transaction tx should spill its data to disk.
+ * Compute the amount of memory used by a change, including the data it
+ * points to.
+ */
+static Size
+ReorderBufferChangeSize(ReorderBufferChange *change)
+{
+	Size		sz = sizeof(ReorderBufferChange);
+
+	switch (change->action)
+	{
+			/* fall through these, they're all similar enough */
+		case REORDER_BUFFER_CHANGE_INSERT:
+		case REORDER_BUFFER_CHANGE_UPDATE:
+		case REORDER_BUFFER_CHANGE_DELETE:
+		case REORDER_BUFFER_CHANGE_INTERNAL_SPEC_INSERT:
+			if (change->data.tp.oldtuple)
+				sz += sizeof(ReorderBufferTupleBuf) +
+					change->data.tp.oldtuple->alloc_tuple_size;
+			if (change->data.tp.newtuple)
+				sz += sizeof(ReorderBufferTupleBuf) +
+					change->data.tp.newtuple->alloc_tuple_size;
+			break;
+		case REORDER_BUFFER_CHANGE_MESSAGE:
+			sz += strlen(change->data.msg.prefix) + 1 +
+				change->data.msg.message_size;
+			break;
+		case REORDER_BUFFER_CHANGE_INTERNAL_SNAPSHOT:
+			{
+				Snapshot	snap = change->data.snapshot;
+
+				sz += sizeof(SnapshotData) +
+					sizeof(TransactionId) * snap->xcnt +
+					sizeof(TransactionId) * snap->subxcnt;
+				break;
+			}
+			/* the base struct contains all the data */
+		case REORDER_BUFFER_CHANGE_INTERNAL_SPEC_CONFIRM:
+		case REORDER_BUFFER_CHANGE_INTERNAL_COMMAND_ID:
+		case REORDER_BUFFER_CHANGE_INTERNAL_TUPLECID:
+			break;
+	}
+
+	return sz;
+}
+
+/*
+ * Account for a change being added to or removed from the memory of the
+ * transaction it belongs to.
  */
 static void
-ReorderBufferCheckSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
+ReorderBufferChangeMemoryUpdate(ReorderBuffer *rb,
+								ReorderBufferChange *change, bool addition)
 {
-	/*
-	 * TODO: improve accounting so we cheaply can take subtransactions into
-	 * account here.
-	 */
-	if (txn->nentries_mem >= max_changes_in_memory)
+	ReorderBufferTXN *txn = change->txn;
+	Size		sz = ReorderBufferChangeSize(change);
+
+	Assert(txn != NULL);
+
+	if (addition)
 	{
-		ReorderBufferSerializeTXN(rb, txn);
-		Assert(txn->nentries_mem == 0);
+		txn->size += sz;
+		rb->size += sz;
+	}
+	else
+	{
+		Assert(txn->size >= sz && rb->size >= sz);
+		txn->size -= sz;
+		rb->size -= sz;
+	}
+}
+
+/*
+ * Find the (sub)transaction using the most memory for changes that can be
+ * evicted from it.
+ *
+ * A linear scan over all transactions is fine here, it only happens once the
+ * memory limit has been reached, and evicting a transaction frees memory for
+ * many more changes.
+ */
+static ReorderBufferTXN *
+ReorderBufferLargestTXN(ReorderBuffer *rb)
+{
+	HASH_SEQ_STATUS hash_seq;
+	ReorderBufferTXNByIdEnt *ent;
+	ReorderBufferTXN *largest = NULL;
+
+	hash_seq_init(&hash_seq, rb->by_txn);
+	while ((ent = hash_seq_search(&hash_seq)) != NULL)
+	{
+		ReorderBufferTXN *txn = ent->txn;
+
+		/* toast chunks pending reassembly can't be spilled */
+		if (txn->nentries_mem == 0)
+			continue;
+
+		if (largest == NULL || txn->size > largest->size)
+			largest = txn;
+	}
+
+	return largest;
+}
+
+/*
+ * Check whether the changes of all transactions exceed the memory limit, and
+ * if so, evict the largest transactions until they don't anymore.
+ *
+ * Evicting means passing the changes to the output plugin if it can cope
+ * with in-progress transactions, or spilling them to disk otherwise.
+ */
+static void
+ReorderBufferCheckMemoryLimit(ReorderBuffer *rb)
+{
+	ReorderBufferTXN *txn;
+	ReorderBufferTXN *toptxn;
+	Size		size_before;
+
+	while (rb->size >= logical_decoding_work_mem * 1024L)
+	{
+		txn = ReorderBufferLargestTXN(rb);
+		if (txn == NULL)
+			break;
+
+		toptxn = txn->toptxn ? txn->toptxn : txn;
+		size_before = rb->size;
+
+		if (ReorderBufferCanStreamTXN(rb, toptxn))
+			ReorderBufferStreamTXN(rb, toptxn);
+		else
+		{
+			ReorderBufferSerializeTXN(rb, txn);
+			Assert(txn->nentries_mem == 0);
+		}
+
+		/*
+		 * Streaming keeps a pending speculative insertion in memory; don't
+		 * loop forever if that's all there is left.
+		 */
+		if (rb->size >= size_before)
+			break;
 	}
 }
 
@@ -2132,11 +2569,26 @@ ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 	int			fd = -1;
 	XLogSegNo	curOpenSegNo = 0;
 	Size		spilled = 0;
+	Size		size_before = txn->size;
 	char		path[MAXPGPATH];
 
 	elog(DEBUG2, "spill %u changes in XID %u to disk",
 		 (uint32) txn->nentries_mem, txn->xid);
 
+	/*
+	 * Restoring and removing the spilled data relies on final_lsn covering
+	 * all of it. For a transaction that's still in progress, advance it to
+	 * the last change; its commit or abort record will set the final value.
+	 */
+	if (!dlist_is_empty(&txn->changes))
+	{
+		ReorderBufferChange *last;
+
+		last = dlist_tail_element(ReorderBufferChange, node, &txn->changes);
+		if (txn->final_lsn < last->lsn)
+			txn->final_lsn = last->lsn;
+	}
+
 	/* do the same to all child TXs */
 	dlist_foreach(subtxn_i, &txn->subtxns)
 	{
@@ -2197,6 +2649,18 @@ ReorderBufferSerializeTXN(ReorderBuffer *rb, ReorderBufferTXN *txn)
 	Assert(spilled == txn->nentries_mem);
 	Assert(dlist_is_empty(&txn->changes));
 	txn->nentries_mem = 0;
+
+	/* update the statistics of the slot */
+	if (spilled > 0)
+	{
+		SpinLockAcquire(&MyReplicationSlot->mutex);
+		if (!txn->serialized)
+			MyReplicationSlot->spill_txns++;
+		MyReplicationSlot->spill_count++;
+		MyReplicationSlot->spill_bytes += size_before - txn->size;
+		SpinLockRelease(&MyReplicationSlot->mutex);
+	}
+
 	txn->serialized = true;
 
 	if (fd != -1)
@@ -2626,8 +3090,11 @@ ReorderBufferRestoreChange(ReorderBuffer *rb, ReorderBufferTXN *txn,
 			break;
 	}
 
+	change->txn = txn;
 	dlist_push_tail(&txn->changes, &change->node);
 	txn->nentries_mem++;
+
+	ReorderBufferChangeMemoryUpdate(rb, change, true);
 }
 
 /*
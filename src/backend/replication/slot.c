@@ -289,6 +289,9 @@ ReplicationSlotCreate(const char *name, bool db_specific,
 	slot->candidate_xmin_lsn = InvalidXLogRecPtr;
 	slot->candidate_restart_valid = InvalidXLogRecPtr;
 	slot->candidate_restart_lsn = InvalidXLogRecPtr;
+	slot->spill_txns = 0;
+	slot->spill_count = 0;
+	slot->spill_bytes = 0;
 
 	/*
 	 * Create the slot on disk.  We haven't actually marked the slot allocated
@@ -1303,6 +1306,9 @@ RestoreSlotFromDisk(const char *name)
 		slot->candidate_xmin_lsn = InvalidXLogRecPtr;
 		slot->candidate_restart_lsn = InvalidXLogRecPtr;
 		slot->candidate_restart_valid = InvalidXLogRecPtr;
+		slot->spill_txns = 0;
+		slot->spill_count = 0;
+		slot->spill_bytes = 0;
 
 		slot->in_use = true;
 		slot->active_pid = 0;
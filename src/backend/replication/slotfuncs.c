@@ -174,7 +174,7 @@ pg_drop_replication_slot(PG_FUNCTION_ARGS)
 Datum
 pg_get_replication_slots(PG_FUNCTION_ARGS)
 {
-#define PG_GET_REPLICATION_SLOTS_COLS 10
+#define PG_GET_REPLICATION_SLOTS_COLS 13
 	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
 	TupleDesc	tupdesc;
 	Tuplestorestate *tupstore;
@@ -223,6 +223,9 @@ pg_get_replication_slots(PG_FUNCTION_ARGS)
 		TransactionId catalog_xmin;
 		XLogRecPtr	restart_lsn;
 		XLogRecPtr	confirmed_flush_lsn;
+		uint64		spill_txns;
+		uint64		spill_count;
+		uint64		spill_bytes;
 		pid_t		active_pid;
 		Oid			database;
 		NameData	slot_name;
@@ -242,6 +245,9 @@ pg_get_replication_slots(PG_FUNCTION_ARGS)
 			database = slot->data.database;
 			restart_lsn = slot->data.restart_lsn;
 			confirmed_flush_lsn = slot->data.confirmed_flush;
+			spill_txns = slot->spill_txns;
+			spill_count = slot->spill_count;
+			spill_bytes = slot->spill_bytes;
 			namecpy(&slot_name, &slot->data.name);
 			namecpy(&plugin, &slot->data.plugin);
 
@@ -296,6 +302,19 @@ pg_get_replication_slots(PG_FUNCTION_ARGS)
 		else
 			nulls[i++] = true;
 
+		if (database == InvalidOid)
+		{
+			nulls[i++] = true;
+			nulls[i++] = true;
+			nulls[i++] = true;
+		}
+		else
+		{
+			values[i++] = Int64GetDatum((int64) spill_txns);
+			values[i++] = Int64GetDatum((int64) spill_count);
+			values[i++] = Int64GetDatum((int64) spill_bytes);
+		}
+
 		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
 	}
 
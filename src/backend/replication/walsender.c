@@ -46,6 +46,7 @@
  */
 #include "postgres.h"
 
+#include <fcntl.h>
 #include <signal.h>
 #include <unistd.h>
 
@@ -66,6 +67,7 @@
 #include "replication/decode.h"
 #include "replication/logical.h"
 #include "replication/logicalfuncs.h"
+#include "replication/readahead.h"
 #include "replication/slot.h"
 #include "replication/snapbuild.h"
 #include "replication/syncrep.h"
@@ -268,6 +270,14 @@ WalSndErrorCleanup(void)
 	if (MyReplicationSlot != NULL)
 		ReplicationSlotRelease();
 
+	/* don't leave a WAL read-ahead worker behind */
+	if (logical_decoding_ctx != NULL &&
+		logical_decoding_ctx->read_ahead != NULL)
+	{
+		XLogReadAheadEnd(logical_decoding_ctx->read_ahead);
+		logical_decoding_ctx->read_ahead = NULL;
+	}
+
 	replication_active = false;
 
 	if (got_STOPPING || got_SIGUSR2)
@@ -1028,6 +1038,7 @@ StartLogicalReplication(StartReplicationCmd *cmd)
 	WalSndLoop(XLogSendLogical);
 
 	FreeDecodingContext(logical_decoding_ctx);
+	logical_decoding_ctx = NULL;
 	ReplicationSlotRelease();
 
 	replication_active = false;
@@ -2150,6 +2161,16 @@ retry:
 									path)));
 			}
 			sendOff = 0;
+
+			/*
+			 * WAL is read sequentially, so have the kernel read the rest of
+			 * the segment in the background while we process its beginning.
+			 * When far behind, reading the WAL thus overlaps with decoding
+			 * or sending it, instead of stalling on every read.
+			 */
+#if defined(USE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+			(void) posix_fadvise(sendFile, startoff, 0, POSIX_FADV_WILLNEED);
+#endif
 		}
 
 		/* Need to seek in the file? */
@@ -2485,7 +2506,7 @@ XLogSendLogical(void)
 	 */
 	WalSndCaughtUp = false;
 
-	record = XLogReadRecord(logical_decoding_ctx->reader, logical_startptr, &errm);
+	record = LogicalDecodingReadRecord(logical_decoding_ctx, logical_startptr, &errm);
 	logical_startptr = InvalidXLogRecPtr;
 
 	/* xlog record was invalid */
@@ -130,6 +130,7 @@ static LWLockTranche MainLWLockTranche;
 static LWLockTranche BufMappingLWLockTranche;
 static LWLockTranche LockManagerLWLockTranche;
 static LWLockTranche PredicateLockManagerLWLockTranche;
+static LWLockTranche TwoPhaseStateLWLockTranche;
 
 /*
  * We use this structure to keep track of locked LWLocks for release
@@ -481,6 +482,13 @@ InitializeLWLocks(void)
 	for (id = 0; id < NUM_PREDICATELOCK_PARTITIONS; id++, lock++)
 		LWLockInitialize(&lock->lock, LWTRANCHE_PREDICATE_LOCK_MANAGER);
 
+	/* Initialize two-phase state LWLocks in main array */
+	lock = MainLWLockArray + NUM_INDIVIDUAL_LWLOCKS +
+		NUM_BUFFER_PARTITIONS + NUM_LOCK_PARTITIONS +
+		NUM_PREDICATELOCK_PARTITIONS;
+	for (id = 0; id < NUM_TWOPHASE_PARTITIONS; id++, lock++)
+		LWLockInitialize(&lock->lock, LWTRANCHE_TWOPHASE_STATE);
+
 	/* Initialize named tranches. */
 	if (NamedLWLockTrancheRequests > 0)
 	{
@@ -555,6 +563,12 @@ RegisterLWLockTranches(void)
 	PredicateLockManagerLWLockTranche.array_stride = sizeof(LWLockPadded);
 	LWLockRegisterTranche(LWTRANCHE_PREDICATE_LOCK_MANAGER, &PredicateLockManagerLWLockTranche);
 
+	TwoPhaseStateLWLockTranche.name = "twophase_state";
+	TwoPhaseStateLWLockTranche.array_base = MainLWLockArray + NUM_INDIVIDUAL_LWLOCKS +
+		NUM_BUFFER_PARTITIONS + NUM_LOCK_PARTITIONS + NUM_PREDICATELOCK_PARTITIONS;
+	TwoPhaseStateLWLockTranche.array_stride = sizeof(LWLockPadded);
+	LWLockRegisterTranche(LWTRANCHE_TWOPHASE_STATE, &TwoPhaseStateLWLockTranche);
+
 	/* Register named tranches. */
 	for (i = 0; i < NamedLWLockTrancheRequests; i++)
 		LWLockRegisterTranche(NamedLWLockTrancheArray[i].trancheId,
@@ -26,6 +26,7 @@
 #include <syslog.h>
 #endif
 
+#include "access/clog.h"
 #include "access/commit_ts.h"
 #include "access/gin.h"
 #include "access/transam.h"
@@ -58,6 +59,8 @@
 #include "postmaster/postmaster.h"
 #include "postmaster/syslogger.h"
 #include "postmaster/walwriter.h"
+#include "replication/readahead.h"
+#include "replication/reorderbuffer.h"
 #include "replication/slot.h"
 #include "replication/syncrep.h"
 #include "replication/walreceiver.h"
@@ -1576,6 +1579,17 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"logical_decoding_read_ahead", PGC_USERSET, REPLICATION_SENDING,
+			gettext_noop("Reads WAL ahead of logical decoding in a background worker."),
+			gettext_noop("Used while logical decoding is at least a WAL "
+						 "segment behind the flushed WAL.")
+		},
+		&logical_decoding_read_ahead,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"allow_system_table_mods", PGC_POSTMASTER, DEVELOPER_OPTIONS,
 			gettext_noop("Allows modifications of the structure of system tables."),
@@ -1864,6 +1878,17 @@ static struct config_int ConfigureNamesInt[] =
 		check_temp_buffers, NULL, NULL
 	},
 
+	{
+		{"clog_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of shared memory buffers used for the commit log."),
+			gettext_noop("Zero chooses a value based on shared_buffers."),
+			GUC_UNIT_BLOCKS
+		},
+		&clog_buffers,
+		0, 0, 1024,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"port", PGC_POSTMASTER, CONN_AUTH_SETTINGS,
 			gettext_noop("Sets the TCP port the server listens on."),
@@ -1927,6 +1952,19 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"logical_decoding_work_mem", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Sets the maximum memory to be used for logical decoding."),
+			gettext_noop("This much memory can be used by each logical "
+						 "decoding session to keep decoded transactions "
+						 "before spilling them to disk."),
+			GUC_UNIT_KB
+		},
+		&logical_decoding_work_mem,
+		65536, 64, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"replacement_sort_tuples", PGC_USERSET, RESOURCES_MEM,
 			gettext_noop("Sets the maximum number of tuples to be sorted using replacement selection."),
@@ -2081,6 +2119,18 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"twophase_state_cache_size", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the amount of shared memory used to cache the state data of each prepared transaction."),
+			gettext_noop("State data that fits is finished without being read "
+						 "back from WAL or the state file; zero disables the cache."),
+			GUC_UNIT_KB
+		},
+		&twophase_state_cache_size,
+		4, 0, 1024,
+		NULL, NULL, NULL
+	},
+
 #ifdef LOCK_DEBUG
 	{
 		{"trace_lock_oidmin", PGC_SUSET, DEVELOPER_OPTIONS,
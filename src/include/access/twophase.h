@@ -33,8 +33,9 @@ typedef struct PreparedTransactionData
  */
 typedef struct GlobalTransactionData *GlobalTransaction;
 
-/* GUC variable */
+/* GUC variables */
 extern int	max_prepared_xacts;
+extern int	twophase_state_cache_size;
 
 extern Size TwoPhaseShmemSize(void);
 extern void TwoPhaseShmemInit(void);
@@ -66,6 +66,20 @@ typedef struct LogicalDecodingContext
 	 */
 	void	   *output_writer_private;
 
+	/*
+	 * Does the output plugin accept in-progress transactions? Set when it
+	 * provides the stream callbacks; the plugin may clear it in its startup
+	 * callback.
+	 */
+	bool		streaming;
+
+	/*
+	 * WAL read-ahead worker while catching up, see readahead.c, and the
+	 * segment it was last started in.
+	 */
+	struct XLogReadAhead *read_ahead;
+	XLogSegNo	read_ahead_segno;
+
 	/*
 	 * State for writing output.
 	 */
@@ -92,6 +106,8 @@ extern LogicalDecodingContext *CreateDecodingContext(
 extern void DecodingContextFindStartpoint(LogicalDecodingContext *ctx);
 extern bool DecodingContextReady(LogicalDecodingContext *ctx);
 extern void FreeDecodingContext(LogicalDecodingContext *ctx);
+extern XLogRecord *LogicalDecodingReadRecord(LogicalDecodingContext *ctx,
+						  XLogRecPtr startptr, char **errormsg);
 
 extern void LogicalIncreaseXminForSlot(XLogRecPtr lsn, TransactionId xmin);
 extern void LogicalIncreaseRestartDecodingForSlot(XLogRecPtr current_lsn,
@@ -78,6 +78,66 @@ typedef void (*LogicalDecodeMessageCB) (struct LogicalDecodingContext *ctx,
 													Size message_size,
 													const char *message);
 
+/*
+ * Called before passing a block of changes of an in-progress transaction to
+ * the stream_change and stream_message callbacks.
+ */
+typedef void (*LogicalDecodeStreamStartCB) (struct LogicalDecodingContext *ctx,
+													  ReorderBufferTXN *txn);
+
+/*
+ * Called after a block of changes of an in-progress transaction has been
+ * streamed.
+ */
+typedef void (*LogicalDecodeStreamStopCB) (struct LogicalDecodingContext *ctx,
+													   ReorderBufferTXN *txn);
+
+/*
+ * Callback for every individual change streamed from an in-progress
+ * transaction.
+ */
+typedef void (*LogicalDecodeStreamChangeCB) (struct LogicalDecodingContext *ctx,
+														 ReorderBufferTXN *txn,
+														 Relation relation,
+												ReorderBufferChange *change);
+
+/*
+ * Called for the transactional generic messages of an in-progress
+ * transaction.
+ */
+typedef void (*LogicalDecodeStreamMessageCB) (struct LogicalDecodingContext *ctx,
+														  ReorderBufferTXN *txn,
+													XLogRecPtr message_lsn,
+														  bool transactional,
+														  const char *prefix,
+														  Size message_size,
+														  const char *message);
+
+/*
+ * Called when a (sub)transaction that has been partially streamed aborts, or
+ * its changes are to be forgotten.
+ */
+typedef void (*LogicalDecodeStreamAbortCB) (struct LogicalDecodingContext *ctx,
+														ReorderBufferTXN *txn,
+														XLogRecPtr abort_lsn);
+
+/*
+ * Called when a partially streamed transaction commits, after the remaining
+ * changes have been streamed.
+ */
+typedef void (*LogicalDecodeStreamCommitCB) (struct LogicalDecodingContext *ctx,
+														 ReorderBufferTXN *txn,
+														 XLogRecPtr commit_lsn);
+
+/*
+ * Called when a partially streamed transaction is prepared, after the
+ * remaining changes have been streamed. Its COMMIT PREPARED or ROLLBACK
+ * PREPARED is passed to commit_cb as for any other prepared transaction.
+ */
+typedef void (*LogicalDecodeStreamPrepareCB) (struct LogicalDecodingContext *ctx,
+														  ReorderBufferTXN *txn,
+														XLogRecPtr prepare_lsn);
+
 /*
  * Filter changes by origin.
  */
@@ -107,6 +167,14 @@ typedef struct OutputPluginCallbacks
 	LogicalDecodeFilterByOriginCB filter_by_origin_cb;
 	LogicalDecodeShutdownCB shutdown_cb;
 	LogicalDecodeCaughtUpCB caughtup_cb;
+	/* streaming of in-progress transactions, optional */
+	LogicalDecodeStreamStartCB stream_start_cb;
+	LogicalDecodeStreamStopCB stream_stop_cb;
+	LogicalDecodeStreamChangeCB stream_change_cb;
+	LogicalDecodeStreamMessageCB stream_message_cb;
+	LogicalDecodeStreamAbortCB stream_abort_cb;
+	LogicalDecodeStreamCommitCB stream_commit_cb;
+	LogicalDecodeStreamPrepareCB stream_prepare_cb;
 } OutputPluginCallbacks;
 
 /* Functions in replication/logical/logical.c */
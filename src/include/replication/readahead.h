@@ -0,0 +1,27 @@
+/*-------------------------------------------------------------------------
+ * readahead.h
+ *	   Reading WAL ahead of logical decoding in a background worker
+ *
+ * Portions Copyright (c) 2012-2016, PostgreSQL Global Development Group
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include "access/xlogreader.h"
+#include "access/xlogrecord.h"
+
+/* GUC */
+extern bool logical_decoding_read_ahead;
+
+typedef struct XLogReadAhead XLogReadAhead;
+
+extern XLogReadAhead *XLogReadAheadStart(XLogRecPtr startptr);
+extern XLogRecord *XLogReadAheadNext(XLogReadAhead *ra,
+				  XLogReaderState *reader);
+extern void XLogReadAheadEnd(XLogReadAhead *ra);
+
+extern void XLogReadAheadWorkerMain(Datum main_arg);
+
+#endif
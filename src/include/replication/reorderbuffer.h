@@ -79,6 +79,9 @@ typedef struct ReorderBufferChange
 
 	RepOriginId origin_id;
 
+	/* Transaction this change is accounted to, while queued in one. */
+	struct ReorderBufferTXN *txn;
+
 	/*
 	 * Context data for the change. Which part of the union is valid depends
 	 * on action.
@@ -162,6 +165,11 @@ typedef struct ReorderBufferTXN
 	 */
 	bool		is_known_as_subxact;
 
+	/*
+	 * Toplevel transaction of a known subxact, NULL otherwise.
+	 */
+	struct ReorderBufferTXN *toptxn;
+
 	/*
 	 * LSN of the first data carrying, WAL record with knowledge about this
 	 * xid. This is allowed to *not* be first record adorned with this xid, if
@@ -222,6 +230,12 @@ typedef struct ReorderBufferTXN
 	 */
 	uint64		nentries_mem;
 
+	/*
+	 * Memory used by the changes of this transaction that are in memory,
+	 * including toast chunks waiting to be reassembled.
+	 */
+	Size		size;
+
 	/*
 	 * Has this transaction been spilled to disk?  It's not always possible to
 	 * deduce that fact by comparing nentries with nentries_mem, because
@@ -231,6 +245,20 @@ typedef struct ReorderBufferTXN
 	 */
 	bool		serialized;
 
+	/*
+	 * Have changes of this transaction been streamed to the output plugin
+	 * before its commit?  Streamed changes are not kept around anymore, so
+	 * the output plugin has to be told about the fate of the transaction.
+	 */
+	bool		streamed;
+
+	/*
+	 * Snapshot and CommandId to continue with when streaming the next block
+	 * of changes of an in-progress toplevel transaction.
+	 */
+	Snapshot	snapshot_now;
+	CommandId	command_id;
+
 	/*
 	 * List of ReorderBufferChange structs, including new Snapshots and new
 	 * CommandIds
@@ -311,6 +339,36 @@ typedef void (*ReorderBufferMessageCB) (
 												 const char *prefix, Size sz,
 													const char *message);
 
+/* start of a block of streamed changes callback signature */
+typedef void (*ReorderBufferStreamStartCB) (
+														ReorderBuffer *rb,
+														ReorderBufferTXN *txn,
+														XLogRecPtr first_lsn);
+
+/* end of a block of streamed changes callback signature */
+typedef void (*ReorderBufferStreamStopCB) (
+													   ReorderBuffer *rb,
+													   ReorderBufferTXN *txn,
+													   XLogRecPtr last_lsn);
+
+/* streamed transaction abort callback signature */
+typedef void (*ReorderBufferStreamAbortCB) (
+														ReorderBuffer *rb,
+														ReorderBufferTXN *txn,
+														XLogRecPtr abort_lsn);
+
+/* streamed transaction commit callback signature */
+typedef void (*ReorderBufferStreamCommitCB) (
+														 ReorderBuffer *rb,
+														 ReorderBufferTXN *txn,
+														 XLogRecPtr commit_lsn);
+
+/* streamed transaction prepare callback signature */
+typedef void (*ReorderBufferStreamPrepareCB) (
+														  ReorderBuffer *rb,
+														  ReorderBufferTXN *txn,
+														  XLogRecPtr prepare_lsn);
+
 struct ReorderBuffer
 {
 	/*
@@ -344,6 +402,18 @@ struct ReorderBuffer
 	ReorderBufferCommitCB commit;
 	ReorderBufferMessageCB message;
 
+	/*
+	 * Callbacks to be called when streaming changes of in-progress
+	 * transactions, see ReorderBufferStreamTXN().
+	 */
+	ReorderBufferStreamStartCB stream_start;
+	ReorderBufferStreamStopCB stream_stop;
+	ReorderBufferApplyChangeCB stream_change;
+	ReorderBufferMessageCB stream_message;
+	ReorderBufferStreamAbortCB stream_abort;
+	ReorderBufferStreamCommitCB stream_commit;
+	ReorderBufferStreamPrepareCB stream_prepare;
+
 	/*
 	 * Pointer that will be passed untouched to the callbacks.
 	 */
@@ -381,8 +451,13 @@ struct ReorderBuffer
 	/* buffer for disk<->memory conversions */
 	char	   *outbuf;
 	Size		outbufsize;
+
+	/* memory used by the changes of all transactions, see txn->size */
+	Size		size;
 };
 
+extern PGDLLIMPORT int logical_decoding_work_mem;
+
 
 ReorderBuffer *ReorderBufferAllocate(void);
 void		ReorderBufferFree(ReorderBuffer *);
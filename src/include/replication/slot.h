@@ -127,6 +127,14 @@ typedef struct ReplicationSlot
 	XLogRecPtr	candidate_xmin_lsn;
 	XLogRecPtr	candidate_restart_valid;
 	XLogRecPtr	candidate_restart_lsn;
+
+	/*
+	 * Statistics about transactions spilled to disk while decoding from this
+	 * slot, since it was created or the server started. Protected by mutex.
+	 */
+	uint64		spill_txns;		/* transactions spilled at least once */
+	uint64		spill_count;	/* number of times anything was spilled */
+	uint64		spill_bytes;	/* in-memory size of the changes spilled */
 } ReplicationSlot;
 
 #define SlotIsPhysical(slot) (slot->data.database == InvalidOid)
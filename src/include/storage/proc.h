@@ -14,6 +14,7 @@
 #ifndef _PROC_H_
 #define _PROC_H_
 
+#include "access/clog.h"
 #include "access/xlogdefs.h"
 #include "lib/ilist.h"
 #include "storage/latch.h"
@@ -155,6 +156,20 @@ struct PGPROC
 	 */
 	TransactionId procArrayGroupMemberXid;
 
+	/* Support for group transaction status update. */
+	/* true, if member of clog group waiting for status update */
+	bool		clogGroupMember;
+	/* next clog group member */
+	pg_atomic_uint32 clogGroupNext;
+	/* transaction id of clog group member */
+	TransactionId clogGroupMemberXid;
+	/* transaction status to be set for clog group member */
+	XidStatus	clogGroupMemberXidStatus;
+	/* clog page of clog group member's transaction id */
+	int			clogGroupMemberPage;
+	/* WAL location of commit record for clog group member */
+	XLogRecPtr	clogGroupMemberLsn;
+
 	uint32		wait_event_info;	/* proc's wait information */
 
 	/* Per-backend LWLock.  Protects fields below (but not group fields). */
@@ -228,6 +243,8 @@ typedef struct PROC_HDR
 	PGPROC	   *bgworkerFreeProcs;
 	/* First pgproc waiting for group XID clear */
 	pg_atomic_uint32 procArrayGroupFirst;
+	/* First pgproc waiting for group transaction status update */
+	pg_atomic_uint32 clogGroupFirst;
 	/* WALWriter process's latch */
 	Latch	   *walwriterLatch;
 	/* Checkpointer process's latch */